@@ -22,6 +22,14 @@
 #include "DetourMath.h"
 #include <stddef.h>
 
+// Define (or define in a build config) the following line to evaluate the geometry 
+// helpers used by the surface queries with integer arithmetic. See dtToFixed().
+//#define DT_FIXED_POINT 1
+
+#ifdef DT_FIXED_POINT
+#include <stdint.h>
+#endif
+
 /**
 @defgroup detour Detour
 
@@ -74,6 +82,106 @@ template<class T> inline T dtSqr(T a) { return a*a; }
 template<class T> inline T dtClamp(T v, T mn, T mx) { return v < mn ? mn : (v > mx ? mx : v); }
 
 /// @}
+
+#ifdef DT_FIXED_POINT
+
+/// @name Fixed-point helper functions
+/// When #DT_FIXED_POINT is defined, the helpers used by dtNavMeshQuery::moveAlongSurface() 
+/// and dtNavMeshQuery::findStraightPath() round positions to 1/#DT_FIXED_SCALE world units 
+/// and compute on the rounded values with 64 bit integers. Their results then do not 
+/// depend on the compiler's floating point settings. These helpers are dtVlerp, dtVdist, 
+/// dtVdistSqr, dtVequal, dtTriArea2D, dtDistancePtSegSqr2D, dtPointInPolygon, 
+/// dtDistancePtPolyEdgesSqr and dtIntersectSegSeg2D.
+///
+/// The other helpers keep using floats. Among them are dtIntersectSegmentPoly2D, used 
+/// by the raycast and segment queries; dtClosestPtPointTriangle and 
+/// dtClosestHeightPointTriangle, used by the height queries; and dtVdist2D and 
+/// dtVdist2DSqr, used by the crowd steering.
+/// @{
+
+/// The number of fixed-point units per world unit.
+static const int DT_FIXED_SCALE = 1024;
+
+/// The largest magnitude of a fixed-point coordinate. Coordinates are clamped to it, so
+/// that the products of two coordinate differences, and sums of three such products, 
+/// fit in 64 bits. This is 512K world units.
+static const int64_t DT_FIXED_MAX = (int64_t)1 << 29;
+
+/// The number of fractional bits of a fixed-point interpolation factor.
+static const int DT_FIXED_T_BITS = 16;
+
+/// Rounds the value to the nearest integer, away from zero on ties.
+///  @param[in]		v	The value, which must be finite.
+///  @return The rounded value.
+inline int64_t dtFixedRound(const double v)
+{
+	return v >= 0.0 ? (int64_t)(v + 0.5) : -(int64_t)(0.5 - v);
+}
+
+/// Converts a coordinate to fixed-point.
+///  @param[in]		v	The coordinate, which must be finite. [Unit: wu]
+///  @return The coordinate rounded to the nearest fixed-point unit, clamped to #DT_FIXED_MAX.
+inline int64_t dtToFixed(const float v)
+{
+	const double limit = (double)DT_FIXED_MAX;
+	return dtFixedRound(dtClamp((double)v * DT_FIXED_SCALE, -limit, limit));
+}
+
+/// Converts a fixed-point coordinate to world units.
+///  @param[in]		v	The fixed-point coordinate.
+///  @return The coordinate. [Unit: wu]
+inline float dtFromFixed(const int64_t v)
+{
+	return (float)v * (1.0f / DT_FIXED_SCALE);
+}
+
+/// Converts a fixed-point area or squared distance to world units.
+///  @param[in]		v	The fixed-point area.
+///  @return The area. [Unit: wu^2]
+inline float dtFromFixedSqr(const int64_t v)
+{
+	return (float)v * (1.0f / ((float)DT_FIXED_SCALE * (float)DT_FIXED_SCALE));
+}
+
+/// Divides two integers, rounding to the nearest integer.
+///  @param[in]		num		The numerator.
+///  @param[in]		den		The denominator. [Limit: > 0]
+///  @return The rounded quotient.
+inline int64_t dtFixedDiv(const int64_t num, const int64_t den)
+{
+	return num >= 0 ? (num + den/2) / den : -((den/2 - num) / den);
+}
+
+/// Converts the ratio of two integers to a fixed-point interpolation factor.
+///  @param[in]		num		The numerator.
+///  @param[in]		den		The denominator. [Limit: > 0]
+///  @return The ratio with #DT_FIXED_T_BITS fractional bits.
+inline int64_t dtFixedRatio(int64_t num, int64_t den)
+{
+	// Drop low bits until the scaled numerator can not overflow.
+	static const int64_t limit = (int64_t)1 << (62 - DT_FIXED_T_BITS);
+	while (den >= limit || num >= limit || num <= -limit)
+	{
+		num /= 2;
+		den /= 2;
+	}
+	if (den == 0)
+		return num > 0 ? limit : -limit;
+	return dtFixedDiv(num * ((int64_t)1 << DT_FIXED_T_BITS), den);
+}
+
+/// Converts a fixed-point interpolation factor to a float.
+///  @param[in]		t	The factor with #DT_FIXED_T_BITS fractional bits.
+///  @return The factor.
+inline float dtFromFixedRatio(const int64_t t)
+{
+	return (float)t * (1.0f / (float)(1 << DT_FIXED_T_BITS));
+}
+
+/// @}
+
+#endif // DT_FIXED_POINT
+
 /// @name Vector helper functions.
 /// @{
 
@@ -116,9 +224,21 @@ inline void dtVmad(float* dest, const float* v1, const float* v2, const float s)
 ///	 @param[in]		t		The interpolation factor. [Limits: 0 <= value <= 1.0]
 inline void dtVlerp(float* dest, const float* v1, const float* v2, const float t)
 {
+#ifdef DT_FIXED_POINT
+	// Clamped so that the products with the coordinate differences fit in 64 bits.
+	const double tlimit = (double)((int64_t)1 << 32);
+	const int64_t ft = dtFixedRound(dtClamp((double)t * (1 << DT_FIXED_T_BITS), -tlimit, tlimit));
+	for (int i = 0; i < 3; ++i)
+	{
+		const int64_t a = dtToFixed(v1[i]);
+		const int64_t b = dtToFixed(v2[i]);
+		dest[i] = dtFromFixed(a + dtFixedDiv((b - a) * ft, (int64_t)1 << DT_FIXED_T_BITS));
+	}
+#else
 	dest[0] = v1[0]+(v2[0]-v1[0])*t;
 	dest[1] = v1[1]+(v2[1]-v1[1])*t;
 	dest[2] = v1[2]+(v2[2]-v1[2])*t;
+#endif
 }
 
 /// Performs a vector addition. (@p v1 + @p v2)
@@ -216,10 +336,17 @@ inline float dtVlenSqr(const float* v)
 /// @return The distance between the two points.
 inline float dtVdist(const float* v1, const float* v2)
 {
+#ifdef DT_FIXED_POINT
+	const int64_t dx = dtToFixed(v2[0]) - dtToFixed(v1[0]);
+	const int64_t dy = dtToFixed(v2[1]) - dtToFixed(v1[1]);
+	const int64_t dz = dtToFixed(v2[2]) - dtToFixed(v1[2]);
+	return dtMathSqrtf(dtFromFixedSqr(dx*dx + dy*dy + dz*dz));
+#else
 	const float dx = v2[0] - v1[0];
 	const float dy = v2[1] - v1[1];
 	const float dz = v2[2] - v1[2];
 	return dtMathSqrtf(dx*dx + dy*dy + dz*dz);
+#endif
 }
 
 /// Returns the square of the distance between two points.
@@ -228,10 +355,17 @@ inline float dtVdist(const float* v1, const float* v2)
 /// @return The square of the distance between the two points.
 inline float dtVdistSqr(const float* v1, const float* v2)
 {
+#ifdef DT_FIXED_POINT
+	const int64_t dx = dtToFixed(v2[0]) - dtToFixed(v1[0]);
+	const int64_t dy = dtToFixed(v2[1]) - dtToFixed(v1[1]);
+	const int64_t dz = dtToFixed(v2[2]) - dtToFixed(v1[2]);
+	return dtFromFixedSqr(dx*dx + dy*dy + dz*dz);
+#else
 	const float dx = v2[0] - v1[0];
 	const float dy = v2[1] - v1[1];
 	const float dz = v2[2] - v1[2];
 	return dx*dx + dy*dy + dz*dz;
+#endif
 }
 
 /// Derives the distance between the specified points on the xz-plane.
@@ -277,9 +411,17 @@ inline void dtVnormalize(float* v)
 /// close enough to eachother to be considered colocated.
 inline bool dtVequal(const float* p0, const float* p1)
 {
+#ifdef DT_FIXED_POINT
+	// Points closer than the float threshold may round to neighbouring units,
+	// so the rounded points may differ by one unit along each axis.
+	return dtAbs(dtToFixed(p0[0]) - dtToFixed(p1[0])) <= 1 &&
+		   dtAbs(dtToFixed(p0[1]) - dtToFixed(p1[1])) <= 1 &&
+		   dtAbs(dtToFixed(p0[2]) - dtToFixed(p1[2])) <= 1;
+#else
 	static const float thr = dtSqr(1.0f/16384.0f);
 	const float d = dtVdistSqr(p0, p1);
 	return d < thr;
+#endif
 }
 
 /// Checks that the specified vector's components are all finite.
@@ -337,11 +479,21 @@ inline float dtVperp2D(const float* u, const float* v)
 /// @return The signed xz-plane area of the triangle.
 inline float dtTriArea2D(const float* a, const float* b, const float* c)
 {
+#ifdef DT_FIXED_POINT
+	const int64_t ax = dtToFixed(a[0]);
+	const int64_t az = dtToFixed(a[2]);
+	const int64_t abx = dtToFixed(b[0]) - ax;
+	const int64_t abz = dtToFixed(b[2]) - az;
+	const int64_t acx = dtToFixed(c[0]) - ax;
+	const int64_t acz = dtToFixed(c[2]) - az;
+	return dtFromFixedSqr(acx*abz - abx*acz);
+#else
 	const float abx = b[0] - a[0];
 	const float abz = b[2] - a[2];
 	const float acx = c[0] - a[0];
 	const float acz = c[2] - a[2];
 	return acx*abz - abx*acz;
+#endif
 }
 
 /// Determines if two axis-aligned bounding boxes overlap.
@@ -70,7 +70,11 @@ static const int DT_VERTS_PER_POLYGON = 6;
 static const int DT_NAVMESH_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'V';
 
 /// A version number used to detect compatibility of navigation tile data.
-static const int DT_NAVMESH_VERSION = 7;
+static const int DT_NAVMESH_VERSION = 8;
+
+/// The oldest navigation tile data version that can still be loaded.
+/// Version 7 data has no wide bounding volume tree. (See: #dtMeshHeader::bvWideNodeCount)
+static const int DT_NAVMESH_VERSION_MIN = 7;
 
 /// A magic number used to detect the compatibility of navigation tile states.
 static const int DT_NAVMESH_STATE_MAGIC = 'D'<<24 | 'N'<<16 | 'M'<<8 | 'S';
@@ -99,7 +103,17 @@ static const int DT_MAX_AREAS = 64;
 enum dtTileFlags
 {
 	/// The navigation mesh owns the tile memory and is responsible for freeing it.
-	DT_TILE_FREE_DATA = 0x01
+	DT_TILE_FREE_DATA = 0x01,
+
+	/// The navigation mesh does not write to the tile memory, so it can be mapped read-only 
+	/// and shared between processes. The polygons and links are kept in a separate block. 
+	/// (See: dtMeshTile::linkData)
+	DT_TILE_READ_ONLY_DATA = 0x02,
+
+	/// Set by the navigation mesh on a removed tile that waits to be reclaimed. The tile 
+	/// memory is still intact, but the tile is no longer part of the mesh. 
+	/// (See: dtNavMesh::setDeferredReclaim)
+	DT_TILE_RETIRED = 0x04
 };
 
 /// Vertex flags returned by dtNavMeshQuery::findStraightPath.
@@ -121,7 +135,8 @@ enum dtStraightPathOptions
 /// Options for dtNavMeshQuery::initSlicedFindPath and updateSlicedFindPath
 enum dtFindPathOptions
 {
-	DT_FINDPATH_ANY_ANGLE	= 0x02		///< use raycasts during pathfind to "shortcut" (raycast still consider costs)
+	DT_FINDPATH_ANY_ANGLE	= 0x02,		///< use raycasts during pathfind to "shortcut" (raycast still consider costs)
+	DT_FINDPATH_REACHABLE_ONLY	= 0x04	///< return early if the end polygon is on another island (see dtNavMeshQuery::isReachable)
 };
 
 /// Options for dtNavMeshQuery::raycast
@@ -209,6 +224,18 @@ struct dtLink
 	unsigned char bmax;				///< If a boundary link, defines the maximum sub-edge area.
 };
 
+/// A portal on a tile border edge, cached by the wall segment cache.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile, dtNavMesh::setWallSegmentCache
+struct dtPolyPortal
+{
+	dtPolyRef ref;					///< The neighbour polygon behind the portal.
+	unsigned char edge;				///< Index of the polygon edge the portal lies on.
+	unsigned char tmin;				///< The start of the portal along the edge. [Unit: 1/255 of the edge]
+	unsigned char tmax;				///< The end of the portal along the edge. [Unit: 1/255 of the edge]
+	unsigned char first;			///< Non-zero if the portal comes from the first link of the edge.
+};
+
 /// Bounding volume node.
 /// @note This structure is rarely if ever used by the end user.
 /// @see dtMeshTile
@@ -219,6 +246,48 @@ struct dtBVNode
 	int i;							///< The node's index. (Negative for escape sequence.)
 };
 
+/// The number of children in a wide bounding volume node.
+/// @see dtBVWideNode
+static const int DT_BVWIDE_WIDTH = 4;
+
+/// The maximum traversal stack size needed for a wide bounding volume tree.
+static const int DT_BVWIDE_MAX_STACK = 128;
+
+/// Wide bounding volume node.
+/// The child bounds are stored one axis at a time so that all the children of
+/// a node can be tested against a query box at once.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtBVWideNode
+{
+	unsigned short bmin[3][DT_BVWIDE_WIDTH];	///< Minimum bounds of the children's AABBs. [(x, y, z)][child]
+	unsigned short bmax[3][DT_BVWIDE_WIDTH];	///< Maximum bounds of the children's AABBs. [(x, y, z)][child]
+
+	/// The children. Positive for the index of a child node, negative for a polygon
+	/// leaf (polygon index = -child - 1), or zero if the slot is unused.
+	int child[DT_BVWIDE_WIDTH];
+};
+
+/// Tests a quantized query box against all the children of a wide bounding volume node.
+///  @param[in]		bmin	Minimum bounds of the query box. [(x, y, z)]
+///  @param[in]		bmax	Maximum bounds of the query box. [(x, y, z)]
+///  @param[in]		node	The node to test.
+/// @return A bit mask with bit n set if the query box overlaps child n.
+inline unsigned int dtOverlapQuantBoundsWide(const unsigned short* bmin, const unsigned short* bmax,
+											 const dtBVWideNode& node)
+{
+	unsigned int mask = 0;
+	for (int i = 0; i < DT_BVWIDE_WIDTH; ++i)
+	{
+		const unsigned int overlap =
+			(unsigned int)(bmin[0] <= node.bmax[0][i]) & (unsigned int)(bmax[0] >= node.bmin[0][i]) &
+			(unsigned int)(bmin[1] <= node.bmax[1][i]) & (unsigned int)(bmax[1] >= node.bmin[1][i]) &
+			(unsigned int)(bmin[2] <= node.bmax[2][i]) & (unsigned int)(bmax[2] >= node.bmin[2][i]);
+		mask |= overlap << i;
+	}
+	return mask;
+}
+
 /// Defines an navigation mesh off-mesh connection within a dtMeshTile object.
 /// An off-mesh connection is a user defined traversable connection made up to two vertices.
 struct dtOffMeshConnection
@@ -274,8 +343,17 @@ struct dtMeshHeader
 	
 	/// The bounding volume quantization factor. 
 	float bvQuantFactor;
+
+	/// The number of wide bounding volume nodes. (Zero if the wide tree is disabled.)
+	/// @note Not present in version 7 data. Use dtMeshTile::bvWideTree instead of reading this directly.
+	int bvWideNodeCount;
 };
 
+/// Gets the size of the tile data header for the specified data version.
+///  @param[in]	version	The tile data version. [Limits: #DT_NAVMESH_VERSION_MIN <= value <= #DT_NAVMESH_VERSION]
+/// @return The size of the header, including padding.
+int dtGetMeshHeaderSize(const int version);
+
 /// Defines a navigation mesh tile.
 /// @ingroup detour
 struct dtMeshTile
@@ -300,12 +378,34 @@ struct dtMeshTile
 	/// (Will be null if bounding volumes are disabled.)
 	dtBVNode* bvTree;
 
+	/// The tile wide bounding volume nodes. [Size: dtMeshHeader::bvWideNodeCount]
+	/// (Will be null if the wide tree is disabled.)
+	dtBVWideNode* bvWideTree;
+
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
+
+	/// The portals on the border edges of the tile polygons, grouped by polygon and sorted along each edge.
+	/// [Size: polyPortalStart[dtMeshHeader::polyCount]]
+	/// (Will be null if the wall segment cache is disabled.)
+	dtPolyPortal* portals;
+
+	/// The index of the first cached portal of each polygon. [Size: dtMeshHeader::polyCount + 1]
+	/// (Will be null if the wall segment cache is disabled.)
+	unsigned int* polyPortalStart;
+
+	/// The running sum of the xz-plane areas of the ground polygons, used to pick random polygons.
+	/// Off-mesh connections add no area. [Size: dtMeshHeader::polyCount]
+	float* polyAreaSum;
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
 	int dataSize;							///< Size of the tile data.
+
+	/// The writable copy of the polygons, links and, if the tile has off-mesh connections, 
+	/// vertices of a tile added with #DT_TILE_READ_ONLY_DATA. Owned by the navigation mesh.
+	/// (Will be null if the tile data is written in place.)
+	unsigned char* linkData;
 	int flags;								///< Tile flags. (See: #dtTileFlags)
-	dtMeshTile* next;						///< The next free tile, or the next tile in the spatial grid.
+	dtMeshTile* next;						///< The next free tile.
 private:
 	dtMeshTile(const dtMeshTile&);
 	dtMeshTile& operator=(const dtMeshTile&);
@@ -333,6 +433,21 @@ struct dtNavMeshParams
 	int maxPolys;					///< The maximum number of polygons each tile can contain. This and maxTiles are used to calculate how many bits are needed to identify tiles and polygons uniquely.
 };
 
+/// A navigation mesh job, run over a range of tiles.
+///  @param[in]		data	The job data.
+///  @param[in]		begin	The first tile of the range.
+///  @param[in]		end		One past the last tile of the range.
+/// @ingroup detour
+typedef void (*dtNavMeshJobFunc)(void* data, const int begin, const int end);
+
+/// Runs a navigation mesh job over the tiles [0, @p count), possibly on several threads.
+///  @param[in]		userData	The user data passed to dtNavMesh::setParallelFor().
+///  @param[in]		job			The job to run.
+///  @param[in]		data		The job data, passed to @p job.
+///  @param[in]		count		The number of tiles to run the job over.
+/// @ingroup detour
+typedef void (*dtNavMeshParallelForFunc)(void* userData, dtNavMeshJobFunc job, void* data, const int count);
+
 /// A navigation mesh based on tiles of convex polygons.
 /// @ingroup detour
 class dtNavMesh
@@ -368,6 +483,22 @@ public:
 	///  @param[out]	result		The tile reference. (If the tile was succesfully added.) [opt]
 	/// @return The status flags for the operation.
 	dtStatus addTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtTileRef* result);
+
+	/// Adds several tiles to the navigation mesh, linking them in bulk.
+	///  @param[in]		data		Data for the new tile meshes. [(data) * @p count]
+	///  @param[in]		dataSizes	Data sizes of the new tile meshes. [(size) * @p count]
+	///  @param[in]		count		The number of tiles to add.
+	///  @param[in]		flags		Tile flags, used for all tiles. (See: #dtTileFlags)
+	///  @param[in]		lastRefs	The desired references for the tiles. [opt] [(ref) * @p count]
+	///  @param[out]	results		The tile references, or zero for tiles that could not be added. [opt] [(ref) * @p count]
+	/// @return The status flags for the operation.
+	dtStatus addTiles(unsigned char* const* data, const int* dataSizes, const int count, int flags,
+					  const dtTileRef* lastRefs, dtTileRef* results);
+
+	/// Sets the function #addTiles uses to link tiles on several threads.
+	///  @param[in]		parallelFor		The parallel for function, or null to link serially.
+	///  @param[in]		userData		The user data passed to @p parallelFor. [Opt]
+	void setParallelFor(dtNavMeshParallelForFunc parallelFor, void* userData);
 	
 	/// Removes the specified tile from the navigation mesh.
 	///  @param[in]		ref			The reference of the tile to remove.
@@ -376,6 +507,44 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus removeTile(dtTileRef ref, unsigned char** data, int* dataSize);
 
+	/// Enables or disables the wall segment cache.
+	/// While enabled, each tile keeps the portals of its border edges, which speeds up 
+	/// dtNavMeshQuery::getPolyWallSegments and dtNavMeshQuery::findDistanceToWall.
+	///  @param[in]	enabled		True to enable the cache.
+	/// @return The status flags for the operation.
+	dtStatus setWallSegmentCache(const bool enabled);
+
+	/// True if the wall segment cache is enabled.
+	bool getWallSegmentCache() const { return m_wallSegmentCache; }
+
+	/// @}
+
+	/// @{
+	/// @name Concurrent Tile Editing
+
+	/// Enables or disables deferred reclamation of removed tiles and links.
+	/// While enabled, tiles can be added and removed while other threads run queries.
+	///  @param[in]	enabled		True to defer reclamation.
+	void setDeferredReclaim(const bool enabled);
+
+	/// True if removed tiles and links are reclaimed only by #reclaimRetired.
+	bool getDeferredReclaim() const { return m_deferReclaim; }
+
+	/// Starts a new edit epoch. Tiles and links removed from now on are tagged with the new epoch.
+	/// @return The new edit epoch.
+	unsigned int advanceEditEpoch();
+
+	/// The current edit epoch.
+	unsigned int getEditEpoch() const { return m_editEpoch; }
+
+	/// Reuses the tiles and links that were removed before the specified epoch.
+	///  @param[in]	safeEpoch	The oldest edit epoch any reader may still be running in.
+	/// @return The number of tiles and links reclaimed.
+	int reclaimRetired(const unsigned int safeEpoch);
+
+	/// The number of removed tiles and links waiting to be reclaimed.
+	int getRetiredCount() const { return m_retiredCount; }
+
 	/// @}
 
 	/// @{
@@ -466,6 +635,16 @@ public:
 	/// @return The specified off-mesh connection, or null if the polygon reference is not valid.
 	const dtOffMeshConnection* getOffMeshConnectionByRef(dtPolyRef ref) const;
 	
+	/// Gets the island of a polygon. Polygons on different islands are not connected by any path.
+	///  @param[in]	ref		The polygon reference.
+	/// @return The island id, or zero if the polygon reference is not valid.
+	unsigned int getPolyIsland(dtPolyRef ref) const;
+
+	/// Recomputes the islands of all polygons, splitting the islands that lost their 
+	/// connections when tiles were removed.
+	/// @return The status flags for the operation.
+	dtStatus rebuildIslands();
+	
 	/// @}
 
 	/// @{
@@ -496,6 +675,11 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus getPolyArea(dtPolyRef ref, unsigned char* resultArea) const;
 
+	/// The revision of the navigation graph. Changes whenever a tile is added or removed,
+	/// or the flags or area of a polygon are changed.
+	/// @return The revision of the navigation graph.
+	unsigned int getRevision() const { return m_revision; }
+
 	/// Gets the size of the buffer required by #storeTileState to store the specified tile's state.
 	///  @param[in]	tile	The tile.
 	/// @return The size of the buffer required to store the state.
@@ -624,10 +808,69 @@ private:
 	int getNeighbourTilesAt(const int x, const int y, const int side,
 							dtMeshTile** tiles, const int maxTiles) const;
 	
+	/// The sorted border edges of a tile, used while adding tiles in bulk.
+	struct dtBorderEdgeIndex;
+	/// The tiles at one tile grid location.
+	struct dtTileColumn;
+	/// A tile grid location in the position lookup.
+	struct dtTileCell;
+	/// The position lookup, an open addressing table of tile grid locations.
+	struct dtTileLookup;
+	/// The union-find forest of the polygon islands.
+	struct dtIslandForest;
+
+	/// Returns the tiles at a tile grid location, or null if there are none.
+	const dtTileColumn* getTileColumn(const int x, const int y) const;
+	/// Allocates the column of a tile's location with the tile added to it.
+	dtTileColumn* createTileColumn(const dtMeshTile* tile);
+	/// Replaces the column of a location, retiring the old one.
+	void publishTileColumn(const int x, const int y, dtTileColumn* column);
+	/// Removes a tile from the column of its location. Returns false if out of memory, 
+	/// the column is left unchanged then.
+	bool removeTileFromColumn(const dtMeshTile* tile);
+	/// Doubles the size of the position lookup, or compacts it if it has many empty cells.
+	bool growTileLookup();
+	/// Returns a tile that failed to be added to the free list, leaving its data to the caller.
+	void discardTile(dtMeshTile* tile);
+
 	/// Returns all polygons in neighbour tile based on portal defined by the segment.
 	int findConnectingPolys(const float* va, const float* vb,
 							const dtMeshTile* tile, int side,
-							dtPolyRef* con, float* conarea, int maxcon) const;
+							dtPolyRef* con, float* conarea, int maxcon,
+							const dtBorderEdgeIndex* index = 0) const;
+	/// Allocates the border edge index of a tile, if it has none yet.
+	void allocBorderEdgeIndex(const dtMeshTile* tile, dtBorderEdgeIndex** indices) const;
+	
+	/// Validates the tile data, allocates a tile for it and builds its internal links.
+	dtStatus prepareTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtMeshTile** result);
+	/// Validates the tile data and allocates a tile for it.
+	dtStatus allocateTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtMeshTile** result);
+	/// Builds the links and the polygon area sums of a tile that only depend on the tile itself.
+	void linkTileInternal(dtMeshTile* tile);
+
+
+	// The tiles and shared state of a phase of #addTiles.
+	struct TileJob;
+	typedef void (dtNavMesh::*TilePhase)(dtMeshTile* tile, const TileJob& job);
+	struct TileJob
+	{
+		dtNavMesh* mesh;
+		TilePhase phase;
+		dtMeshTile** tiles;
+		dtBorderEdgeIndex** indices;
+		const unsigned char* isNew;
+	};
+	
+	/// Runs a phase on each tile of the job, on several threads if a parallel for function is set.
+	/// Each call of the phase may only write to the tile it is passed.
+	void runTilePhase(TilePhase phase, TileJob& job, const int count);
+	static void runTileJob(void* data, const int begin, const int end);
+	/// Builds the internal links of a new tile.
+	void linkTileInternalPhase(dtMeshTile* tile, const TileJob& job);
+	/// Fills in the border edge index of a tile, allocated by #allocBorderEdgeIndex.
+	void indexBorderEdgesPhase(dtMeshTile* tile, const TileJob& job);
+	/// Links a new tile to all its neighbours, or an old tile to its new neighbours.
+	void connectNeighboursPhase(dtMeshTile* tile, const TileJob& job);
 	
 	/// Builds internal polygons links for a tile.
 	void connectIntLinks(dtMeshTile* tile);
@@ -635,12 +878,44 @@ private:
 	void baseOffMeshLinks(dtMeshTile* tile);
 
 	/// Builds external polygon links for a tile.
-	void connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side);
+	void connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side,
+						 const dtBorderEdgeIndex* targetEdges = 0);
 	/// Builds external polygon links for a tile.
 	void connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side);
 	
 	/// Removes external links at specified side.
 	void unconnectLinks(dtMeshTile* tile, dtMeshTile* target);
+
+	/// Returns a link to the tile's free list, or retires it when reclamation is deferred.
+	void releaseLink(dtMeshTile* tile, unsigned int link);
+	/// Resets a removed tile and returns it to the free list.
+	void resetTile(dtMeshTile* tile);
+	/// Adds a link, tile or replaced lookup memory to the retired list.
+	void retire(const unsigned int tileIndex, const unsigned int link, void* memory = 0);
+	/// Reuses or frees a retired link, tile or lookup memory.
+	void reclaim(const unsigned int tileIndex, const unsigned int link, void* memory);
+
+	/// Orders the preceding writes before the write that publishes them, if queries may run concurrently.
+	void publishWrites() const;
+	/// Rebuilds the wall segment cache of a tile after its links have changed.
+	void updateWallSegmentCache(dtMeshTile* tile);
+	/// Frees the wall segment cache of a tile.
+	void freeWallSegmentCache(dtMeshTile* tile);
+	/// Adds the area of a tile to the tile area tree, or removes it.
+	void updateTileArea(const dtMeshTile* tile, const bool add);
+	/// Returns the total area of the tiles in the tile area tree.
+	double getTotalTileArea() const;
+	/// Returns the tile at the specified position along the running sum of the tile areas.
+	const dtMeshTile* getTileAtArea(const double area) const;
+	/// Gives the polygons of a tile island nodes, merged for each group connected inside the tile.
+	/// The nodes must have been reserved, see #reserveIslands.
+	void createTileIslands(dtIslandForest* islands, const dtMeshTile* tile);
+	/// Makes room for @p count more island nodes.
+	bool reserveIslands(const unsigned int count);
+	/// Merges the islands of the polygons of a tile with the islands of their linked polygons.
+	void mergeTileIslands(dtIslandForest* islands, const dtMeshTile* tile);
+	/// Returns the island of an island node, without modifying the forest.
+	static unsigned int findIsland(const dtIslandForest* islands, unsigned int node);
 	
 
 	// TODO: These methods are duplicates from dtNavMeshQuery, but are needed for off-mesh connection finding.
@@ -660,12 +935,30 @@ private:
 	float m_orig[3];					///< Origin of the tile (0,0)
 	float m_tileWidth, m_tileHeight;	///< Dimensions of each tile.
 	int m_maxTiles;						///< Max number of tiles.
-	int m_tileLutSize;					///< Tile hash lookup size (must be pot).
-	int m_tileLutMask;					///< Tile hash lookup mask.
-
-	dtMeshTile** m_posLookup;			///< Tile hash lookup.
+	dtTileLookup* m_tileLookup;			///< Tile position lookup.
+	int m_tileCellCount;				///< Number of claimed cells in the tile position lookup.
 	dtMeshTile* m_nextFree;				///< Freelist of tiles.
 	dtMeshTile* m_tiles;				///< List of tiles.
+	double* m_tileAreaTree;				///< Binary indexed tree of the tile areas, by tile index. Double, so that removing tiles cancels their area.
+	dtIslandForest* m_islands;			///< Polygon islands.
+
+	/// A removed link or tile waiting for the readers to move on.
+	struct dtRetiredItem
+	{
+		unsigned int epoch;				///< The edit epoch during which the item was removed.
+		unsigned int tile;				///< The index of the tile.
+		unsigned int link;				///< The removed link, or #DT_NULL_LINK for the whole tile.
+		void* memory;					///< Replaced lookup memory to free instead, if not null.
+	};
+	bool m_deferReclaim;				///< True if removed tiles and links are reclaimed by reclaimRetired().
+	unsigned int m_editEpoch;			///< Current edit epoch.
+	dtRetiredItem* m_retired;			///< Items waiting to be reclaimed, oldest first.
+	int m_retiredCount;					///< Number of items waiting to be reclaimed.
+	int m_retiredCapacity;				///< Size of the retired item array.
+	unsigned int m_revision;			///< Incremented on every change to the navigation graph.
+	bool m_wallSegmentCache;			///< True if the tiles cache the portals of their border edges.
+	dtNavMeshParallelForFunc m_parallelFor;	///< Runs the parallel phases of #addTiles, or null.
+	void* m_parallelForUserData;		///< The user data passed to #m_parallelFor.
 		
 #ifndef DT_POLYREF64
 	unsigned int m_saltBits;			///< Number of salt bits in the tile ID.
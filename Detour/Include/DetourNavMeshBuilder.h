@@ -101,6 +101,10 @@ struct dtNavMeshCreateParams
 	/// @note The BVTree is not normally needed for layered navigation meshes.
 	bool buildBvTree;
 
+	/// True if a wide bounding volume tree should be built for the tile.
+	/// Polygon queries use it in place of the binary tree when present.
+	bool buildWideBvTree;
+
 	/// @}
 };
 
@@ -122,6 +126,32 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int dataSize);
 ///  @param[in]		dataSize	The size of the data array.
 bool dtNavMeshDataSwapEndian(unsigned char* data, const int dataSize);
 
+/// A magic number used to detect compatibility of compact tile data.
+static const int DT_NAVMESH_COMPACT_MAGIC = 'D'<<24 | 'N'<<16 | 'C'<<8 | 'T';
+
+/// A version number used to detect compatibility of compact tile data.
+static const int DT_NAVMESH_COMPACT_VERSION = 2;
+
+/// Encodes tile data into the compact storage format.
+/// This is a storage format only, the compact data must be decoded with 
+/// #dtDecompressNavMeshData before it can be added to a navigation mesh.
+/// @ingroup detour
+///  @param[in]		data		The tile data, as created by #dtCreateNavMeshData.
+///  @param[in]		dataSize	The size of the tile data.
+///  @param[out]	outData		The resulting compact data.
+///  @param[out]	outDataSize	The size of the compact data array.
+/// @return True if the compact data was successfully created.
+bool dtCompressNavMeshData(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize);
+
+/// Decodes compact data created by #dtCompressNavMeshData back into tile data.
+/// @ingroup detour
+///  @param[in]		data		The compact data.
+///  @param[in]		dataSize	The size of the compact data.
+///  @param[out]	outData		The resulting tile data, ready for dtNavMesh::addTile().
+///  @param[out]	outDataSize	The size of the tile data array.
+/// @return True if the tile data was successfully decoded.
+bool dtDecompressNavMeshData(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize);
+
 #endif // DETOURNAVMESHBUILDER_H
 
 // This section contains detailed documentation for members that don't have
@@ -119,6 +119,10 @@ public:
 
 };
 
+/// Names the filter type of the templated queries in a context where it can not be 
+/// deduced, so that calls without an explicit filter type use the dtQueryFilter versions.
+template<class T> struct dtQueryFilterType { typedef T Type; };
+
 /// Provides information about raycast hit
 /// filled by dtNavMeshQuery::raycast
 /// @ingroup detour
@@ -146,6 +150,21 @@ struct dtRaycastHit
 	float pathCost;
 };
 
+/// Provides statistics about a path search.
+/// Filled by dtNavMeshQuery::findPath.
+/// @ingroup detour
+struct dtFindPathStats
+{
+	/// The number of nodes taken from the open list.
+	int expandedNodes;
+
+	/// The number of raycasts done to find any-angle shortcuts.
+	int raycasts;
+
+	/// The number of any-angle shortcut tests answered from the cache.
+	int cachedRaycasts;
+};
+
 /// Provides custom polygon query behavior.
 /// Used by dtNavMeshQuery::queryPolygons.
 /// @ingroup detour
@@ -159,6 +178,134 @@ public:
 	virtual void process(const dtMeshTile* tile, dtPoly** polys, dtPolyRef* refs, int count) = 0;
 };
 
+/// Holds the search nodes and open list used by the search functions of a #dtNavMeshQuery.
+/// @ingroup detour
+class dtNavMeshQueryScratch
+{
+public:
+	dtNavMeshQueryScratch();
+	~dtNavMeshQueryScratch();
+
+	/// Initializes the scratch space.
+	///  @param[in]		maxNodes	Maximum number of search nodes. [Limits: 0 < value <= 65535]
+	/// @returns The status flags for the operation.
+	dtStatus init(const int maxNodes);
+
+	/// The maximum number of search nodes.
+	/// @return The maximum number of search nodes, or zero if the scratch space is not initialized.
+	int getMaxNodes() const;
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtNavMeshQueryScratch(const dtNavMeshQueryScratch&);
+	dtNavMeshQueryScratch& operator=(const dtNavMeshQueryScratch&);
+
+	class dtNodePool* m_tinyNodePool;	///< Pointer to small node pool.
+	class dtNodePool* m_nodePool;		///< Pointer to node pool.
+	class dtNodeQueue* m_openList;		///< Pointer to open list queue.
+
+	friend class dtNavMeshQuery;
+};
+
+/// Allocates a query scratch object using the Detour allocator.
+/// @return An allocated scratch object, or null on failure.
+/// @ingroup detour
+dtNavMeshQueryScratch* dtAllocNavMeshQueryScratch();
+
+/// Frees the specified query scratch object using the Detour allocator.
+///  @param[in]		scratch		A scratch object allocated using #dtAllocNavMeshQueryScratch
+/// @ingroup detour
+void dtFreeNavMeshQueryScratch(dtNavMeshQueryScratch* scratch);
+
+/// Stores the next polygon and remaining cost towards a single goal for every polygon
+/// of a navigation mesh.
+/// @see dtNavMeshQuery::buildFlowField
+/// @ingroup detour
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	/// Gets the next polygon towards the goal and the remaining cost to reach the goal.
+	///  @param[in]		ref			The reference id of the polygon to look up.
+	///  @param[out]	nextRef		The next polygon towards the goal. Zero for the goal polygon
+	///  							and for polygons that cannot reach the goal.
+	///  @param[out]	cost		The cost from the polygon to the goal, FLT_MAX if the goal
+	///  							cannot be reached. [opt]
+	/// @returns The status flags for the query.
+	dtStatus getNextPoly(dtPolyRef ref, dtPolyRef* nextRef, float* cost) const;
+
+	/// The reference id of the goal polygon, or zero if the field has not been built.
+	dtPolyRef getGoalRef() const { return m_goalRef; }
+
+	/// The goal position the field was built for. [(x, y, z)]
+	const float* getGoalPos() const { return m_goalPos; }
+
+	/// The number of polygons that can reach the goal.
+	int getReachedCount() const { return m_reachedCount; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowField(const dtFlowField&);
+	dtFlowField& operator=(const dtFlowField&);
+
+	/// Returns the index of the polygon in the field arrays, or -1 if the polygon is not covered.
+	int getPolyIndex(dtPolyRef ref) const;
+
+	/// Grows the scratch space to hold at least @p npolys polygons, returns false when out of memory.
+	bool reserveScratch(const int npolys);
+
+	/// Returns the index of a polygon of a tile that has not changed since the layout was computed.
+	int getPolyIndexUnsafe(dtPolyRef ref) const
+	{
+		return m_tileBase[m_nav->decodePolyIdTile(ref)] + (int)m_nav->decodePolyIdPoly(ref);
+	}
+
+	const dtNavMesh* m_nav;			///< The navigation mesh the field was built for.
+	int m_maxTiles;					///< The number of tile slots in the tile arrays.
+	int* m_tileBase;				///< Index of the first polygon of each tile in the field arrays. [Size: #m_maxTiles]
+	int* m_tilePolyCount;			///< The number of polygons of each tile when the field was built. [Size: #m_maxTiles]
+	unsigned int* m_tileSalt;		///< The salt of each tile when the field was built. [Size: #m_maxTiles]
+	int m_polyCapacity;				///< The capacity of the polygon arrays.
+	dtPolyRef* m_next;				///< The next polygon towards the goal. [Size: #m_polyCapacity]
+	float* m_cost;					///< The cost to the goal. [Size: #m_polyCapacity]
+	// Scratch space of the searches, kept between updates so that they do not allocate.
+	// updateFlowField() builds the new layout in the scratch tile and polygon arrays and
+	// then swaps them with the arrays above.
+	int* m_scratchTileBase;			///< [Size: #m_maxTiles]
+	int* m_scratchTilePolyCount;	///< [Size: #m_maxTiles]
+	unsigned int* m_scratchTileSalt;	///< [Size: #m_maxTiles]
+	unsigned char* m_tileChanged;	///< [Size: #m_maxTiles]
+	int m_scratchCapacity;			///< The capacity of the scratch polygon arrays swapped with #m_next and #m_cost.
+	dtPolyRef* m_scratchNext;		///< [Size: #m_scratchCapacity]
+	float* m_scratchCost;			///< [Size: #m_scratchCapacity]
+	int m_searchCapacity;			///< The capacity of the search state arrays.
+	dtPolyRef* m_refs;				///< [Size: #m_searchCapacity]
+	float* m_pos;					///< [Size: 3 * #m_searchCapacity]
+	int* m_heap;					///< [Size: #m_searchCapacity]
+	int* m_heapPos;					///< [Size: #m_searchCapacity]
+	unsigned char* m_state;			///< [Size: #m_searchCapacity]
+	dtPolyRef* m_oneWayLinks;		///< The links of one-way off-mesh connections as (target, connection) pairs, sorted by target. [Size: 2 * #m_oneWayLinkCapacity]
+	int m_oneWayLinkCount;			///< The number of links in #m_oneWayLinks.
+	int m_oneWayLinkCapacity;		///< The capacity of #m_oneWayLinks in links.
+	dtPolyRef m_goalRef;			///< The goal polygon.
+	float m_goalPos[3];				///< The goal position.
+	int m_reachedCount;				///< The number of polygons that can reach the goal.
+
+	friend class dtNavMeshQuery;
+};
+
+/// Allocates a flow field object using the Detour allocator.
+/// @return An allocated flow field object, or null on failure.
+/// @ingroup detour
+dtFlowField* dtAllocFlowField();
+
+/// Frees the specified flow field object using the Detour allocator.
+///  @param[in]		field		A flow field object allocated using #dtAllocFlowField
+/// @ingroup detour
+void dtFreeFlowField(dtFlowField* field);
+
 /// Provides the ability to perform pathfinding related queries against
 /// a navigation mesh.
 /// @ingroup detour
@@ -173,6 +320,12 @@ public:
 	///  @param[in]		maxNodes	Maximum number of search nodes. [Limits: 0 < value <= 65535]
 	/// @returns The status flags for the query.
 	dtStatus init(const dtNavMesh* nav, const int maxNodes);
+
+	/// Initializes the query object to use external scratch space for its searches.
+	///  @param[in]		nav			Pointer to the dtNavMesh object to use for all queries.
+	///  @param[in]		scratch		The initialized scratch space to use. Must outlive its use by the query.
+	/// @returns The status flags for the query.
+	dtStatus init(const dtNavMesh* nav, dtNavMeshQueryScratch* scratch);
 	
 	/// @name Standard Pathfinding Functions
 	/// @{
@@ -187,10 +340,13 @@ public:
 	///  							[(polyRef) * @p pathCount]
 	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
 	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	///  @param[in]		options		Query options. (see: #dtFindPathOptions)
+	///  @param[out]	stats		Search statistics. [opt]
 	dtStatus findPath(dtPolyRef startRef, dtPolyRef endRef,
 					  const float* startPos, const float* endPos,
 					  const dtQueryFilter* filter,
-					  dtPolyRef* path, int* pathCount, const int maxPath) const;
+					  dtPolyRef* path, int* pathCount, const int maxPath,
+					  const unsigned int options = 0, dtFindPathStats* stats = 0) const;
 
 	/// Finds the straight path from the start to the end position within the polygon corridor.
 	///  @param[in]		startPos			Path start position. [(x, y, z)]
@@ -209,6 +365,79 @@ public:
 							  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 							  int* straightPathCount, const int maxStraightPath, const int options = 0) const;
 
+	/// Finds the straight path from the start to the end position within the polygon corridor, 
+	/// using portals gathered earlier with getPathPortals().
+	///  @param[in]		startPos			Path start position. [(x, y, z)]
+	///  @param[in]		endPos				Path end position. [(x, y, z)]
+	///  @param[in]		path				An array of polygon references that represent the path corridor.
+	///  @param[in]		pathSize			The number of polygons in the @p path array.
+	///  @param[in]		portalLeftVerts		The left vertex of each portal. [(x, y, z) * @p portalCount]
+	///  @param[in]		portalRightVerts	The right vertex of each portal. [(x, y, z) * @p portalCount]
+	///  @param[in]		polyTypes			The type of each polygon of the path. [(type) * (@p portalCount + 1)]
+	///  @param[in]		polyAreas			The area id of each polygon of the path. [(area) * (@p portalCount + 1)]
+	///  @param[in]		portalCount			The number of portals gathered. [Limits: 0 <= value < @p pathSize]
+	///  @param[out]	straightPath		Points describing the straight path. [(x, y, z) * @p straightPathCount].
+	///  @param[out]	straightPathFlags	Flags describing each point. (See: #dtStraightPathFlags) [opt]
+	///  @param[out]	straightPathRefs	The reference id of the polygon that is being entered at each point. [opt]
+	///  @param[out]	straightPathCount	The number of points in the straight path.
+	///  @param[in]		maxStraightPath		The maximum number of points the straight path arrays can hold.  [Limit: > 0]
+	///  @param[in]		options				Query options. (see: #dtStraightPathOptions)
+	/// @returns The status flags for the query. #DT_OUT_OF_PORTALS is set if the funnel 
+	/// reached the last supplied portal before the end of the path.
+	dtStatus findStraightPath(const float* startPos, const float* endPos,
+							  const dtPolyRef* path, const int pathSize,
+							  const float* portalLeftVerts, const float* portalRightVerts,
+							  const unsigned char* polyTypes, const unsigned char* polyAreas, const int portalCount,
+							  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
+							  int* straightPathCount, const int maxStraightPath, const int options = 0) const;
+
+	/// Gathers the portals between the polygons of a path corridor.
+	///  @param[in]		path			An array of polygon references that represent the path corridor.
+	///  @param[in]		pathSize		The number of polygons in the @p path array.
+	///  @param[out]	portalLeftVerts	The left vertex of each portal. [(x, y, z) * (@p pathSize - 1)]
+	///  @param[out]	portalRightVerts	The right vertex of each portal. [(x, y, z) * (@p pathSize - 1)]
+	///  @param[out]	polyTypes		The type of each polygon of the path. [(type) * @p pathSize]
+	///  @param[out]	polyAreas		The area id of each polygon of the path. [(area) * @p pathSize]
+	/// @returns The number of portals gathered.
+	int getPathPortals(const dtPolyRef* path, const int pathSize, float* portalLeftVerts, float* portalRightVerts,
+					   unsigned char* polyTypes, unsigned char* polyAreas) const;
+
+	///@}
+	/// @name Templated Filter Functions
+	/// Variants of findPath(), raycast() and findPolysAroundCircle() that call the filter 
+	/// through its static type, so that the filter functions can be inlined into the search 
+	/// without #DT_VIRTUAL_QUERYFILTER. The filter type must be named in the call, and 
+	/// the calling file must include DetourNavMeshQueryTemplates.h:
+	/// @code
+	/// #include "DetourNavMeshQueryTemplates.h"
+	/// ...
+	/// query->findPath<MyFilter>(startRef, endRef, startPos, endPos, &myFilter, path, &pathCount, maxPath);
+	/// @endcode
+	/// The filter type does not need to derive from dtQueryFilter, but must provide its 
+	/// passFilter() and getCost() functions.
+	///@{
+
+	/// Finds a path from the start polygon to the end polygon. (See the dtQueryFilter version.)
+	template<class TFilter>
+	dtStatus findPath(dtPolyRef startRef, dtPolyRef endRef,
+					  const float* startPos, const float* endPos,
+					  const typename dtQueryFilterType<TFilter>::Type* filter,
+					  dtPolyRef* path, int* pathCount, const int maxPath,
+					  const unsigned int options = 0, dtFindPathStats* stats = 0) const;
+
+	/// Casts a 'walkability' ray along the surface of the navigation mesh. (See the dtQueryFilter version.)
+	template<class TFilter>
+	dtStatus raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const typename dtQueryFilterType<TFilter>::Type* filter, const unsigned int options,
+					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
+
+	/// Finds the polygons along the navigation graph that touch the specified circle. (See the dtQueryFilter version.)
+	template<class TFilter>
+	dtStatus findPolysAroundCircle(dtPolyRef startRef, const float* centerPos, const float radius,
+								   const typename dtQueryFilterType<TFilter>::Type* filter,
+								   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
+								   int* resultCount, const int maxResult) const;
+
 	///@}
 	/// @name Sliced Pathfinding Functions
 	/// Common use case:
@@ -293,7 +522,41 @@ public:
 								  const dtQueryFilter* filter,
 								  dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 								  int* resultCount, const int maxResult) const;
-	
+
+	/// Finds the path costs between every pair of start and end polygons.
+	///  @param[in]		startRefs		The reference ids of the start polygons. [(polyRef) * @p nstart]
+	///  @param[in]		startPos		A position within each start polygon. [(x, y, z) * @p nstart]
+	///  @param[in]		nstart			The number of start polygons.
+	///  @param[in]		endRefs			The reference ids of the end polygons. [(polyRef) * @p nend]
+	///  @param[in]		endPos			A position within each end polygon. [(x, y, z) * @p nend]
+	///  @param[in]		nend			The number of end polygons.
+	///  @param[in]		filter			The polygon filter to apply to the query.
+	///  @param[out]	resultCost		The path cost from each start to each end position, FLT_MAX if
+	///  								the end could not be reached. [(cost) * @p nstart * @p nend]
+	///  @param[out]	resultParent	The reference id of the polygon preceding each end polygon on its path.
+	///  								Zero if there is no such polygon. [opt] [(polyRef) * @p nstart * @p nend]
+	/// @returns The status flags for the query.
+	dtStatus findDistanceMatrix(const dtPolyRef* startRefs, const float* startPos, const int nstart,
+								const dtPolyRef* endRefs, const float* endPos, const int nend,
+								const dtQueryFilter* filter,
+								float* resultCost, dtPolyRef* resultParent) const;
+
+	/// Builds a flow field towards the goal over the whole navigation mesh.
+	///  @param[in]		goalRef		The reference id of the goal polygon.
+	///  @param[in]		goalPos		A position within the goal polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	field		The flow field to fill in.
+	/// @returns The status flags for the query.
+	dtStatus buildFlowField(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+							dtFlowField* field) const;
+
+	/// Repairs a flow field after tiles have been added, removed or rebuilt.
+	///  @param[in]		filter			The polygon filter the field was built with.
+	///  @param[in,out]	field			The flow field to update.
+	///  @param[out]	repairedCount	The number of polygons searched again. [opt]
+	/// @returns The status flags for the query.
+	dtStatus updateFlowField(const dtQueryFilter* filter, dtFlowField* field, int* repairedCount = 0) const;
+
 	/// Gets a path from the explored nodes in the previous search.
 	///  @param[in]		endRef		The reference id of the end polygon.
 	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.)
@@ -305,7 +568,8 @@ public:
 	///  				if @p path cannot contain the entire path. In this case it is filled to capacity with a partial path.
 	///  				Otherwise returns DT_SUCCESS.
 	///  @remarks		The result of this function depends on the state of the query object. For that reason it should only
-	///  				be used immediately after one of the two Dijkstra searches, findPolysAroundCircle or findPolysAroundShape.
+	///  				be used immediately after one of the Dijkstra searches, findPolysAroundCircle, findPolysAroundShape
+	///  				or findDistanceMatrix.
 	dtStatus getPathFromDijkstraSearch(dtPolyRef endRef, dtPolyRef* path, int* pathCount, int maxPath) const;
 
 	/// @}
@@ -339,6 +603,24 @@ public:
 							 const dtQueryFilter* filter,
 							 dtPolyRef* nearestRef, float* nearestPt, bool* isOverPoly) const;
 	
+	/// Finds the polygon nearest to each of the specified center points.
+	/// [opt] means the specified parameter can be a null pointer, in that case the output parameter will not be set.
+	///
+	///  @param[in]		centers		The centers of the search boxes. [(x, y, z) * @p count]
+	///  @param[in]		count		The number of points to query. [Limit: >= 0]
+	///  @param[in]		halfExtents	The search distance along each axis, shared by all points. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	nearestRefs	The reference id of the nearest polygon for each point. 
+	///  							Set to 0 where no polygon is found. [(polyRef) * @p count]
+	///  @param[out]	nearestPts	The nearest point on the polygon for each point. 
+	///  							Unchanged where no polygon is found. [opt] [(x, y, z) * @p count]
+	///  @param[out]	isOverPoly	Set to true where the point's X/Z coordinate lies inside the polygon. 
+	///  							Unchanged where no polygon is found. [opt] [(flag) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolyBatch(const float* centers, const int count, const float* halfExtents,
+								  const dtQueryFilter* filter,
+								  dtPolyRef* nearestRefs, float* nearestPts, bool* isOverPoly) const;
+
 	/// Finds polygons that overlap the search box.
 	///  @param[in]		center		The center of the search box. [(x, y, z)]
 	///  @param[in]		halfExtents		The search distance along each axis. [(x, y, z)]
@@ -388,6 +670,21 @@ public:
 	dtStatus moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
 							  const dtQueryFilter* filter,
 							  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const;
+
+	/// Moves many movers from their start to their end positions constrained to the navigation mesh.
+	/// [opt] means the specified parameter can be a null pointer, in that case the output parameter will not be set.
+	///
+	///  @param[in]		startRefs	The reference id of the start polygon of each mover. [(polyRef) * @p count]
+	///  @param[in]		startPos	The position of each mover, within its start polygon. [(x, y, z) * @p count]
+	///  @param[in]		endPos		The desired end position of each mover. [(x, y, z) * @p count]
+	///  @param[in]		count		The number of movers. [Limit: >= 0]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	resultPos	The result position of each mover. [(x, y, z) * @p count]
+	///  @param[out]	resultRefs	The reference id of the polygon each mover ends up in. [opt] [(polyRef) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus moveAlongSurfaceBatch(const dtPolyRef* startRefs, const float* startPos, const float* endPos, const int count,
+								   const dtQueryFilter* filter,
+								   float* resultPos, dtPolyRef* resultRefs) const;
 	
 	/// Casts a 'walkability' ray along the surface of the navigation mesh from 
 	/// the start position toward the end position.
@@ -422,6 +719,22 @@ public:
 					 const dtQueryFilter* filter, const unsigned int options,
 					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
 
+	/// Casts many 'walkability' rays along the surface of the navigation mesh.
+	/// [opt] means the specified parameter can be a null pointer, in that case the output parameter will not be set.
+	///
+	///  @param[in]		startRefs	The reference id of the start polygon of each ray. [(polyRef) * @p count]
+	///  @param[in]		startPos	The start position of each ray, within its start polygon. [(x, y, z) * @p count]
+	///  @param[in]		endPos		The position each ray is cast toward. [(x, y, z) * @p count]
+	///  @param[in]		count		The number of rays. [Limit: >= 0]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	hitT		The hit parameter of each ray. (FLT_MAX if no wall hit.) [(t) * @p count]
+	///  @param[out]	hitNormals	The normal of the wall hit by each ray. [opt] [(x, y, z) * @p count]
+	///  @param[out]	lastRefs	The reference id of the last polygon visited by each ray. [opt] [(polyRef) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus raycastBatch(const dtPolyRef* startRefs, const float* startPos, const float* endPos, const int count,
+						  const dtQueryFilter* filter,
+						  float* hitT, float* hitNormals, dtPolyRef* lastRefs) const;
+
 
 	/// Finds the distance from the specified position to the nearest polygon wall.
 	///  @param[in]		startRef		The reference id of the polygon containing @p centerPos.
@@ -451,7 +764,7 @@ public:
 								 const int maxSegments) const;
 
 	/// Returns random location on navmesh.
-	/// Polygons are chosen weighted by area. The search runs in linear related to number of polygon.
+	/// Polygons are chosen weighted by area. The search runs in logarithmic time related to the number of tiles and polygons.
 	///  @param[in]		filter			The polygon filter to apply to the query.
 	///  @param[in]		frand			Function returning a random number [0..1).
 	///  @param[out]	randomRef		The reference id of the random location.
@@ -507,6 +820,13 @@ public:
 	///  @param[in]		filter		The filter to apply.
 	bool isValidPolyRef(dtPolyRef ref, const dtQueryFilter* filter) const;
 
+	/// Returns false if no path can connect the polygons, because they are on different islands.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[in]		endRef		The reference id of the end polygon.
+	///  @param[in]		filter		The filter the polygons must pass.
+	/// @returns True if both polygons pass the filter and are on the same island.
+	bool isReachable(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter) const;
+
 	/// Returns true if the polygon reference is in the closed list. 
 	///  @param[in]		ref		The reference id of the polygon to check.
 	/// @returns True if the polygon is in closed list.
@@ -547,6 +867,14 @@ private:
 	dtStatus getNearestPoint(dtPolyRef from, const dtPoly* fromPoly, const dtMeshTile* fromTile, float* fromPt,
 							 dtPolyRef to, const dtPoly* toPoly, const dtMeshTile* toTile, float* toPt) const;
 	
+	/// Collects the links of the one-way off-mesh connections, which the flow field search cannot find
+	/// by following the links of the polygons they lead to.
+	dtStatus collectOneWayLinks(dtFlowField* field) const;
+
+	/// Runs the flow field search from the polygons in the heap, returns the number of polygons expanded.
+	int expandFlowField(const dtQueryFilter* filter, dtFlowField* field,
+						dtPolyRef* refs, float* pos, int* heap, int* heapPos, int heapSize) const;
+
 	// Appends vertex to a straight path
 	dtStatus appendVertex(const float* pos, const unsigned char flags, const dtPolyRef ref,
 						  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
@@ -554,11 +882,39 @@ private:
 
 	// Appends intermediate portal points to a straight path.
 	dtStatus appendPortals(const int startIdx, const int endIdx, const float* endPos, const dtPolyRef* path,
+						   const float* portalLeft, const float* portalRight, const unsigned char* polyAreas,
 						   float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 						   int* straightPathCount, const int maxStraightPath, const int options) const;
 
+	// Finds the neighbour polygon a ray enters through the specified edge.
+	template<class TFilter>
+	dtPolyRef getRaycastNextRef(const dtMeshTile* tile, const dtPoly* poly, const int segMax, const float tmax,
+								const float* startPos, const float* endPos, const TFilter* filter,
+								const dtMeshTile** nextTile, const dtPoly** nextPoly) const;
+
+	// Walks the polygons from the start toward the end position for moveAlongSurface() and
+	// moveAlongSurfaceBatch(). Returns the index of the walk node the mover ends up in, or -1.
+	int walkSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
+					const dtQueryFilter* filter, struct dtQueryBatchScratch* cache,
+					struct dtSurfaceWalk* walk, float* resultPos) const;
+
 	// Gets the path leading to the specified end node.
 	dtStatus getPathToNode(struct dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const;
+
+	// Gets the path to the node of an any-angle search, including the polygons along raycast shortcuts.
+	template<class TFilter>
+	dtStatus getPathToNodeAnyAngle(struct dtNode* endNode, const TFilter* filter,
+								   dtPolyRef* path, int* pathCount, int maxPath) const;
+	
+	// The line of sight cache of an any-angle path search, see DetourNavMeshQuery.cpp.
+	static class dtLosCache* allocLosCache();
+	static void freeLosCache(class dtLosCache* cache);
+	static bool findLos(const class dtLosCache* cache, const unsigned int fromIdx, const unsigned int toIdx,
+						const dtPolyRef prevRef, bool& visible, float& pathCost);
+	static void storeLos(class dtLosCache* cache, const unsigned int fromIdx, const unsigned int toIdx,
+						 const dtPolyRef prevRef, const bool visible, const float pathCost);
+	
+	static const float H_SCALE;			///< The scale of the A* search heuristic.
 	
 	const dtNavMesh* m_nav;				///< Pointer to navmesh data.
 
@@ -575,6 +931,8 @@ private:
 	};
 	dtQueryData m_query;				///< Sliced query state.
 
+	dtNavMeshQueryScratch m_ownScratch;	///< Scratch space allocated by init(nav, maxNodes).
+
 	class dtNodePool* m_tinyNodePool;	///< Pointer to small node pool.
 	class dtNodePool* m_nodePool;		///< Pointer to node pool.
 	class dtNodeQueue* m_openList;		///< Pointer to open list queue.
@@ -0,0 +1,777 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURNAVMESHQUERYTEMPLATES_H
+#define DETOURNAVMESHQUERYTEMPLATES_H
+
+// Definitions of the dtNavMeshQuery functions that are templated on the filter type.
+// Include this file where the templated queries are called with a custom filter type.
+
+#include <string.h>
+#include <float.h>
+#include "DetourNavMeshQuery.h"
+#include "DetourNavMesh.h"
+#include "DetourNode.h"
+#include "DetourCommon.h"
+#include "DetourAssert.h"
+
+#ifndef DT_VIRTUAL_QUERYFILTER
+inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
+									  const dtMeshTile* /*tile*/,
+									  const dtPoly* poly) const
+{
+	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
+}
+
+inline float dtQueryFilter::getCost(const float* pa, const float* pb,
+									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
+									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+{
+	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
+}
+#endif
+
+// Finds the neighbour the ray enters when it leaves the polygon through edge segMax at tmax.
+// Returns zero if the edge is a wall for the ray. The tile and polygon of the last link 
+// examined are returned, raycast() passes them to the cost function when a wall is hit.
+template<class TFilter>
+dtPolyRef dtNavMeshQuery::getRaycastNextRef(const dtMeshTile* tile, const dtPoly* poly, const int segMax, const float tmax,
+											const float* startPos, const float* endPos, const TFilter* filter,
+											const dtMeshTile** nextTile, const dtPoly** nextPoly) const
+{
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		const dtLink* link = &tile->links[i];
+		
+		// Find link which contains this edge.
+		if ((int)link->edge != segMax)
+			continue;
+		
+		// Get pointer to the next polygon.
+		*nextTile = 0;
+		*nextPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(link->ref, nextTile, nextPoly);
+		
+		// Skip off-mesh connections.
+		if ((*nextPoly)->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+			continue;
+		
+		// Skip links based on filter.
+		if (!filter->passFilter(link->ref, *nextTile, *nextPoly))
+			continue;
+		
+		// If the link is internal, just return the ref.
+		if (link->side == 0xff)
+			return link->ref;
+		
+		// If the link is at tile boundary,
+		
+		// Check if the link spans the whole edge, and accept.
+		if (link->bmin == 0 && link->bmax == 255)
+			return link->ref;
+		
+		// Check for partial edge links.
+		const int v0 = poly->verts[link->edge];
+		const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
+		const float* left = &tile->verts[v0*3];
+		const float* right = &tile->verts[v1*3];
+		
+		// Check that the intersection lies inside the link portal.
+		if (link->side == 0 || link->side == 4)
+		{
+			// Calculate link size.
+			const float s = 1.0f/255.0f;
+			float lmin = left[2] + (right[2] - left[2])*(link->bmin*s);
+			float lmax = left[2] + (right[2] - left[2])*(link->bmax*s);
+			if (lmin > lmax) dtSwap(lmin, lmax);
+			
+			// Find Z intersection.
+			float z = startPos[2] + (endPos[2]-startPos[2])*tmax;
+			if (z >= lmin && z <= lmax)
+				return link->ref;
+		}
+		else if (link->side == 2 || link->side == 6)
+		{
+			// Calculate link size.
+			const float s = 1.0f/255.0f;
+			float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
+			float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
+			if (lmin > lmax) dtSwap(lmin, lmax);
+			
+			// Find X intersection.
+			float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
+			if (x >= lmin && x <= lmax)
+				return link->ref;
+		}
+	}
+	
+	return 0;
+}
+
+template<class TFilter>
+dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+								 const typename dtQueryFilterType<TFilter>::Type* filter, const unsigned int options,
+								 dtRaycastHit* hit, dtPolyRef prevRef) const
+{
+	dtAssert(m_nav);
+
+	if (!hit)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	hit->t = 0;
+	hit->pathCount = 0;
+	hit->pathCost = 0;
+	dtVset(hit->hitNormal, 0, 0, 0);
+
+	// Validate input
+	if (!m_nav->isValidPolyRef(startRef) ||
+		!startPos || !dtVisfinite(startPos) ||
+		!endPos || !dtVisfinite(endPos) ||
+		!filter ||
+		(prevRef && !m_nav->isValidPolyRef(prevRef)))
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
+	float dir[3], curPos[3], lastPos[3];
+	float verts[DT_VERTS_PER_POLYGON*3+3];	
+	int n = 0;
+
+	dtVcopy(curPos, startPos);
+	dtVsub(dir, endPos, startPos);
+
+	dtStatus status = DT_SUCCESS;
+
+	const dtMeshTile* prevTile, *tile, *nextTile;
+	const dtPoly* prevPoly, *poly, *nextPoly;
+	dtPolyRef curRef;
+
+	// The API input has been checked already, skip checking internal data.
+	curRef = startRef;
+	tile = 0;
+	poly = 0;
+	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
+	nextTile = prevTile = tile;
+	nextPoly = prevPoly = poly;
+	if (prevRef)
+		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
+
+	while (curRef)
+	{
+		// Cast ray against current polygon.
+		
+		// Collect vertices.
+		int nv = 0;
+		for (int i = 0; i < (int)poly->vertCount; ++i)
+		{
+			dtVcopy(&verts[nv*3], &tile->verts[poly->verts[i]*3]);
+			nv++;
+		}
+		
+		float tmin, tmax;
+		int segMin, segMax;
+		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
+		{
+			// Could not hit the polygon, keep the old t and report hit.
+			hit->pathCount = n;
+			return status;
+		}
+
+		hit->hitEdgeIndex = segMax;
+
+		// Keep track of furthest t so far.
+		if (tmax > hit->t)
+			hit->t = tmax;
+		
+		// Store visited polygons.
+		if (n < hit->maxPath)
+			hit->path[n++] = curRef;
+		else
+			status |= DT_BUFFER_TOO_SMALL;
+
+		// Ray end is completely inside the polygon.
+		if (segMax == -1)
+		{
+			hit->t = FLT_MAX;
+			hit->pathCount = n;
+			
+			// add the cost
+			if (options & DT_RAYCAST_USE_COSTS)
+				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
+			return status;
+		}
+
+		// Follow neighbours.
+		const dtPolyRef nextRef = getRaycastNextRef(tile, poly, segMax, tmax, startPos, endPos, filter, &nextTile, &nextPoly);
+		
+		// add the cost
+		if (options & DT_RAYCAST_USE_COSTS)
+		{
+			// compute the intersection point at the furthest end of the polygon
+			// and correct the height (since the raycast moves in 2d)
+			dtVcopy(lastPos, curPos);
+			dtVmad(curPos, startPos, dir, hit->t);
+			float* e1 = &verts[segMax*3];
+			float* e2 = &verts[((segMax+1)%nv)*3];
+			float eDir[3], diff[3];
+			dtVsub(eDir, e2, e1);
+			dtVsub(diff, curPos, e1);
+			float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
+			curPos[1] = e1[1] + eDir[1] * s;
+
+			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
+		}
+
+		if (!nextRef)
+		{
+			// No neighbour, we hit a wall.
+			
+			// Calculate hit normal.
+			const int a = segMax;
+			const int b = segMax+1 < nv ? segMax+1 : 0;
+			const float* va = &verts[a*3];
+			const float* vb = &verts[b*3];
+			const float dx = vb[0] - va[0];
+			const float dz = vb[2] - va[2];
+			hit->hitNormal[0] = dz;
+			hit->hitNormal[1] = 0;
+			hit->hitNormal[2] = -dx;
+			dtVnormalize(hit->hitNormal);
+			
+			hit->pathCount = n;
+			return status;
+		}
+
+		// No hit, advance to neighbour polygon.
+		prevRef = curRef;
+		curRef = nextRef;
+		prevTile = tile;
+		tile = nextTile;
+		prevPoly = poly;
+		poly = nextPoly;
+
+		if (status & DT_BUFFER_TOO_SMALL)
+		{
+			status |= DT_PARTIAL_RESULT;
+			break;
+		}
+	}
+	
+	hit->pathCount = n;
+	
+	return status;
+}
+
+/// Stores the path to the node, filling in the polygons along the raycast 
+/// shortcuts of an any-angle search. The parent links of the nodes are reversed.
+template<class TFilter>
+dtStatus dtNavMeshQuery::getPathToNodeAnyAngle(dtNode* endNode, const TFilter* filter,
+											   dtPolyRef* path, int* pathCount, int maxPath) const
+{
+	// Reverse the path.
+	dtNode* prev = 0;
+	dtNode* node = endNode;
+	int prevRay = 0;
+	do
+	{
+		dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
+		node->pidx = m_nodePool->getNodeIdx(prev);
+		prev = node;
+		int nextRay = node->flags & DT_NODE_PARENT_DETACHED; // keep track of whether parent is not adjacent (i.e. due to raycast shortcut)
+		node->flags = (node->flags & ~DT_NODE_PARENT_DETACHED) | prevRay; // and store it in the reversed path's node
+		prevRay = nextRay;
+		node = next;
+	}
+	while (node);
+	
+	// Store path
+	dtStatus details = 0;
+	int n = 0;
+	node = prev;
+	do
+	{
+		dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
+		dtStatus status = 0;
+		if (node->flags & DT_NODE_PARENT_DETACHED)
+		{
+			dtRaycastHit hit;
+			hit.path = path+n;
+			hit.maxPath = maxPath-n;
+			status = raycast<TFilter>(node->id, node->pos, next->pos, filter, 0, &hit);
+			n += hit.pathCount;
+			// raycast ends on poly boundary and the path might include the next poly boundary.
+			if (path[n-1] == next->id)
+				n--; // remove to avoid duplicates
+		}
+		else
+		{
+			path[n++] = node->id;
+			if (n >= maxPath)
+				status = DT_BUFFER_TOO_SMALL;
+		}
+
+		if (status & DT_STATUS_DETAIL_MASK)
+		{
+			details |= status & DT_STATUS_DETAIL_MASK;
+			break;
+		}
+		node = next;
+	}
+	while (node);
+
+	*pathCount = n;
+
+	return DT_SUCCESS | details;
+}
+
+template<class TFilter>
+dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
+								  const float* startPos, const float* endPos,
+								  const typename dtQueryFilterType<TFilter>::Type* filter,
+								  dtPolyRef* path, int* pathCount, const int maxPath,
+								  const unsigned int options, dtFindPathStats* stats) const
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+
+	if (stats)
+		memset(stats, 0, sizeof(dtFindPathStats));
+
+	if (!pathCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*pathCount = 0;
+	
+	// Validate input
+	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
+		!startPos || !dtVisfinite(startPos) ||
+		!endPos || !dtVisfinite(endPos) ||
+		!filter || !path || maxPath <= 0)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	if (startRef == endRef)
+	{
+		path[0] = startRef;
+		*pathCount = 1;
+		return DT_SUCCESS;
+	}
+
+	if ((options & DT_FINDPATH_REACHABLE_ONLY) && m_nav->getPolyIsland(startRef) != m_nav->getPolyIsland(endRef))
+	{
+		// No search can get closer to the end polygon than the start polygon.
+		path[0] = startRef;
+		*pathCount = 1;
+		return DT_SUCCESS | DT_PARTIAL_RESULT;
+	}
+
+	const bool anyAngle = (options & DT_FINDPATH_ANY_ANGLE) != 0;
+	float raycastLimitSqr = FLT_MAX;
+	if (anyAngle)
+	{
+		// Same limit as the sliced query, see initSlicedFindPath().
+		const dtMeshTile* tile = m_nav->getTileByRef(startRef);
+		raycastLimitSqr = dtSqr(tile->header->walkableRadius * DT_RAY_CAST_LIMIT_PROPORTIONS);
+	}
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	dtNode* startNode = m_nodePool->getNode(startRef);
+	dtVcopy(startNode->pos, startPos);
+	startNode->pidx = 0;
+	startNode->cost = 0;
+	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+	startNode->id = startRef;
+	startNode->flags = DT_NODE_OPEN;
+	m_openList->push(startNode);
+	
+	dtNode* lastBestNode = startNode;
+	float lastBestNodeCost = startNode->total;
+	
+	bool outOfNodes = false;
+
+	dtLosCache* losCache = 0;
+	if (anyAngle)
+	{
+		losCache = allocLosCache();
+		if (!losCache)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	dtRaycastHit rayHit;
+	rayHit.maxPath = 0;
+	
+	while (!m_openList->empty())
+	{
+		// Remove node from open list and put it in closed list.
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+
+		if (stats)
+			stats->expandedNodes++;
+		
+		// Reached the goal, stop searching.
+		if (bestNode->id == endRef)
+		{
+			lastBestNode = bestNode;
+			break;
+		}
+		
+		// Get current poly and tile.
+		// The API input has been checked already, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+		
+		// Get parent and grand parent poly and tile.
+		dtPolyRef parentRef = 0, grandpaRef = 0;
+		const dtMeshTile* parentTile = 0;
+		const dtPoly* parentPoly = 0;
+		dtNode* parentNode = 0;
+		if (bestNode->pidx)
+		{
+			parentNode = m_nodePool->getNodeAtIdx(bestNode->pidx);
+			parentRef = parentNode->id;
+			if (parentNode->pidx)
+				grandpaRef = m_nodePool->getNodeAtIdx(parentNode->pidx)->id;
+		}
+		if (parentRef)
+			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+
+		// Decide whether to test raycast to previous nodes.
+		const bool tryLOS = anyAngle && parentRef != 0 &&
+							dtVdistSqr(parentNode->pos, bestNode->pos) < raycastLimitSqr;
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			dtPolyRef neighbourRef = bestTile->links[i].ref;
+			
+			// Skip invalid ids and do not expand back to where we came from.
+			if (!neighbourRef || neighbourRef == parentRef)
+				continue;
+			
+			// Get neighbour poly and tile.
+			// The API input has been checked already, skip checking internal data.
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
+			
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+
+			// deal explicitly with crossing tile boundaries
+			unsigned char crossSide = 0;
+			if (!anyAngle && bestTile->links[i].side != 0xff)
+				crossSide = bestTile->links[i].side >> 1;
+
+			// get the node
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
+			if (!neighbourNode)
+			{
+				outOfNodes = true;
+				continue;
+			}
+
+			// do not expand to nodes that were already visited from the same parent
+			if (anyAngle && neighbourNode->pidx != 0 && neighbourNode->pidx == bestNode->pidx)
+				continue;
+			
+			// If the node is visited the first time, calculate node position.
+			if (neighbourNode->flags == 0)
+			{
+				getNearestPoint(bestRef, bestPoly, bestTile, bestNode->pos,
+								neighbourRef, neighbourPoly, neighbourTile,
+								neighbourNode->pos);
+			}
+
+			// Calculate cost and heuristic.
+			float cost = 0;
+			float heuristic = 0;
+
+			// raycast parent
+			bool foundShortCut = false;
+			if (tryLOS)
+			{
+				const unsigned int neighbourIdx = m_nodePool->getNodeIdx(neighbourNode);
+				float shortCutCost = 0;
+				if (findLos(losCache, bestNode->pidx, neighbourIdx, grandpaRef, foundShortCut, shortCutCost))
+				{
+					if (stats)
+						stats->cachedRaycasts++;
+				}
+				else
+				{
+					rayHit.pathCost = rayHit.t = 0;
+					raycast<TFilter>(parentRef, parentNode->pos, neighbourNode->pos, filter, DT_RAYCAST_USE_COSTS, &rayHit, grandpaRef);
+					foundShortCut = rayHit.t >= 1.0f;
+					shortCutCost = rayHit.pathCost;
+					storeLos(losCache, bestNode->pidx, neighbourIdx, grandpaRef, foundShortCut, shortCutCost);
+					if (stats)
+						stats->raycasts++;
+				}
+				if (foundShortCut)
+				{
+					// shortcut found using raycast. Using shorter cost instead
+					cost = parentNode->cost + shortCutCost;
+				}
+			}
+
+			if (!foundShortCut)
+			{
+				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
+													  parentRef, parentTile, parentPoly,
+													  bestRef, bestTile, bestPoly,
+													  neighbourRef, neighbourTile, neighbourPoly);
+				cost = bestNode->cost + curCost;
+			}
+			
+			// Special case for last node.
+			if (neighbourRef == endRef)
+			{
+				const float endCost = filter->getCost(neighbourNode->pos, endPos,
+													  bestRef, bestTile, bestPoly,
+													  neighbourRef, neighbourTile, neighbourPoly,
+													  0, 0, 0);
+				
+				cost = cost + endCost;
+				heuristic = 0;
+			}
+			else
+			{
+				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
+			}
+
+			const float total = cost + heuristic;
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+				continue;
+			// The node is already visited and process, and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
+				continue;
+			
+			// Add or update the node.
+			neighbourNode->pidx = foundShortCut ? bestNode->pidx : m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->id = neighbourRef;
+			neighbourNode->flags = (neighbourNode->flags & ~(DT_NODE_CLOSED | DT_NODE_PARENT_DETACHED));
+			neighbourNode->cost = cost;
+			neighbourNode->total = total;
+			if (foundShortCut)
+				neighbourNode->flags = (neighbourNode->flags | DT_NODE_PARENT_DETACHED);
+			
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				// Already in open, update node location.
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				// Put the node in open list.
+				neighbourNode->flags |= DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+			
+			// Update nearest node to target so far.
+			if (heuristic < lastBestNodeCost)
+			{
+				lastBestNodeCost = heuristic;
+				lastBestNode = neighbourNode;
+			}
+		}
+	}
+
+	dtStatus status;
+	if (anyAngle)
+	{
+		freeLosCache(losCache);
+		status = getPathToNodeAnyAngle(lastBestNode, filter, path, pathCount, maxPath);
+	}
+	else
+	{
+		status = getPathToNode(lastBestNode, path, pathCount, maxPath);
+	}
+
+	if (lastBestNode->id != endRef)
+		status |= DT_PARTIAL_RESULT;
+
+	if (outOfNodes)
+		status |= DT_OUT_OF_NODES;
+	
+	return status;
+}
+
+template<class TFilter>
+dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float* centerPos, const float radius,
+											   const typename dtQueryFilterType<TFilter>::Type* filter,
+											   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
+											   int* resultCount, const int maxResult) const
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+
+	if (!resultCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*resultCount = 0;
+
+	if (!m_nav->isValidPolyRef(startRef) ||
+		!centerPos || !dtVisfinite(centerPos) ||
+		radius < 0 || !dtMathIsfinite(radius) ||
+		!filter || maxResult < 0)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	dtNode* startNode = m_nodePool->getNode(startRef);
+	dtVcopy(startNode->pos, centerPos);
+	startNode->pidx = 0;
+	startNode->cost = 0;
+	startNode->total = 0;
+	startNode->id = startRef;
+	startNode->flags = DT_NODE_OPEN;
+	m_openList->push(startNode);
+	
+	dtStatus status = DT_SUCCESS;
+	
+	int n = 0;
+	
+	const float radiusSqr = dtSqr(radius);
+	
+	while (!m_openList->empty())
+	{
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		
+		// Get poly and tile.
+		// The API input has been checked already, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+		
+		// Get parent poly and tile.
+		dtPolyRef parentRef = 0;
+		const dtMeshTile* parentTile = 0;
+		const dtPoly* parentPoly = 0;
+		if (bestNode->pidx)
+			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (parentRef)
+			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+
+		if (n < maxResult)
+		{
+			if (resultRef)
+				resultRef[n] = bestRef;
+			if (resultParent)
+				resultParent[n] = parentRef;
+			if (resultCost)
+				resultCost[n] = bestNode->total;
+			++n;
+		}
+		else
+		{
+			status |= DT_BUFFER_TOO_SMALL;
+		}
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			const dtLink* link = &bestTile->links[i];
+			dtPolyRef neighbourRef = link->ref;
+			// Skip invalid neighbours and do not follow back to parent.
+			if (!neighbourRef || neighbourRef == parentRef)
+				continue;
+			
+			// Expand to neighbour
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+		
+			// Do not advance if the polygon is excluded by the filter.
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+			
+			// Find edge and calc distance to the edge.
+			float va[3], vb[3];
+			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
+				continue;
+			
+			// If the circle is not touching the next polygon, skip it.
+			float tseg;
+			float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
+			if (distSqr > radiusSqr)
+				continue;
+			
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
+			if (!neighbourNode)
+			{
+				status |= DT_OUT_OF_NODES;
+				continue;
+			}
+				
+			if (neighbourNode->flags & DT_NODE_CLOSED)
+				continue;
+			
+			// Cost
+			if (neighbourNode->flags == 0)
+				dtVlerp(neighbourNode->pos, va, vb, 0.5f);
+			
+			float cost = filter->getCost(
+				bestNode->pos, neighbourNode->pos,
+				parentRef, parentTile, parentPoly,
+				bestRef, bestTile, bestPoly,
+				neighbourRef, neighbourTile, neighbourPoly);
+
+			const float total = bestNode->total + cost;
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+				continue;
+			
+			neighbourNode->id = neighbourRef;
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->total = total;
+			
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				neighbourNode->flags = DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+		}
+	}
+	
+	*resultCount = n;
+	
+	return status;
+}
+
+#endif // DETOURNAVMESHQUERYTEMPLATES_H
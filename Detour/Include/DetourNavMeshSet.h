@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURNAVMESHSET_H
+#define DETOURNAVMESHSET_H
+
+#include "DetourNavMesh.h"
+
+/// A magic number used to detect compatibility of navigation mesh set data.
+static const int DT_NAVMESH_SET_MAGIC = 'D'<<24 | 'N'<<16 | 'M'<<8 | 'S';
+
+/// A version number used to detect compatibility of navigation mesh set data.
+static const int DT_NAVMESH_SET_VERSION = 1;
+
+/// The maximum number of navigation meshes in a set.
+static const int DT_MAX_NAVMESH_SET_SIZE = 8;
+
+/// The agent dimensions a navigation mesh in a set was built for.
+/// @ingroup detour
+struct dtNavMeshSetAgent
+{
+	float radius;		///< The agent radius. [Unit: wu]
+	float height;		///< The agent height. [Unit: wu]
+	float climb;		///< The agent maximum traversable ledge. [Unit: wu]
+};
+
+/// A set of navigation meshes of the same world, built for different agent sizes.
+/// @ingroup detour
+class dtNavMeshSet
+{
+public:
+	dtNavMeshSet();
+	~dtNavMeshSet();
+
+	/// Adds a navigation mesh to the set. The set takes ownership of the mesh.
+	///  @param[in]	nav		The navigation mesh.
+	///  @param[in]	agent	The agent dimensions the mesh was built for.
+	/// @return The status flags for the operation.
+	dtStatus addNavMesh(dtNavMesh* nav, const dtNavMeshSetAgent& agent);
+
+	/// Frees all navigation meshes of the set.
+	void clear();
+
+	/// The number of navigation meshes in the set.
+	int getNavMeshCount() const { return m_count; }
+
+	/// Returns the navigation mesh at the specified index.
+	dtNavMesh* getNavMesh(const int i) { return m_navMeshes[i]; }
+
+	/// Returns the navigation mesh at the specified index.
+	const dtNavMesh* getNavMesh(const int i) const { return m_navMeshes[i]; }
+
+	/// Returns the agent dimensions of the navigation mesh at the specified index.
+	const dtNavMeshSetAgent& getAgent(const int i) const { return m_agents[i]; }
+
+	/// Finds the navigation mesh built for the smallest agent that is at least as large as the specified one.
+	///  @param[in]	radius	The agent radius. [Unit: wu]
+	///  @param[in]	height	The agent height. [Unit: wu]
+	/// @return The index of the navigation mesh, or -1 if the agent does not fit any of them.
+	int findNavMesh(const float radius, const float height) const;
+
+	/// Stores all navigation meshes into one block of data.
+	///  @param[out]	outData		The resulting data, allocated with #dtAlloc.
+	///  @param[out]	outDataSize	The size of the data.
+	/// @return The status flags for the operation.
+	dtStatus store(unsigned char** outData, int* outDataSize) const;
+
+	/// Replaces the navigation meshes of the set with the ones stored in @p data.
+	///  @param[in]	data		The data created by #store.
+	///  @param[in]	dataSize	The size of the data.
+	///  @param[in]	flags		Either 0 to copy the tiles, or #DT_TILE_READ_ONLY_DATA to use them in place.
+	/// @return The status flags for the operation.
+	dtStatus load(unsigned char* data, const int dataSize, const int flags);
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtNavMeshSet(const dtNavMeshSet&);
+	dtNavMeshSet& operator=(const dtNavMeshSet&);
+
+	dtNavMesh* m_navMeshes[DT_MAX_NAVMESH_SET_SIZE];
+	dtNavMeshSetAgent m_agents[DT_MAX_NAVMESH_SET_SIZE];
+	int m_count;
+};
+
+/// Allocates a navigation mesh set object using the Detour allocator.
+/// @return A navigation mesh set object, or null on failure.
+/// @ingroup detour
+dtNavMeshSet* dtAllocNavMeshSet();
+
+/// Frees the specified navigation mesh set object using the Detour allocator.
+///  @param[in]		set		A navigation mesh set object allocated using #dtAllocNavMeshSet
+/// @ingroup detour
+void dtFreeNavMeshSet(dtNavMeshSet* set);
+
+#endif // DETOURNAVMESHSET_H
+
+// This section contains detailed documentation for members that don't have
+// a source file. It reduces clutter in the main section of the header.
+
+/**
+
+@class dtNavMeshSet
+@par
+
+The meshes of a set are typically built from the same input geometry in one pass. 
+Recast bakes the agent height and climb into the compact heightfield, but the agent 
+radius is only applied by #rcErodeWalkableArea. For agents that differ only in radius, 
+#rcBuildCompactHeightfields compacts the rasterized and filtered heightfield once and 
+erodes a copy for each radius. The build then continues separately for each agent, from 
+the regions to dtCreateNavMeshData(), and the meshes are added to one set.
+
+A single dtNavMeshQuery object can serve all meshes of a set. Switching the mesh with 
+dtNavMeshQuery::init() is cheap, the node pools are reused if they are large enough.
+
+@code
+const int i = set->findNavMesh(agentRadius, agentHeight);
+if (i != -1)
+	query->init(set->getNavMesh(i), &scratch);
+@endcode
+
+@see dtNavMesh, dtNavMeshQuery
+
+*/
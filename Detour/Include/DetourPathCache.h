@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURPATHCACHE_H
+#define DETOURPATHCACHE_H
+
+#include "DetourNavMeshQuery.h"
+
+/// Computes a hash of the default filter data. (Include and exclude flags, and area costs.)
+///  @param[in]		filter		The filter to hash.
+/// @return The hash of the filter.
+/// @ingroup detour
+unsigned int dtHashQueryFilter(const dtQueryFilter* filter);
+
+/// Caches the results of dtNavMeshQuery::findPath, keyed by the start and end 
+/// polygons and the filter.
+/// @ingroup detour
+class dtPathCache
+{
+public:
+	dtPathCache();
+	~dtPathCache();
+
+	/// Initializes the cache.
+	///  @param[in]		maxEntries		The maximum number of cached paths. [Limit: > 0]
+	///  @param[in]		maxPathSize		The maximum number of polygons in a cached path. [Limit: > 0]
+	/// @returns The status flags for the operation.
+	dtStatus init(const int maxEntries, const int maxPathSize);
+
+	/// Finds a path from the start polygon to the end polygon, reusing a cached result if possible.
+	///  @param[in]		query		The query object used to find paths that are not in the cache.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[in]		endRef		The reference id of the end polygon.
+	///  @param[in]		startPos	A position within the start polygon. [(x, y, z)]
+	///  @param[in]		endPos		A position within the end polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.) 
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	/// @returns The status flags for the query.
+	dtStatus findPath(const dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef,
+					  const float* startPos, const float* endPos,
+					  const dtQueryFilter* filter,
+					  dtPolyRef* path, int* pathCount, const int maxPath);
+
+	/// Removes all cached paths.
+	void clear();
+
+	/// The number of paths in the cache.
+	int getEntryCount() const { return m_entryCount; }
+
+	/// The number of queries answered from the cache.
+	unsigned int getHitCount() const { return m_hitCount; }
+
+	/// The number of queries that required a path search.
+	unsigned int getMissCount() const { return m_missCount; }
+
+	/// The number of times the cache was emptied because the navigation mesh changed.
+	unsigned int getInvalidationCount() const { return m_invalidationCount; }
+
+	/// Resets the hit, miss and invalidation counters.
+	void resetStats();
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtPathCache(const dtPathCache&);
+	dtPathCache& operator=(const dtPathCache&);
+
+	struct Entry
+	{
+		dtPolyRef startRef;
+		dtPolyRef endRef;
+		unsigned int filterHash;
+		float areaCost[DT_MAX_AREAS];	///< The area costs of the filter, compared on a hit together with the flags.
+		unsigned short includeFlags;
+		unsigned short excludeFlags;
+		int pathCount;
+		int hashNext;		///< Next entry in the same bucket, or -1.
+		int lruPrev;		///< More recently used entry, or -1.
+		int lruNext;		///< Less recently used entry, or -1.
+	};
+
+	void purge();
+	int hashKey(dtPolyRef startRef, dtPolyRef endRef, unsigned int filterHash) const;
+	void unlinkLru(const int idx);
+	void pushLru(const int idx);
+	void removeFromBucket(const int idx);
+
+	Entry* m_entries;
+	dtPolyRef* m_paths;				///< Path storage, @p m_maxPathSize polygons per entry.
+	int* m_buckets;
+	int m_bucketMask;
+	int m_maxEntries;
+	int m_maxPathSize;
+	int m_entryCount;
+	int m_lruHead;					///< Most recently used entry, or -1.
+	int m_lruTail;					///< Least recently used entry, or -1.
+
+	const dtNavMesh* m_nav;			///< The navigation mesh the cached paths belong to.
+	unsigned int m_revision;		///< The revision of the navigation mesh the cached paths belong to.
+
+	unsigned int m_hitCount;
+	unsigned int m_missCount;
+	unsigned int m_invalidationCount;
+};
+
+/// Allocates a path cache object using the Detour allocator.
+/// @return An allocated path cache object, or null on failure.
+/// @ingroup detour
+dtPathCache* dtAllocPathCache();
+
+/// Frees the specified path cache object using the Detour allocator.
+///  @param[in]		cache		A path cache object allocated using #dtAllocPathCache
+/// @ingroup detour
+void dtFreePathCache(dtPathCache* cache);
+
+#endif // DETOURPATHCACHE_H
@@ -169,6 +169,24 @@ bool dtIntersectSegmentPoly2D(const float* p0, const float* p1,
 
 float dtDistancePtSegSqr2D(const float* pt, const float* p, const float* q, float& t)
 {
+#ifdef DT_FIXED_POINT
+	const int64_t px = dtToFixed(p[0]);
+	const int64_t pz = dtToFixed(p[2]);
+	const int64_t pqx = dtToFixed(q[0]) - px;
+	const int64_t pqz = dtToFixed(q[2]) - pz;
+	const int64_t ptx = dtToFixed(pt[0]);
+	const int64_t ptz = dtToFixed(pt[2]);
+	const int64_t d = pqx*pqx + pqz*pqz;
+	const int64_t num = pqx*(ptx - px) + pqz*(ptz - pz);
+	int64_t ft = 0;
+	if (d > 0)
+		ft = dtFixedRatio(dtClamp(num, (int64_t)0, d), d);
+	t = dtFromFixedRatio(ft);
+	const int64_t one = (int64_t)1 << DT_FIXED_T_BITS;
+	const int64_t dx = px + dtFixedDiv(pqx*ft, one) - ptx;
+	const int64_t dz = pz + dtFixedDiv(pqz*ft, one) - ptz;
+	return dtFromFixedSqr(dx*dx + dz*dz);
+#else
 	float pqx = q[0] - p[0];
 	float pqz = q[2] - p[2];
 	float dx = pt[0] - p[0];
@@ -181,6 +199,7 @@ float dtDistancePtSegSqr2D(const float* pt, const float* p, const float* q, floa
 	dx = p[0] + t*pqx - pt[0];
 	dz = p[2] + t*pqz - pt[2];
 	return dx*dx + dz*dz;
+#endif
 }
 
 void dtCalcPolyCenter(float* tc, const unsigned short* idx, int nidx, const float* verts)
@@ -232,6 +251,28 @@ bool dtClosestHeightPointTriangle(const float* p, const float* a, const float* b
 	return false;
 }
 
+// Returns true if the ray from the point toward +x crosses the edge (vi, vj) on the xz-plane.
+static bool crossesEdge(const float* pt, const float* vi, const float* vj)
+{
+#ifdef DT_FIXED_POINT
+	const int64_t px = dtToFixed(pt[0]);
+	const int64_t pz = dtToFixed(pt[2]);
+	const int64_t ix = dtToFixed(vi[0]);
+	const int64_t iz = dtToFixed(vi[2]);
+	const int64_t jx = dtToFixed(vj[0]);
+	const int64_t jz = dtToFixed(vj[2]);
+	if ((iz > pz) == (jz > pz))
+		return false;
+	// The float test below, multiplied through by (jz - iz).
+	const int64_t lhs = (px - ix) * (jz - iz);
+	const int64_t rhs = (jx - ix) * (pz - iz);
+	return jz > iz ? lhs < rhs : lhs > rhs;
+#else
+	return ((vi[2] > pt[2]) != (vj[2] > pt[2])) &&
+		(pt[0] < (vj[0]-vi[0]) * (pt[2]-vi[2]) / (vj[2]-vi[2]) + vi[0]);
+#endif
+}
+
 /// @par
 ///
 /// All points are projected onto the xz-plane, so the y-values are ignored.
@@ -244,8 +285,7 @@ bool dtPointInPolygon(const float* pt, const float* verts, const int nverts)
 	{
 		const float* vi = &verts[i*3];
 		const float* vj = &verts[j*3];
-		if (((vi[2] > pt[2]) != (vj[2] > pt[2])) &&
-			(pt[0] < (vj[0]-vi[0]) * (pt[2]-vi[2]) / (vj[2]-vi[2]) + vi[0]) )
+		if (crossesEdge(pt, vi, vj))
 			c = !c;
 	}
 	return c;
@@ -261,8 +301,7 @@ bool dtDistancePtPolyEdgesSqr(const float* pt, const float* verts, const int nve
 	{
 		const float* vi = &verts[i*3];
 		const float* vj = &verts[j*3];
-		if (((vi[2] > pt[2]) != (vj[2] > pt[2])) &&
-			(pt[0] < (vj[0]-vi[0]) * (pt[2]-vi[2]) / (vj[2]-vi[2]) + vi[0]) )
+		if (crossesEdge(pt, vi, vj))
 			c = !c;
 		ed[j] = dtDistancePtSegSqr2D(pt, vj, vi, et[j]);
 	}
@@ -374,6 +413,27 @@ bool dtIntersectSegSeg2D(const float* ap, const float* aq,
 						 const float* bp, const float* bq,
 						 float& s, float& t)
 {
+#ifdef DT_FIXED_POINT
+	const int64_t ux = dtToFixed(aq[0]) - dtToFixed(ap[0]);
+	const int64_t uz = dtToFixed(aq[2]) - dtToFixed(ap[2]);
+	const int64_t vx = dtToFixed(bq[0]) - dtToFixed(bp[0]);
+	const int64_t vz = dtToFixed(bq[2]) - dtToFixed(bp[2]);
+	const int64_t wx = dtToFixed(ap[0]) - dtToFixed(bp[0]);
+	const int64_t wz = dtToFixed(ap[2]) - dtToFixed(bp[2]);
+	int64_t d = ux*vz - uz*vx;
+	if (d == 0) return false;
+	int64_t sn = vx*wz - vz*wx;
+	int64_t tn = ux*wz - uz*wx;
+	if (d < 0)
+	{
+		d = -d;
+		sn = -sn;
+		tn = -tn;
+	}
+	s = dtFromFixedRatio(dtFixedRatio(sn, d));
+	t = dtFromFixedRatio(dtFixedRatio(tn, d));
+	return true;
+#else
 	float u[3], v[3], w[3];
 	dtVsub(u,aq,ap);
 	dtVsub(v,bq,bp);
@@ -383,5 +443,6 @@ bool dtIntersectSegSeg2D(const float* ap, const float* aq,
 	s = vperpXZ(v,w) / d;
 	t = vperpXZ(u,w) / d;
 	return true;
+#endif
 }
 
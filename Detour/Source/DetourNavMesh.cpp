@@ -19,6 +19,10 @@
 #include <float.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
@@ -111,6 +115,51 @@ static void calcSlabEndPoints(const float* va, const float* vb, float* bmin, flo
 	}
 }
 
+// A border edge of a tile, see dtNavMesh::dtBorderEdgeIndex.
+struct dtBorderEdge
+{
+	float pos;				// The slab coordinate of the edge.
+	float min, max;			// The extent of the edge along the slab.
+	unsigned short poly;	// The index of the polygon.
+	unsigned char edge;		// The index of the edge in the polygon.
+	unsigned char side;		// The side of the tile the edge is on.
+};
+
+// The border edges of a tile, sorted by side and then by their start along the slab.
+struct dtNavMesh::dtBorderEdgeIndex
+{
+	dtBorderEdge* edges;
+	int sideStart[9];		// The first edge of each side, the last entry is the edge count.
+	float maxLength[8];		// The length of the longest edge on each side.
+};
+
+static int compareBorderEdges(const void* va, const void* vb)
+{
+	const dtBorderEdge* a = (const dtBorderEdge*)va;
+	const dtBorderEdge* b = (const dtBorderEdge*)vb;
+	if (a->side != b->side)
+		return a->side < b->side ? -1 : 1;
+	if (a->min != b->min)
+		return a->min < b->min ? -1 : 1;
+	return 0;
+}
+
+// A candidate polygon found through the border edge index.
+struct dtConnectingEdge
+{
+	unsigned short poly;
+	unsigned char edge;
+};
+
+static int compareConnectingEdges(const void* va, const void* vb)
+{
+	const dtConnectingEdge* a = (const dtConnectingEdge*)va;
+	const dtConnectingEdge* b = (const dtConnectingEdge*)vb;
+	if (a->poly != b->poly)
+		return a->poly < b->poly ? -1 : 1;
+	return (int)a->edge - (int)b->edge;
+}
+
 inline int computeTileHash(int x, int y, const int mask)
 {
 	const unsigned int h1 = 0x8da6b343; // Large multiplicative constants;
@@ -119,6 +168,126 @@ inline int computeTileHash(int x, int y, const int mask)
 	return (int)(n & mask);
 }
 
+// The tiles at one grid location, sorted by layer. A column is never modified once
+// published, adding or removing a tile replaces it, so readers always see a whole column.
+struct dtNavMesh::dtTileColumn
+{
+	int count;
+	dtMeshTile* tiles[1];
+	
+	static dtTileColumn* alloc(const int count)
+	{
+		const int memSize = (int)(sizeof(dtTileColumn) + sizeof(dtMeshTile*)*(count > 0 ? count-1 : 0));
+		dtTileColumn* column = (dtTileColumn*)dtAlloc(memSize, DT_ALLOC_PERM);
+		if (column)
+			column->count = count;
+		return column;
+	}
+};
+
+// A grid location in the tile lookup. Cells are claimed for good, so a probe can
+// stop at the first unused cell. Empty cells are dropped when the table grows.
+struct dtNavMesh::dtTileCell
+{
+	int x, y;
+	int used;
+	dtTileColumn* column;
+};
+
+// Open addressing table of the grid locations that have tiles, probed linearly.
+struct dtNavMesh::dtTileLookup
+{
+	int mask;
+	dtTileCell cells[1];
+	
+	static dtTileLookup* alloc(const int size)
+	{
+		const int memSize = (int)(sizeof(dtTileLookup) + sizeof(dtTileCell)*(size-1));
+		dtTileLookup* lookup = (dtTileLookup*)dtAlloc(memSize, DT_ALLOC_PERM);
+		if (!lookup)
+			return 0;
+		memset(lookup, 0, memSize);
+		lookup->mask = size-1;
+		return lookup;
+	}
+	
+	dtTileCell* find(const int x, const int y)
+	{
+		int h = computeTileHash(x, y, mask);
+		while (cells[h].used)
+		{
+			if (cells[h].x == x && cells[h].y == y)
+				return &cells[h];
+			h = (h+1) & mask;
+		}
+		return 0;
+	}
+	
+	// Returns the first unused cell for the location, which must not be in the table.
+	dtTileCell* insert(const int x, const int y)
+	{
+		int h = computeTileHash(x, y, mask);
+		while (cells[h].used)
+			h = (h+1) & mask;
+		return &cells[h];
+	}
+};
+
+// Union-find forest of the polygon islands, with a node for each polygon. Node zero is not used.
+// The forest is replaced as a whole when it grows or is rebuilt, so that a reader always 
+// finds the nodes of a polygon in the same forest as the tile offsets that lead to them.
+struct dtNavMesh::dtIslandForest
+{
+	struct Node
+	{
+		unsigned int parent;
+		unsigned int size;
+	};
+	
+	unsigned int capacity;
+	unsigned int count;			// The nodes in use, including the nodes of removed tiles.
+	unsigned int liveCount;		// The nodes of the tiles in the mesh.
+	unsigned int* tileNodes;	// The first node of each tile by tile index, zero if the tile has none.
+	Node nodes[1];
+	
+	static dtIslandForest* alloc(const unsigned int capacity, const int maxTiles)
+	{
+		const int memSize = (int)(sizeof(dtIslandForest) + sizeof(Node)*(capacity-1) + sizeof(unsigned int)*maxTiles);
+		dtIslandForest* islands = (dtIslandForest*)dtAlloc(memSize, DT_ALLOC_PERM);
+		if (!islands)
+			return 0;
+		memset(islands, 0, memSize);
+		islands->capacity = capacity;
+		islands->count = 1;
+		islands->tileNodes = (unsigned int*)(islands->nodes + capacity);
+		return islands;
+	}
+	
+	// Finds the root of a node, halving the path on the way. Only for the writer, 
+	// readers use dtNavMesh::findIsland(), which does not modify the forest.
+	unsigned int find(unsigned int node)
+	{
+		while (nodes[node].parent != node)
+		{
+			nodes[node].parent = nodes[nodes[node].parent].parent;
+			node = nodes[node].parent;
+		}
+		return node;
+	}
+	
+	void merge(const unsigned int a, const unsigned int b)
+	{
+		unsigned int ra = find(a);
+		unsigned int rb = find(b);
+		if (ra == rb)
+			return;
+		if (nodes[ra].size < nodes[rb].size)
+			dtSwap(ra, rb);
+		nodes[ra].size += nodes[rb].size;
+		nodes[rb].parent = ra;
+	}
+};
+
 inline unsigned int allocLink(dtMeshTile* tile)
 {
 	if (tile->linksFreeList == DT_NULL_LINK)
@@ -134,6 +303,20 @@ inline void freeLink(dtMeshTile* tile, unsigned int link)
 	tile->linksFreeList = link;
 }
 
+// Orders the writes that fill in a link or tile before the write that publishes it.
+// Only the writer issues it, readers rely on dependency ordering.
+// (See dtNavMesh::publishWrites and dtNavMesh::setDeferredReclaim.)
+inline void publishFence()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__sync_synchronize();
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+	__dmb(0xB);
+#elif defined(_MSC_VER)
+	_ReadWriteBarrier();
+#endif
+}
+
 
 dtNavMesh* dtAllocNavMesh()
 {
@@ -153,6 +336,17 @@ void dtFreeNavMesh(dtNavMesh* navmesh)
 	dtFree(navmesh);
 }
 
+/// @par
+///
+/// Version 7 headers end just before #dtMeshHeader::bvWideNodeCount, all later
+/// versions use the full structure.
+int dtGetMeshHeaderSize(const int version)
+{
+	if (version < 8)
+		return dtAlign4((int)offsetof(dtMeshHeader, bvWideNodeCount));
+	return dtAlign4(sizeof(dtMeshHeader));
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -182,6 +376,46 @@ Notes:
 - This class does not implement any asynchronous methods. So the ::dtStatus result of all methods will 
   always contain either a success or failure flag.
 
+Threading:
+
+The constant member functions only read the navigation mesh. They keep no caches and have no 
+other hidden state, so any number of threads may call them concurrently. This includes the 
+dtNavMeshQuery objects attached to the mesh, provided each of them uses its own scratch space. 
+(See dtNavMeshQueryScratch.)
+
+The non-constant member functions (init(), addTile(), addTiles(), removeTile(), setPolyFlags(), setPolyArea(), 
+restoreTileState()) modify the tiles and their links in place. They require exclusive access: 
+no other thread may read or modify the mesh while they run.
+
+The exception is streaming tiles with deferred reclamation enabled. (See setDeferredReclaim().) 
+Then a single writer thread may call addTile() and removeTile() while other threads keep 
+running queries:
+
+- addTile() fills in the tile and its links, issues a fence, and then publishes them. Readers 
+  reach the new data only through the published pointers and indices, so on common hardware 
+  they either see the complete tile or none of it. (See setDeferredReclaim() for the exact 
+  guarantee and its limits.)
+- removeTile() unlinks the tile and invalidates its references, but the tile memory and the 
+  links removed from the neighbour tiles are not reused until reclaimRetired() says so.
+
+Reclamation is based on epochs driven by the application. The writer calls advanceEditEpoch() 
+after each batch of edits and publishes the new epoch to the readers, e.g. through an atomic 
+variable. Before starting a batch of queries, each reader stores the published epoch where the 
+writer can see it, and starts over if the published epoch changed in the meantime. The writer 
+then calls reclaimRetired() with the oldest epoch stored by a reader that is still running.
+
+Notes on deferred reclamation:
+
+- Until a removed tile is reclaimed, getTile() still returns it with its header set, and 
+  its slot can not be reused. Tiles added with @p lastRef pointing at that slot will fail. 
+  The tile has #DT_TILE_RETIRED set in its flags, so code that walks all the tiles, like 
+  dtNavMeshSet::store(), must skip such tiles. getTileRef() returns zero for them.
+- Links removed from a tile are only available to new connections after they are reclaimed. 
+  Re-adding a neighbour before that may leave some portal links unconnected, so reclaim 
+  regularly.
+- If tile data is owned by the caller, it must stay alive until the tile is reclaimed.
+- The wall segment cache is rebuilt in place and is disabled while deferred reclamation is enabled.
+
 @see dtNavMeshQuery, dtCreateNavMeshData, dtNavMeshCreateParams, #dtAllocNavMesh, #dtFreeNavMesh
 */
 
@@ -189,11 +423,21 @@ dtNavMesh::dtNavMesh() :
 	m_tileWidth(0),
 	m_tileHeight(0),
 	m_maxTiles(0),
-	m_tileLutSize(0),
-	m_tileLutMask(0),
-	m_posLookup(0),
+	m_tileLookup(0),
+	m_tileCellCount(0),
 	m_nextFree(0),
-	m_tiles(0)
+	m_tiles(0),
+	m_tileAreaTree(0),
+	m_islands(0),
+	m_deferReclaim(false),
+	m_editEpoch(0),
+	m_retired(0),
+	m_retiredCount(0),
+	m_retiredCapacity(0),
+	m_revision(0),
+	m_wallSegmentCache(false),
+	m_parallelFor(0),
+	m_parallelForUserData(0)
 {
 #ifndef DT_POLYREF64
 	m_saltBits = 0;
@@ -216,9 +460,22 @@ dtNavMesh::~dtNavMesh()
 			m_tiles[i].data = 0;
 			m_tiles[i].dataSize = 0;
 		}
+		dtFree(m_tiles[i].linkData);
+		dtFree(m_tiles[i].polyAreaSum);
+		freeWallSegmentCache(&m_tiles[i]);
 	}
-	dtFree(m_posLookup);
+	if (m_tileLookup)
+	{
+		for (int i = 0; i <= m_tileLookup->mask; ++i)
+			dtFree(m_tileLookup->cells[i].column);
+	}
+	dtFree(m_tileLookup);
+	for (int i = 0; i < m_retiredCount; ++i)
+		dtFree(m_retired[i].memory);
 	dtFree(m_tiles);
+	dtFree(m_tileAreaTree);
+	dtFree(m_islands);
+	dtFree(m_retired);
 }
 		
 dtStatus dtNavMesh::init(const dtNavMeshParams* params)
@@ -230,19 +487,25 @@ dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 	
 	// Init tiles
 	m_maxTiles = params->maxTiles;
-	m_tileLutSize = dtNextPow2(params->maxTiles/4);
-	if (!m_tileLutSize) m_tileLutSize = 1;
-	m_tileLutMask = m_tileLutSize-1;
 	
 	m_tiles = (dtMeshTile*)dtAlloc(sizeof(dtMeshTile)*m_maxTiles, DT_ALLOC_PERM);
 	if (!m_tiles)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
-	m_posLookup = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*m_tileLutSize, DT_ALLOC_PERM);
-	if (!m_posLookup)
+	// The lookup grows as needed, start with room for a quarter of the tiles in separate locations.
+	m_tileLookup = dtTileLookup::alloc((int)dtNextPow2((unsigned int)dtMax(params->maxTiles/2, 8)));
+	if (!m_tileLookup)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	m_tileCellCount = 0;
+	m_tileAreaTree = (double*)dtAlloc(sizeof(double)*m_maxTiles, DT_ALLOC_PERM);
+	if (!m_tileAreaTree)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memset(m_tileAreaTree, 0, sizeof(double)*m_maxTiles);
+	m_islands = dtIslandForest::alloc(256, m_maxTiles);
+	if (!m_islands)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	memset(m_tiles, 0, sizeof(dtMeshTile)*m_maxTiles);
-	memset(m_posLookup, 0, sizeof(dtMeshTile*)*m_tileLutSize);
 	m_nextFree = 0;
+	m_retiredCount = 0;
 	for (int i = m_maxTiles-1; i >= 0; --i)
 	{
 		m_tiles[i].salt = 1;
@@ -274,7 +537,7 @@ dtStatus dtNavMesh::init(unsigned char* data, const int dataSize, const int flag
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
+	if (header->version < DT_NAVMESH_VERSION_MIN || header->version > DT_NAVMESH_VERSION)
 		return DT_FAILURE | DT_WRONG_VERSION;
 
 	dtNavMeshParams params;
@@ -303,13 +566,81 @@ const dtNavMeshParams* dtNavMesh::getParams() const
 //////////////////////////////////////////////////////////////////////////////////////////
 int dtNavMesh::findConnectingPolys(const float* va, const float* vb,
 								   const dtMeshTile* tile, int side,
-								   dtPolyRef* con, float* conarea, int maxcon) const
+								   dtPolyRef* con, float* conarea, int maxcon,
+								   const dtBorderEdgeIndex* index) const
 {
 	if (!tile) return 0;
 	
 	float amin[2], amax[2];
 	calcSlabEndPoints(va, vb, amin, amax, side);
 	const float apos = getSlabCoord(va, side);
+	
+	if (index && side >= 0 && side < 8)
+	{
+		// Find the edges overlapping the segment, and report the polygons in the same
+		// order as the scan below: by polygon index, using the first matching edge.
+		static const int MAX_CANDIDATES = 32;
+		dtConnectingEdge candidates[MAX_CANDIDATES];
+		int ncandidates = 0;
+		
+		const dtBorderEdge* edges = index->edges;
+		int lo = index->sideStart[side];
+		int hi = index->sideStart[side+1];
+		const float first = amin[0] - index->maxLength[side];
+		while (lo < hi)
+		{
+			const int mid = (lo + hi) / 2;
+			if (edges[mid].min < first)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		
+		float bmin[2], bmax[2];
+		for (int i = lo; i < index->sideStart[side+1] && edges[i].min <= amax[0]; ++i)
+		{
+			const dtBorderEdge& e = edges[i];
+			if (dtAbs(apos-e.pos) > 0.01f)
+				continue;
+			const dtPoly* poly = &tile->polys[e.poly];
+			const float* vc = &tile->verts[poly->verts[e.edge]*3];
+			const float* vd = &tile->verts[poly->verts[(e.edge+1) % poly->vertCount]*3];
+			calcSlabEndPoints(vc,vd, bmin,bmax, side);
+			if (!overlapSlabs(amin,amax, bmin,bmax, 0.01f, tile->header->walkableClimb))
+				continue;
+			if (ncandidates == MAX_CANDIDATES)
+			{
+				// Too many to sort here, use the full scan.
+				ncandidates = -1;
+				break;
+			}
+			candidates[ncandidates].poly = e.poly;
+			candidates[ncandidates].edge = e.edge;
+			ncandidates++;
+		}
+		
+		if (ncandidates >= 0)
+		{
+			qsort(candidates, ncandidates, sizeof(dtConnectingEdge), compareConnectingEdges);
+			
+			const dtPolyRef base = getPolyRefBase(tile);
+			int n = 0;
+			for (int i = 0; i < ncandidates && n < maxcon; ++i)
+			{
+				if (i > 0 && candidates[i].poly == candidates[i-1].poly)
+					continue;
+				const dtPoly* poly = &tile->polys[candidates[i].poly];
+				const int j = candidates[i].edge;
+				calcSlabEndPoints(&tile->verts[poly->verts[j]*3], &tile->verts[poly->verts[(j+1) % poly->vertCount]*3],
+								  bmin, bmax, side);
+				conarea[n*2+0] = dtMax(amin[0], bmin[0]);
+				conarea[n*2+1] = dtMin(amax[0], bmax[0]);
+				con[n] = base | (dtPolyRef)candidates[i].poly;
+				n++;
+			}
+			return n;
+		}
+	}
 
 	// Remove links pointing to 'side' and compact the links array. 
 	float bmin[2], bmax[2];
@@ -375,7 +706,8 @@ void dtNavMesh::unconnectLinks(dtMeshTile* tile, dtMeshTile* target)
 					poly->firstLink = nj;
 				else
 					tile->links[pj].next = nj;
-				freeLink(tile, j);
+				// The link keeps its next index so that readers standing on it can move on.
+				releaseLink(tile, j);
 				j = nj;
 			}
 			else
@@ -388,7 +720,8 @@ void dtNavMesh::unconnectLinks(dtMeshTile* tile, dtMeshTile* target)
 	}
 }
 
-void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
+void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side,
+								const dtBorderEdgeIndex* targetEdges)
 {
 	if (!tile) return;
 	
@@ -416,7 +749,7 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 			const float* vb = &tile->verts[poly->verts[(j+1) % nv]*3];
 			dtPolyRef nei[4];
 			float neia[4*2];
-			int nnei = findConnectingPolys(va,vb, target, dtOppositeTile(dir), nei,neia,4);
+			int nnei = findConnectingPolys(va,vb, target, dtOppositeTile(dir), nei,neia,4, targetEdges);
 			for (int k = 0; k < nnei; ++k)
 			{
 				unsigned int idx = allocLink(tile);
@@ -427,8 +760,6 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 					link->edge = (unsigned char)j;
 					link->side = (unsigned char)dir;
 					
-					link->next = poly->firstLink;
-					poly->firstLink = idx;
 
 					// Compress portal limits to a byte value.
 					if (dir == 0 || dir == 4)
@@ -449,6 +780,11 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 						link->bmin = (unsigned char)roundf(dtClamp(tmin, 0.0f, 1.0f)*255.0f);
 						link->bmax = (unsigned char)roundf(dtClamp(tmax, 0.0f, 1.0f)*255.0f);
 					}
+
+					// Add to linked list, once the link is complete.
+					link->next = poly->firstLink;
+					publishWrites();
+					poly->firstLink = idx;
 				}
 			}
 		}
@@ -500,6 +836,7 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = targetPoly->firstLink;
+			publishWrites();
 			targetPoly->firstLink = idx;
 		}
 		
@@ -518,6 +855,7 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 				link->bmin = link->bmax = 0;
 				// Add to linked list.
 				link->next = landPoly->firstLink;
+				publishWrites();
 				landPoly->firstLink = tidx;
 			}
 		}
@@ -556,6 +894,7 @@ void dtNavMesh::connectIntLinks(dtMeshTile* tile)
 				link->bmin = link->bmax = 0;
 				// Add to linked list.
 				link->next = poly->firstLink;
+				publishWrites();
 				poly->firstLink = idx;
 			}
 		}			
@@ -599,6 +938,7 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = poly->firstLink;
+			publishWrites();
 			poly->firstLink = idx;
 		}
 
@@ -615,6 +955,7 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = landPoly->firstLink;
+			publishWrites();
 			landPoly->firstLink = tidx;
 		}
 	}
@@ -812,7 +1153,52 @@ dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile,
 int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 								   dtPolyRef* polys, const int maxPolys) const
 {
-	if (tile->bvTree)
+	if (tile->bvWideTree)
+	{
+		const float* tbmin = tile->header->bmin;
+		const float* tbmax = tile->header->bmax;
+		const float qfac = tile->header->bvQuantFactor;
+		
+		// Calculate quantized box
+		unsigned short bmin[3], bmax[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			bmin[i] = (unsigned short)(qfac * (dtClamp(qmin[i], tbmin[i], tbmax[i]) - tbmin[i])) & 0xfffe;
+			bmax[i] = (unsigned short)(qfac * (dtClamp(qmax[i], tbmin[i], tbmax[i]) - tbmin[i]) + 1) | 1;
+		}
+		
+		// Traverse tree. Children are pushed in reverse so that polygons come
+		// out in the same order as from the binary tree.
+		dtPolyRef base = getPolyRefBase(tile);
+		int n = 0;
+		int stack[DT_BVWIDE_MAX_STACK];
+		int nstack = 0;
+		stack[nstack++] = 0;
+		while (nstack > 0)
+		{
+			const int child = stack[--nstack];
+			if (child < 0)
+			{
+				if (n < maxPolys)
+					polys[n++] = base | (dtPolyRef)(-child - 1);
+				continue;
+			}
+			
+			const dtBVWideNode& node = tile->bvWideTree[child];
+			const unsigned int mask = dtOverlapQuantBoundsWide(bmin, bmax, node);
+			for (int i = DT_BVWIDE_WIDTH-1; i >= 0; --i)
+			{
+				if ((mask & (1u << i)) && node.child[i] != 0)
+				{
+					dtAssert(nstack < DT_BVWIDE_MAX_STACK);
+					stack[nstack++] = node.child[i];
+				}
+			}
+		}
+		
+		return n;
+	}
+	else if (tile->bvTree)
 	{
 		const dtBVNode* node = &tile->bvTree[0];
 		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
@@ -908,118 +1294,28 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 /// should not be reused in other nav meshes until the tile has been successfully
 /// removed from this nav mesh.
 ///
+/// With the #DT_TILE_READ_ONLY_DATA flag the data is only read. The polygons and 
+/// links are copied into a block owned by the nav mesh, which makes it possible 
+/// to use tiles in place from a read-only memory mapped file, or to share the same 
+/// data between several nav meshes. The data must stay valid until the tile is removed.
+///
 /// @see dtCreateNavMeshData, #removeTile
 dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 							dtTileRef lastRef, dtTileRef* result)
 {
-	// Make sure the data is in right format.
-	dtMeshHeader* header = (dtMeshHeader*)data;
-	if (header->magic != DT_NAVMESH_MAGIC)
-		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
-		return DT_FAILURE | DT_WRONG_VERSION;
-
-#ifndef DT_POLYREF64
-	// Do not allow adding more polygons than specified in the NavMesh's maxPolys constraint.
-	// Otherwise, the poly ID cannot be represented with the given number of bits.
-	if (m_polyBits < dtIlog2(dtNextPow2((unsigned int)header->polyCount)))
-		return DT_FAILURE | DT_INVALID_PARAM;
-#endif
-		
-	// Make sure the location is free.
-	if (getTileAt(header->x, header->y, header->layer))
-		return DT_FAILURE | DT_ALREADY_OCCUPIED;
-		
-	// Allocate a tile.
 	dtMeshTile* tile = 0;
-	if (!lastRef)
-	{
-		if (m_nextFree)
-		{
-			tile = m_nextFree;
-			m_nextFree = tile->next;
-			tile->next = 0;
-		}
-	}
-	else
+	dtStatus status = prepareTile(data, dataSize, flags, lastRef, &tile);
+	if (dtStatusFailed(status))
+		return status;
+	const dtMeshHeader* header = tile->header;
+	
+	// Allocate the lookup entry before linking, there is nothing to undo yet.
+	dtTileColumn* column = createTileColumn(tile);
+	if (!column)
 	{
-		// Try to relocate the tile to specific index with same salt.
-		int tileIndex = (int)decodePolyIdTile((dtPolyRef)lastRef);
-		if (tileIndex >= m_maxTiles)
-			return DT_FAILURE | DT_OUT_OF_MEMORY;
-		// Try to find the specific tile id from the free list.
-		dtMeshTile* target = &m_tiles[tileIndex];
-		dtMeshTile* prev = 0;
-		tile = m_nextFree;
-		while (tile && tile != target)
-		{
-			prev = tile;
-			tile = tile->next;
-		}
-		// Could not find the correct location.
-		if (tile != target)
-			return DT_FAILURE | DT_OUT_OF_MEMORY;
-		// Remove from freelist
-		if (!prev)
-			m_nextFree = tile->next;
-		else
-			prev->next = tile->next;
-
-		// Restore salt.
-		tile->salt = decodePolyIdSalt((dtPolyRef)lastRef);
-	}
-
-	// Make sure we could allocate a tile.
-	if (!tile)
+		discardTile(tile);
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
-	
-	// Insert tile into the position lut.
-	int h = computeTileHash(header->x, header->y, m_tileLutMask);
-	tile->next = m_posLookup[h];
-	m_posLookup[h] = tile;
-	
-	// Patch header pointers.
-	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
-	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
-	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
-	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
-	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
-	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
-	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
-	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
-	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
-	
-	unsigned char* d = data + headerSize;
-	tile->verts = dtGetThenAdvanceBufferPointer<float>(d, vertsSize);
-	tile->polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
-	tile->links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
-	tile->detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
-	tile->detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
-	tile->bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
-	tile->offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshLinksSize);
-
-	// If there are no items in the bvtree, reset the tree pointer.
-	if (!bvtreeSize)
-		tile->bvTree = 0;
-
-	// Build links freelist
-	tile->linksFreeList = 0;
-	tile->links[header->maxLinkCount-1].next = DT_NULL_LINK;
-	for (int i = 0; i < header->maxLinkCount-1; ++i)
-		tile->links[i].next = i+1;
-
-	// Init tile.
-	tile->header = header;
-	tile->data = data;
-	tile->dataSize = dataSize;
-	tile->flags = flags;
-
-	connectIntLinks(tile);
-
-	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
-	baseOffMeshLinks(tile);
-	connectExtOffMeshLinks(tile, tile, -1);
+	}
 
 	// Create connections with neighbour tiles.
 	static const int MAX_NEIS = 32;
@@ -1037,6 +1333,8 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		connectExtLinks(neis[j], tile, -1);
 		connectExtOffMeshLinks(tile, neis[j], -1);
 		connectExtOffMeshLinks(neis[j], tile, -1);
+		updateWallSegmentCache(neis[j]);
+		mergeTileIslands(m_islands, neis[j]);
 	}
 	
 	// Connect with neighbour tiles.
@@ -1049,71 +1347,690 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 			connectExtLinks(neis[j], tile, dtOppositeTile(i));
 			connectExtOffMeshLinks(tile, neis[j], i);
 			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+			updateWallSegmentCache(neis[j]);
+			mergeTileIslands(m_islands, neis[j]);
 		}
 	}
 	
+	updateWallSegmentCache(tile);
+	mergeTileIslands(m_islands, tile);
+	
+	// Insert tile into the position lookup last, so that readers only find it once it is complete.
+	publishTileColumn(header->x, header->y, column);
+	updateTileArea(tile, true);
+	
 	if (result)
 		*result = getTileRef(tile);
 	
+	m_revision++;
+	
 	return DT_SUCCESS;
 }
 
-const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer) const
+/// @par
+///
+/// Adds the tiles like calling addTile() for each of them, but links them in two
+/// passes: first each tile on its own, then the tiles with their neighbours. The 
+/// border edges of the tiles are sorted once, so that finding the polygons on the 
+/// other side of a portal does not scan every polygon of the neighbour tile.
+///
+/// Each link is stored in the tile it starts from, so the passes that only write
+/// to one tile at a time run through the function set with #setParallelFor(): the
+/// internal links of the new tiles, the border edge indices, and the links from 
+/// each tile to its neighbours. Off-mesh connections write to both of the tiles 
+/// they connect, and are linked serially like the islands and wall segment caches.
+///
+/// Tiles that can not be added are skipped and their result reference is set to zero. 
+/// The other tiles are still added, and #DT_PARTIAL_RESULT is returned.
+///
+/// With deferred reclamation enabled the tiles are added one at a time, so that 
+/// readers never see a tile before it is linked to its neighbours.
+///
+/// @see addTile, setParallelFor
+dtStatus dtNavMesh::addTiles(unsigned char* const* data, const int* dataSizes, const int count, int flags,
+							 const dtTileRef* lastRefs, dtTileRef* results)
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
-	while (tile)
+	if (!data || !dataSizes || count < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	dtStatus status = DT_SUCCESS;
+	
+	if (m_deferReclaim)
 	{
-		if (tile->header &&
-			tile->header->x == x &&
-			tile->header->y == y &&
-			tile->header->layer == layer)
+		for (int i = 0; i < count; ++i)
 		{
-			return tile;
+			dtTileRef ref = 0;
+			if (dtStatusFailed(addTile(data[i], dataSizes[i], flags, lastRefs ? lastRefs[i] : 0, &ref)))
+				status |= DT_PARTIAL_RESULT;
+			if (results)
+				results[i] = ref;
 		}
-		tile = tile->next;
+		return status;
 	}
-	return 0;
-}
-
-int dtNavMesh::getNeighbourTilesAt(const int x, const int y, const int side, dtMeshTile** tiles, const int maxTiles) const
-{
-	int nx = x, ny = y;
-	switch (side)
+	
+	// The border edge indices of the tiles by tile index, whether each tile is new (1) or 
+	// an old neighbour of a new tile (2), and the new tiles followed by their old neighbours.
+	dtBorderEdgeIndex** indices = (dtBorderEdgeIndex**)dtAlloc(sizeof(dtBorderEdgeIndex*)*m_maxTiles, DT_ALLOC_TEMP);
+	unsigned char* isNew = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_maxTiles, DT_ALLOC_TEMP);
+	dtMeshTile** touched = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*m_maxTiles, DT_ALLOC_TEMP);
+	if (!indices || !isNew || !touched)
 	{
-		case 0: nx++; break;
-		case 1: nx++; ny++; break;
-		case 2: ny++; break;
-		case 3: nx--; ny++; break;
-		case 4: nx--; break;
-		case 5: nx--; ny--; break;
-		case 6: ny--; break;
-		case 7: nx++; ny--; break;
-	};
+		dtFree(indices);
+		dtFree(isNew);
+		dtFree(touched);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	memset(indices, 0, sizeof(dtBorderEdgeIndex*)*m_maxTiles);
+	memset(isNew, 0, sizeof(unsigned char)*m_maxTiles);
+	
+	// Allocate the tiles and make them findable, so that duplicates are detected.
+	// The islands are reserved up front, so that creating them can not fail.
+	int nadded = 0;
+	unsigned int islandCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (results)
+			results[i] = 0;
+		dtMeshTile* tile = 0;
+		if (dtStatusFailed(allocateTile(data[i], dataSizes[i], flags, lastRefs ? lastRefs[i] : 0, &tile)))
+		{
+			status |= DT_PARTIAL_RESULT;
+			continue;
+		}
+		dtTileColumn* column = 0;
+		if (reserveIslands(islandCount + (unsigned int)tile->header->polyCount))
+			column = createTileColumn(tile);
+		if (!column)
+		{
+			discardTile(tile);
+			status |= DT_PARTIAL_RESULT;
+			continue;
+		}
+		publishTileColumn(tile->header->x, tile->header->y, column);
+		islandCount += (unsigned int)tile->header->polyCount;
+		isNew[tile - m_tiles] = 1;
+		touched[nadded++] = tile;
+		if (results)
+			results[i] = getTileRef(tile);
+	}
+	
+	TileJob job;
+	job.mesh = this;
+	job.tiles = touched;
+	job.indices = indices;
+	job.isNew = isNew;
+	
+	runTilePhase(&dtNavMesh::linkTileInternalPhase, job, nadded);
+	for (int i = 0; i < nadded; ++i)
+	{
+		updateTileArea(touched[i], true);
+		createTileIslands(m_islands, touched[i]);
+	}
+	
+	// Find the old neighbours of the new tiles.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int ntouched = nadded;
+	for (int i = 0; i < nadded; ++i)
+	{
+		const dtMeshHeader* header = touched[i]->header;
+		for (int side = -1; side < 8; ++side)
+		{
+			int nneis;
+			if (side == -1)
+				nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+			else
+				nneis = getNeighbourTilesAt(header->x, header->y, side, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+			{
+				if (isNew[neis[j] - m_tiles])
+					continue;
+				isNew[neis[j] - m_tiles] = 2;
+				touched[ntouched++] = neis[j];
+			}
+		}
+	}
+	
+	// Connect the tiles with their neighbours. Each tile creates the links that start from it:
+	// new tiles to all their neighbours, old tiles only to their new neighbours.
+	for (int i = 0; i < ntouched; ++i)
+		allocBorderEdgeIndex(touched[i], indices);
+	runTilePhase(&dtNavMesh::indexBorderEdgesPhase, job, ntouched);
+	runTilePhase(&dtNavMesh::connectNeighboursPhase, job, ntouched);
+	
+	for (int i = 0; i < nadded; ++i)
+	{
+		dtMeshTile* tile = touched[i];
+		const dtMeshHeader* header = tile->header;
+		for (int side = -1; side < 8; ++side)
+		{
+			int nneis;
+			if (side == -1)
+				nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+			else
+				nneis = getNeighbourTilesAt(header->x, header->y, side, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+			{
+				dtMeshTile* nei = neis[j];
+				if (nei == tile)
+					continue;
+				connectExtOffMeshLinks(tile, nei, side);
+				if (isNew[nei - m_tiles] == 2)
+					connectExtOffMeshLinks(nei, tile, side == -1 ? -1 : dtOppositeTile(side));
+			}
+		}
+	}
+	
+	for (int i = 0; i < ntouched; ++i)
+	{
+		dtMeshTile* tile = touched[i];
+		updateWallSegmentCache(tile);
+		mergeTileIslands(m_islands, tile);
+		dtBorderEdgeIndex* index = indices[tile - m_tiles];
+		if (index)
+		{
+			dtFree(index->edges);
+			dtFree(index);
+		}
+	}
+	dtFree(indices);
+	dtFree(isNew);
+	dtFree(touched);
+	
+	if (nadded)
+		m_revision++;
+	
+	return status;
+}
 
-	return getTilesAt(nx, ny, tiles, maxTiles);
+/// @par
+///
+/// @p parallelFor must run the job over every tile of the range before returning. It may
+/// split the range into any number of sub ranges and run them concurrently. The links do 
+/// not depend on the split, except for their order in the link lists of the polygons.
+///
+/// The allocator set with dtAllocSetCustom() is only called from the calling thread.
+void dtNavMesh::setParallelFor(dtNavMeshParallelForFunc parallelFor, void* userData)
+{
+	m_parallelFor = parallelFor;
+	m_parallelForUserData = parallelFor ? userData : 0;
 }
 
-int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const int maxTiles) const
+void dtNavMesh::runTileJob(void* data, const int begin, const int end)
+{
+	const TileJob* job = (const TileJob*)data;
+	for (int i = begin; i < end; ++i)
+		(job->mesh->*job->phase)(job->tiles[i], *job);
+}
+
+void dtNavMesh::runTilePhase(TilePhase phase, TileJob& job, const int count)
+{
+	if (!count)
+		return;
+	job.phase = phase;
+	if (m_parallelFor)
+		m_parallelFor(m_parallelForUserData, runTileJob, &job, count);
+	else
+		runTileJob(&job, 0, count);
+}
+
+void dtNavMesh::linkTileInternalPhase(dtMeshTile* tile, const TileJob& /*job*/)
+{
+	linkTileInternal(tile);
+}
+
+void dtNavMesh::connectNeighboursPhase(dtMeshTile* tile, const TileJob& job)
+{
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	const dtMeshHeader* header = tile->header;
+	const bool tileIsNew = job.isNew[tile - m_tiles] == 1;
+	for (int side = -1; side < 8; ++side)
+	{
+		int nneis;
+		if (side == -1)
+			nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+		else
+			nneis = getNeighbourTilesAt(header->x, header->y, side, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+		{
+			dtMeshTile* nei = neis[j];
+			if (nei == tile || (!tileIsNew && job.isNew[nei - m_tiles] != 1))
+				continue;
+			connectExtLinks(tile, nei, side, job.indices[nei - m_tiles]);
+		}
+	}
+}
+
+void dtNavMesh::allocBorderEdgeIndex(const dtMeshTile* tile, dtBorderEdgeIndex** indices) const
 {
+	dtBorderEdgeIndex*& index = indices[tile - m_tiles];
+	if (index)
+		return;
+	
+	int nedges = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (int j = 0; j < (int)poly->vertCount; ++j)
+		{
+			// Only the axis aligned sides have slab end points. (See calcSlabEndPoints.)
+			const int side = poly->neis[j] & 0xff;
+			if ((poly->neis[j] & DT_EXT_LINK) && side < 8 && !(side & 1))
+				nedges++;
+		}
+	}
+	
+	// Without an index findConnectingPolys falls back to scanning the polygons.
+	index = (dtBorderEdgeIndex*)dtAlloc(sizeof(dtBorderEdgeIndex), DT_ALLOC_TEMP);
+	if (!index)
+		return;
+	index->edges = (dtBorderEdge*)dtAlloc(sizeof(dtBorderEdge)*(nedges > 0 ? nedges : 1), DT_ALLOC_TEMP);
+	if (!index->edges)
+	{
+		dtFree(index);
+		index = 0;
+	}
+}
+
+void dtNavMesh::indexBorderEdgesPhase(dtMeshTile* tile, const TileJob& job)
+{
+	dtBorderEdgeIndex* index = job.indices[tile - m_tiles];
+	if (!index)
+		return;
+	
 	int n = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		const int nv = poly->vertCount;
+		for (int j = 0; j < nv; ++j)
+		{
+			// Only the axis aligned sides have slab end points. (See calcSlabEndPoints.)
+			const int side = poly->neis[j] & 0xff;
+			if (!(poly->neis[j] & DT_EXT_LINK) || side >= 8 || (side & 1))
+				continue;
+			const float* vc = &tile->verts[poly->verts[j]*3];
+			const float* vd = &tile->verts[poly->verts[(j+1) % nv]*3];
+			// The compiler can not tell that the side is axis aligned.
+			float bmin[2] = { 0, 0 }, bmax[2] = { 0, 0 };
+			calcSlabEndPoints(vc, vd, bmin, bmax, side);
+			dtBorderEdge& e = index->edges[n++];
+			e.pos = getSlabCoord(vc, side);
+			e.min = bmin[0];
+			e.max = bmax[0];
+			e.poly = (unsigned short)i;
+			e.edge = (unsigned char)j;
+			e.side = (unsigned char)side;
+		}
+	}
+	qsort(index->edges, n, sizeof(dtBorderEdge), compareBorderEdges);
+	
+	for (int i = 0; i < 8; ++i)
+		index->maxLength[i] = 0.0f;
+	int side = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const dtBorderEdge& e = index->edges[i];
+		while (side <= (int)e.side)
+			index->sideStart[side++] = i;
+		index->maxLength[e.side] = dtMax(index->maxLength[e.side], e.max - e.min);
+	}
+	while (side <= 8)
+		index->sideStart[side++] = n;
+}
+
+dtStatus dtNavMesh::prepareTile(unsigned char* data, int dataSize, int flags,
+								dtTileRef lastRef, dtMeshTile** result)
+{
+	dtMeshTile* tile = 0;
+	dtStatus status = allocateTile(data, dataSize, flags, lastRef, &tile);
+	if (dtStatusFailed(status))
+		return status;
 	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
-	while (tile)
+	if (!reserveIslands((unsigned int)tile->header->polyCount))
 	{
-		if (tile->header &&
-			tile->header->x == x &&
-			tile->header->y == y)
+		discardTile(tile);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	
+	linkTileInternal(tile);
+	createTileIslands(m_islands, tile);
+	
+	*result = tile;
+	
+	return DT_SUCCESS;
+}
+
+dtStatus dtNavMesh::allocateTile(unsigned char* data, int dataSize, int flags,
+								 dtTileRef lastRef, dtMeshTile** result)
+{
+	// Make sure the data is in right format.
+	dtMeshHeader* header = (dtMeshHeader*)data;
+	if (header->magic != DT_NAVMESH_MAGIC)
+		return DT_FAILURE | DT_WRONG_MAGIC;
+	if (header->version < DT_NAVMESH_VERSION_MIN || header->version > DT_NAVMESH_VERSION)
+		return DT_FAILURE | DT_WRONG_VERSION;
+
+#ifndef DT_POLYREF64
+	// Do not allow adding more polygons than specified in the NavMesh's maxPolys constraint.
+	// Otherwise, the poly ID cannot be represented with the given number of bits.
+	if (m_polyBits < dtIlog2(dtNextPow2((unsigned int)header->polyCount)))
+		return DT_FAILURE | DT_INVALID_PARAM;
+#endif
+		
+	// Make sure the location is free.
+	if (getTileAt(header->x, header->y, header->layer))
+		return DT_FAILURE | DT_ALREADY_OCCUPIED;
+		
+	// Allocate a tile.
+	dtMeshTile* tile = 0;
+	if (!lastRef)
+	{
+		if (m_nextFree)
 		{
-			if (n < maxTiles)
-				tiles[n++] = tile;
+			tile = m_nextFree;
+			m_nextFree = tile->next;
+			tile->next = 0;
 		}
-		tile = tile->next;
 	}
+	else
+	{
+		// Try to relocate the tile to specific index with same salt.
+		int tileIndex = (int)decodePolyIdTile((dtPolyRef)lastRef);
+		if (tileIndex >= m_maxTiles)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		// Try to find the specific tile id from the free list.
+		dtMeshTile* target = &m_tiles[tileIndex];
+		dtMeshTile* prev = 0;
+		tile = m_nextFree;
+		while (tile && tile != target)
+		{
+			prev = tile;
+			tile = tile->next;
+		}
+		// Could not find the correct location.
+		if (tile != target)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		// Remove from freelist
+		if (!prev)
+			m_nextFree = tile->next;
+		else
+			prev->next = tile->next;
+
+		// Restore salt.
+		tile->salt = decodePolyIdSalt((dtPolyRef)lastRef);
+	}
+
+	// Make sure we could allocate a tile.
+	if (!tile)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	// Patch header pointers.
+	const int headerSize = dtGetMeshHeaderSize(header->version);
+	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
+	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
+	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
+	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
+	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
+	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
+	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
+	const int bvWideTreeSize = header->version >= 8 ? dtAlign4(sizeof(dtBVWideNode)*header->bvWideNodeCount) : 0;
+	
+	unsigned char* d = data + headerSize;
+	tile->verts = dtGetThenAdvanceBufferPointer<float>(d, vertsSize);
+	tile->polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
+	tile->links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
+	tile->detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
+	tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	tile->detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
+	tile->bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
+	tile->offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshLinksSize);
+	tile->bvWideTree = dtGetThenAdvanceBufferPointer<dtBVWideNode>(d, bvWideTreeSize);
+
+	// If there are no items in the bvtree, reset the tree pointer.
+	if (!bvtreeSize)
+		tile->bvTree = 0;
+	if (!bvWideTreeSize)
+		tile->bvWideTree = 0;
+
+	if (flags & DT_TILE_READ_ONLY_DATA)
+	{
+		// Move everything the mesh writes to into a block of its own. Off-mesh connection 
+		// vertices are snapped to the mesh, so the vertices are only needed for those tiles.
+		const int linkVertsSize = header->offMeshConCount ? vertsSize : 0;
+		unsigned char* linkData = (unsigned char*)dtAlloc(polysSize + linksSize + linkVertsSize, DT_ALLOC_PERM);
+		if (!linkData)
+		{
+			tile->next = m_nextFree;
+			m_nextFree = tile;
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+		d = linkData;
+		dtPoly* polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
+		memcpy(polys, tile->polys, polysSize);
+		tile->polys = polys;
+		tile->links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
+		if (linkVertsSize)
+		{
+			float* verts = dtGetThenAdvanceBufferPointer<float>(d, linkVertsSize);
+			memcpy(verts, tile->verts, linkVertsSize);
+			tile->verts = verts;
+		}
+		tile->linkData = linkData;
+	}
+
+	// Sum up the polygon areas for picking random locations.
+	tile->polyAreaSum = (float*)dtAlloc(sizeof(float)*dtMax(header->polyCount, 1), DT_ALLOC_PERM);
+	if (!tile->polyAreaSum)
+	{
+		dtFree(tile->linkData);
+		tile->linkData = 0;
+		tile->next = m_nextFree;
+		m_nextFree = tile;
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	// Build links freelist
+	tile->linksFreeList = 0;
+	tile->links[header->maxLinkCount-1].next = DT_NULL_LINK;
+	for (int i = 0; i < header->maxLinkCount-1; ++i)
+		tile->links[i].next = i+1;
+
+	// Init tile.
+	tile->header = header;
+	tile->data = data;
+	tile->dataSize = dataSize;
+	tile->flags = flags;
+
+	*result = tile;
+	
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::linkTileInternal(dtMeshTile* tile)
+{
+	const dtMeshHeader* header = tile->header;
+	
+	// Sum up the polygon areas for picking random locations.
+	float areaSum = 0.0f;
+	for (int i = 0; i < header->polyCount; ++i)
+	{
+		const dtPoly* p = &tile->polys[i];
+		if (p->getType() == DT_POLYTYPE_GROUND)
+		{
+			const float* va = &tile->verts[p->verts[0]*3];
+			for (int j = 2; j < p->vertCount; ++j)
+				areaSum += dtTriArea2D(va, &tile->verts[p->verts[j-1]*3], &tile->verts[p->verts[j]*3]);
+		}
+		tile->polyAreaSum[i] = areaSum;
+	}
+
+	connectIntLinks(tile);
+
+	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
+	baseOffMeshLinks(tile);
+	connectExtOffMeshLinks(tile, tile, -1);
+}
+
+const dtNavMesh::dtTileColumn* dtNavMesh::getTileColumn(const int x, const int y) const
+{
+	const dtTileCell* cell = m_tileLookup->find(x, y);
+	return cell ? cell->column : 0;
+}
+
+dtNavMesh::dtTileColumn* dtNavMesh::createTileColumn(const dtMeshTile* tile)
+{
+	const int x = tile->header->x;
+	const int y = tile->header->y;
+	dtTileCell* cell = m_tileLookup->find(x, y);
+	if (!cell)
+	{
+		// Keep the table at most half full.
+		if ((m_tileCellCount+1)*2 > m_tileLookup->mask+1 && !growTileLookup())
+			return 0;
+		cell = m_tileLookup->insert(x, y);
+		cell->x = x;
+		cell->y = y;
+		cell->column = 0;
+		publishWrites();
+		cell->used = 1;
+		m_tileCellCount++;
+	}
+	
+	const dtTileColumn* old = cell->column;
+	const int oldCount = old ? old->count : 0;
+	dtTileColumn* column = dtTileColumn::alloc(oldCount+1);
+	if (!column)
+		return 0;
+	int n = 0;
+	for (int i = 0; i < oldCount && old->tiles[i]->header->layer < tile->header->layer; ++i)
+		column->tiles[n++] = old->tiles[i];
+	column->tiles[n] = const_cast<dtMeshTile*>(tile);
+	for (int i = n; i < oldCount; ++i)
+		column->tiles[i+1] = old->tiles[i];
 	
+	return column;
+}
+
+void dtNavMesh::publishTileColumn(const int x, const int y, dtTileColumn* column)
+{
+	dtTileCell* cell = m_tileLookup->find(x, y);
+	dtAssert(cell);
+	dtTileColumn* old = cell->column;
+	publishWrites();
+	cell->column = column;
+	if (old)
+		retire(0, DT_NULL_LINK, old);
+}
+
+bool dtNavMesh::removeTileFromColumn(const dtMeshTile* tile)
+{
+	dtTileCell* cell = m_tileLookup->find(tile->header->x, tile->header->y);
+	if (!cell || !cell->column)
+		return true;
+	dtTileColumn* old = cell->column;
+	
+	if (old->count == 1)
+	{
+		publishTileColumn(tile->header->x, tile->header->y, 0);
+		return true;
+	}
+	
+	// The published column is never modified, readers may be iterating it.
+	dtTileColumn* column = dtTileColumn::alloc(old->count-1);
+	if (!column)
+		return false;
+	int n = 0;
+	for (int i = 0; i < old->count; ++i)
+	{
+		if (old->tiles[i] != tile && n < column->count)
+			column->tiles[n++] = old->tiles[i];
+	}
+	publishTileColumn(tile->header->x, tile->header->y, column);
+	return true;
+}
+
+bool dtNavMesh::growTileLookup()
+{
+	// Count the cells that still have tiles, the empty ones are dropped.
+	int ncells = 0;
+	for (int i = 0; i <= m_tileLookup->mask; ++i)
+	{
+		if (m_tileLookup->cells[i].used && m_tileLookup->cells[i].column)
+			ncells++;
+	}
+	int size = m_tileLookup->mask+1;
+	while ((ncells+1)*2 > size/2)
+		size *= 2;
+	
+	dtTileLookup* lookup = dtTileLookup::alloc(size);
+	if (!lookup)
+		return false;
+	for (int i = 0; i <= m_tileLookup->mask; ++i)
+	{
+		const dtTileCell& cell = m_tileLookup->cells[i];
+		if (!cell.used || !cell.column)
+			continue;
+		*lookup->insert(cell.x, cell.y) = cell;
+	}
+	
+	dtTileLookup* old = m_tileLookup;
+	publishWrites();
+	m_tileLookup = lookup;
+	m_tileCellCount = ncells;
+	retire(0, DT_NULL_LINK, old);
+	
+	return true;
+}
+
+void dtNavMesh::discardTile(dtMeshTile* tile)
+{
+	// The caller keeps the data of a tile that failed to be added.
+	tile->flags &= ~DT_TILE_FREE_DATA;
+	resetTile(tile);
+}
+
+const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer) const
+{
+	const dtTileColumn* column = getTileColumn(x, y);
+	if (!column)
+		return 0;
+	for (int i = 0; i < column->count; ++i)
+	{
+		if (column->tiles[i]->header->layer == layer)
+			return column->tiles[i];
+	}
+	return 0;
+}
+
+int dtNavMesh::getNeighbourTilesAt(const int x, const int y, const int side, dtMeshTile** tiles, const int maxTiles) const
+{
+	int nx = x, ny = y;
+	switch (side)
+	{
+		case 0: nx++; break;
+		case 1: nx++; ny++; break;
+		case 2: ny++; break;
+		case 3: nx--; ny++; break;
+		case 4: nx--; break;
+		case 5: nx--; ny--; break;
+		case 6: ny--; break;
+		case 7: nx++; ny--; break;
+	};
+
+	return getTilesAt(nx, ny, tiles, maxTiles);
+}
+
+int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const int maxTiles) const
+{
+	const dtTileColumn* column = getTileColumn(x, y);
+	if (!column)
+		return 0;
+	const int n = dtMin(column->count, maxTiles);
+	for (int i = 0; i < n; ++i)
+		tiles[i] = column->tiles[i];
 	return n;
 }
 
@@ -1123,44 +2040,19 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const in
 /// entire result set.  It will simply fill the array to capacity.
 int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile const** tiles, const int maxTiles) const
 {
-	int n = 0;
-	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
-	while (tile)
-	{
-		if (tile->header &&
-			tile->header->x == x &&
-			tile->header->y == y)
-		{
-			if (n < maxTiles)
-				tiles[n++] = tile;
-		}
-		tile = tile->next;
-	}
-	
+	const dtTileColumn* column = getTileColumn(x, y);
+	if (!column)
+		return 0;
+	const int n = dtMin(column->count, maxTiles);
+	for (int i = 0; i < n; ++i)
+		tiles[i] = column->tiles[i];
 	return n;
 }
 
 
 dtTileRef dtNavMesh::getTileRefAt(const int x, const int y, const int layer) const
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
-	while (tile)
-	{
-		if (tile->header &&
-			tile->header->x == x &&
-			tile->header->y == y &&
-			tile->header->layer == layer)
-		{
-			return getTileRef(tile);
-		}
-		tile = tile->next;
-	}
-	return 0;
+	return getTileRef(getTileAt(x, y, layer));
 }
 
 const dtMeshTile* dtNavMesh::getTileByRef(dtTileRef ref) const
@@ -1172,7 +2064,7 @@ const dtMeshTile* dtNavMesh::getTileByRef(dtTileRef ref) const
 	if ((int)tileIndex >= m_maxTiles)
 		return 0;
 	const dtMeshTile* tile = &m_tiles[tileIndex];
-	if (tile->salt != tileSalt)
+	if (tile->salt != tileSalt || (tile->flags & DT_TILE_RETIRED))
 		return 0;
 	return tile;
 }
@@ -1204,7 +2096,7 @@ dtStatus dtNavMesh::getTileAndPolyByRef(const dtPolyRef ref, const dtMeshTile**
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	*tile = &m_tiles[it];
 	*poly = &m_tiles[it].polys[ip];
@@ -1230,7 +2122,7 @@ bool dtNavMesh::isValidPolyRef(dtPolyRef ref) const
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return false;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return false;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return false;
 	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return false;
 	return true;
 }
@@ -1240,6 +2132,10 @@ bool dtNavMesh::isValidPolyRef(dtPolyRef ref) const
 /// This function returns the data for the tile so that, if desired,
 /// it can be added back to the navigation mesh at a later point.
 ///
+/// Removing a tile that shares its location with other layers allocates the
+/// new list of tiles at the location. If that fails, the tile is not removed
+/// and #DT_OUT_OF_MEMORY is returned.
+///
 /// @see #addTile
 dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSize)
 {
@@ -1250,26 +2146,13 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	if ((int)tileIndex >= m_maxTiles)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	dtMeshTile* tile = &m_tiles[tileIndex];
-	if (tile->salt != tileSalt)
+	if (tile->salt != tileSalt || (tile->flags & DT_TILE_RETIRED))
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	// Remove tile from hash lookup.
-	int h = computeTileHash(tile->header->x,tile->header->y,m_tileLutMask);
-	dtMeshTile* prev = 0;
-	dtMeshTile* cur = m_posLookup[h];
-	while (cur)
-	{
-		if (cur == tile)
-		{
-			if (prev)
-				prev->next = cur->next;
-			else
-				m_posLookup[h] = cur->next;
-			break;
-		}
-		prev = cur;
-		cur = cur->next;
-	}
+	// Remove tile from the position lookup. Nothing has changed yet if this fails.
+	if (!removeTileFromColumn(tile))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	updateTileArea(tile, false);
 	
 	// Remove connections to neighbour tiles.
 	static const int MAX_NEIS = 32;
@@ -1282,6 +2165,7 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	{
 		if (neis[j] == tile) continue;
 		unconnectLinks(neis[j], tile);
+		updateWallSegmentCache(neis[j]);
 	}
 	
 	// Disconnect from neighbour tiles.
@@ -1289,16 +2173,14 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	{
 		nneis = getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
 		for (int j = 0; j < nneis; ++j)
+		{
 			unconnectLinks(neis[j], tile);
+			updateWallSegmentCache(neis[j]);
+		}
 	}
-		
-	// Reset tile.
+	
 	if (tile->flags & DT_TILE_FREE_DATA)
 	{
-		// Owns data
-		dtFree(tile->data);
-		tile->data = 0;
-		tile->dataSize = 0;
 		if (data) *data = 0;
 		if (dataSize) *dataSize = 0;
 	}
@@ -1307,6 +2189,67 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		if (data) *data = tile->data;
 		if (dataSize) *dataSize = tile->dataSize;
 	}
+	
+	// A retired tile keeps its header until it is reclaimed, so mark it before
+	// the new salt makes references with that salt decodable.
+	if (m_deferReclaim)
+	{
+		tile->flags |= DT_TILE_RETIRED;
+		publishWrites();
+	}
+	
+	// Update salt, salt should never be zero.
+#ifdef DT_POLYREF64
+	tile->salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
+#else
+	tile->salt = (tile->salt+1) & ((1<<m_saltBits)-1);
+#endif
+	if (tile->salt == 0)
+		tile->salt++;
+	
+	if (m_deferReclaim)
+	{
+		// References to the tile are invalid from here on, but its memory
+		// stays intact until the readers are done with it.
+		retire(tileIndex, DT_NULL_LINK);
+	}
+	else
+	{
+		resetTile(tile);
+	}
+	
+	// Release the island nodes of the removed tiles once they outnumber the others.
+	// If out of memory, the forest keeps them.
+	if (m_islands->count - 1 - m_islands->liveCount > dtMax(m_islands->liveCount, 256u))
+		rebuildIslands();
+
+	m_revision++;
+
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::resetTile(dtMeshTile* tile)
+{
+	// Release the island nodes, the tile might not have been given any.
+	const unsigned int tileIndex = (unsigned int)(tile - m_tiles);
+	if (m_islands->tileNodes[tileIndex])
+	{
+		m_islands->tileNodes[tileIndex] = 0;
+		m_islands->liveCount -= (unsigned int)tile->header->polyCount;
+	}
+	
+	// Reset tile.
+	if (tile->flags & DT_TILE_FREE_DATA)
+	{
+		// Owns data
+		dtFree(tile->data);
+	}
+	tile->data = 0;
+	tile->dataSize = 0;
+	dtFree(tile->linkData);
+	tile->linkData = 0;
+	dtFree(tile->polyAreaSum);
+	tile->polyAreaSum = 0;
 
 	tile->header = 0;
 	tile->flags = 0;
@@ -1318,27 +2261,445 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->detailVerts = 0;
 	tile->detailTris = 0;
 	tile->bvTree = 0;
+	tile->bvWideTree = 0;
 	tile->offMeshCons = 0;
-
-	// Update salt, salt should never be zero.
-#ifdef DT_POLYREF64
-	tile->salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
-#else
-	tile->salt = (tile->salt+1) & ((1<<m_saltBits)-1);
-#endif
-	if (tile->salt == 0)
-		tile->salt++;
+	freeWallSegmentCache(tile);
 
 	// Add to free list.
 	tile->next = m_nextFree;
 	m_nextFree = tile;
+}
+
+/// @par
+///
+/// The cache keeps, for every polygon, the portals of its tile border edges 
+/// sorted along the edge. getPolyWallSegments() and findDistanceToWall() read 
+/// them instead of walking and sorting the polygon links. The filter is still 
+/// applied by the queries, so changing polygon flags or areas does not 
+/// invalidate the cache. It is rebuilt for a tile and its neighbours whenever 
+/// addTile() or removeTile() changes the links between them.
+///
+/// The cache is rebuilt in place, so it can not be combined with deferred 
+/// reclamation. Enabling deferred reclamation disables the cache.
+///
+/// @see setDeferredReclaim
+dtStatus dtNavMesh::setWallSegmentCache(const bool enabled)
+{
+	if (enabled && m_deferReclaim)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (enabled == m_wallSegmentCache)
+		return DT_SUCCESS;
+
+	m_wallSegmentCache = enabled;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		if (enabled)
+			updateWallSegmentCache(&m_tiles[i]);
+		else
+			freeWallSegmentCache(&m_tiles[i]);
+	}
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::updateWallSegmentCache(dtMeshTile* tile)
+{
+	freeWallSegmentCache(tile);
+	if (!m_wallSegmentCache || !tile->header)
+		return;
+
+	const int polyCount = tile->header->polyCount;
+
+	// Count the links on border edges.
+	unsigned int portalCount = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+		{
+			const dtLink* link = &tile->links[k];
+			if (link->ref && link->edge < poly->vertCount && (poly->neis[link->edge] & DT_EXT_LINK))
+				portalCount++;
+		}
+	}
+
+	// If out of memory, the queries fall back to the links.
+	tile->polyPortalStart = (unsigned int*)dtAlloc(sizeof(unsigned int)*(polyCount+1), DT_ALLOC_PERM);
+	if (!tile->polyPortalStart)
+		return;
+	if (portalCount)
+	{
+		tile->portals = (dtPolyPortal*)dtAlloc(sizeof(dtPolyPortal)*portalCount, DT_ALLOC_PERM);
+		if (!tile->portals)
+		{
+			freeWallSegmentCache(tile);
+			return;
+		}
+	}
+
+	unsigned int n = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		tile->polyPortalStart[i] = n;
+		
+		// Store the edges in the same order as the wall queries visit them.
+		for (int e = 0, j = (int)poly->vertCount-1; e < (int)poly->vertCount; j = e++)
+		{
+			if (!(poly->neis[j] & DT_EXT_LINK))
+				continue;
+			
+			const unsigned int edgeStart = n;
+			bool first = true;
+			for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+			{
+				const dtLink* link = &tile->links[k];
+				if (link->edge != j)
+					continue;
+				const bool isFirst = first;
+				first = false;
+				if (!link->ref)
+					continue;
+				
+				// Insert sorted along the edge.
+				unsigned int idx = edgeStart;
+				while (idx < n && link->bmax > tile->portals[idx].tmin)
+					idx++;
+				if (n > idx)
+					memmove(&tile->portals[idx+1], &tile->portals[idx], sizeof(dtPolyPortal)*(n-idx));
+				
+				dtPolyPortal& portal = tile->portals[idx];
+				portal.ref = link->ref;
+				portal.edge = link->edge;
+				portal.tmin = link->bmin;
+				portal.tmax = link->bmax;
+				portal.first = isFirst ? 1 : 0;
+				n++;
+			}
+		}
+	}
+	tile->polyPortalStart[polyCount] = n;
+}
+
+void dtNavMesh::freeWallSegmentCache(dtMeshTile* tile)
+{
+	dtFree(tile->portals);
+	dtFree(tile->polyPortalStart);
+	tile->portals = 0;
+	tile->polyPortalStart = 0;
+}
+
+void dtNavMesh::updateTileArea(const dtMeshTile* tile, const bool add)
+{
+	const int polyCount = tile->header->polyCount;
+	if (!polyCount)
+		return;
+	const double area = add ? tile->polyAreaSum[polyCount-1] : -tile->polyAreaSum[polyCount-1];
+	for (int i = (int)(tile - m_tiles) + 1; i <= m_maxTiles; i += i & -i)
+		m_tileAreaTree[i-1] += area;
+}
+
+double dtNavMesh::getTotalTileArea() const
+{
+	double area = 0.0;
+	for (int i = m_maxTiles; i > 0; i -= i & -i)
+		area += m_tileAreaTree[i-1];
+	return area;
+}
+
+const dtMeshTile* dtNavMesh::getTileAtArea(const double area) const
+{
+	// Descend the tree to the first tile whose running area sum is larger than the area.
+	int idx = 0;
+	double rem = area;
+	for (int step = (int)dtNextPow2((unsigned int)m_maxTiles); step > 0; step >>= 1)
+	{
+		if (idx + step <= m_maxTiles && m_tileAreaTree[idx+step-1] <= rem)
+		{
+			idx += step;
+			rem -= m_tileAreaTree[idx-1];
+		}
+	}
+	return idx < m_maxTiles ? &m_tiles[idx] : 0;
+}
+
+bool dtNavMesh::reserveIslands(const unsigned int count)
+{
+	if (m_islands->count + count <= m_islands->capacity)
+		return true;
+	
+	const unsigned int capacity = dtMax(m_islands->capacity*2, m_islands->count + count);
+	dtIslandForest* islands = dtIslandForest::alloc(capacity, m_maxTiles);
+	if (!islands)
+		return false;
+	memcpy(islands->nodes, m_islands->nodes, sizeof(dtIslandForest::Node)*m_islands->count);
+	memcpy(islands->tileNodes, m_islands->tileNodes, sizeof(unsigned int)*m_maxTiles);
+	islands->count = m_islands->count;
+	islands->liveCount = m_islands->liveCount;
+	dtIslandForest* old = m_islands;
+	publishWrites();
+	m_islands = islands;
+	retire(0, DT_NULL_LINK, old);
+	return true;
+}
+
+void dtNavMesh::createTileIslands(dtIslandForest* islands, const dtMeshTile* tile)
+{
+	const int polyCount = tile->header->polyCount;
+	dtAssert(islands->count + (unsigned int)polyCount <= islands->capacity);
+	
+	// Group the polygons connected inside the tile. The links are followed in 
+	// both directions, off-mesh connections may be one way.
+	const unsigned int first = islands->count;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		islands->nodes[first+i].parent = first + (unsigned int)i;
+		islands->nodes[first+i].size = 1;
+	}
+	islands->count += (unsigned int)polyCount;
+	islands->liveCount += (unsigned int)polyCount;
+	const unsigned int tileIndex = (unsigned int)(tile - m_tiles);
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+		{
+			const dtPolyRef ref = tile->links[k].ref;
+			if (ref && decodePolyIdTile(ref) == tileIndex)
+				islands->merge(first + (unsigned int)i, first + decodePolyIdPoly(ref));
+		}
+	}
+	
+	publishWrites();
+	islands->tileNodes[tileIndex] = first;
+}
+
+void dtNavMesh::mergeTileIslands(dtIslandForest* islands, const dtMeshTile* tile)
+{
+	if (!tile->header)
+		return;
+	const unsigned int tileIndex = (unsigned int)(tile - m_tiles);
+	const unsigned int first = islands->tileNodes[tileIndex];
+	if (!first)
+		return;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+		{
+			const dtPolyRef ref = tile->links[k].ref;
+			if (!ref || decodePolyIdTile(ref) == tileIndex)
+				continue;
+			const unsigned int neiFirst = islands->tileNodes[decodePolyIdTile(ref)];
+			if (neiFirst)
+				islands->merge(first + (unsigned int)i, neiFirst + decodePolyIdPoly(ref));
+		}
+	}
+}
+
+unsigned int dtNavMesh::findIsland(const dtIslandForest* islands, unsigned int node)
+{
+	while (islands->nodes[node].parent != node)
+		node = islands->nodes[node].parent;
+	return node;
+}
+
+/// @par
+///
+/// Islands group the polygons connected by links, in either direction, and ignore 
+/// polygon flags and areas. Changing flags or areas does not change the islands.
+/// The ids are only comparable until the next change to the mesh.
+///
+/// @see rebuildIslands, dtNavMeshQuery::isReachable
+unsigned int dtNavMesh::getPolyIsland(dtPolyRef ref) const
+{
+	if (!ref) return 0;
+	unsigned int salt, it, ip;
+	decodePolyId(ref, salt, it, ip);
+	if (it >= (unsigned int)m_maxTiles) return 0;
+	const dtMeshTile* tile = &m_tiles[it];
+	if (tile->salt != salt || tile->header == 0) return 0;
+	if (ip >= (unsigned int)tile->header->polyCount) return 0;
+	const dtIslandForest* islands = m_islands;
+	const unsigned int first = islands->tileNodes[it];
+	if (!first) return 0;
+	return findIsland(islands, first + ip);
+}
 
+/// @par
+///
+/// Islands are merged as tiles are added, but removing a tile never splits them, 
+/// so two polygons may share an island after the tiles connecting them are gone. 
+/// Call this function after removing tiles to get exact islands again. 
+///
+/// The islands are built into a new forest that replaces the old one as a whole, 
+/// so with deferred reclamation other threads may keep reading the mesh meanwhile. 
+/// The writer must not add or remove tiles during the call, like for any other 
+/// change to the mesh.
+///
+/// removeTile() calls this function itself once the island nodes of the removed 
+/// tiles outnumber the nodes of the tiles in the mesh, so that the forest does not 
+/// grow without bound while tiles are streamed in and out.
+///
+/// @see setDeferredReclaim
+dtStatus dtNavMesh::rebuildIslands()
+{
+	// Skip the tiles waiting to be reclaimed.
+	unsigned int polyCount = 0;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* tile = &m_tiles[i];
+		if (tile->header && !(tile->flags & DT_TILE_RETIRED))
+			polyCount += (unsigned int)tile->header->polyCount;
+	}
+	
+	dtIslandForest* islands = dtIslandForest::alloc(dtMax(256u, dtNextPow2(polyCount+1)), m_maxTiles);
+	if (!islands)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* tile = &m_tiles[i];
+		if (tile->header && !(tile->flags & DT_TILE_RETIRED))
+			createTileIslands(islands, tile);
+	}
+	for (int i = 0; i < m_maxTiles; ++i)
+		mergeTileIslands(islands, &m_tiles[i]);
+	
+	dtIslandForest* old = m_islands;
+	publishWrites();
+	m_islands = islands;
+	retire(0, DT_NULL_LINK, old);
 	return DT_SUCCESS;
 }
 
+void dtNavMesh::releaseLink(dtMeshTile* tile, unsigned int link)
+{
+	if (m_deferReclaim)
+		retire((unsigned int)(tile - m_tiles), link);
+	else
+		freeLink(tile, link);
+}
+
+/// @par
+///
+/// The fence is a full barrier, so it is only issued when tiles may be edited while
+/// other threads run queries. (See #setDeferredReclaim.)
+void dtNavMesh::publishWrites() const
+{
+	if (m_deferReclaim)
+		publishFence();
+}
+
+void dtNavMesh::retire(const unsigned int tileIndex, const unsigned int link, void* memory)
+{
+	if (memory && !m_deferReclaim)
+	{
+		dtFree(memory);
+		return;
+	}
+
+	if (m_retiredCount == m_retiredCapacity)
+	{
+		const int capacity = m_retiredCapacity ? m_retiredCapacity*2 : 64;
+		dtRetiredItem* retired = (dtRetiredItem*)dtAlloc(sizeof(dtRetiredItem)*capacity, DT_ALLOC_PERM);
+		if (!retired)
+		{
+			// Out of memory, reclaim the item right away. Leaking it instead would keep
+			// a removed tile's slot and data for good.
+			reclaim(tileIndex, link, memory);
+			return;
+		}
+		if (m_retiredCount)
+			memcpy(retired, m_retired, sizeof(dtRetiredItem)*m_retiredCount);
+		dtFree(m_retired);
+		m_retired = retired;
+		m_retiredCapacity = capacity;
+	}
+	
+	dtRetiredItem& item = m_retired[m_retiredCount++];
+	item.epoch = m_editEpoch;
+	item.tile = tileIndex;
+	item.link = link;
+	item.memory = memory;
+}
+
+void dtNavMesh::reclaim(const unsigned int tileIndex, const unsigned int link, void* memory)
+{
+	dtMeshTile* tile = &m_tiles[tileIndex];
+	if (memory)
+		dtFree(memory);
+	else if (link == DT_NULL_LINK)
+		resetTile(tile);
+	else
+		freeLink(tile, link);
+}
+
+/// @par
+///
+/// Disabling deferred reclamation reclaims all the retired tiles and links 
+/// immediately, so it must only be done while no other thread is reading the mesh.
+///
+/// Enabling deferred reclamation disables the wall segment cache.
+///
+/// Only the writer issues fences. The queries use plain loads and no acquire fences, 
+/// and rely on dependency ordering instead: they reach new tile and link data only 
+/// through a pointer or index loaded from the field that published it (the position 
+/// lookup, a link index, a polygon reference). Mainstream CPUs, including x86 and ARM, 
+/// keep such dependent loads in order, but the C++ memory model does not guarantee it, 
+/// so an optimizing compiler could in principle break it. Reads that do not depend on 
+/// the published field, such as checking a reference's salt and then reading the tile 
+/// header, are not ordered at all; they are only safe because a retired tile stays 
+/// intact until it is reclaimed. ThreadSanitizer does not model any of this and reports 
+/// the published fields (e.g. the portal limits read by dtNavMeshQuery::getPortalPoints) 
+/// as races.
+///
+/// If the retired list can not grow, the removed item is reclaimed right away, which 
+/// is only safe if no reader still uses it.
+void dtNavMesh::setDeferredReclaim(const bool enabled)
+{
+	if (!enabled)
+		reclaimRetired(m_editEpoch + 1);
+	else
+		setWallSegmentCache(false);
+	m_deferReclaim = enabled;
+}
+
+unsigned int dtNavMesh::advanceEditEpoch()
+{
+	return ++m_editEpoch;
+}
+
+/// @par
+///
+/// An item removed during epoch @e e is reclaimed if @e e is older than 
+/// @p safeEpoch. Pass the oldest epoch that any reader observed via 
+/// getEditEpoch() before starting its current queries, or the current 
+/// epoch if no reader is active.
+///
+/// @see setDeferredReclaim
+int dtNavMesh::reclaimRetired(const unsigned int safeEpoch)
+{
+	// Items are retired in epoch order, and a link is always retired before
+	// the tile it belongs to, so reclaiming from the front is safe.
+	int n = 0;
+	while (n < m_retiredCount && (int)(safeEpoch - m_retired[n].epoch) > 0)
+	{
+		const dtRetiredItem& item = m_retired[n];
+		reclaim(item.tile, item.link, item.memory);
+		n++;
+	}
+	
+	if (n > 0)
+	{
+		m_retiredCount -= n;
+		memmove(m_retired, m_retired + n, sizeof(dtRetiredItem)*m_retiredCount);
+	}
+	
+	return n;
+}
+
 dtTileRef dtNavMesh::getTileRef(const dtMeshTile* tile) const
 {
-	if (!tile) return 0;
+	if (!tile || (tile->flags & DT_TILE_RETIRED)) return 0;
 	const unsigned int it = (unsigned int)(tile - m_tiles);
 	return (dtTileRef)encodePolyId(tile->salt, it, 0);
 }
@@ -1450,6 +2811,8 @@ dtStatus dtNavMesh::restoreTileState(dtMeshTile* tile, const unsigned char* data
 		p->setArea(s->area);
 	}
 	
+	m_revision++;
+
 	return DT_SUCCESS;
 }
 
@@ -1470,7 +2833,7 @@ dtStatus dtNavMesh::getOffMeshConnectionPolyEndPoints(dtPolyRef prevRef, dtPolyR
 	// Get current polygon
 	decodePolyId(polyRef, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtPoly* poly = &tile->polys[ip];
@@ -1513,7 +2876,7 @@ const dtOffMeshConnection* dtNavMesh::getOffMeshConnectionByRef(dtPolyRef ref) c
 	// Get current polygon
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return 0;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return 0;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return 0;
 	const dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return 0;
 	const dtPoly* poly = &tile->polys[ip];
@@ -1534,13 +2897,14 @@ dtStatus dtNavMesh::setPolyFlags(dtPolyRef ref, unsigned short flags)
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	dtPoly* poly = &tile->polys[ip];
 	
 	// Change flags.
 	poly->flags = flags;
+	m_revision++;
 	
 	return DT_SUCCESS;
 }
@@ -1551,7 +2915,7 @@ dtStatus dtNavMesh::getPolyFlags(dtPolyRef ref, unsigned short* resultFlags) con
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtPoly* poly = &tile->polys[ip];
@@ -1567,12 +2931,13 @@ dtStatus dtNavMesh::setPolyArea(dtPolyRef ref, unsigned char area)
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	dtPoly* poly = &tile->polys[ip];
 	
 	poly->setArea(area);
+	m_revision++;
 	
 	return DT_SUCCESS;
 }
@@ -1583,7 +2948,7 @@ dtStatus dtNavMesh::getPolyArea(dtPolyRef ref, unsigned char* resultArea) const
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_tiles[it].salt != salt || m_tiles[it].header == 0 || (m_tiles[it].flags & DT_TILE_RETIRED)) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtMeshTile* tile = &m_tiles[it];
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	const dtPoly* poly = &tile->polys[ip];
@@ -240,6 +240,80 @@ static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nn
 	return curNode;
 }
 
+// Returns the index of the second child of a binary BVTree node.
+static int getRightChild(const dtBVNode* nodes, const int inode)
+{
+	const int left = inode + 1;
+	return nodes[left].i >= 0 ? left + 1 : left - nodes[left].i;
+}
+
+// Collapses the binary subtree at inode into a wide node, pulling the children
+// of the largest subtrees up until the node is full. Children keep the order of
+// the binary tree so that both trees report polygons in the same order.
+static int collapseBVTree(const dtBVNode* nodes, const int inode, dtBVWideNode* wideNodes, int& curNode)
+{
+	const int iwide = curNode++;
+	
+	int items[DT_BVWIDE_WIDTH];
+	int nitems = 0;
+	if (nodes[inode].i >= 0)
+	{
+		// Single polygon tile.
+		items[nitems++] = inode;
+	}
+	else
+	{
+		items[nitems++] = inode + 1;
+		items[nitems++] = getRightChild(nodes, inode);
+	}
+	
+	while (nitems < DT_BVWIDE_WIDTH)
+	{
+		int best = -1;
+		int bestSize = 0;
+		for (int j = 0; j < nitems; ++j)
+		{
+			const int size = -nodes[items[j]].i;
+			if (size > bestSize)
+			{
+				best = j;
+				bestSize = size;
+			}
+		}
+		if (best == -1)
+			break;
+		
+		const int split = items[best];
+		for (int j = nitems; j > best+1; --j)
+			items[j] = items[j-1];
+		items[best] = split + 1;
+		items[best+1] = getRightChild(nodes, split);
+		nitems++;
+	}
+	
+	int children[DT_BVWIDE_WIDTH];
+	for (int j = 0; j < nitems; ++j)
+	{
+		const dtBVNode& item = nodes[items[j]];
+		children[j] = item.i >= 0 ? -(item.i + 1) : collapseBVTree(nodes, items[j], wideNodes, curNode);
+	}
+	
+	dtBVWideNode& node = wideNodes[iwide];
+	for (int j = 0; j < DT_BVWIDE_WIDTH; ++j)
+	{
+		const bool used = j < nitems;
+		for (int k = 0; k < 3; ++k)
+		{
+			// Unused slots get an inverted box so they never overlap.
+			node.bmin[k][j] = used ? nodes[items[j]].bmin[k] : 0xffff;
+			node.bmax[k][j] = used ? nodes[items[j]].bmax[k] : 0;
+		}
+		node.child[j] = used ? children[j] : 0;
+	}
+	
+	return iwide;
+}
+
 static unsigned char classifyOffMeshPoint(const float* pt, const float* bmin, const float* bmax)
 {
 	static const unsigned char XP = 1<<0;
@@ -423,6 +497,26 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 		}
 	}
 	
+	// Build the binary tree up front if it needs to be collapsed into the wide tree.
+	dtBVNode* bvNodes = 0;
+	dtBVWideNode* bvWideNodes = 0;
+	int bvWideNodeCount = 0;
+	if (params->buildWideBvTree && params->polyCount > 0)
+	{
+		bvNodes = (dtBVNode*)dtAlloc(sizeof(dtBVNode)*params->polyCount*2, DT_ALLOC_TEMP);
+		bvWideNodes = (dtBVWideNode*)dtAlloc(sizeof(dtBVWideNode)*params->polyCount, DT_ALLOC_TEMP);
+		if (!bvNodes || !bvWideNodes)
+		{
+			dtFree(bvNodes);
+			dtFree(bvWideNodes);
+			dtFree(offMeshConClass);
+			return false;
+		}
+		memset(bvNodes, 0, sizeof(dtBVNode)*params->polyCount*2);
+		createBVTree(params, bvNodes, 2*params->polyCount);
+		collapseBVTree(bvNodes, 0, bvWideNodes, bvWideNodeCount);
+	}
+	
 	// Calculate data size
 	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
 	const int vertsSize = dtAlign4(sizeof(float)*3*totVertCount);
@@ -433,14 +527,17 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*detailTriCount);
 	const int bvTreeSize = params->buildBvTree ? dtAlign4(sizeof(dtBVNode)*params->polyCount*2) : 0;
 	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*storedOffMeshConCount);
+	const int bvWideTreeSize = dtAlign4(sizeof(dtBVWideNode)*bvWideNodeCount);
 	
 	const int dataSize = headerSize + vertsSize + polysSize + linksSize +
 						 detailMeshesSize + detailVertsSize + detailTrisSize +
-						 bvTreeSize + offMeshConsSize;
+						 bvTreeSize + offMeshConsSize + bvWideTreeSize;
 						 
 	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dataSize, DT_ALLOC_PERM);
 	if (!data)
 	{
+		dtFree(bvNodes);
+		dtFree(bvWideNodes);
 		dtFree(offMeshConClass);
 		return false;
 	}
@@ -457,6 +554,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	unsigned char* navDTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	dtBVNode* navBvtree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvTreeSize);
 	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshConsSize);
+	dtBVWideNode* navBvWideTree = dtGetThenAdvanceBufferPointer<dtBVWideNode>(d, bvWideTreeSize);
 	
 	
 	// Store header
@@ -481,6 +579,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	header->walkableClimb = params->walkableClimb;
 	header->offMeshConCount = storedOffMeshConCount;
 	header->bvNodeCount = params->buildBvTree ? params->polyCount*2 : 0;
+	header->bvWideNodeCount = bvWideNodeCount;
 	
 	const int offMeshVertsBase = params->vertCount;
 	const int offMeshPolyBase = params->polyCount;
@@ -624,9 +723,20 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	// Store and create BVtree.
 	if (params->buildBvTree)
 	{
-		createBVTree(params, navBvtree, 2*params->polyCount);
+		if (bvNodes)
+			memcpy(navBvtree, bvNodes, sizeof(dtBVNode)*params->polyCount*2);
+		else
+			createBVTree(params, navBvtree, 2*params->polyCount);
 	}
 	
+	// Store wide BVtree.
+	if (bvWideNodeCount)
+	{
+		memcpy(navBvWideTree, bvWideNodes, sizeof(dtBVWideNode)*bvWideNodeCount);
+	}
+	dtFree(bvNodes);
+	dtFree(bvWideNodes);
+	
 	// Store Off-Mesh connections.
 	n = 0;
 	for (int i = 0; i < params->offMeshConCount; ++i)
@@ -662,15 +772,15 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	
 	int swappedMagic = DT_NAVMESH_MAGIC;
-	int swappedVersion = DT_NAVMESH_VERSION;
 	dtSwapEndian(&swappedMagic);
-	dtSwapEndian(&swappedVersion);
 	
-	if ((header->magic != DT_NAVMESH_MAGIC || header->version != DT_NAVMESH_VERSION) &&
-		(header->magic != swappedMagic || header->version != swappedVersion))
-	{
+	int version = header->version;
+	if (header->magic == swappedMagic)
+		dtSwapEndian(&version);
+	else if (header->magic != DT_NAVMESH_MAGIC)
+		return false;
+	if (version < DT_NAVMESH_VERSION_MIN || version > DT_NAVMESH_VERSION)
 		return false;
-	}
 		
 	dtSwapEndian(&header->magic);
 	dtSwapEndian(&header->version);
@@ -697,6 +807,8 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtSwapEndian(&header->bmax[1]);
 	dtSwapEndian(&header->bmax[2]);
 	dtSwapEndian(&header->bvQuantFactor);
+	if (version >= 8)
+		dtSwapEndian(&header->bvWideNodeCount);
 
 	// Freelist index and pointers are updated when tile is added, no need to swap.
 
@@ -715,11 +827,11 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return false;
-	if (header->version != DT_NAVMESH_VERSION)
+	if (header->version < DT_NAVMESH_VERSION_MIN || header->version > DT_NAVMESH_VERSION)
 		return false;
 	
 	// Patch header pointers.
-	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
+	const int headerSize = dtGetMeshHeaderSize(header->version);
 	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
 	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
 	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
@@ -728,6 +840,8 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
 	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
 	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
+	const int bvWideNodeCount = header->version >= 8 ? header->bvWideNodeCount : 0;
+	const int bvWideTreeSize = dtAlign4(sizeof(dtBVWideNode)*bvWideNodeCount);
 	
 	unsigned char* d = data + headerSize;
 	float* verts = dtGetThenAdvanceBufferPointer<float>(d, vertsSize);
@@ -740,6 +854,7 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	//unsigned char* detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	dtBVNode* bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
 	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshLinksSize);
+	dtBVWideNode* bvWideTree = dtGetThenAdvanceBufferPointer<dtBVWideNode>(d, bvWideTreeSize);
 	
 	// Vertices
 	for (int i = 0; i < header->vertCount*3; ++i)
@@ -798,5 +913,539 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 		dtSwapEndian(&con->poly);
 	}
 	
+	// Wide BV-tree
+	for (int i = 0; i < bvWideNodeCount; ++i)
+	{
+		dtBVWideNode* node = &bvWideTree[i];
+		for (int j = 0; j < DT_BVWIDE_WIDTH; ++j)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				dtSwapEndian(&node->bmin[k][j]);
+				dtSwapEndian(&node->bmax[k][j]);
+			}
+			dtSwapEndian(&node->child[j]);
+		}
+	}
+	
+	return true;
+}
+
+// Header of the compact tile format, followed by the original tile header.
+struct dtCompactTileHeader
+{
+	int magic;			// DT_NAVMESH_COMPACT_MAGIC
+	int version;		// DT_NAVMESH_COMPACT_VERSION
+	float qmin[3];		// Bounds the vertices are quantized to.
+	float qmax[3];
+	int borderVertCount;	// Number of vertices on the tile borders, which are stored exactly.
+};
+
+// True if the vertex lies on the border of the tile, where it is shared with the neighbour tile.
+inline bool isTileBorderVert(const float* v, const dtMeshHeader* header)
+{
+	return v[0] == header->bmin[0] || v[0] == header->bmax[0] ||
+		   v[2] == header->bmin[2] || v[2] == header->bmax[2];
+}
+
+inline unsigned short quantizeCoord(const float v, const float qmin, const float qmax)
+{
+	if (qmax <= qmin)
+		return 0;
+	const float t = (v - qmin) / (qmax - qmin);
+	return (unsigned short)dtClamp((int)(t*65535.0f + 0.5f), 0, 0xffff);
+}
+
+// Written as a blend so that the bounds themselves are restored exactly.
+inline float dequantizeCoord(const unsigned short q, const float qmin, const float qmax)
+{
+	const float t = q / 65535.0f;
+	return qmin*(1.0f - t) + qmax*t;
+}
+
+static int varintSize(unsigned int v)
+{
+	int n = 1;
+	while (v >= 0x80)
+	{
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+static unsigned char* writeVarint(unsigned char* d, unsigned int v)
+{
+	while (v >= 0x80)
+	{
+		*d++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*d++ = (unsigned char)v;
+	return d;
+}
+
+static const unsigned char* readVarint(const unsigned char* d, const unsigned char* end, unsigned int& v)
+{
+	v = 0;
+	for (int shift = 0; d < end && shift < 35; shift += 7)
+	{
+		const unsigned char b = *d++;
+		v |= (unsigned int)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return d;
+	}
+	return 0;
+}
+
+// Zig-zag encodes the difference between a detail mesh base and the end of the previous mesh.
+inline unsigned int encodeBaseDelta(const unsigned int base, const unsigned int expected)
+{
+	const int d = (int)(base - expected);
+	return ((unsigned int)d << 1) ^ (unsigned int)(d >> 31);
+}
+
+inline unsigned int decodeBaseDelta(const unsigned int v, const unsigned int expected)
+{
+	const int d = (int)(v >> 1) ^ -(int)(v & 1);
+	return expected + (unsigned int)d;
+}
+
+// Rebuilds the bounding volume trees of a decoded tile. The vertices are not exactly 
+// the ones the tree was first built from, so the boxes are rounded outwards.
+static bool rebuildBVTrees(const dtMeshHeader* header, const float* verts, const dtPoly* polys,
+						   const dtPolyDetail* detailMeshes, const float* detailVerts,
+						   dtBVNode* bvTree, dtBVWideNode* bvWideTree)
+{
+	const int polyCount = header->offMeshBase;
+	if (polyCount <= 0)
+		return header->bvNodeCount == 0 && header->bvWideNodeCount == 0;
+	
+	BVItem* items = (BVItem*)dtAlloc(sizeof(BVItem)*polyCount, DT_ALLOC_TEMP);
+	dtBVNode* nodes = (dtBVNode*)dtAlloc(sizeof(dtBVNode)*polyCount*2, DT_ALLOC_TEMP);
+	if (!items || !nodes)
+	{
+		dtFree(items);
+		dtFree(nodes);
+		return false;
+	}
+	memset(nodes, 0, sizeof(dtBVNode)*polyCount*2);
+	
+	const float qfac = header->bvQuantFactor;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* p = &polys[i];
+		float bmin[3], bmax[3];
+		dtVcopy(bmin, &verts[p->verts[0]*3]);
+		dtVcopy(bmax, bmin);
+		for (int j = 1; j < (int)p->vertCount; ++j)
+		{
+			dtVmin(bmin, &verts[p->verts[j]*3]);
+			dtVmax(bmax, &verts[p->verts[j]*3]);
+		}
+		const dtPolyDetail& pd = detailMeshes[i];
+		for (int j = 0; j < (int)pd.vertCount; ++j)
+		{
+			dtVmin(bmin, &detailVerts[(pd.vertBase+j)*3]);
+			dtVmax(bmax, &detailVerts[(pd.vertBase+j)*3]);
+		}
+		
+		BVItem& it = items[i];
+		it.i = i;
+		for (int k = 0; k < 3; ++k)
+		{
+			it.bmin[k] = (unsigned short)dtClamp((int)dtMathFloorf((bmin[k] - header->bmin[k])*qfac), 0, 0xffff);
+			it.bmax[k] = (unsigned short)dtClamp((int)dtMathCeilf((bmax[k] - header->bmin[k])*qfac), 0, 0xffff);
+		}
+	}
+	
+	int nodeCount = 0;
+	subdivide(items, polyCount, 0, polyCount, nodeCount, nodes);
+	dtFree(items);
+	
+	bool ok = true;
+	if (header->bvNodeCount)
+		memcpy(bvTree, nodes, sizeof(dtBVNode)*header->bvNodeCount);
+	if (header->bvWideNodeCount)
+	{
+		dtBVWideNode* wideNodes = (dtBVWideNode*)dtAlloc(sizeof(dtBVWideNode)*polyCount, DT_ALLOC_TEMP);
+		if (wideNodes)
+		{
+			int wideNodeCount = 0;
+			collapseBVTree(nodes, 0, wideNodes, wideNodeCount);
+			if (wideNodeCount == header->bvWideNodeCount)
+				memcpy(bvWideTree, wideNodes, sizeof(dtBVWideNode)*wideNodeCount);
+			else
+				ok = false;
+			dtFree(wideNodes);
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+	dtFree(nodes);
+	
+	return ok;
+}
+
+/// @par
+///
+/// The compact format is meant for keeping many tiles in memory, or on disk, 
+/// while only some of them are added to a navigation mesh. It is typically 
+/// 2-4 times smaller than the tile data:
+///
+/// - Polygon and detail mesh vertices are quantized to 16 bits relative to the 
+///   bounds of the vertices of the tile, so they move by at most 1/131070 of 
+///   the tile size. The bounds differ between tiles, so vertices on the tile 
+///   borders are stored exactly instead, and still match between neighbour 
+///   tiles after decoding. Off-mesh connection vertices are kept as is.
+/// - Polygons store only their used vertices and neighbours.
+/// - The link array is not stored, links are built when the tile is added.
+/// - The detail mesh bases are stored as differences to the end of the previous 
+///   detail mesh, which are zero for tiles created by #dtCreateNavMeshData.
+/// - The bounding volume trees are not stored, they are rebuilt by 
+///   #dtDecompressNavMeshData.
+///
+/// This is a storage format only. The compact data can not be added to a 
+/// navigation mesh or queried, decode it with #dtDecompressNavMeshData first; 
+/// an added tile takes as much memory as if it had never been compressed. Like 
+/// the tile data, it is stored in the native endianness.
+///
+/// Only data of the current version #DT_NAVMESH_VERSION can be compressed.
+bool dtCompressNavMeshData(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize)
+{
+	if (!data || dataSize < (int)sizeof(dtMeshHeader) || !outData || !outDataSize)
+		return false;
+	const dtMeshHeader* header = (const dtMeshHeader*)data;
+	if (header->magic != DT_NAVMESH_MAGIC || header->version != DT_NAVMESH_VERSION)
+		return false;
+	
+	const int offMeshVertCount = header->offMeshConCount*2;
+	const int groundVertCount = header->vertCount - offMeshVertCount;
+	if (groundVertCount < 0 || header->detailMeshCount > header->polyCount)
+		return false;
+	
+	// Locate the tile data.
+	const int headerSize = dtGetMeshHeaderSize(header->version);
+	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
+	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
+	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
+	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
+	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
+	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
+	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
+	const int bvWideTreeSize = dtAlign4(sizeof(dtBVWideNode)*header->bvWideNodeCount);
+	if (headerSize + vertsSize + polysSize + linksSize + detailMeshesSize + detailVertsSize +
+		detailTrisSize + bvtreeSize + offMeshConsSize + bvWideTreeSize > dataSize)
+		return false;
+	
+	// The trees are rebuilt on decode, which only works for the layout dtCreateNavMeshData uses.
+	if (header->bvNodeCount && header->bvNodeCount != header->offMeshBase*2)
+		return false;
+	if (header->bvWideNodeCount && header->offMeshBase <= 0)
+		return false;
+	
+	const unsigned char* s = data + headerSize;
+	const float* verts = (const float*)s; s += vertsSize;
+	const dtPoly* polys = (const dtPoly*)s; s += polysSize;
+	s += linksSize;
+	const dtPolyDetail* detailMeshes = (const dtPolyDetail*)s; s += detailMeshesSize;
+	const float* detailVerts = (const float*)s; s += detailVertsSize;
+	const unsigned char* detailTris = s; s += detailTrisSize;
+	s += bvtreeSize;
+	const dtOffMeshConnection* offMeshCons = (const dtOffMeshConnection*)s;
+	
+	// Quantization bounds, grown to cover vertices outside of the tile bounds.
+	dtCompactTileHeader compact;
+	compact.magic = DT_NAVMESH_COMPACT_MAGIC;
+	compact.version = DT_NAVMESH_COMPACT_VERSION;
+	dtVcopy(compact.qmin, header->bmin);
+	dtVcopy(compact.qmax, header->bmax);
+	for (int i = 0; i < groundVertCount; ++i)
+	{
+		dtVmin(compact.qmin, &verts[i*3]);
+		dtVmax(compact.qmax, &verts[i*3]);
+	}
+	for (int i = 0; i < header->detailVertCount; ++i)
+	{
+		dtVmin(compact.qmin, &detailVerts[i*3]);
+		dtVmax(compact.qmax, &detailVerts[i*3]);
+	}
+	compact.borderVertCount = 0;
+	for (int i = 0; i < groundVertCount; ++i)
+	{
+		if (isTileBorderVert(&verts[i*3], header))
+			compact.borderVertCount++;
+	}
+	for (int i = 0; i < header->detailVertCount; ++i)
+	{
+		if (isTileBorderVert(&detailVerts[i*3], header))
+			compact.borderVertCount++;
+	}
+	
+	// Calculate the compact size.
+	const int compactHeaderSize = dtAlign4(sizeof(dtCompactTileHeader));
+	const int meshHeaderSize = dtAlign4(sizeof(dtMeshHeader));
+	const int offMeshVertsSize = sizeof(float)*3*offMeshVertCount;
+	const int compactOffMeshConsSize = sizeof(dtOffMeshConnection)*header->offMeshConCount;
+	const int borderVertsSize = (sizeof(float)*3 + sizeof(unsigned int))*compact.borderVertCount;
+	const int qvertsSize = sizeof(unsigned short)*3*groundVertCount;
+	const int qdetailVertsSize = sizeof(unsigned short)*3*header->detailVertCount;
+	int compactPolysSize = 0;
+	for (int i = 0; i < header->polyCount; ++i)
+		compactPolysSize += 4 + 4*polys[i].vertCount;
+	int compactDetailMeshesSize = 0;
+	unsigned int expectedVertBase = 0, expectedTriBase = 0;
+	for (int i = 0; i < header->detailMeshCount; ++i)
+	{
+		const dtPolyDetail& pd = detailMeshes[i];
+		compactDetailMeshesSize += 2 + varintSize(encodeBaseDelta(pd.vertBase, expectedVertBase)) +
+								   varintSize(encodeBaseDelta(pd.triBase, expectedTriBase));
+		expectedVertBase = pd.vertBase + pd.vertCount;
+		expectedTriBase = pd.triBase + pd.triCount;
+	}
+	const int compactDetailTrisSize = 4*header->detailTriCount;
+	
+	const int compactSize = compactHeaderSize + meshHeaderSize + offMeshVertsSize + compactOffMeshConsSize +
+							borderVertsSize + qvertsSize + qdetailVertsSize + compactPolysSize +
+							compactDetailMeshesSize + compactDetailTrisSize;
+	
+	unsigned char* out = (unsigned char*)dtAlloc(sizeof(unsigned char)*compactSize, DT_ALLOC_PERM);
+	if (!out)
+		return false;
+	memset(out, 0, compactSize);
+	
+	// The sections are ordered by alignment, 4 byte items first and bytes last.
+	unsigned char* d = out;
+	memcpy(d, &compact, sizeof(dtCompactTileHeader));
+	d += compactHeaderSize;
+	memcpy(d, header, sizeof(dtMeshHeader));
+	d += meshHeaderSize;
+	memcpy(d, &verts[groundVertCount*3], offMeshVertsSize);
+	d += offMeshVertsSize;
+	memcpy(d, offMeshCons, compactOffMeshConsSize);
+	d += compactOffMeshConsSize;
+	
+	// Border vertices, indexed over the polygon vertices followed by the detail vertices.
+	float* bv = (float*)d;
+	unsigned int* bi = (unsigned int*)(bv + compact.borderVertCount*3);
+	for (int i = 0; i < groundVertCount + header->detailVertCount; ++i)
+	{
+		const float* v = i < groundVertCount ? &verts[i*3] : &detailVerts[(i-groundVertCount)*3];
+		if (!isTileBorderVert(v, header))
+			continue;
+		dtVcopy(bv, v);
+		bv += 3;
+		*bi++ = (unsigned int)i;
+	}
+	d = (unsigned char*)bi;
+	
+	unsigned short* qv = (unsigned short*)d;
+	for (int i = 0; i < groundVertCount*3; ++i)
+		*qv++ = quantizeCoord(verts[i], compact.qmin[i%3], compact.qmax[i%3]);
+	for (int i = 0; i < header->detailVertCount*3; ++i)
+		*qv++ = quantizeCoord(detailVerts[i], compact.qmin[i%3], compact.qmax[i%3]);
+	
+	for (int i = 0; i < header->polyCount; ++i)
+	{
+		const dtPoly& p = polys[i];
+		*qv++ = p.flags;
+		unsigned char* b = (unsigned char*)qv;
+		b[0] = p.vertCount;
+		b[1] = p.areaAndtype;
+		qv++;
+		for (int j = 0; j < (int)p.vertCount; ++j)
+			*qv++ = p.verts[j];
+		for (int j = 0; j < (int)p.vertCount; ++j)
+			*qv++ = p.neis[j];
+	}
+	
+	d = (unsigned char*)qv;
+	expectedVertBase = expectedTriBase = 0;
+	for (int i = 0; i < header->detailMeshCount; ++i)
+	{
+		const dtPolyDetail& pd = detailMeshes[i];
+		*d++ = pd.vertCount;
+		*d++ = pd.triCount;
+		d = writeVarint(d, encodeBaseDelta(pd.vertBase, expectedVertBase));
+		d = writeVarint(d, encodeBaseDelta(pd.triBase, expectedTriBase));
+		expectedVertBase = pd.vertBase + pd.vertCount;
+		expectedTriBase = pd.triBase + pd.triCount;
+	}
+	memcpy(d, detailTris, compactDetailTrisSize);
+	d += compactDetailTrisSize;
+	dtAssert(d == out + compactSize);
+	
+	*outData = out;
+	*outDataSize = compactSize;
+	
+	return true;
+}
+
+bool dtDecompressNavMeshData(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize)
+{
+	const int compactHeaderSize = dtAlign4(sizeof(dtCompactTileHeader));
+	const int meshHeaderSize = dtAlign4(sizeof(dtMeshHeader));
+	if (!data || dataSize < compactHeaderSize + meshHeaderSize || !outData || !outDataSize)
+		return false;
+	
+	const dtCompactTileHeader* compact = (const dtCompactTileHeader*)data;
+	if (compact->magic != DT_NAVMESH_COMPACT_MAGIC || compact->version != DT_NAVMESH_COMPACT_VERSION)
+		return false;
+	const dtMeshHeader* srcHeader = (const dtMeshHeader*)(data + compactHeaderSize);
+	if (srcHeader->magic != DT_NAVMESH_MAGIC || srcHeader->version != DT_NAVMESH_VERSION)
+		return false;
+	
+	const int offMeshVertCount = srcHeader->offMeshConCount*2;
+	const int groundVertCount = srcHeader->vertCount - offMeshVertCount;
+	if (groundVertCount < 0 || srcHeader->polyCount < 0 || srcHeader->detailMeshCount > srcHeader->polyCount ||
+		srcHeader->detailVertCount < 0 || srcHeader->detailTriCount < 0)
+		return false;
+	
+	// Calculate the tile data size, same layout as dtCreateNavMeshData.
+	const int headerSize = dtGetMeshHeaderSize(DT_NAVMESH_VERSION);
+	const int vertsSize = dtAlign4(sizeof(float)*3*srcHeader->vertCount);
+	const int polysSize = dtAlign4(sizeof(dtPoly)*srcHeader->polyCount);
+	const int linksSize = dtAlign4(sizeof(dtLink)*(srcHeader->maxLinkCount));
+	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*srcHeader->detailMeshCount);
+	const int detailVertsSize = dtAlign4(sizeof(float)*3*srcHeader->detailVertCount);
+	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*srcHeader->detailTriCount);
+	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*srcHeader->bvNodeCount);
+	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*srcHeader->offMeshConCount);
+	const int bvWideTreeSize = dtAlign4(sizeof(dtBVWideNode)*srcHeader->bvWideNodeCount);
+	const int tileSize = headerSize + vertsSize + polysSize + linksSize + detailMeshesSize + detailVertsSize +
+						 detailTrisSize + bvtreeSize + offMeshConsSize + bvWideTreeSize;
+	
+	// Check the fixed size sections of the compact data.
+	const int offMeshVertsSize = sizeof(float)*3*offMeshVertCount;
+	const int compactOffMeshConsSize = sizeof(dtOffMeshConnection)*srcHeader->offMeshConCount;
+	if (compact->borderVertCount < 0 || compact->borderVertCount > groundVertCount + srcHeader->detailVertCount)
+		return false;
+	const int borderVertsSize = (sizeof(float)*3 + sizeof(unsigned int))*compact->borderVertCount;
+	const int qvertsSize = sizeof(unsigned short)*3*(groundVertCount + srcHeader->detailVertCount);
+	const unsigned char* s = data + compactHeaderSize + meshHeaderSize;
+	const unsigned char* end = data + dataSize;
+	if (offMeshVertsSize + compactOffMeshConsSize + borderVertsSize + qvertsSize > (int)(end - s))
+		return false;
+	
+	unsigned char* tile = (unsigned char*)dtAlloc(sizeof(unsigned char)*tileSize, DT_ALLOC_PERM);
+	if (!tile)
+		return false;
+	memset(tile, 0, tileSize);
+	
+	unsigned char* d = tile;
+	dtMeshHeader* header = dtGetThenAdvanceBufferPointer<dtMeshHeader>(d, headerSize);
+	float* verts = dtGetThenAdvanceBufferPointer<float>(d, vertsSize);
+	dtPoly* polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
+	d += linksSize; // Links are created on load.
+	dtPolyDetail* detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
+	float* detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	unsigned char* detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
+	dtBVNode* bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
+	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshConsSize);
+	dtBVWideNode* bvWideTree = dtGetThenAdvanceBufferPointer<dtBVWideNode>(d, bvWideTreeSize);
+	
+	memcpy(header, srcHeader, sizeof(dtMeshHeader));
+	memcpy(&verts[groundVertCount*3], s, offMeshVertsSize);
+	s += offMeshVertsSize;
+	memcpy(offMeshCons, s, compactOffMeshConsSize);
+	s += compactOffMeshConsSize;
+	const float* bv = (const float*)s;
+	const unsigned int* bi = (const unsigned int*)(bv + compact->borderVertCount*3);
+	s += borderVertsSize;
+	
+	const unsigned short* qv = (const unsigned short*)s;
+	for (int i = 0; i < groundVertCount*3; ++i)
+		verts[i] = dequantizeCoord(*qv++, compact->qmin[i%3], compact->qmax[i%3]);
+	for (int i = 0; i < header->detailVertCount*3; ++i)
+		detailVerts[i] = dequantizeCoord(*qv++, compact->qmin[i%3], compact->qmax[i%3]);
+	
+	bool ok = true;
+	for (int i = 0; i < compact->borderVertCount; ++i)
+	{
+		const unsigned int idx = bi[i];
+		if (idx < (unsigned int)groundVertCount)
+			dtVcopy(&verts[idx*3], &bv[i*3]);
+		else if (idx < (unsigned int)(groundVertCount + header->detailVertCount))
+			dtVcopy(&detailVerts[(idx-groundVertCount)*3], &bv[i*3]);
+		else
+			ok = false;
+	}
+	for (int i = 0; i < header->polyCount && ok; ++i)
+	{
+		if ((const unsigned char*)(qv + 2) > end)
+		{
+			ok = false;
+			break;
+		}
+		dtPoly& p = polys[i];
+		p.flags = *qv++;
+		const unsigned char* b = (const unsigned char*)qv;
+		p.vertCount = b[0];
+		p.areaAndtype = b[1];
+		qv++;
+		if (p.vertCount > DT_VERTS_PER_POLYGON || (const unsigned char*)(qv + 2*p.vertCount) > end)
+		{
+			ok = false;
+			break;
+		}
+		for (int j = 0; j < (int)p.vertCount; ++j)
+		{
+			p.verts[j] = *qv++;
+			if (p.verts[j] >= header->vertCount)
+				ok = false;
+		}
+		for (int j = 0; j < (int)p.vertCount; ++j)
+			p.neis[j] = *qv++;
+	}
+	
+	s = (const unsigned char*)qv;
+	unsigned int expectedVertBase = 0, expectedTriBase = 0;
+	for (int i = 0; i < header->detailMeshCount && ok; ++i)
+	{
+		if (end - s < 2)
+		{
+			ok = false;
+			break;
+		}
+		dtPolyDetail& pd = detailMeshes[i];
+		pd.vertCount = *s++;
+		pd.triCount = *s++;
+		unsigned int vertDelta = 0, triDelta = 0;
+		if (s) s = readVarint(s, end, vertDelta);
+		if (s) s = readVarint(s, end, triDelta);
+		if (!s)
+		{
+			ok = false;
+			break;
+		}
+		pd.vertBase = decodeBaseDelta(vertDelta, expectedVertBase);
+		pd.triBase = decodeBaseDelta(triDelta, expectedTriBase);
+		if (pd.vertBase + pd.vertCount > (unsigned int)header->detailVertCount ||
+			pd.triBase + pd.triCount > (unsigned int)header->detailTriCount)
+			ok = false;
+		expectedVertBase = pd.vertBase + pd.vertCount;
+		expectedTriBase = pd.triBase + pd.triCount;
+	}
+	
+	if (ok && end - s >= 4*header->detailTriCount)
+		memcpy(detailTris, s, 4*header->detailTriCount);
+	else
+		ok = false;
+	
+	if (ok && (header->bvNodeCount || header->bvWideNodeCount))
+		ok = rebuildBVTrees(header, verts, polys, detailMeshes, detailVerts, bvTree, bvWideTree);
+	
+	if (!ok)
+	{
+		dtFree(tile);
+		return false;
+	}
+	
+	*outData = tile;
+	*outDataSize = tileSize;
+	
 	return true;
 }
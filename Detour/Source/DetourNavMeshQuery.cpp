@@ -18,7 +18,9 @@
 
 #include <float.h>
 #include <string.h>
+#include <stdlib.h>
 #include "DetourNavMeshQuery.h"
+#include "DetourNavMeshQueryTemplates.h"
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
@@ -83,24 +85,95 @@ float dtQueryFilter::getCost(const float* pa, const float* pb,
 {
 	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
 }
-#else
-inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
-									  const dtMeshTile* /*tile*/,
-									  const dtPoly* poly) const
+#endif	
+	
+const float dtNavMeshQuery::H_SCALE = 0.999f; // Search heuristic scale.
+
+// Caches the line of sight tests of an any-angle path search. A test is keyed by 
+// the two nodes it connects, the node positions do not change during a search.
+class dtLosCache
 {
-	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
+public:
+	dtLosCache()
+	{
+		memset(m_entries, 0, sizeof(m_entries));
+	}
+
+	bool find(const unsigned int fromIdx, const unsigned int toIdx, const dtPolyRef prevRef,
+			  bool& visible, float& pathCost) const
+	{
+		const unsigned int key = makeKey(fromIdx, toIdx);
+		const Entry& e = m_entries[hash(key)];
+		if (e.key != key || e.prevRef != prevRef)
+			return false;
+		visible = e.visible;
+		pathCost = e.pathCost;
+		return true;
+	}
+
+	void store(const unsigned int fromIdx, const unsigned int toIdx, const dtPolyRef prevRef,
+			   const bool visible, const float pathCost)
+	{
+		const unsigned int key = makeKey(fromIdx, toIdx);
+		Entry& e = m_entries[hash(key)];
+		e.key = key;
+		e.prevRef = prevRef;
+		e.visible = visible;
+		e.pathCost = pathCost;
+	}
+
+private:
+	static const int SIZE = 256;
+
+	struct Entry
+	{
+		unsigned int key;	///< Zero for unused entries, node indices start from one.
+		dtPolyRef prevRef;	///< The polygon before the start node, it affects the cost.
+		float pathCost;
+		bool visible;
+	};
+
+	static unsigned int makeKey(const unsigned int fromIdx, const unsigned int toIdx)
+	{
+		return (fromIdx << 16) | (toIdx & 0xffff);
+	}
+
+	static unsigned int hash(unsigned int key)
+	{
+		key *= 2654435761u;
+		return (key >> 24) & (SIZE-1);
+	}
+
+	Entry m_entries[SIZE];
+};
+
+dtLosCache* dtNavMeshQuery::allocLosCache()
+{
+	void* mem = dtAlloc(sizeof(dtLosCache), DT_ALLOC_TEMP);
+	if (!mem)
+		return 0;
+	return new(mem) dtLosCache;
 }
 
-inline float dtQueryFilter::getCost(const float* pa, const float* pb,
-									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
-									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
-									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+void dtNavMeshQuery::freeLosCache(dtLosCache* cache)
 {
-	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
+	if (!cache)
+		return;
+	cache->~dtLosCache();
+	dtFree(cache);
+}
+
+bool dtNavMeshQuery::findLos(const dtLosCache* cache, const unsigned int fromIdx, const unsigned int toIdx,
+							 const dtPolyRef prevRef, bool& visible, float& pathCost)
+{
+	return cache->find(fromIdx, toIdx, prevRef, visible, pathCost);
+}
+
+void dtNavMeshQuery::storeLos(dtLosCache* cache, const unsigned int fromIdx, const unsigned int toIdx,
+							  const dtPolyRef prevRef, const bool visible, const float pathCost)
+{
+	cache->store(fromIdx, toIdx, prevRef, visible, pathCost);
 }
-#endif	
-	
-static const float H_SCALE = 0.999f; // Search heuristic scale.
 
 
 dtNavMeshQuery* dtAllocNavMeshQuery()
@@ -124,32 +197,42 @@ dtPolyQuery::~dtPolyQuery()
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
-/// @class dtNavMeshQuery
+/// @class dtNavMeshQueryScratch
 ///
-/// For methods that support undersized buffers, if the buffer is too small 
-/// to hold the entire result set the return status of the method will include 
-/// the #DT_BUFFER_TOO_SMALL flag.
+/// The scratch space holds all the state a search writes to: the node pools
+/// and the open list. These make up nearly all of the memory used by a 
+/// #dtNavMeshQuery, so a query object that uses external scratch space is small 
+/// and cheap to create.
 ///
-/// Constant member functions can be used by multiple clients without side
-/// effects. (E.g. No change to the closed list. No impact on an in-progress
-/// sliced path query. Etc.)
-/// 
-/// Walls and portals: A @e wall is a polygon segment that is 
-/// considered impassable. A @e portal is a passable segment between polygons.
-/// A portal may be treated as a wall based on the dtQueryFilter used for a query.
+/// A scratch object may be shared by several query objects as long as they 
+/// do not run at the same time. Sliced path queries keep their state in the 
+/// scratch between calls, so the scratch must not be used by another query 
+/// until the sliced query has been finalized.
 ///
-/// @see dtNavMesh, dtQueryFilter, #dtAllocNavMeshQuery(), #dtAllocNavMeshQuery()
+/// @see dtNavMeshQuery::init
 
-dtNavMeshQuery::dtNavMeshQuery() :
-	m_nav(0),
+dtNavMeshQueryScratch* dtAllocNavMeshQueryScratch()
+{
+	void* mem = dtAlloc(sizeof(dtNavMeshQueryScratch), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtNavMeshQueryScratch;
+}
+
+void dtFreeNavMeshQueryScratch(dtNavMeshQueryScratch* scratch)
+{
+	if (!scratch) return;
+	scratch->~dtNavMeshQueryScratch();
+	dtFree(scratch);
+}
+
+dtNavMeshQueryScratch::dtNavMeshQueryScratch() :
 	m_tinyNodePool(0),
 	m_nodePool(0),
 	m_openList(0)
 {
-	memset(&m_query, 0, sizeof(dtQueryData));
 }
 
-dtNavMeshQuery::~dtNavMeshQuery()
+dtNavMeshQueryScratch::~dtNavMeshQueryScratch()
 {
 	if (m_tinyNodePool)
 		m_tinyNodePool->~dtNodePool();
@@ -164,17 +247,13 @@ dtNavMeshQuery::~dtNavMeshQuery()
 
 /// @par 
 ///
-/// Must be the first function called after construction, before other
-/// functions are used.
-///
-/// This function can be used multiple times.
-dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
+/// This function can be used multiple times. The allocations are reused
+/// if they are large enough.
+dtStatus dtNavMeshQueryScratch::init(const int maxNodes)
 {
 	if (maxNodes > DT_NULL_IDX || maxNodes > (1 << DT_NODE_PARENT_BITS) - 1)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
-	m_nav = nav;
-	
 	if (!m_nodePool || m_nodePool->getMaxNodes() < maxNodes)
 	{
 		if (m_nodePool)
@@ -223,6 +302,251 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 	return DT_SUCCESS;
 }
 
+int dtNavMeshQueryScratch::getMaxNodes() const
+{
+	return m_nodePool ? m_nodePool->getMaxNodes() : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/// @class dtFlowField
+///
+/// A flow field answers "where do I go next?" towards a single goal for any 
+/// polygon of the navigation mesh in constant time. It is meant for large 
+/// groups of agents heading for the same destination, where one search replaces 
+/// a path query per agent.
+///
+/// The field is filled in by dtNavMeshQuery::buildFlowField(). It stays valid 
+/// for the tiles that have not been removed or replaced since; looking up a 
+/// polygon of a tile that has changed fails with #DT_INVALID_PARAM until the 
+/// field is repaired with dtNavMeshQuery::updateFlowField(). Changes to polygon 
+/// flags or areas are not detected, the field has to be rebuilt.
+///
+/// @see dtNavMeshQuery::buildFlowField, dtNavMeshQuery::updateFlowField
+
+dtFlowField* dtAllocFlowField()
+{
+	void* mem = dtAlloc(sizeof(dtFlowField), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtFlowField;
+}
+
+void dtFreeFlowField(dtFlowField* field)
+{
+	if (!field) return;
+	field->~dtFlowField();
+	dtFree(field);
+}
+
+dtFlowField::dtFlowField() :
+	m_nav(0),
+	m_maxTiles(0),
+	m_tileBase(0),
+	m_tilePolyCount(0),
+	m_tileSalt(0),
+	m_polyCapacity(0),
+	m_next(0),
+	m_cost(0),
+	m_scratchTileBase(0),
+	m_scratchTilePolyCount(0),
+	m_scratchTileSalt(0),
+	m_tileChanged(0),
+	m_scratchCapacity(0),
+	m_scratchNext(0),
+	m_scratchCost(0),
+	m_searchCapacity(0),
+	m_refs(0),
+	m_pos(0),
+	m_heap(0),
+	m_heapPos(0),
+	m_state(0),
+	m_oneWayLinks(0),
+	m_oneWayLinkCount(0),
+	m_oneWayLinkCapacity(0),
+	m_goalRef(0),
+	m_reachedCount(0)
+{
+	dtVset(m_goalPos, 0, 0, 0);
+}
+
+dtFlowField::~dtFlowField()
+{
+	dtFree(m_tileBase);
+	dtFree(m_tilePolyCount);
+	dtFree(m_tileSalt);
+	dtFree(m_next);
+	dtFree(m_cost);
+	dtFree(m_scratchTileBase);
+	dtFree(m_scratchTilePolyCount);
+	dtFree(m_scratchTileSalt);
+	dtFree(m_tileChanged);
+	dtFree(m_scratchNext);
+	dtFree(m_scratchCost);
+	dtFree(m_refs);
+	dtFree(m_pos);
+	dtFree(m_heap);
+	dtFree(m_heapPos);
+	dtFree(m_state);
+	dtFree(m_oneWayLinks);
+}
+
+bool dtFlowField::reserveScratch(const int npolys)
+{
+	if (m_scratchCapacity < npolys)
+	{
+		dtFree(m_scratchNext);
+		dtFree(m_scratchCost);
+		m_scratchNext = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*npolys, DT_ALLOC_PERM);
+		m_scratchCost = (float*)dtAlloc(sizeof(float)*npolys, DT_ALLOC_PERM);
+		m_scratchCapacity = npolys;
+		if (!m_scratchNext || !m_scratchCost)
+		{
+			m_scratchCapacity = 0;
+			return false;
+		}
+	}
+
+	if (m_searchCapacity < npolys)
+	{
+		dtFree(m_refs);
+		dtFree(m_pos);
+		dtFree(m_heap);
+		dtFree(m_heapPos);
+		dtFree(m_state);
+		m_refs = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*npolys, DT_ALLOC_PERM);
+		m_pos = (float*)dtAlloc(sizeof(float)*3*npolys, DT_ALLOC_PERM);
+		m_heap = (int*)dtAlloc(sizeof(int)*npolys, DT_ALLOC_PERM);
+		m_heapPos = (int*)dtAlloc(sizeof(int)*npolys, DT_ALLOC_PERM);
+		m_state = (unsigned char*)dtAlloc(sizeof(unsigned char)*npolys, DT_ALLOC_PERM);
+		m_searchCapacity = npolys;
+		if (!m_refs || !m_pos || !m_heap || !m_heapPos || !m_state)
+		{
+			m_searchCapacity = 0;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int dtFlowField::getPolyIndex(dtPolyRef ref) const
+{
+	if (!m_nav || !m_goalRef)
+		return -1;
+	unsigned int salt, it, ip;
+	m_nav->decodePolyId(ref, salt, it, ip);
+	if (it >= (unsigned int)m_maxTiles)
+		return -1;
+	if (m_tileSalt[it] != salt || ip >= (unsigned int)m_tilePolyCount[it])
+		return -1;
+	return m_tileBase[it] + (int)ip;
+}
+
+dtStatus dtFlowField::getNextPoly(dtPolyRef ref, dtPolyRef* nextRef, float* cost) const
+{
+	if (!nextRef)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*nextRef = 0;
+
+	const int idx = getPolyIndex(ref);
+	if (idx == -1 || !m_nav->isValidPolyRef(ref))
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*nextRef = m_next[idx];
+	if (cost)
+		*cost = m_cost[idx];
+
+	return DT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/// @class dtNavMeshQuery
+///
+/// For methods that support undersized buffers, if the buffer is too small 
+/// to hold the entire result set the return status of the method will include 
+/// the #DT_BUFFER_TOO_SMALL flag.
+///
+/// Constant member functions can be used by multiple clients without side
+/// effects. (E.g. No change to the closed list. No impact on an in-progress
+/// sliced path query. Etc.)
+/// 
+/// Walls and portals: A @e wall is a polygon segment that is 
+/// considered impassable. A @e portal is a passable segment between polygons.
+/// A portal may be treated as a wall based on the dtQueryFilter used for a query.
+///
+/// <b>Threading</b>
+///
+/// A query object is not thread safe: even the constant search functions 
+/// write to the node pools in its scratch space. Any number of query objects 
+/// may however run concurrently against the same dtNavMesh, as long as each 
+/// uses its own scratch space and the navigation mesh is not modified at the 
+/// same time. (See the threading notes for dtNavMesh.)
+///
+/// To avoid a full set of node pools per query object, initialize the query 
+/// objects with init(nav, scratch) and hand out scratch objects per thread, 
+/// e.g. from a thread local or a pool owned by the worker. Such query objects 
+/// hold only the sliced query state and can be created on the stack for each call.
+///
+/// @see dtNavMesh, dtQueryFilter, dtNavMeshQueryScratch, #dtAllocNavMeshQuery(), #dtAllocNavMeshQuery()
+
+dtNavMeshQuery::dtNavMeshQuery() :
+	m_nav(0),
+	m_tinyNodePool(0),
+	m_nodePool(0),
+	m_openList(0)
+{
+	memset(&m_query, 0, sizeof(dtQueryData));
+}
+
+dtNavMeshQuery::~dtNavMeshQuery()
+{
+}
+
+/// @par 
+///
+/// Must be the first function called after construction, before other
+/// functions are used.
+///
+/// This function can be used multiple times.
+dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
+{
+	dtStatus status = m_ownScratch.init(maxNodes);
+	if (dtStatusFailed(status))
+		return status;
+
+	return init(nav, &m_ownScratch);
+}
+
+/// @par 
+///
+/// The query does not take ownership of @p scratch. Any in-progress sliced
+/// path query is discarded.
+///
+/// This function can be used multiple times, e.g. to switch to the scratch 
+/// space of the calling thread.
+dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, dtNavMeshQueryScratch* scratch)
+{
+	if (!scratch || !scratch->m_nodePool)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_nav = nav;
+	m_nodePool = scratch->m_nodePool;
+	m_tinyNodePool = scratch->m_tinyNodePool;
+	m_openList = scratch->m_openList;
+	memset(&m_query, 0, sizeof(dtQueryData));
+	
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Locations are spread uniformly over the area of the polygons that pass the filter.
+/// A tile is picked from the running sum of the tile areas and a polygon from the 
+/// running sum of its polygon areas, both in logarithmic time. Picks rejected by the 
+/// filter are retried a few times before falling back to visiting every polygon, so 
+/// filters that exclude most of the mesh are slower.
 dtStatus dtNavMeshQuery::findRandomPoint(const dtQueryFilter* filter, float (*frand)(),
 										 dtPolyRef* randomRef, float* randomPt) const
 {
@@ -231,58 +555,73 @@ dtStatus dtNavMeshQuery::findRandomPoint(const dtQueryFilter* filter, float (*fr
 	if (!filter || !frand || !randomRef || !randomPt)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
-	// Randomly pick one tile. Assume that all tiles cover roughly the same area.
 	const dtMeshTile* tile = 0;
-	float tsum = 0.0f;
-	for (int i = 0; i < m_nav->getMaxTiles(); i++)
-	{
-		const dtMeshTile* t = m_nav->getTile(i);
-		if (!t || !t->header) continue;
-		
-		// Choose random tile using reservoir sampling.
-		const float area = 1.0f; // Could be tile area too.
-		tsum += area;
-		const float u = frand();
-		if (u*tsum <= area)
-			tile = t;
-	}
-	if (!tile)
-		return DT_FAILURE;
-
-	// Randomly pick one polygon weighted by polygon area.
 	const dtPoly* poly = 0;
 	dtPolyRef polyRef = 0;
-	const dtPolyRef base = m_nav->getPolyRefBase(tile);
 
-	float areaSum = 0.0f;
-	for (int i = 0; i < tile->header->polyCount; ++i)
+	static const int MAX_PICKS = 16;
+	const double totalArea = m_nav->getTotalTileArea();
+	for (int n = 0; n < MAX_PICKS && totalArea > 0.0 && !poly; ++n)
 	{
-		const dtPoly* p = &tile->polys[i];
-		// Do not return off-mesh connection polygons.
-		if (p->getType() != DT_POLYTYPE_GROUND)
+		const dtMeshTile* t = m_nav->getTileAtArea(frand()*totalArea);
+		if (!t || !t->header || !t->header->polyCount)
 			continue;
-		// Must pass filter
-		const dtPolyRef ref = base | (dtPolyRef)i;
-		if (!filter->passFilter(ref, tile, p))
-			continue;
-
-		// Calc area of the polygon.
-		float polyArea = 0.0f;
-		for (int j = 2; j < p->vertCount; ++j)
+		
+		// Find the first polygon whose running area sum is larger than the picked area.
+		const float* areaSum = t->polyAreaSum;
+		const int polyCount = t->header->polyCount;
+		const float area = frand()*areaSum[polyCount-1];
+		int lo = 0, hi = polyCount-1;
+		while (lo < hi)
 		{
-			const float* va = &tile->verts[p->verts[0]*3];
-			const float* vb = &tile->verts[p->verts[j-1]*3];
-			const float* vc = &tile->verts[p->verts[j]*3];
-			polyArea += dtTriArea2D(va,vb,vc);
+			const int mid = (lo+hi)/2;
+			if (areaSum[mid] > area)
+				hi = mid;
+			else
+				lo = mid+1;
 		}
-
-		// Choose random polygon weighted by area, using reservoir sampling.
-		areaSum += polyArea;
-		const float u = frand();
-		if (u*areaSum <= polyArea)
+		const dtPoly* p = &t->polys[lo];
+		if (p->getType() != DT_POLYTYPE_GROUND)
+			continue;
+		const dtPolyRef ref = m_nav->getPolyRefBase(t) | (dtPolyRef)lo;
+		if (!filter->passFilter(ref, t, p))
+			continue;
+		tile = t;
+		poly = p;
+		polyRef = ref;
+	}
+	
+	if (!poly)
+	{
+		// Randomly pick one polygon weighted by polygon area, using reservoir sampling.
+		float areaSum = 0.0f;
+		for (int i = 0; i < m_nav->getMaxTiles(); i++)
 		{
-			poly = p;
-			polyRef = ref;
+			const dtMeshTile* t = m_nav->getTile(i);
+			if (!t || !t->header || (t->flags & DT_TILE_RETIRED)) continue;
+			
+			const dtPolyRef base = m_nav->getPolyRefBase(t);
+			for (int j = 0; j < t->header->polyCount; ++j)
+			{
+				const dtPoly* p = &t->polys[j];
+				// Do not return off-mesh connection polygons.
+				if (p->getType() != DT_POLYTYPE_GROUND)
+					continue;
+				// Must pass filter
+				const dtPolyRef ref = base | (dtPolyRef)j;
+				if (!filter->passFilter(ref, t, p))
+					continue;
+				
+				const float polyArea = t->polyAreaSum[j] - (j > 0 ? t->polyAreaSum[j-1] : 0.0f);
+				areaSum += polyArea;
+				const float u = frand();
+				if (u*areaSum <= polyArea)
+				{
+					tile = t;
+					poly = p;
+					polyRef = ref;
+				}
+			}
 		}
 	}
 	
@@ -374,15 +713,9 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 		// Place random locations on on ground.
 		if (bestPoly->getType() == DT_POLYTYPE_GROUND)
 		{
-			// Calc area of the polygon.
-			float polyArea = 0.0f;
-			for (int j = 2; j < bestPoly->vertCount; ++j)
-			{
-				const float* va = &bestTile->verts[bestPoly->verts[0]*3];
-				const float* vb = &bestTile->verts[bestPoly->verts[j-1]*3];
-				const float* vc = &bestTile->verts[bestPoly->verts[j]*3];
-				polyArea += dtTriArea2D(va,vb,vc);
-			}
+			// Area of the polygon from the running sum of the tile.
+			const unsigned int ip = m_nav->decodePolyIdPoly(bestRef);
+			const float polyArea = bestTile->polyAreaSum[ip] - (ip > 0 ? bestTile->polyAreaSum[ip-1] : 0.0f);
 			// Choose random polygon weighted by area, using reservoir sampling.
 			areaSum += polyArea;
 			const float u = frand();
@@ -729,48 +1062,468 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* halfE
 	return DT_SUCCESS;
 }
 
-void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
-										 const dtQueryFilter* filter, dtPolyQuery* query) const
+class dtFindNearestPolyBatchQuery
 {
-	dtAssert(m_nav);
-	static const int batchSize = 32;
-	dtPolyRef polyRefs[batchSize];
-	dtPoly* polys[batchSize];
-	int n = 0;
+public:
+	static const int MAX_POINTS = 256;
 
-	if (tile->bvTree)
+private:
+	struct PointKey
 	{
-		const dtBVNode* node = &tile->bvTree[0];
-		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
-		const float* tbmin = tile->header->bmin;
-		const float* tbmax = tile->header->bmax;
-		const float qfac = tile->header->bvQuantFactor;
+		int minx, miny, maxx, maxy;	///< The tile range touched by the point's search box.
+		int idx;					///< The index of the point in the caller's arrays.
+	};
 
-		// Calculate quantized box
-		unsigned short bmin[3], bmax[3];
-		// dtClamp query box to world box.
-		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
-		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
-		// Quantize
-		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
-		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
-		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
-		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
-		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
-		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+	const dtNavMeshQuery* m_query;
+	const dtQueryFilter* m_filter;
+	const float* m_centers;
+	const float* m_halfExtents;
+
+	PointKey m_keys[MAX_POINTS];
+	unsigned short m_members[MAX_POINTS];
+	float m_bmin[MAX_POINTS*3];
+	float m_bmax[MAX_POINTS*3];
+	unsigned short m_qmin[MAX_POINTS*3];
+	unsigned short m_qmax[MAX_POINTS*3];
+
+	float m_nearestDistanceSqr[MAX_POINTS];
+	dtPolyRef m_nearestRef[MAX_POINTS];
+	float m_nearestPoint[MAX_POINTS*3];
+	bool m_overPoly[MAX_POINTS];
+
+	static int compareKeys(const void* va, const void* vb)
+	{
+		const PointKey* a = (const PointKey*)va;
+		const PointKey* b = (const PointKey*)vb;
+		if (a->miny != b->miny) return a->miny < b->miny ? -1 : 1;
+		if (a->minx != b->minx) return a->minx < b->minx ? -1 : 1;
+		if (a->maxy != b->maxy) return a->maxy < b->maxy ? -1 : 1;
+		if (a->maxx != b->maxx) return a->maxx < b->maxx ? -1 : 1;
+		return a->idx - b->idx;
+	}
 
-		// Traverse tree
-		const dtPolyRef base = m_nav->getPolyRefBase(tile);
+	static bool sameTileRange(const PointKey& a, const PointKey& b)
+	{
+		return a.minx == b.minx && a.miny == b.miny && a.maxx == b.maxx && a.maxy == b.maxy;
+	}
+
+	void testPoly(const dtMeshTile* tile, const int slot, const dtPolyRef ref)
+	{
+		const float* center = &m_centers[m_keys[slot].idx*3];
+		float closestPtPoly[3];
+		float diff[3];
+		bool posOverPoly = false;
+		float d;
+		m_query->closestPointOnPoly(ref, center, closestPtPoly, &posOverPoly);
+
+		// Same metric as dtFindNearestPolyQuery.
+		dtVsub(diff, center, closestPtPoly);
+		if (posOverPoly)
+		{
+			d = dtAbs(diff[1]) - tile->header->walkableClimb;
+			d = d > 0 ? d*d : 0;
+		}
+		else
+		{
+			d = dtVlenSqr(diff);
+		}
+
+		if (d < m_nearestDistanceSqr[slot])
+		{
+			dtVcopy(&m_nearestPoint[slot*3], closestPtPoly);
+			m_nearestDistanceSqr[slot] = d;
+			m_nearestRef[slot] = ref;
+			m_overPoly[slot] = posOverPoly;
+		}
+	}
+
+	// Visits the sibling nodes in [node, end). Before descending into a node, the
+	// member list is partitioned so that the members overlapping the node come first,
+	// and only those are passed on. The partition only reorders the list, so the
+	// remaining siblings still see the same member set.
+	void traverse(const dtMeshTile* tile, const dtPolyRef base, const dtBVNode* node, const dtBVNode* end,
+				  unsigned short* members, const int nmembers)
+	{
 		while (node < end)
 		{
-			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
-			const bool isLeafNode = node->i >= 0;
+			int noverlap = 0;
+			for (int k = 0; k < nmembers; ++k)
+			{
+				const int slot = members[k];
+				if (dtOverlapQuantBounds(&m_qmin[slot*3], &m_qmax[slot*3], node->bmin, node->bmax))
+					dtSwap(members[k], members[noverlap++]);
+			}
 
-			if (isLeafNode && overlap)
+			if (node->i >= 0)
+			{
+				if (noverlap > 0)
+				{
+					const dtPolyRef ref = base | (dtPolyRef)node->i;
+					if (m_filter->passFilter(ref, tile, &tile->polys[node->i]))
+					{
+						for (int k = 0; k < noverlap; ++k)
+							testPoly(tile, members[k], ref);
+					}
+				}
+				node++;
+			}
+			else
+			{
+				const dtBVNode* subtreeEnd = node - node->i;
+				if (noverlap > 0)
+					traverse(tile, base, node + 1, subtreeEnd, members, noverlap);
+				node = subtreeEnd;
+			}
+		}
+	}
+
+	// Same as traverse(), for the 4-wide tree. The children are visited in order, so
+	// the polygons are tested in the same order as by queryPolygonsInTile().
+	void traverseWide(const dtMeshTile* tile, const dtPolyRef base, const int nodeIdx,
+					  unsigned short* members, const int nmembers)
+	{
+		const dtBVWideNode& node = tile->bvWideTree[nodeIdx];
+
+		unsigned char masks[MAX_POINTS];
+		for (int k = 0; k < nmembers; ++k)
+		{
+			const int slot = members[k];
+			masks[k] = (unsigned char)dtOverlapQuantBoundsWide(&m_qmin[slot*3], &m_qmax[slot*3], node);
+		}
+
+		for (int i = 0; i < DT_BVWIDE_WIDTH; ++i)
+		{
+			const int child = node.child[i];
+			if (child == 0)
+				continue;
+
+			int noverlap = 0;
+			for (int k = 0; k < nmembers; ++k)
+			{
+				if (masks[k] & (1u << i))
+				{
+					dtSwap(members[k], members[noverlap]);
+					dtSwap(masks[k], masks[noverlap]);
+					noverlap++;
+				}
+			}
+			if (noverlap == 0)
+				continue;
+
+			if (child < 0)
+			{
+				const int polyIdx = -child - 1;
+				const dtPolyRef ref = base | (dtPolyRef)polyIdx;
+				if (m_filter->passFilter(ref, tile, &tile->polys[polyIdx]))
+				{
+					for (int k = 0; k < noverlap; ++k)
+						testPoly(tile, members[k], ref);
+				}
+			}
+			else
+			{
+				// The recursion reorders the members it is given, keep the masks in step.
+				unsigned short sub[MAX_POINTS];
+				memcpy(sub, members, sizeof(unsigned short)*noverlap);
+				traverseWide(tile, base, child, sub, noverlap);
+			}
+		}
+	}
+
+	void queryTile(const dtMeshTile* tile, const int first, const int last)
+	{
+		const int nmembers = last - first;
+		for (int k = 0; k < nmembers; ++k)
+			m_members[k] = (unsigned short)(first + k);
+
+		const dtPolyRef base = m_query->getAttachedNavMesh()->getPolyRefBase(tile);
+
+		if (tile->bvWideTree || tile->bvTree)
+		{
+			const float* tbmin = tile->header->bmin;
+			const float* tbmax = tile->header->bmax;
+			const float qfac = tile->header->bvQuantFactor;
+
+			// Quantize each member's search box against this tile, exactly like queryPolygonsInTile().
+			for (int slot = first; slot < last; ++slot)
+			{
+				const float* qmin = &m_bmin[slot*3];
+				const float* qmax = &m_bmax[slot*3];
+				unsigned short* bmin = &m_qmin[slot*3];
+				unsigned short* bmax = &m_qmax[slot*3];
+				for (int j = 0; j < 3; ++j)
+				{
+					const float mn = dtClamp(qmin[j], tbmin[j], tbmax[j]) - tbmin[j];
+					const float mx = dtClamp(qmax[j], tbmin[j], tbmax[j]) - tbmin[j];
+					bmin[j] = (unsigned short)(qfac * mn) & 0xfffe;
+					bmax[j] = (unsigned short)(qfac * mx + 1) | 1;
+				}
+			}
+
+			if (tile->bvWideTree)
+				traverseWide(tile, base, 0, m_members, nmembers);
+			else
+				traverse(tile, base, &tile->bvTree[0], &tile->bvTree[tile->header->bvNodeCount], m_members, nmembers);
+		}
+		else
+		{
+			float bmin[3], bmax[3];
+			for (int i = 0; i < tile->header->polyCount; ++i)
+			{
+				const dtPoly* p = &tile->polys[i];
+				// Do not return off-mesh connection polygons.
+				if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+					continue;
+				// Must pass filter
+				const dtPolyRef ref = base | (dtPolyRef)i;
+				if (!m_filter->passFilter(ref, tile, p))
+					continue;
+				// Calc polygon bounds.
+				const float* v = &tile->verts[p->verts[0]*3];
+				dtVcopy(bmin, v);
+				dtVcopy(bmax, v);
+				for (int j = 1; j < p->vertCount; ++j)
+				{
+					v = &tile->verts[p->verts[j]*3];
+					dtVmin(bmin, v);
+					dtVmax(bmax, v);
+				}
+				for (int slot = first; slot < last; ++slot)
+				{
+					if (dtOverlapBounds(&m_bmin[slot*3], &m_bmax[slot*3], bmin, bmax))
+						testPoly(tile, slot, ref);
+				}
+			}
+		}
+	}
+
+public:
+	dtFindNearestPolyBatchQuery(const dtNavMeshQuery* query, const dtQueryFilter* filter,
+								const float* centers, const float* halfExtents)
+		: m_query(query), m_filter(filter), m_centers(centers), m_halfExtents(halfExtents)
+	{
+	}
+
+	void run(const int first, const int count, dtPolyRef* nearestRefs, float* nearestPts, bool* isOverPoly)
+	{
+		dtAssert(count <= MAX_POINTS);
+		const dtNavMesh* nav = m_query->getAttachedNavMesh();
+
+		for (int slot = 0; slot < count; ++slot)
+		{
+			PointKey& key = m_keys[slot];
+			key.idx = first + slot;
+			const float* center = &m_centers[key.idx*3];
+			float bmin[3], bmax[3];
+			dtVsub(bmin, center, m_halfExtents);
+			dtVadd(bmax, center, m_halfExtents);
+			nav->calcTileLoc(bmin, &key.minx, &key.miny);
+			nav->calcTileLoc(bmax, &key.maxx, &key.maxy);
+		}
+
+		// Group the points that touch the same tiles next to each other.
+		qsort(m_keys, count, sizeof(PointKey), compareKeys);
+
+		for (int slot = 0; slot < count; ++slot)
+		{
+			const float* center = &m_centers[m_keys[slot].idx*3];
+			dtVsub(&m_bmin[slot*3], center, m_halfExtents);
+			dtVadd(&m_bmax[slot*3], center, m_halfExtents);
+			m_nearestDistanceSqr[slot] = FLT_MAX;
+			m_nearestRef[slot] = 0;
+			m_overPoly[slot] = false;
+		}
+
+		static const int MAX_NEIS = 32;
+		const dtMeshTile* neis[MAX_NEIS];
+
+		int groupStart = 0;
+		while (groupStart < count)
+		{
+			int groupEnd = groupStart + 1;
+			while (groupEnd < count && sameTileRange(m_keys[groupStart], m_keys[groupEnd]))
+				groupEnd++;
+
+			const PointKey& key = m_keys[groupStart];
+			for (int y = key.miny; y <= key.maxy; ++y)
+			{
+				for (int x = key.minx; x <= key.maxx; ++x)
+				{
+					const int nneis = nav->getTilesAt(x, y, neis, MAX_NEIS);
+					for (int j = 0; j < nneis; ++j)
+						queryTile(neis[j], groupStart, groupEnd);
+				}
+			}
+
+			groupStart = groupEnd;
+		}
+
+		for (int slot = 0; slot < count; ++slot)
+		{
+			const int idx = m_keys[slot].idx;
+			nearestRefs[idx] = m_nearestRef[slot];
+			// Only override the nearest point if a poly was found.
+			if (nearestPts && m_nearestRef[slot])
+			{
+				dtVcopy(&nearestPts[idx*3], &m_nearestPoint[slot*3]);
+				if (isOverPoly)
+					isOverPoly[idx] = m_overPoly[slot];
+			}
+		}
+	}
+};
+
+/// @par
+///
+/// Produces the same result for every point as calling findNearestPoly() 
+/// once per point, but amortizes the work: the points are processed in chunks 
+/// of up to 256, the points in a chunk are grouped by the tiles their search 
+/// boxes touch, and the BVTree of each tile (the 4-wide one when the tile has it) 
+/// is walked once per group rather than once per point. Points that are spatially 
+/// coherent in the input arrays group best, so sorting them by position beforehand 
+/// is worthwhile for large batches.
+///
+/// The results are returned in separate arrays indexed like @p centers. 
+/// As with findNearestPoly(), a point whose search box does not intersect any 
+/// polygon gets a zero reference, and its @p nearestPts and @p isOverPoly 
+/// entries are left unchanged.
+///
+dtStatus dtNavMeshQuery::findNearestPolyBatch(const float* centers, const int count, const float* halfExtents,
+											  const dtQueryFilter* filter,
+											  dtPolyRef* nearestRefs, float* nearestPts, bool* isOverPoly) const
+{
+	dtAssert(m_nav);
+
+	if (!centers || count < 0 ||
+		!halfExtents || !dtVisfinite(halfExtents) ||
+		!filter || !nearestRefs)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (!dtVisfinite(&centers[i*3]))
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	// The batch query is large, keep it off the stack.
+	dtFindNearestPolyBatchQuery* query = (dtFindNearestPolyBatchQuery*)dtAlloc(sizeof(dtFindNearestPolyBatchQuery), DT_ALLOC_TEMP);
+	if (!query)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	new(query) dtFindNearestPolyBatchQuery(this, filter, centers, halfExtents);
+
+	for (int first = 0; first < count; first += dtFindNearestPolyBatchQuery::MAX_POINTS)
+	{
+		const int n = dtMin(dtFindNearestPolyBatchQuery::MAX_POINTS, count - first);
+		query->run(first, n, nearestRefs, nearestPts, isOverPoly);
+	}
+
+	query->~dtFindNearestPolyBatchQuery();
+	dtFree(query);
+
+	return DT_SUCCESS;
+}
+
+void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
+										 const dtQueryFilter* filter, dtPolyQuery* query) const
+{
+	dtAssert(m_nav);
+	static const int batchSize = 32;
+	dtPolyRef polyRefs[batchSize];
+	dtPoly* polys[batchSize];
+	int n = 0;
+
+	if (tile->bvWideTree)
+	{
+		const float* tbmin = tile->header->bmin;
+		const float* tbmax = tile->header->bmax;
+		const float qfac = tile->header->bvQuantFactor;
+
+		// Calculate quantized box
+		unsigned short bmin[3], bmax[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			bmin[i] = (unsigned short)(qfac * (dtClamp(qmin[i], tbmin[i], tbmax[i]) - tbmin[i])) & 0xfffe;
+			bmax[i] = (unsigned short)(qfac * (dtClamp(qmax[i], tbmin[i], tbmax[i]) - tbmin[i]) + 1) | 1;
+		}
+
+		// Traverse tree. Children are pushed in reverse so that polygons come
+		// out in the same order as from the binary tree.
+		const dtPolyRef base = m_nav->getPolyRefBase(tile);
+		int stack[DT_BVWIDE_MAX_STACK];
+		int nstack = 0;
+		stack[nstack++] = 0;
+		while (nstack > 0)
+		{
+			const int child = stack[--nstack];
+			if (child < 0)
+			{
+				const int polyIdx = -child - 1;
+				dtPolyRef ref = base | (dtPolyRef)polyIdx;
+				if (filter->passFilter(ref, tile, &tile->polys[polyIdx]))
+				{
+					polyRefs[n] = ref;
+					polys[n] = &tile->polys[polyIdx];
+
+					if (n == batchSize - 1)
+					{
+						query->process(tile, polys, polyRefs, batchSize);
+						n = 0;
+					}
+					else
+					{
+						n++;
+					}
+				}
+				continue;
+			}
+
+			const dtBVWideNode& node = tile->bvWideTree[child];
+			const unsigned int mask = dtOverlapQuantBoundsWide(bmin, bmax, node);
+			for (int i = DT_BVWIDE_WIDTH-1; i >= 0; --i)
+			{
+				if ((mask & (1u << i)) && node.child[i] != 0)
+				{
+					dtAssert(nstack < DT_BVWIDE_MAX_STACK);
+					stack[nstack++] = node.child[i];
+				}
+			}
+		}
+	}
+	else if (tile->bvTree)
+	{
+		const dtBVNode* node = &tile->bvTree[0];
+		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
+		const float* tbmin = tile->header->bmin;
+		const float* tbmax = tile->header->bmax;
+		const float qfac = tile->header->bvQuantFactor;
+
+		// Calculate quantized box
+		unsigned short bmin[3], bmax[3];
+		// dtClamp query box to world box.
+		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
+		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
+		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
+		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
+		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
+		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
+		// Quantize
+		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
+		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
+		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
+		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
+		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
+		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+
+		// Traverse tree
+		const dtPolyRef base = m_nav->getPolyRefBase(tile);
+		while (node < end)
+		{
+			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+			const bool isLeafNode = node->i >= 0;
+
+			if (isLeafNode && overlap)
 			{
 				dtPolyRef ref = base | (dtPolyRef)node->i;
 				if (filter->passFilter(ref, tile, &tile->polys[node->i]))
@@ -970,228 +1723,53 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 /// The start and end positions are used to calculate traversal costs. 
 /// (The y-values impact the result.)
 ///
+/// With #DT_FINDPATH_ANY_ANGLE the search tries to connect each new node 
+/// directly to the parent of the node it is expanded from using raycasts, 
+/// the same way the sliced path queries do. The corridor follows those 
+/// shortcuts, which gives findStraightPath() fewer turns to process. Raycasts 
+/// between the same pair of nodes are cached for the duration of the search.
+///
+/// With #DT_FINDPATH_REACHABLE_ONLY the search is skipped if the end polygon is 
+/// on another island than the start polygon. (See isReachable().) The path then 
+/// only holds the start polygon instead of the polygon nearest to the end.
+///
 dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 								  const float* startPos, const float* endPos,
 								  const dtQueryFilter* filter,
-								  dtPolyRef* path, int* pathCount, const int maxPath) const
+								  dtPolyRef* path, int* pathCount, const int maxPath,
+								  const unsigned int options, dtFindPathStats* stats) const
 {
-	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
+	return findPath<dtQueryFilter>(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath, options, stats);
+}
 
-	if (!pathCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
+dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const
+{
+	// Find the length of the entire path.
+	dtNode* curNode = endNode;
+	int length = 0;
+	do
+	{
+		length++;
+		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
+	} while (curNode);
 
-	*pathCount = 0;
-	
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter || !path || maxPath <= 0)
+	// If the path cannot be fully stored then advance to the last node we will be able to store.
+	curNode = endNode;
+	int writeCount;
+	for (writeCount = length; writeCount > maxPath; writeCount--)
 	{
-		return DT_FAILURE | DT_INVALID_PARAM;
+		dtAssert(curNode);
+
+		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
 	}
 
-	if (startRef == endRef)
+	// Write path
+	for (int i = writeCount - 1; i >= 0; i--)
 	{
-		path[0] = startRef;
-		*pathCount = 1;
-		return DT_SUCCESS;
-	}
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, startPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	dtNode* lastBestNode = startNode;
-	float lastBestNodeCost = startNode->total;
-	
-	bool outOfNodes = false;
-	
-	while (!m_openList->empty())
-	{
-		// Remove node from open list and put it in closed list.
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Reached the goal, stop searching.
-		if (bestNode->id == endRef)
-		{
-			lastBestNode = bestNode;
-			break;
-		}
-		
-		// Get current poly and tile.
-		// The API input has been checked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
-		if (parentRef)
-			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
-		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
-			// Skip invalid ids and do not expand back to where we came from.
-			if (!neighbourRef || neighbourRef == parentRef)
-				continue;
-			
-			// Get neighbour poly and tile.
-			// The API input has been checked already, skip checking internal data.
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
-			
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-
-			// deal explicitly with crossing tile boundaries
-			unsigned char crossSide = 0;
-			if (bestTile->links[i].side != 0xff)
-				crossSide = bestTile->links[i].side >> 1;
-
-			// get the node
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
-			if (!neighbourNode)
-			{
-				outOfNodes = true;
-				continue;
-			}
-			
-			// If the node is visited the first time, calculate node position.
-			if (neighbourNode->flags == 0)
-			{
-				getNearestPoint(bestRef, bestPoly, bestTile, bestNode->pos,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
-
-			// Calculate cost and heuristic.
-			float cost = 0;
-			float heuristic = 0;
-			
-			// Special case for last node.
-			if (neighbourRef == endRef)
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				const float endCost = filter->getCost(neighbourNode->pos, endPos,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly,
-													  0, 0, 0);
-				
-				cost = bestNode->cost + curCost + endCost;
-				heuristic = 0;
-			}
-			else
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
-			}
-
-			const float total = cost + heuristic;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
-				continue;
-			// The node is already visited and process, and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
-				continue;
-			
-			// Add or update the node.
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->id = neighbourRef;
-			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
-			neighbourNode->cost = cost;
-			neighbourNode->total = total;
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
-			{
-				// Already in open, update node location.
-				m_openList->modify(neighbourNode);
-			}
-			else
-			{
-				// Put the node in open list.
-				neighbourNode->flags |= DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
-			}
-			
-			// Update nearest node to target so far.
-			if (heuristic < lastBestNodeCost)
-			{
-				lastBestNodeCost = heuristic;
-				lastBestNode = neighbourNode;
-			}
-		}
-	}
-
-	dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
-
-	if (lastBestNode->id != endRef)
-		status |= DT_PARTIAL_RESULT;
-
-	if (outOfNodes)
-		status |= DT_OUT_OF_NODES;
-	
-	return status;
-}
-
-dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const
-{
-	// Find the length of the entire path.
-	dtNode* curNode = endNode;
-	int length = 0;
-	do
-	{
-		length++;
-		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
-	} while (curNode);
-
-	// If the path cannot be fully stored then advance to the last node we will be able to store.
-	curNode = endNode;
-	int writeCount;
-	for (writeCount = length; writeCount > maxPath; writeCount--)
-	{
-		dtAssert(curNode);
-
-		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
-	}
-
-	// Write path
-	for (int i = writeCount - 1; i >= 0; i--)
-	{
-		dtAssert(curNode);
-
-		path[i] = curNode->id;
-		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
+		dtAssert(curNode);
+
+		path[i] = curNode->id;
+		curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
 	}
 
 	dtAssert(!curNode);
@@ -1274,6 +1852,10 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	m_query.lastBestNode = startNode;
 	m_query.lastBestNodeCost = startNode->total;
 	
+	// The end polygon is on another island, the start polygon is as close as the search would get.
+	if ((options & DT_FINDPATH_REACHABLE_ONLY) && m_nav->getPolyIsland(startRef) != m_nav->getPolyIsland(endRef))
+		m_query.status = DT_SUCCESS;
+	
 	return m_query.status;
 }
 	
@@ -1520,58 +2102,13 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount,
 	}
 	else
 	{
-		// Reverse the path.
 		dtAssert(m_query.lastBestNode);
 		
 		if (m_query.lastBestNode->id != m_query.endRef)
 			m_query.status |= DT_PARTIAL_RESULT;
 		
-		dtNode* prev = 0;
-		dtNode* node = m_query.lastBestNode;
-		int prevRay = 0;
-		do
-		{
-			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
-			node->pidx = m_nodePool->getNodeIdx(prev);
-			prev = node;
-			int nextRay = node->flags & DT_NODE_PARENT_DETACHED; // keep track of whether parent is not adjacent (i.e. due to raycast shortcut)
-			node->flags = (node->flags & ~DT_NODE_PARENT_DETACHED) | prevRay; // and store it in the reversed path's node
-			prevRay = nextRay;
-			node = next;
-		}
-		while (node);
-		
-		// Store path
-		node = prev;
-		do
-		{
-			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
-			dtStatus status = 0;
-			if (node->flags & DT_NODE_PARENT_DETACHED)
-			{
-				float t, normal[3];
-				int m;
-				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
-				n += m;
-				// raycast ends on poly boundary and the path might include the next poly boundary.
-				if (path[n-1] == next->id)
-					n--; // remove to avoid duplicates
-			}
-			else
-			{
-				path[n++] = node->id;
-				if (n >= maxPath)
-					status = DT_BUFFER_TOO_SMALL;
-			}
-
-			if (status & DT_STATUS_DETAIL_MASK)
-			{
-				m_query.status |= status & DT_STATUS_DETAIL_MASK;
-				break;
-			}
-			node = next;
-		}
-		while (node);
+		const dtStatus status = getPathToNodeAnyAngle(m_query.lastBestNode, m_query.filter, path, &n, maxPath);
+		m_query.status |= status & DT_STATUS_DETAIL_MASK;
 	}
 	
 	const dtStatus details = m_query.status & DT_STATUS_DETAIL_MASK;
@@ -1612,7 +2149,6 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing
 	else
 	{
 		// Find furthest existing node that was visited.
-		dtNode* prev = 0;
 		dtNode* node = 0;
 		for (int i = existingSize-1; i >= 0; --i)
 		{
@@ -1628,51 +2164,8 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing
 			node = m_query.lastBestNode;
 		}
 		
-		// Reverse the path.
-		int prevRay = 0;
-		do
-		{
-			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
-			node->pidx = m_nodePool->getNodeIdx(prev);
-			prev = node;
-			int nextRay = node->flags & DT_NODE_PARENT_DETACHED; // keep track of whether parent is not adjacent (i.e. due to raycast shortcut)
-			node->flags = (node->flags & ~DT_NODE_PARENT_DETACHED) | prevRay; // and store it in the reversed path's node
-			prevRay = nextRay;
-			node = next;
-		}
-		while (node);
-		
-		// Store path
-		node = prev;
-		do
-		{
-			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
-			dtStatus status = 0;
-			if (node->flags & DT_NODE_PARENT_DETACHED)
-			{
-				float t, normal[3];
-				int m;
-				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
-				n += m;
-				// raycast ends on poly boundary and the path might include the next poly boundary.
-				if (path[n-1] == next->id)
-					n--; // remove to avoid duplicates
-			}
-			else
-			{
-				path[n++] = node->id;
-				if (n >= maxPath)
-					status = DT_BUFFER_TOO_SMALL;
-			}
-
-			if (status & DT_STATUS_DETAIL_MASK)
-			{
-				m_query.status |= status & DT_STATUS_DETAIL_MASK;
-				break;
-			}
-			node = next;
-		}
-		while (node);
+		const dtStatus status = getPathToNodeAnyAngle(node, m_query.filter, path, &n, maxPath);
+		m_query.status |= status & DT_STATUS_DETAIL_MASK;
 	}
 	
 	const dtStatus details = m_query.status & DT_STATUS_DETAIL_MASK;
@@ -1724,6 +2217,7 @@ dtStatus dtNavMeshQuery::appendVertex(const float* pos, const unsigned char flag
 }
 
 dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, const float* endPos, const dtPolyRef* path,
+									  const float* portalLeft, const float* portalRight, const unsigned char* polyAreas,
 									  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 									  int* straightPathCount, const int maxStraightPath, const int options) const
 {
@@ -1732,31 +2226,16 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 	dtStatus stat = 0;
 	for (int i = startIdx; i < endIdx; i++)
 	{
-		// Calculate portal
-		const dtPolyRef from = path[i];
-		const dtMeshTile* fromTile = 0;
-		const dtPoly* fromPoly = 0;
-		if (dtStatusFailed(m_nav->getTileAndPolyByRef(from, &fromTile, &fromPoly)))
-			return DT_FAILURE | DT_INVALID_PARAM;
-		
-		const dtPolyRef to = path[i+1];
-		const dtMeshTile* toTile = 0;
-		const dtPoly* toPoly = 0;
-		if (dtStatusFailed(m_nav->getTileAndPolyByRef(to, &toTile, &toPoly)))
-			return DT_FAILURE | DT_INVALID_PARAM;
-		
-		float left[3], right[3];
-		if (dtStatusFailed(getPortalPoints(from, fromPoly, fromTile, to, toPoly, toTile, left, right)))
-			break;
-	
 		if (options & DT_STRAIGHTPATH_AREA_CROSSINGS)
 		{
 			// Skip intersection if only area crossings are requested.
-			if (fromPoly->getArea() == toPoly->getArea())
+			if (polyAreas[i] == polyAreas[i+1])
 				continue;
 		}
 		
 		// Append intersection
+		const float* left = &portalLeft[i*3];
+		const float* right = &portalRight[i*3];
 		float s,t;
 		if (dtIntersectSegSeg2D(startPos, endPos, left, right, s, t))
 		{
@@ -1773,6 +2252,102 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 	return DT_IN_PROGRESS;
 }
 
+/// @par
+///
+/// Gathers the portals into contiguous arrays, so that the funnel of 
+/// findStraightPath() can revisit them without looking up the polygons again. 
+/// Each polygon of the corridor is looked up once.
+///
+/// Fewer than @p pathSize - 1 portals are gathered if <tt>path[n+1]</tt> is 
+/// invalid or not connected to <tt>path[n]</tt>.
+///
+int dtNavMeshQuery::getPathPortals(const dtPolyRef* path, const int pathSize,
+								   float* portalLeftVerts, float* portalRightVerts,
+								   unsigned char* polyTypes, unsigned char* polyAreas) const
+{
+	dtAssert(m_nav);
+
+	if (!path || pathSize <= 0 || !polyTypes || !polyAreas)
+		return 0;
+
+	const dtMeshTile* fromTile = 0;
+	const dtPoly* fromPoly = 0;
+	if (dtStatusFailed(m_nav->getTileAndPolyByRef(path[0], &fromTile, &fromPoly)))
+		return 0;
+	polyTypes[0] = fromPoly->getType();
+	polyAreas[0] = fromPoly->getArea();
+	
+	int n = 0;
+	for (; n+1 < pathSize; ++n)
+	{
+		const dtMeshTile* toTile = 0;
+		const dtPoly* toPoly = 0;
+		if (dtStatusFailed(m_nav->getTileAndPolyByRef(path[n+1], &toTile, &toPoly)))
+			break;
+		if (dtStatusFailed(getPortalPoints(path[n], fromPoly, fromTile, path[n+1], toPoly, toTile,
+										   &portalLeftVerts[n*3], &portalRightVerts[n*3])))
+			break;
+		polyTypes[n+1] = toPoly->getType();
+		polyAreas[n+1] = toPoly->getArea();
+		fromTile = toTile;
+		fromPoly = toPoly;
+	}
+	return n;
+}
+
+// Holds the portals gathered for findStraightPath(). Short corridors fit into 
+// the fixed size buffers, longer ones are allocated.
+class dtStraightPathPortals
+{
+public:
+	dtStraightPathPortals() : left(0), right(0), types(0), areas(0), m_data(0)
+	{
+	}
+
+	~dtStraightPathPortals()
+	{
+		dtFree(m_data);
+	}
+
+	bool init(const int maxPortals)
+	{
+		if (maxPortals <= MAX_STACK_PORTALS)
+		{
+			left = &m_stackVerts[0];
+			right = &m_stackVerts[MAX_STACK_PORTALS*3];
+			types = &m_stackPolys[0];
+			areas = &m_stackPolys[MAX_STACK_PORTALS+1];
+			return true;
+		}
+		
+		const int vertsSize = sizeof(float)*maxPortals*6;
+		m_data = (unsigned char*)dtAlloc(vertsSize + (maxPortals+1)*2, DT_ALLOC_TEMP);
+		if (!m_data)
+			return false;
+		left = (float*)m_data;
+		right = left + maxPortals*3;
+		types = m_data + vertsSize;
+		areas = types + maxPortals+1;
+		return true;
+	}
+
+	float* left;			///< Left portal vertices. [(x, y, z) * maxPortals]
+	float* right;			///< Right portal vertices. [(x, y, z) * maxPortals]
+	unsigned char* types;	///< Polygon types of the corridor. [Size: maxPortals+1]
+	unsigned char* areas;	///< Polygon areas of the corridor. [Size: maxPortals+1]
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtStraightPathPortals(const dtStraightPathPortals&);
+	dtStraightPathPortals& operator=(const dtStraightPathPortals&);
+
+	static const int MAX_STACK_PORTALS = 64;
+
+	float m_stackVerts[MAX_STACK_PORTALS*6];
+	unsigned char m_stackPolys[(MAX_STACK_PORTALS+1)*2];
+	unsigned char* m_data;
+};
+
 /// @par
 /// 
 /// This method peforms what is often called 'string pulling'.
@@ -1790,8 +2365,74 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 /// they will be filled as far as possible from the start toward the end 
 /// position.
 ///
+/// The portals of the corridor are gathered in chunks of growing size, and 
+/// only as far along the corridor as the funnel gets before the result 
+/// buffers are full. Each polygon is looked up once, no matter how many times 
+/// the funnel restarts from an earlier corner. The funnel is rerun from the 
+/// start after each chunk, which at most doubles its work since each chunk is 
+/// at least as large as the portals gathered before it. Corridors of more than 
+/// 64 polygons use a temporary allocation for the portals.
+///
+dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* endPos,
+										  const dtPolyRef* path, const int pathSize,
+										  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
+										  int* straightPathCount, const int maxStraightPath, const int options) const
+{
+	dtAssert(m_nav);
+
+	if (!straightPathCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*straightPathCount = 0;
+
+	if (!path || pathSize <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	static const int MIN_GATHER = 8;
+
+	dtStraightPathPortals portals;
+	if (!portals.init(pathSize-1))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+
+	int portalCount = 0;
+	for (;;)
+	{
+		const int start = portalCount;
+		const int end = dtMin(pathSize-1, start + dtMax(start, MIN_GATHER));
+		const int n = getPathPortals(&path[start], end-start+1,
+									 &portals.left[start*3], &portals.right[start*3],
+									 &portals.types[start], &portals.areas[start]);
+		portalCount += n;
+
+		const dtStatus status = findStraightPath(startPos, endPos, path, pathSize,
+												 portals.left, portals.right, portals.types, portals.areas, portalCount,
+												 straightPath, straightPathFlags, straightPathRefs,
+												 straightPathCount, maxStraightPath, options);
+
+		if (!dtStatusDetail(status, DT_OUT_OF_PORTALS))
+			return status;
+
+		// The funnel ran past the gathered portals. If no more could be gathered, 
+		// path[portalCount+1] is invalid and the path so far is the result.
+		if (n < end-start)
+			return (status & ~DT_OUT_OF_PORTALS) | DT_PARTIAL_RESULT;
+	}
+}
+
+/// @par
+///
+/// Runs the same funnel as the findStraightPath() overload without portals. 
+/// If fewer portals than <tt>pathSize - 1</tt> are provided and the funnel 
+/// reaches the last of them, the end position is clamped to 
+/// <tt>path[portalCount]</tt> and #DT_OUT_OF_PORTALS is returned instead of 
+/// #DT_PARTIAL_RESULT. This lets the caller keep the portals of a long 
+/// corridor between calls and gather more of them only when the funnel 
+/// reaches the end of the gathered ones. See dtPathCorridor::findCorners().
+///
 dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* endPos,
 										  const dtPolyRef* path, const int pathSize,
+										  const float* portalLeftVerts, const float* portalRightVerts,
+										  const unsigned char* polyTypes, const unsigned char* polyAreas, const int portalCount,
 										  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 										  int* straightPathCount, const int maxStraightPath, const int options) const
 {
@@ -1805,7 +2446,9 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 	if (!startPos || !dtVisfinite(startPos) ||
 		!endPos || !dtVisfinite(endPos) ||
 		!path || pathSize <= 0 || !path[0] ||
-		maxStraightPath <= 0)
+		maxStraightPath <= 0 ||
+		portalCount < 0 || portalCount >= pathSize ||
+		(portalCount > 0 && (!portalLeftVerts || !portalRightVerts || !polyTypes || !polyAreas)))
 	{
 		return DT_FAILURE | DT_INVALID_PARAM;
 	}
@@ -1846,18 +2489,16 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 		
 		for (int i = 0; i < pathSize; ++i)
 		{
-			float left[3], right[3];
+			const float* left;
+			const float* right;
 			unsigned char toType;
 			
 			if (i+1 < pathSize)
 			{
-				unsigned char fromType; // fromType is ignored.
-
 				// Next portal.
-				if (dtStatusFailed(getPortalPoints(path[i], path[i+1], left, right, fromType, toType)))
+				if (i >= portalCount)
 				{
-					// Failed to get portal points, in practice this means that path[i+1] is invalid polygon.
-					// Clamp the end point to path[i], and return the path so far.
+					// Ran out of portals. Clamp the end point to path[i], and return the path so far.
 					
 					if (dtStatusFailed(closestPointOnPolyBoundary(path[i], endPos, closestEndPos)))
 					{
@@ -1870,7 +2511,8 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 					{
 						// Ignore status return value as we're just about to return anyway.
 						appendPortals(apexIndex, i, closestEndPos, path,
-											 straightPath, straightPathFlags, straightPathRefs,
+									  portalLeftVerts, portalRightVerts, polyAreas,
+									  straightPath, straightPathFlags, straightPathRefs,
 											 straightPathCount, maxStraightPath, options);
 					}
 
@@ -1879,9 +2521,13 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 										straightPath, straightPathFlags, straightPathRefs,
 										straightPathCount, maxStraightPath);
 					
-					return DT_SUCCESS | DT_PARTIAL_RESULT | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
+					return DT_SUCCESS | DT_OUT_OF_PORTALS | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
 				}
 				
+				left = &portalLeftVerts[i*3];
+				right = &portalRightVerts[i*3];
+				toType = polyTypes[i+1];
+				
 				// If starting really close the portal, advance.
 				if (i == 0)
 				{
@@ -1893,8 +2539,8 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 			else
 			{
 				// End of the path.
-				dtVcopy(left, closestEndPos);
-				dtVcopy(right, closestEndPos);
+				left = closestEndPos;
+				right = closestEndPos;
 				
 				toType = DT_POLYTYPE_GROUND;
 			}
@@ -1915,6 +2561,7 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 					if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
 					{
 						stat = appendPortals(apexIndex, leftIndex, portalLeft, path,
+											 portalLeftVerts, portalRightVerts, polyAreas,
 											 straightPath, straightPathFlags, straightPathRefs,
 											 straightPathCount, maxStraightPath, options);
 						if (stat != DT_IN_PROGRESS)
@@ -1966,6 +2613,7 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 					if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
 					{
 						stat = appendPortals(apexIndex, rightIndex, portalRight, path,
+											 portalLeftVerts, portalRightVerts, polyAreas,
 											 straightPath, straightPathFlags, straightPathRefs,
 											 straightPathCount, maxStraightPath, options);
 						if (stat != DT_IN_PROGRESS)
@@ -2006,6 +2654,7 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 		if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
 		{
 			stat = appendPortals(apexIndex, pathSize-1, closestEndPos, path,
+								 portalLeftVerts, portalRightVerts, polyAreas,
 								 straightPath, straightPathFlags, straightPathRefs,
 								 straightPathCount, maxStraightPath, options);
 			if (stat != DT_IN_PROGRESS)
@@ -2021,66 +2670,84 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 	return DT_SUCCESS | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
 }
 
-/// @par
-///
-/// This method is optimized for small delta movement and a small number of 
-/// polygons. If used for too great a distance, the result set will form an 
-/// incomplete path.
-///
-/// @p resultPos will equal the @p endPos if the end is reached. 
-/// Otherwise the closest reachable position will be returned.
-/// 
-/// @p resultPos is not projected onto the surface of the navigation 
-/// mesh. Use #getPolyHeight if this is needed.
-///
-/// This method treats the end position in the same manner as 
-/// the #raycast method. (As a 2D point.) See that method's documentation 
-/// for details.
-/// 
-/// If the @p visited array is too small to hold the entire result set, it will 
-/// be filled as far as possible from the start position toward the end 
-/// position.
-///
-dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
-										  const dtQueryFilter* filter,
-										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
+struct dtQueryBatchKey
 {
-	dtAssert(m_nav);
-	dtAssert(m_tinyNodePool);
+	dtPolyRef ref;
+	int idx;
+};
 
-	if (!visitedCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
+static int compareQueryBatchKeys(const void* va, const void* vb)
+{
+	const dtQueryBatchKey* a = (const dtQueryBatchKey*)va;
+	const dtQueryBatchKey* b = (const dtQueryBatchKey*)vb;
+	if (a->ref < b->ref) return -1;
+	if (a->ref > b->ref) return 1;
+	return a->idx - b->idx;
+}
 
-	*visitedCount = 0;
+// Scratch data of the batch queries. The polygon cache keeps the vertices of recently 
+// walked polygons, queries that start close to each other mostly cross the same polygons.
+struct dtQueryBatchScratch
+{
+	static const int MAX_QUERIES = 256;
+	static const int CACHE_SIZE = 64;
 
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter || !resultPos || !visited ||
-		maxVisitedSize <= 0)
+	struct PolyEntry
 	{
-		return DT_FAILURE | DT_INVALID_PARAM;
+		dtPolyRef ref;
+		const dtMeshTile* tile;
+		const dtPoly* poly;
+		int nv;
+		float verts[DT_VERTS_PER_POLYGON*3];
+	};
+
+	const PolyEntry* getPoly(const dtNavMesh* nav, const dtPolyRef ref)
+	{
+		unsigned int h = (unsigned int)(ref ^ (ref >> 16));
+		h *= 2654435761u;
+		PolyEntry& e = cache[h >> 26];
+		if (e.ref != ref)
+		{
+			e.ref = ref;
+			nav->getTileAndPolyByRefUnsafe(ref, &e.tile, &e.poly);
+			e.nv = (int)e.poly->vertCount;
+			for (int i = 0; i < e.nv; ++i)
+				dtVcopy(&e.verts[i*3], &e.tile->verts[e.poly->verts[i]*3]);
+		}
+		return &e;
 	}
-	
-	dtStatus status = DT_SUCCESS;
-	
+
+	dtQueryBatchKey keys[MAX_QUERIES];
+	PolyEntry cache[CACHE_SIZE];
+};
+
+// The nodes of a surface walk. The limits are those of the tiny node pool and 
+// the search stack the walk was written for.
+struct dtSurfaceWalk
+{
+	static const int MAX_NODES = 64;
 	static const int MAX_STACK = 48;
-	dtNode* stack[MAX_STACK];
-	int nstack = 0;
-	
-	m_tinyNodePool->clear();
-	
-	dtNode* startNode = m_tinyNodePool->getNode(startRef);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_CLOSED;
-	stack[nstack++] = startNode;
+
+	dtPolyRef refs[MAX_NODES];
+	int parents[MAX_NODES];
+	bool closed[MAX_NODES];
+	int stack[MAX_NODES];
+};
+
+int dtNavMeshQuery::walkSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
+								const dtQueryFilter* filter, dtQueryBatchScratch* cache,
+								dtSurfaceWalk* walk, float* resultPos) const
+{
+	int nnodes = 1;
+	walk->refs[0] = startRef;
+	walk->parents[0] = -1;
+	walk->closed[0] = true;
+	int stackHead = 0, stackTail = 0;
+	walk->stack[stackTail++] = 0;
 	
 	float bestPos[3];
 	float bestDist = FLT_MAX;
-	dtNode* bestNode = 0;
+	int bestNode = -1;
 	dtVcopy(bestPos, startPos);
 	
 	// Search constraints
@@ -2088,27 +2755,33 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 	dtVlerp(searchPos, startPos, endPos, 0.5f);
 	searchRadSqr = dtSqr(dtVdist(startPos, endPos)/2.0f + 0.001f);
 	
-	float verts[DT_VERTS_PER_POLYGON*3];
+	float polyVerts[DT_VERTS_PER_POLYGON*3];
 	
-	while (nstack)
+	while (stackHead < stackTail)
 	{
-		// Pop front.
-		dtNode* curNode = stack[0];
-		for (int i = 0; i < nstack-1; ++i)
-			stack[i] = stack[i+1];
-		nstack--;
+		const int curNode = walk->stack[stackHead++];
 		
-		// Get poly and tile.
+		// Get poly and tile, from the cache if there is one.
 		// The API input has been checked already, skip checking internal data.
-		const dtPolyRef curRef = curNode->id;
 		const dtMeshTile* curTile = 0;
 		const dtPoly* curPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);			
-		
-		// Collect vertices.
-		const int nverts = curPoly->vertCount;
-		for (int i = 0; i < nverts; ++i)
-			dtVcopy(&verts[i*3], &curTile->verts[curPoly->verts[i]*3]);
+		const float* verts = polyVerts;
+		int nverts = 0;
+		if (cache)
+		{
+			const dtQueryBatchScratch::PolyEntry* e = cache->getPoly(m_nav, walk->refs[curNode]);
+			curTile = e->tile;
+			curPoly = e->poly;
+			verts = e->verts;
+			nverts = e->nv;
+		}
+		else
+		{
+			m_nav->getTileAndPolyByRefUnsafe(walk->refs[curNode], &curTile, &curPoly);
+			nverts = (int)curPoly->vertCount;
+			for (int i = 0; i < nverts; ++i)
+				dtVcopy(&polyVerts[i*3], &curTile->verts[curPoly->verts[i]*3]);
+		}
 		
 		// If target is inside the poly, stop search.
 		if (dtPointInPolygon(endPos, verts, nverts))
@@ -2119,7 +2792,7 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 		}
 		
 		// Find wall edges and find nearest point inside the walls.
-		for (int i = 0, j = (int)curPoly->vertCount-1; i < (int)curPoly->vertCount; j = i++)
+		for (int i = 0, j = nverts-1; i < nverts; j = i++)
 		{
 			// Find links to neighbours.
 			static const int MAX_NEIS = 8;
@@ -2132,19 +2805,13 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 				for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
 				{
 					const dtLink* link = &curTile->links[k];
-					if (link->edge == j)
+					if (link->edge == j && link->ref != 0)
 					{
-						if (link->ref != 0)
-						{
-							const dtMeshTile* neiTile = 0;
-							const dtPoly* neiPoly = 0;
-							m_nav->getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
-							if (filter->passFilter(link->ref, neiTile, neiPoly))
-							{
-								if (nneis < MAX_NEIS)
-									neis[nneis++] = link->ref;
-							}
-						}
+						const dtMeshTile* neiTile = 0;
+						const dtPoly* neiPoly = 0;
+						m_nav->getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
+						if (filter->passFilter(link->ref, neiTile, neiPoly) && nneis < MAX_NEIS)
+							neis[nneis++] = link->ref;
 					}
 				}
 			}
@@ -2159,86 +2826,130 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 				}
 			}
 			
+			const float* vj = &verts[j*3];
+			const float* vi = &verts[i*3];
 			if (!nneis)
 			{
 				// Wall edge, calc distance.
-				const float* vj = &verts[j*3];
-				const float* vi = &verts[i*3];
 				float tseg;
 				const float distSqr = dtDistancePtSegSqr2D(endPos, vj, vi, tseg);
 				if (distSqr < bestDist)
 				{
-                    // Update nearest distance.
-					dtVlerp(bestPos, vj,vi, tseg);
+					// Update nearest distance.
+					dtVlerp(bestPos, vj, vi, tseg);
 					bestDist = distSqr;
 					bestNode = curNode;
 				}
+				continue;
 			}
-			else
+			
+			for (int k = 0; k < nneis; ++k)
 			{
-				for (int k = 0; k < nneis; ++k)
+				// Find or allocate the node, skip if the nodes ran out.
+				int node = 0;
+				while (node < nnodes && walk->refs[node] != neis[k])
+					node++;
+				if (node == nnodes)
 				{
-					// Skip if no node can be allocated.
-					dtNode* neighbourNode = m_tinyNodePool->getNode(neis[k]);
-					if (!neighbourNode)
-						continue;
-					// Skip if already visited.
-					if (neighbourNode->flags & DT_NODE_CLOSED)
-						continue;
-					
-					// Skip the link if it is too far from search constraint.
-					// TODO: Maybe should use getPortalPoints(), but this one is way faster.
-					const float* vj = &verts[j*3];
-					const float* vi = &verts[i*3];
-					float tseg;
-					float distSqr = dtDistancePtSegSqr2D(searchPos, vj, vi, tseg);
-					if (distSqr > searchRadSqr)
+					if (nnodes == dtSurfaceWalk::MAX_NODES)
 						continue;
-					
-					// Mark as the node as visited and push to queue.
-					if (nstack < MAX_STACK)
-					{
-						neighbourNode->pidx = m_tinyNodePool->getNodeIdx(curNode);
-						neighbourNode->flags |= DT_NODE_CLOSED;
-						stack[nstack++] = neighbourNode;
-					}
+					walk->refs[nnodes] = neis[k];
+					walk->closed[nnodes] = false;
+					nnodes++;
+				}
+				// Skip if already visited.
+				if (walk->closed[node])
+					continue;
+				
+				// Skip the link if it is too far from search constraint.
+				// TODO: Maybe should use getPortalPoints(), but this one is way faster.
+				float tseg;
+				if (dtDistancePtSegSqr2D(searchPos, vj, vi, tseg) > searchRadSqr)
+					continue;
+				
+				// Mark the node as visited and push to queue.
+				if (stackTail - stackHead < dtSurfaceWalk::MAX_STACK)
+				{
+					walk->parents[node] = curNode;
+					walk->closed[node] = true;
+					walk->stack[stackTail++] = node;
 				}
 			}
 		}
 	}
 	
+	dtVcopy(resultPos, bestPos);
+	
+	return bestNode;
+}
+
+/// @par
+///
+/// This method is optimized for small delta movement and a small number of 
+/// polygons. If used for too great a distance, the result set will form an 
+/// incomplete path.
+///
+/// @p resultPos will equal the @p endPos if the end is reached. 
+/// Otherwise the closest reachable position will be returned.
+/// 
+/// @p resultPos is not projected onto the surface of the navigation 
+/// mesh. Use #getPolyHeight if this is needed.
+///
+/// This method treats the end position in the same manner as 
+/// the #raycast method. (As a 2D point.) See that method's documentation 
+/// for details.
+/// 
+/// If the @p visited array is too small to hold the entire result set, it will 
+/// be filled as far as possible from the start position toward the end 
+/// position.
+///
+dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
+										  const dtQueryFilter* filter,
+										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
+{
+	dtAssert(m_nav);
+
+	if (!visitedCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*visitedCount = 0;
+
+	if (!m_nav->isValidPolyRef(startRef) ||
+		!startPos || !dtVisfinite(startPos) ||
+		!endPos || !dtVisfinite(endPos) ||
+		!filter || !resultPos || !visited ||
+		maxVisitedSize <= 0)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
+	dtStatus status = DT_SUCCESS;
+	
+	dtSurfaceWalk walk;
+	const int bestNode = walkSurface(startRef, startPos, endPos, filter, 0, &walk, resultPos);
+	
 	int n = 0;
-	if (bestNode)
+	if (bestNode >= 0)
 	{
-		// Reverse the path.
-		dtNode* prev = 0;
-		dtNode* node = bestNode;
-		do
+		// Count the nodes leading to the best node, then store them from the start.
+		int depth = 0;
+		for (int node = bestNode; node >= 0; node = walk.parents[node])
+			depth++;
+		n = depth;
+		if (n >= maxVisitedSize)
 		{
-			dtNode* next = m_tinyNodePool->getNodeAtIdx(node->pidx);
-			node->pidx = m_tinyNodePool->getNodeIdx(prev);
-			prev = node;
-			node = next;
+			n = maxVisitedSize;
+			status |= DT_BUFFER_TOO_SMALL;
 		}
-		while (node);
-		
-		// Store result
-		node = prev;
-		do
+		int node = bestNode;
+		for (int i = depth-1; i >= 0; --i)
 		{
-			visited[n++] = node->id;
-			if (n >= maxVisitedSize)
-			{
-				status |= DT_BUFFER_TOO_SMALL;
-				break;
-			}
-			node = m_tinyNodePool->getNodeAtIdx(node->pidx);
+			if (i < n)
+				visited[i] = walk.refs[node];
+			node = walk.parents[node];
 		}
-		while (node);
 	}
 	
-	dtVcopy(resultPos, bestPos);
-	
 	*visitedCount = n;
 	
 	return status;
@@ -2493,231 +3204,191 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 								 const dtQueryFilter* filter, const unsigned int options,
 								 dtRaycastHit* hit, dtPolyRef prevRef) const
 {
-	dtAssert(m_nav);
-
-	if (!hit)
-		return DT_FAILURE | DT_INVALID_PARAM;
+	return raycast<dtQueryFilter>(startRef, startPos, endPos, filter, options, hit, prevRef);
+}
 
-	hit->t = 0;
-	hit->pathCount = 0;
-	hit->pathCost = 0;
+/// @par
+///
+/// Produces the same hit parameter and normal for every ray as raycast() 
+/// without options, given a path buffer large enough for the whole walk. 
+/// The rays are processed in chunks of up to 256 and sorted by their start 
+/// polygon. The geometry of the polygons walked is kept in a small cache 
+/// shared by all rays, so rays that start in the same polygon or cross the 
+/// same area do not fetch and gather the same polygons over and over again. 
+/// No memory is allocated per ray.
+///
+/// The results are returned in separate arrays indexed like @p startRefs. 
+/// See raycast() on how to interpret the hit parameter. The hit normal is 
+/// zero when the ray does not hit a wall.
+///
+dtStatus dtNavMeshQuery::raycastBatch(const dtPolyRef* startRefs, const float* startPos, const float* endPos, const int count,
+									  const dtQueryFilter* filter,
+									  float* hitT, float* hitNormals, dtPolyRef* lastRefs) const
+{
+	dtAssert(m_nav);
 
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter ||
-		(prevRef && !m_nav->isValidPolyRef(prevRef)))
+	if (!startRefs || !startPos || !endPos || count < 0 ||
+		!filter || !hitT)
 	{
 		return DT_FAILURE | DT_INVALID_PARAM;
 	}
-	
-	float dir[3], curPos[3], lastPos[3];
-	float verts[DT_VERTS_PER_POLYGON*3+3];	
-	int n = 0;
-
-	dtVcopy(curPos, startPos);
-	dtVsub(dir, endPos, startPos);
-	dtVset(hit->hitNormal, 0, 0, 0);
-
-	dtStatus status = DT_SUCCESS;
-
-	const dtMeshTile* prevTile, *tile, *nextTile;
-	const dtPoly* prevPoly, *poly, *nextPoly;
-	dtPolyRef curRef;
 
-	// The API input has been checked already, skip checking internal data.
-	curRef = startRef;
-	tile = 0;
-	poly = 0;
-	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
-	nextTile = prevTile = tile;
-	nextPoly = prevPoly = poly;
-	if (prevRef)
-		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
-
-	while (curRef)
+	for (int i = 0; i < count; ++i)
 	{
-		// Cast ray against current polygon.
-		
-		// Collect vertices.
-		int nv = 0;
-		for (int i = 0; i < (int)poly->vertCount; ++i)
-		{
-			dtVcopy(&verts[nv*3], &tile->verts[poly->verts[i]*3]);
-			nv++;
-		}
-		
-		float tmin, tmax;
-		int segMin, segMax;
-		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
+		if (!m_nav->isValidPolyRef(startRefs[i]) ||
+			!dtVisfinite(&startPos[i*3]) ||
+			!dtVisfinite(&endPos[i*3]))
 		{
-			// Could not hit the polygon, keep the old t and report hit.
-			hit->pathCount = n;
-			return status;
+			return DT_FAILURE | DT_INVALID_PARAM;
 		}
+	}
 
-		hit->hitEdgeIndex = segMax;
-
-		// Keep track of furthest t so far.
-		if (tmax > hit->t)
-			hit->t = tmax;
-		
-		// Store visited polygons.
-		if (n < hit->maxPath)
-			hit->path[n++] = curRef;
-		else
-			status |= DT_BUFFER_TOO_SMALL;
+	// The scratch data is large, keep it off the stack.
+	dtQueryBatchScratch* scratch = (dtQueryBatchScratch*)dtAlloc(sizeof(dtQueryBatchScratch), DT_ALLOC_TEMP);
+	if (!scratch)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (int i = 0; i < dtQueryBatchScratch::CACHE_SIZE; ++i)
+		scratch->cache[i].ref = 0;
 
-		// Ray end is completely inside the polygon.
-		if (segMax == -1)
+	for (int first = 0; first < count; first += dtQueryBatchScratch::MAX_QUERIES)
+	{
+		const int n = dtMin(dtQueryBatchScratch::MAX_QUERIES, count - first);
+		for (int i = 0; i < n; ++i)
 		{
-			hit->t = FLT_MAX;
-			hit->pathCount = n;
-			
-			// add the cost
-			if (options & DT_RAYCAST_USE_COSTS)
-				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
-			return status;
+			scratch->keys[i].ref = startRefs[first+i];
+			scratch->keys[i].idx = first+i;
 		}
+		qsort(scratch->keys, n, sizeof(dtQueryBatchKey), compareQueryBatchKeys);
 
-		// Follow neighbours.
-		dtPolyRef nextRef = 0;
-		
-		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		for (int k = 0; k < n; ++k)
 		{
-			const dtLink* link = &tile->links[i];
+			const int idx = scratch->keys[k].idx;
+			const float* sp = &startPos[idx*3];
+			const float* ep = &endPos[idx*3];
 			
-			// Find link which contains this edge.
-			if ((int)link->edge != segMax)
-				continue;
-			
-			// Get pointer to the next polygon.
-			nextTile = 0;
-			nextPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
-			
-			// Skip off-mesh connections.
-			if (nextPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			
-			// Skip links based on filter.
-			if (!filter->passFilter(link->ref, nextTile, nextPoly))
-				continue;
+			float t = 0;
+			float normal[3] = { 0, 0, 0 };
+			dtPolyRef curRef = startRefs[idx];
+			dtPolyRef lastRef = curRef;
 			
-			// If the link is internal, just return the ref.
-			if (link->side == 0xff)
+			while (curRef)
 			{
-				nextRef = link->ref;
-				break;
-			}
-			
-			// If the link is at tile boundary,
-			
-			// Check if the link spans the whole edge, and accept.
-			if (link->bmin == 0 && link->bmax == 255)
-			{
-				nextRef = link->ref;
-				break;
-			}
-			
-			// Check for partial edge links.
-			const int v0 = poly->verts[link->edge];
-			const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
-			const float* left = &tile->verts[v0*3];
-			const float* right = &tile->verts[v1*3];
-			
-			// Check that the intersection lies inside the link portal.
-			if (link->side == 0 || link->side == 4)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[2] + (right[2] - left[2])*(link->bmin*s);
-				float lmax = left[2] + (right[2] - left[2])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
+				const dtQueryBatchScratch::PolyEntry* e = scratch->getPoly(m_nav, curRef);
 				
-				// Find Z intersection.
-				float z = startPos[2] + (endPos[2]-startPos[2])*tmax;
-				if (z >= lmin && z <= lmax)
+				float tmin, tmax;
+				int segMin, segMax;
+				if (!dtIntersectSegmentPoly2D(sp, ep, e->verts, e->nv, tmin, tmax, segMin, segMax))
 				{
-					nextRef = link->ref;
+					// Could not hit the polygon, keep the old t and report hit.
 					break;
 				}
-			}
-			else if (link->side == 2 || link->side == 6)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
-				float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
 				
-				// Find X intersection.
-				float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
-				if (x >= lmin && x <= lmax)
+				// Keep track of furthest t so far.
+				if (tmax > t)
+					t = tmax;
+				lastRef = curRef;
+				
+				// Ray end is completely inside the polygon.
+				if (segMax == -1)
 				{
-					nextRef = link->ref;
+					t = FLT_MAX;
 					break;
 				}
+				
+				// Follow neighbours.
+				const dtMeshTile* nextTile = e->tile;
+				const dtPoly* nextPoly = e->poly;
+				const dtPolyRef nextRef = getRaycastNextRef(e->tile, e->poly, segMax, tmax, sp, ep, filter, &nextTile, &nextPoly);
+				if (!nextRef)
+				{
+					// No neighbour, we hit a wall.
+					const float* va = &e->verts[segMax*3];
+					const float* vb = &e->verts[(segMax+1 < e->nv ? segMax+1 : 0)*3];
+					normal[0] = vb[2] - va[2];
+					normal[2] = -(vb[0] - va[0]);
+					dtVnormalize(normal);
+				}
+				curRef = nextRef;
 			}
+			
+			hitT[idx] = t;
+			if (hitNormals)
+				dtVcopy(&hitNormals[idx*3], normal);
+			if (lastRefs)
+				lastRefs[idx] = lastRef;
 		}
-		
-		// add the cost
-		if (options & DT_RAYCAST_USE_COSTS)
-		{
-			// compute the intersection point at the furthest end of the polygon
-			// and correct the height (since the raycast moves in 2d)
-			dtVcopy(lastPos, curPos);
-			dtVmad(curPos, startPos, dir, hit->t);
-			float* e1 = &verts[segMax*3];
-			float* e2 = &verts[((segMax+1)%nv)*3];
-			float eDir[3], diff[3];
-			dtVsub(eDir, e2, e1);
-			dtVsub(diff, curPos, e1);
-			float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
-			curPos[1] = e1[1] + eDir[1] * s;
-
-			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
-		}
-
-		if (!nextRef)
-		{
-			// No neighbour, we hit a wall.
-			
-			// Calculate hit normal.
-			const int a = segMax;
-			const int b = segMax+1 < nv ? segMax+1 : 0;
-			const float* va = &verts[a*3];
-			const float* vb = &verts[b*3];
-			const float dx = vb[0] - va[0];
-			const float dz = vb[2] - va[2];
-			hit->hitNormal[0] = dz;
-			hit->hitNormal[1] = 0;
-			hit->hitNormal[2] = -dx;
-			dtVnormalize(hit->hitNormal);
-			
-			hit->pathCount = n;
-			return status;
+	}
+
+	dtFree(scratch);
+
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Produces the same result position for every mover as moveAlongSurface(), 
+/// and the polygon the mover ends up in, which is the last polygon 
+/// moveAlongSurface() reports as visited. The visited polygons are not 
+/// returned, use moveAlongSurface() where they are needed, for example to 
+/// update a path corridor.
+///
+/// Like raycastBatch(), the movers are processed in chunks sorted by their 
+/// start polygon and share a cache of polygon vertices. No memory is 
+/// allocated per mover.
+///
+dtStatus dtNavMeshQuery::moveAlongSurfaceBatch(const dtPolyRef* startRefs, const float* startPos, const float* endPos, const int count,
+											   const dtQueryFilter* filter,
+											   float* resultPos, dtPolyRef* resultRefs) const
+{
+	dtAssert(m_nav);
+
+	if (!startRefs || !startPos || !endPos || count < 0 ||
+		!filter || !resultPos)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (!m_nav->isValidPolyRef(startRefs[i]) ||
+			!dtVisfinite(&startPos[i*3]) ||
+			!dtVisfinite(&endPos[i*3]))
+		{
+			return DT_FAILURE | DT_INVALID_PARAM;
 		}
+	}
+
+	dtQueryBatchScratch* scratch = (dtQueryBatchScratch*)dtAlloc(sizeof(dtQueryBatchScratch), DT_ALLOC_TEMP);
+	if (!scratch)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (int i = 0; i < dtQueryBatchScratch::CACHE_SIZE; ++i)
+		scratch->cache[i].ref = 0;
+
+	dtSurfaceWalk walk;
 
-		// No hit, advance to neighbour polygon.
-		prevRef = curRef;
-		curRef = nextRef;
-		prevTile = tile;
-		tile = nextTile;
-		prevPoly = poly;
-		poly = nextPoly;
+	for (int first = 0; first < count; first += dtQueryBatchScratch::MAX_QUERIES)
+	{
+		const int n = dtMin(dtQueryBatchScratch::MAX_QUERIES, count - first);
+		for (int i = 0; i < n; ++i)
+		{
+			scratch->keys[i].ref = startRefs[first+i];
+			scratch->keys[i].idx = first+i;
+		}
+		qsort(scratch->keys, n, sizeof(dtQueryBatchKey), compareQueryBatchKeys);
 
-		if (status & DT_BUFFER_TOO_SMALL)
+		for (int k = 0; k < n; ++k)
 		{
-			status |= DT_PARTIAL_RESULT;
-			break;
+			const int idx = scratch->keys[k].idx;
+			const int bestNode = walkSurface(startRefs[idx], &startPos[idx*3], &endPos[idx*3], filter,
+											 scratch, &walk, &resultPos[idx*3]);
+			if (resultRefs)
+				resultRefs[idx] = bestNode >= 0 ? walk.refs[bestNode] : startRefs[idx];
 		}
 	}
-	
-	hit->pathCount = n;
-	
-	return status;
+
+	dtFree(scratch);
+
+	return DT_SUCCESS;
 }
 
 /// @par
@@ -2753,6 +3424,37 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 											   const dtQueryFilter* filter,
 											   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 											   int* resultCount, const int maxResult) const
+{
+	return findPolysAroundCircle<dtQueryFilter>(startRef, centerPos, radius, filter,
+												resultRef, resultParent, resultCost, resultCount, maxResult);
+}
+
+/// @par
+///
+/// The order of the result set is from least to highest cost.
+/// 
+/// At least one result array must be provided.
+///
+/// A common use case for this method is to perform Dijkstra searches. 
+/// Candidate polygons are found by searching the graph beginning at the start 
+/// polygon.
+/// 
+/// The same intersection test restrictions that apply to findPolysAroundCircle()
+/// method apply to this method.
+/// 
+/// The 3D centroid of the search polygon is used as the start position for cost 
+/// calculations.
+/// 
+/// Intersection tests occur in 2D. All polygons are projected onto the 
+/// xz-plane. So the y-values of the vertices do not effect intersection tests.
+/// 
+/// If the result arrays are is too small to hold the entire result set, they will 
+/// be filled to capacity.
+///
+dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* verts, const int nverts,
+											  const dtQueryFilter* filter,
+											  dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
+											  int* resultCount, const int maxResult) const
 {
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
@@ -2764,16 +3466,24 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 	*resultCount = 0;
 
 	if (!m_nav->isValidPolyRef(startRef) ||
-		!centerPos || !dtVisfinite(centerPos) ||
-		radius < 0 || !dtMathIsfinite(radius) ||
+		!verts || nverts < 3 ||
 		!filter || maxResult < 0)
 	{
 		return DT_FAILURE | DT_INVALID_PARAM;
 	}
 	
+	// Validate input
+	if (!startRef || !m_nav->isValidPolyRef(startRef))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
 	m_nodePool->clear();
 	m_openList->clear();
 	
+	float centerPos[3] = {0,0,0};
+	for (int i = 0; i < nverts; ++i)
+		dtVadd(centerPos,centerPos,&verts[i*3]);
+	dtVscale(centerPos,centerPos,1.0f/nverts);
+
 	dtNode* startNode = m_nodePool->getNode(startRef);
 	dtVcopy(startNode->pos, centerPos);
 	startNode->pidx = 0;
@@ -2784,11 +3494,9 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 	m_openList->push(startNode);
 	
 	dtStatus status = DT_SUCCESS;
-	
+
 	int n = 0;
 	
-	const float radiusSqr = dtSqr(radius);
-	
 	while (!m_openList->empty())
 	{
 		dtNode* bestNode = m_openList->pop();
@@ -2819,6 +3527,7 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 				resultParent[n] = parentRef;
 			if (resultCost)
 				resultCost[n] = bestNode->total;
+
 			++n;
 		}
 		else
@@ -2838,7 +3547,7 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			const dtMeshTile* neighbourTile = 0;
 			const dtPoly* neighbourPoly = 0;
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
-		
+			
 			// Do not advance if the polygon is excluded by the filter.
 			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
 				continue;
@@ -2848,10 +3557,12 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
 				continue;
 			
-			// If the circle is not touching the next polygon, skip it.
-			float tseg;
-			float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
-			if (distSqr > radiusSqr)
+			// If the poly is not touching the edge to the next polygon, skip the connection it.
+			float tmin, tmax;
+			int segMin, segMax;
+			if (!dtIntersectSegmentPoly2D(va, vb, verts, nverts, tmin, tmax, segMin, segMax))
+				continue;
+			if (tmin > 1.0f || tmax < 0.0f)
 				continue;
 			
 			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
@@ -2860,7 +3571,7 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 				status |= DT_OUT_OF_NODES;
 				continue;
 			}
-				
+			
 			if (neighbourNode->flags & DT_NODE_CLOSED)
 				continue;
 			
@@ -2895,193 +3606,818 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			}
 		}
 	}
-	
-	*resultCount = n;
-	
-	return status;
+	
+	*resultCount = n;
+	
+	return status;
+}
+
+static int compareRefs(const void* va, const void* vb)
+{
+	const dtPolyRef a = *(const dtPolyRef*)va;
+	const dtPolyRef b = *(const dtPolyRef*)vb;
+	if (a < b) return -1;
+	if (a > b) return 1;
+	return 0;
+}
+
+static int findRefIndex(const dtPolyRef* refs, const int count, const dtPolyRef ref)
+{
+	int lo = 0, hi = count-1;
+	while (lo <= hi)
+	{
+		const int mid = (lo+hi)/2;
+		if (refs[mid] < ref)
+			lo = mid+1;
+		else if (refs[mid] > ref)
+			hi = mid-1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+/// @par
+///
+/// The cost matrix is stored row-major, one row per start polygon: the cost from
+/// start @p i to end @p j is stored at <tt>resultCost[i*nend+j]</tt>. Unreachable
+/// ends are set to FLT_MAX and flagged with #DT_PARTIAL_RESULT.
+///
+/// Each row is computed with a single Dijkstra search from the start polygon which
+/// stops as soon as all of the end polygons have been settled, instead of running
+/// one A* search per start/end pair. Node positions and edge costs are computed the
+/// same way as in findPath(), including the final segment from the last node to
+/// the end position, so the costs match the cost of the paths findPath() returns
+/// as long as the node pool does not run out.
+///
+/// @p resultParent receives the polygon preceding each end polygon on its path,
+/// which is zero if the end is the start polygon or was not reached. After the call
+/// the node pool holds the search tree of the last start polygon, so the full path
+/// to any of the ends can be extracted with getPathFromDijkstraSearch(). Call the
+/// method once per start polygon to access every tree.
+///
+dtStatus dtNavMeshQuery::findDistanceMatrix(const dtPolyRef* startRefs, const float* startPos, const int nstart,
+											const dtPolyRef* endRefs, const float* endPos, const int nend,
+											const dtQueryFilter* filter,
+											float* resultCost, dtPolyRef* resultParent) const
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+
+	if (!startRefs || !startPos || nstart < 0 ||
+		!endRefs || !endPos || nend < 0 ||
+		!filter || !resultCost)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	for (int i = 0; i < nstart; ++i)
+	{
+		if (!m_nav->isValidPolyRef(startRefs[i]) || !dtVisfinite(&startPos[i*3]))
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	for (int i = 0; i < nend; ++i)
+	{
+		if (!m_nav->isValidPolyRef(endRefs[i]) || !dtVisfinite(&endPos[i*3]))
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	if (nstart == 0 || nend == 0)
+		return DT_SUCCESS;
+
+	// Sorted set of the unique end polygons, used to detect when all ends are settled.
+	dtPolyRef* targets = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*nend, DT_ALLOC_TEMP);
+	unsigned char* settled = (unsigned char*)dtAlloc(sizeof(unsigned char)*nend, DT_ALLOC_TEMP);
+	if (!targets || !settled)
+	{
+		dtFree(targets);
+		dtFree(settled);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	memcpy(targets, endRefs, sizeof(dtPolyRef)*nend);
+	qsort(targets, nend, sizeof(dtPolyRef), compareRefs);
+	int ntargets = 0;
+	for (int i = 0; i < nend; ++i)
+	{
+		if (ntargets == 0 || targets[ntargets-1] != targets[i])
+			targets[ntargets++] = targets[i];
+	}
+
+	dtStatus status = DT_SUCCESS;
+
+	for (int s = 0; s < nstart; ++s)
+	{
+		const dtPolyRef startRef = startRefs[s];
+
+		memset(settled, 0, sizeof(unsigned char)*ntargets);
+		int remaining = ntargets;
+
+		m_nodePool->clear();
+		m_openList->clear();
+
+		dtNode* startNode = m_nodePool->getNode(startRef);
+		dtVcopy(startNode->pos, &startPos[s*3]);
+		startNode->pidx = 0;
+		startNode->cost = 0;
+		startNode->total = 0;
+		startNode->id = startRef;
+		startNode->flags = DT_NODE_OPEN;
+		m_openList->push(startNode);
+
+		while (!m_openList->empty())
+		{
+			dtNode* bestNode = m_openList->pop();
+			bestNode->flags &= ~DT_NODE_OPEN;
+			bestNode->flags |= DT_NODE_CLOSED;
+
+			// Stop once every end polygon has been settled.
+			const int ti = findRefIndex(targets, ntargets, bestNode->id);
+			if (ti != -1 && !settled[ti])
+			{
+				settled[ti] = 1;
+				if (--remaining == 0)
+					break;
+			}
+
+			// Get poly and tile.
+			// The API input has been checked already, skip checking internal data.
+			const dtPolyRef bestRef = bestNode->id;
+			const dtMeshTile* bestTile = 0;
+			const dtPoly* bestPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+
+			// Get parent poly and tile.
+			dtPolyRef parentRef = 0;
+			const dtMeshTile* parentTile = 0;
+			const dtPoly* parentPoly = 0;
+			if (bestNode->pidx)
+				parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+			if (parentRef)
+				m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+
+			for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+			{
+				const dtPolyRef neighbourRef = bestTile->links[i].ref;
+
+				// Skip invalid ids and do not expand back to where we came from.
+				if (!neighbourRef || neighbourRef == parentRef)
+					continue;
+
+				const dtMeshTile* neighbourTile = 0;
+				const dtPoly* neighbourPoly = 0;
+				m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+
+				if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+					continue;
+
+				dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
+				if (!neighbourNode)
+				{
+					status |= DT_OUT_OF_NODES;
+					continue;
+				}
+
+				if (neighbourNode->flags & DT_NODE_CLOSED)
+					continue;
+
+				// If the node is visited the first time, calculate node position.
+				if (neighbourNode->flags == 0)
+				{
+					getNearestPoint(bestRef, bestPoly, bestTile, bestNode->pos,
+									neighbourRef, neighbourPoly, neighbourTile,
+									neighbourNode->pos);
+				}
+
+				const float cost = bestNode->cost + filter->getCost(bestNode->pos, neighbourNode->pos,
+																	parentRef, parentTile, parentPoly,
+																	bestRef, bestTile, bestPoly,
+																	neighbourRef, neighbourTile, neighbourPoly);
+
+				// The node is already in open list and the new result is worse, skip.
+				if ((neighbourNode->flags & DT_NODE_OPEN) && cost >= neighbourNode->cost)
+					continue;
+
+				neighbourNode->id = neighbourRef;
+				neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+				neighbourNode->cost = cost;
+				neighbourNode->total = cost;
+
+				if (neighbourNode->flags & DT_NODE_OPEN)
+				{
+					m_openList->modify(neighbourNode);
+				}
+				else
+				{
+					neighbourNode->flags = DT_NODE_OPEN;
+					m_openList->push(neighbourNode);
+				}
+			}
+		}
+
+		// Add the segment from the last node to each end position.
+		float* costRow = &resultCost[s*nend];
+		dtPolyRef* parentRow = resultParent ? &resultParent[s*nend] : 0;
+		for (int j = 0; j < nend; ++j)
+		{
+			const dtPolyRef endRef = endRefs[j];
+			dtNode* endNode = 0;
+			if (m_nodePool->findNodes(endRef, &endNode, 1) != 1 || !(endNode->flags & DT_NODE_CLOSED))
+			{
+				costRow[j] = FLT_MAX;
+				if (parentRow)
+					parentRow[j] = 0;
+				status |= DT_PARTIAL_RESULT;
+				continue;
+			}
+
+			dtPolyRef parentRef = 0;
+			const dtMeshTile* parentTile = 0;
+			const dtPoly* parentPoly = 0;
+			if (endNode->pidx)
+				parentRef = m_nodePool->getNodeAtIdx(endNode->pidx)->id;
+			if (parentRef)
+				m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+
+			const dtMeshTile* endTile = 0;
+			const dtPoly* endPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(endRef, &endTile, &endPoly);
+
+			costRow[j] = endNode->cost + filter->getCost(endNode->pos, &endPos[j*3],
+														 parentRef, parentTile, parentPoly,
+														 endRef, endTile, endPoly,
+														 0, 0, 0);
+			if (parentRow)
+				parentRow[j] = parentRef;
+		}
+	}
+
+	dtFree(targets);
+	dtFree(settled);
+
+	return status;
+}
+
+static void flowHeapUp(int* heap, int* heapPos, const float* cost, int i)
+{
+	const int idx = heap[i];
+	while (i > 0)
+	{
+		const int parent = (i-1)/2;
+		if (cost[heap[parent]] <= cost[idx])
+			break;
+		heap[i] = heap[parent];
+		heapPos[heap[i]] = i;
+		i = parent;
+	}
+	heap[i] = idx;
+	heapPos[idx] = i;
+}
+
+static void flowHeapDown(int* heap, int* heapPos, const float* cost, const int size, int i)
+{
+	const int idx = heap[i];
+	for (;;)
+	{
+		int child = i*2+1;
+		if (child >= size)
+			break;
+		if (child+1 < size && cost[heap[child+1]] < cost[heap[child]])
+			child++;
+		if (cost[idx] <= cost[heap[child]])
+			break;
+		heap[i] = heap[child];
+		heapPos[heap[i]] = i;
+		i = child;
+	}
+	heap[i] = idx;
+	heapPos[idx] = i;
+}
+
+static const int FLOW_HEAP_NONE = -1;
+static const int FLOW_HEAP_CLOSED = -2;
+
+// Lays out the polygons of all tiles one after another, returns the total polygon count.
+static int computeFlowFieldLayout(const dtNavMesh* nav, int* tileBase, int* tilePolyCount, unsigned int* tileSalt)
+{
+	int npolys = 0;
+	for (int i = 0; i < nav->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = nav->getTile(i);
+		const int count = (tile->header && !(tile->flags & DT_TILE_RETIRED)) ? tile->header->polyCount : 0;
+		tileBase[i] = npolys;
+		tilePolyCount[i] = count;
+		tileSalt[i] = tile->salt;
+		npolys += count;
+	}
+	return npolys;
+}
+
+dtStatus dtNavMeshQuery::collectOneWayLinks(dtFlowField* field) const
+{
+	int count = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		count = 0;
+		for (int i = 0; i < m_nav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = m_nav->getTile(i);
+			if (!tile->header || (tile->flags & DT_TILE_RETIRED))
+				continue;
+			const dtPolyRef base = m_nav->getPolyRefBase(tile);
+			for (int j = 0; j < tile->header->offMeshConCount; ++j)
+			{
+				const dtOffMeshConnection* con = &tile->offMeshCons[j];
+				if (con->flags & DT_OFFMESH_CON_BIDIR)
+					continue;
+				const dtPoly* poly = &tile->polys[con->poly];
+				for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+				{
+					if (pass == 1)
+					{
+						field->m_oneWayLinks[count*2+0] = tile->links[k].ref;
+						field->m_oneWayLinks[count*2+1] = base | (dtPolyRef)con->poly;
+					}
+					count++;
+				}
+			}
+		}
+
+		if (pass == 0 && field->m_oneWayLinkCapacity < count)
+		{
+			dtFree(field->m_oneWayLinks);
+			field->m_oneWayLinkCount = 0;
+			field->m_oneWayLinks = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*2*count, DT_ALLOC_PERM);
+			field->m_oneWayLinkCapacity = field->m_oneWayLinks ? count : 0;
+			if (!field->m_oneWayLinks)
+				return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+	}
+
+	// The pairs are sorted by their first element, the target polygon.
+	qsort(field->m_oneWayLinks, count, sizeof(dtPolyRef)*2, compareRefs);
+	field->m_oneWayLinkCount = count;
+
+	return DT_SUCCESS;
+}
+
+int dtNavMeshQuery::expandFlowField(const dtQueryFilter* filter, dtFlowField* field,
+									dtPolyRef* refs, float* pos, int* heap, int* heapPos, int heapSize) const
+{
+	dtPolyRef* next = field->m_next;
+	float* cost = field->m_cost;
+	const dtPolyRef* oneWayLinks = field->m_oneWayLinks;
+	const int oneWayLinkCount = field->m_oneWayLinkCount;
+
+	int expanded = 0;
+
+	while (heapSize > 0)
+	{
+		const int bestIdx = heap[0];
+		heapSize--;
+		if (heapSize > 0)
+		{
+			heap[0] = heap[heapSize];
+			flowHeapDown(heap, heapPos, cost, heapSize, 0);
+		}
+		heapPos[bestIdx] = FLOW_HEAP_CLOSED;
+		expanded++;
+
+		// The API input has been checked already, skip checking internal data.
+		const dtPolyRef bestRef = refs[bestIdx];
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+
+		// The polygon the best polygon leads to.
+		const dtPolyRef nextRef = next[bestIdx];
+		const dtMeshTile* nextTile = 0;
+		const dtPoly* nextPoly = 0;
+		if (nextRef)
+			m_nav->getTileAndPolyByRefUnsafe(nextRef, &nextTile, &nextPoly);
+
+		// The links of the best polygon lead to all of its neighbours except the
+		// one-way off-mesh connections ending at it, which are looked up separately.
+		int oneWay = 0;
+		if (oneWayLinkCount)
+		{
+			int hi = oneWayLinkCount;
+			while (oneWay < hi)
+			{
+				const int mid = (oneWay+hi)/2;
+				if (oneWayLinks[mid*2] < bestRef)
+					oneWay = mid+1;
+				else
+					hi = mid;
+			}
+		}
+
+		unsigned int link = bestPoly->firstLink;
+		for (;;)
+		{
+			dtPolyRef neighbourRef = 0;
+			if (link != DT_NULL_LINK)
+			{
+				neighbourRef = bestTile->links[link].ref;
+				link = bestTile->links[link].next;
+			}
+			else if (oneWay < oneWayLinkCount && oneWayLinks[oneWay*2] == bestRef)
+			{
+				neighbourRef = oneWayLinks[oneWay*2+1];
+				oneWay++;
+			}
+			else
+			{
+				break;
+			}
+
+			// Skip invalid ids and do not expand back to where we came from.
+			if (!neighbourRef || neighbourRef == nextRef)
+				continue;
+
+			const int neighbourIdx = field->getPolyIndexUnsafe(neighbourRef);
+			if (heapPos[neighbourIdx] == FLOW_HEAP_CLOSED)
+				continue;
+
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+
+			// The search runs backwards, the neighbour must have a link to the best polygon.
+			float mid[3];
+			if (dtStatusFailed(getEdgeMidPoint(neighbourRef, neighbourPoly, neighbourTile,
+											   bestRef, bestPoly, bestTile, mid)))
+				continue;
+
+			const float total = cost[bestIdx] + filter->getCost(mid, &pos[bestIdx*3],
+																neighbourRef, neighbourTile, neighbourPoly,
+																bestRef, bestTile, bestPoly,
+																nextRef, nextTile, nextPoly);
+			if (total >= cost[neighbourIdx])
+				continue;
+
+			refs[neighbourIdx] = neighbourRef;
+			next[neighbourIdx] = bestRef;
+			cost[neighbourIdx] = total;
+			dtVcopy(&pos[neighbourIdx*3], mid);
+
+			if (heapPos[neighbourIdx] == FLOW_HEAP_NONE)
+			{
+				heap[heapSize] = neighbourIdx;
+				flowHeapUp(heap, heapPos, cost, heapSize);
+				heapSize++;
+			}
+			else
+			{
+				flowHeapUp(heap, heapPos, cost, heapPos[neighbourIdx]);
+			}
+		}
+	}
+
+	return expanded;
+}
+
+/// @par
+///
+/// The field is computed with a single Dijkstra search running backwards from 
+/// the goal, following the links into each polygon in reverse. One-way 
+/// off-mesh connections are respected: a polygon only points at a neighbour 
+/// it has a link to, and a connection leading into a polygon is found even 
+/// though the polygon has no link back to it. Polygons rejected by the filter 
+/// are not entered, and polygons that cannot reach the goal get a cost of 
+/// FLT_MAX.
+///
+/// Costs are measured between polygon edge midpoints, the same way the other 
+/// Dijkstra searches measure them, ending at @p goalPos. They are close to, 
+/// but not the same as, the costs findPath() would report.
+///
+/// The search uses its own storage sized to the navigation mesh rather than 
+/// the node pool of the query, so the whole mesh is always covered. The 
+/// storage of @p field is reused when it is large enough.
+///
+/// @see updateFlowField
+dtStatus dtNavMeshQuery::buildFlowField(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+										dtFlowField* field) const
+{
+	dtAssert(m_nav);
+
+	if (!m_nav->isValidPolyRef(goalRef) ||
+		!goalPos || !dtVisfinite(goalPos) ||
+		!filter || !field)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	field->m_goalRef = 0;
+	field->m_reachedCount = 0;
+
+	// Lay out the polygons of all tiles in the field arrays.
+	const int maxTiles = m_nav->getMaxTiles();
+	if (field->m_maxTiles != maxTiles)
+	{
+		dtFree(field->m_tileBase);
+		dtFree(field->m_tilePolyCount);
+		dtFree(field->m_tileSalt);
+		dtFree(field->m_scratchTileBase);
+		dtFree(field->m_scratchTilePolyCount);
+		dtFree(field->m_scratchTileSalt);
+		dtFree(field->m_tileChanged);
+		field->m_tileBase = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		field->m_tilePolyCount = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		field->m_tileSalt = (unsigned int*)dtAlloc(sizeof(unsigned int)*maxTiles, DT_ALLOC_PERM);
+		field->m_scratchTileBase = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		field->m_scratchTilePolyCount = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		field->m_scratchTileSalt = (unsigned int*)dtAlloc(sizeof(unsigned int)*maxTiles, DT_ALLOC_PERM);
+		field->m_tileChanged = (unsigned char*)dtAlloc(sizeof(unsigned char)*maxTiles, DT_ALLOC_PERM);
+		field->m_maxTiles = maxTiles;
+		if (!field->m_tileBase || !field->m_tilePolyCount || !field->m_tileSalt ||
+			!field->m_scratchTileBase || !field->m_scratchTilePolyCount || !field->m_scratchTileSalt ||
+			!field->m_tileChanged)
+		{
+			field->m_maxTiles = 0;
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+	}
+
+	const int npolys = computeFlowFieldLayout(m_nav, field->m_tileBase, field->m_tilePolyCount, field->m_tileSalt);
+
+	if (field->m_polyCapacity < npolys)
+	{
+		dtFree(field->m_next);
+		dtFree(field->m_cost);
+		field->m_next = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*npolys, DT_ALLOC_PERM);
+		field->m_cost = (float*)dtAlloc(sizeof(float)*npolys, DT_ALLOC_PERM);
+		field->m_polyCapacity = npolys;
+		if (!field->m_next || !field->m_cost)
+		{
+			field->m_polyCapacity = 0;
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+	}
+
+	field->m_nav = m_nav;
+
+	dtStatus status = collectOneWayLinks(field);
+	if (dtStatusFailed(status))
+		return status;
+
+	if (!field->reserveScratch(npolys))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+
+	dtPolyRef* refs = field->m_refs;
+	float* pos = field->m_pos;
+	int* heap = field->m_heap;
+	int* heapPos = field->m_heapPos;
+
+	for (int i = 0; i < npolys; ++i)
+	{
+		field->m_next[i] = 0;
+		field->m_cost[i] = FLT_MAX;
+		heapPos[i] = FLOW_HEAP_NONE;
+	}
+
+	const int goalIdx = field->getPolyIndexUnsafe(goalRef);
+	refs[goalIdx] = goalRef;
+	field->m_cost[goalIdx] = 0;
+	dtVcopy(&pos[goalIdx*3], goalPos);
+	heap[0] = goalIdx;
+	heapPos[goalIdx] = 0;
+
+	const int reached = expandFlowField(filter, field, refs, pos, heap, heapPos, 1);
+
+	field->m_goalRef = goalRef;
+	dtVcopy(field->m_goalPos, goalPos);
+	field->m_reachedCount = reached;
+
+	return DT_SUCCESS;
 }
 
 /// @par
 ///
-/// The order of the result set is from least to highest cost.
-/// 
-/// At least one result array must be provided.
+/// Use this method after tiles have been added, removed or rebuilt, for example 
+/// by a dtTileCache update, to bring the field up to date without searching 
+/// the whole mesh again.
 ///
-/// A common use case for this method is to perform Dijkstra searches. 
-/// Candidate polygons are found by searching the graph beginning at the start 
-/// polygon.
-/// 
-/// The same intersection test restrictions that apply to findPolysAroundCircle()
-/// method apply to this method.
-/// 
-/// The 3D centroid of the search polygon is used as the start position for cost 
-/// calculations.
-/// 
-/// Intersection tests occur in 2D. All polygons are projected onto the 
-/// xz-plane. So the y-values of the vertices do not effect intersection tests.
-/// 
-/// If the result arrays are is too small to hold the entire result set, they will 
-/// be filled to capacity.
+/// The polygons of the changed tiles, and the polygons whose route to the goal 
+/// crossed a changed tile, are reset. They are then searched again starting 
+/// from the unaffected polygons around them, and any shortcut opened by the new 
+/// tiles is propagated to the rest of the field. The search work is 
+/// proportional to the number of reset and improved polygons rather than to 
+/// the size of the mesh; only a linear pass over the field arrays is needed to 
+/// find them.
 ///
-dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* verts, const int nverts,
-											  const dtQueryFilter* filter,
-											  dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
-											  int* resultCount, const int maxResult) const
+/// The scratch space of the search is kept in @p field, so updates only allocate 
+/// when the mesh has grown past the largest size seen so far.
+///
+/// The same filter that was used to build the field must be used. Changes to 
+/// polygon flags or areas are not detected, the field must be rebuilt with 
+/// buildFlowField() after them. The update fails if the tile of the goal 
+/// polygon has changed.
+///
+/// @see buildFlowField
+dtStatus dtNavMeshQuery::updateFlowField(const dtQueryFilter* filter, dtFlowField* field, int* repairedCount) const
 {
 	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
-
-	if (!resultCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
 
-	*resultCount = 0;
+	if (repairedCount)
+		*repairedCount = 0;
 
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!verts || nverts < 3 ||
-		!filter || maxResult < 0)
+	if (!filter || !field || field->m_nav != m_nav || !field->m_goalRef ||
+		!m_nav->isValidPolyRef(field->m_goalRef))
 	{
 		return DT_FAILURE | DT_INVALID_PARAM;
 	}
-	
-	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	float centerPos[3] = {0,0,0};
-	for (int i = 0; i < nverts; ++i)
-		dtVadd(centerPos,centerPos,&verts[i*3]);
-	dtVscale(centerPos,centerPos,1.0f/nverts);
 
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, centerPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	dtStatus status = DT_SUCCESS;
+	dtStatus status = collectOneWayLinks(field);
+	if (dtStatusFailed(status))
+		return status;
 
-	int n = 0;
-	
-	while (!m_openList->empty())
-	{
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Get poly and tile.
-		// The API input has been checked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
-		if (parentRef)
-			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+	const int maxTiles = field->m_maxTiles;
 
-		if (n < maxResult)
+	// The new layout is computed in the scratch arrays, the old one is still needed to carry polygons over.
+	int* tileBase = field->m_scratchTileBase;
+	int* tilePolyCount = field->m_scratchTilePolyCount;
+	unsigned int* tileSalt = field->m_scratchTileSalt;
+	unsigned char* tileChanged = field->m_tileChanged;
+
+	const int npolys = computeFlowFieldLayout(m_nav, tileBase, tilePolyCount, tileSalt);
+
+	if (!field->reserveScratch(npolys))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+
+	dtPolyRef* next = field->m_scratchNext;
+	float* cost = field->m_scratchCost;
+	dtPolyRef* refs = field->m_refs;
+	float* pos = field->m_pos;
+	int* heap = field->m_heap;
+	int* heapPos = field->m_heapPos;
+	unsigned char* state = field->m_state;
+
+	enum { STATE_UNKNOWN, STATE_VALID, STATE_AFFECTED };
+
+	// Carry the polygons of unchanged tiles over to the new layout.
+	for (int i = 0; i < maxTiles; ++i)
+	{
+		const dtMeshTile* tile = m_nav->getTile(i);
+		tileChanged[i] = (unsigned char)(tileSalt[i] != field->m_tileSalt[i] ||
+										 tilePolyCount[i] != field->m_tilePolyCount[i]);
+		if (!tilePolyCount[i])
+			continue;
+		const dtPolyRef base = m_nav->getPolyRefBase(tile);
+		for (int j = 0; j < tilePolyCount[i]; ++j)
 		{
-			if (resultRef)
-				resultRef[n] = bestRef;
-			if (resultParent)
-				resultParent[n] = parentRef;
-			if (resultCost)
-				resultCost[n] = bestNode->total;
+			const int idx = tileBase[i] + j;
+			refs[idx] = base | (dtPolyRef)j;
+			heapPos[idx] = FLOW_HEAP_NONE;
+			if (tileChanged[i])
+			{
+				next[idx] = 0;
+				cost[idx] = FLT_MAX;
+				state[idx] = STATE_AFFECTED;
+			}
+			else
+			{
+				const int oldIdx = field->m_tileBase[i] + j;
+				next[idx] = field->m_next[oldIdx];
+				cost[idx] = field->m_cost[oldIdx];
+				state[idx] = STATE_UNKNOWN;
+			}
+		}
+	}
 
-			++n;
+	// Find the polygons whose route to the goal crosses a changed tile. The heap 
+	// array is used as the stack of the route being followed.
+	int* stack = heap;
+	for (int i = 0; i < npolys; ++i)
+	{
+		if (state[i] != STATE_UNKNOWN)
+			continue;
+		int nstack = 0;
+		int cur = i;
+		unsigned char result = STATE_VALID;
+		while (state[cur] == STATE_UNKNOWN)
+		{
+			dtAssert(nstack < npolys);
+			stack[nstack++] = cur;
+			// The goal and unreachable polygons do not lead anywhere.
+			if (!next[cur])
+				break;
+			unsigned int salt, it, ip;
+			m_nav->decodePolyId(next[cur], salt, it, ip);
+			if (tileChanged[it] || tileSalt[it] != salt)
+			{
+				result = STATE_AFFECTED;
+				break;
+			}
+			cur = tileBase[it] + (int)ip;
 		}
-		else
+		if (state[cur] != STATE_UNKNOWN)
+			result = state[cur];
+		for (int j = 0; j < nstack; ++j)
+			state[stack[j]] = result;
+	}
+
+	for (int i = 0; i < npolys; ++i)
+	{
+		if (state[i] == STATE_AFFECTED)
 		{
-			status |= DT_BUFFER_TOO_SMALL;
+			next[i] = 0;
+			cost[i] = FLT_MAX;
 		}
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+	}
+
+	// Switch the field to the new layout, the old one becomes scratch space.
+	dtSwap(field->m_tileBase, field->m_scratchTileBase);
+	dtSwap(field->m_tilePolyCount, field->m_scratchTilePolyCount);
+	dtSwap(field->m_tileSalt, field->m_scratchTileSalt);
+	dtSwap(field->m_next, field->m_scratchNext);
+	dtSwap(field->m_cost, field->m_scratchCost);
+	dtSwap(field->m_polyCapacity, field->m_scratchCapacity);
+
+	// Seed the search with the best route from each reset polygon through its unaffected neighbours.
+	int heapSize = 0;
+	for (int i = 0; i < npolys; ++i)
+	{
+		if (state[i] != STATE_AFFECTED)
+			continue;
+
+		const dtPolyRef ref = refs[i];
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(ref, &tile, &poly);
+		if (!filter->passFilter(ref, tile, poly))
+			continue;
+
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
 		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
-			// Skip invalid neighbours and do not follow back to parent.
-			if (!neighbourRef || neighbourRef == parentRef)
+			const dtPolyRef neighbourRef = tile->links[j].ref;
+			if (!neighbourRef)
 				continue;
-			
-			// Expand to neighbour
+			const int neighbourIdx = field->getPolyIndexUnsafe(neighbourRef);
+			if (state[neighbourIdx] == STATE_AFFECTED || cost[neighbourIdx] == FLT_MAX)
+				continue;
+
 			const dtMeshTile* neighbourTile = 0;
 			const dtPoly* neighbourPoly = 0;
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
-			
-			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
-			
-			// If the poly is not touching the edge to the next polygon, skip the connection it.
-			float tmin, tmax;
-			int segMin, segMax;
-			if (!dtIntersectSegmentPoly2D(va, vb, verts, nverts, tmin, tmax, segMin, segMax))
-				continue;
-			if (tmin > 1.0f || tmax < 0.0f)
-				continue;
-			
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
-			if (!neighbourNode)
-			{
-				status |= DT_OUT_OF_NODES;
-				continue;
-			}
-			
-			if (neighbourNode->flags & DT_NODE_CLOSED)
-				continue;
-			
-			// Cost
-			if (neighbourNode->flags == 0)
-				dtVlerp(neighbourNode->pos, va, vb, 0.5f);
-			
-			float cost = filter->getCost(
-				bestNode->pos, neighbourNode->pos,
-				parentRef, parentTile, parentPoly,
-				bestRef, bestTile, bestPoly,
-				neighbourRef, neighbourTile, neighbourPoly);
 
-			const float total = bestNode->total + cost;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+			float mid[3];
+			if (dtStatusFailed(getEdgeMidPoint(ref, poly, tile, neighbourRef, neighbourPoly, neighbourTile, mid)))
 				continue;
-			
-			neighbourNode->id = neighbourRef;
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->total = total;
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
+
+			// Where the route of the neighbour leaves it.
+			const dtPolyRef nextRef = next[neighbourIdx];
+			const dtMeshTile* nextTile = 0;
+			const dtPoly* nextPoly = 0;
+			float neighbourPos[3];
+			if (nextRef)
 			{
-				m_openList->modify(neighbourNode);
+				m_nav->getTileAndPolyByRefUnsafe(nextRef, &nextTile, &nextPoly);
+				getEdgeMidPoint(neighbourRef, neighbourPoly, neighbourTile, nextRef, nextPoly, nextTile, neighbourPos);
 			}
 			else
 			{
-				neighbourNode->flags = DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
+				dtVcopy(neighbourPos, field->m_goalPos);
 			}
+
+			const float total = cost[neighbourIdx] + filter->getCost(mid, neighbourPos,
+																	 ref, tile, poly,
+																	 neighbourRef, neighbourTile, neighbourPoly,
+																	 nextRef, nextTile, nextPoly);
+			if (total >= cost[i])
+				continue;
+
+			next[i] = neighbourRef;
+			cost[i] = total;
+			dtVcopy(&pos[i*3], mid);
+		}
+
+		if (cost[i] < FLT_MAX)
+		{
+			heap[heapSize] = i;
+			flowHeapUp(heap, heapPos, cost, heapSize);
+			heapSize++;
 		}
 	}
-	
-	*resultCount = n;
-	
-	return status;
+
+	const int repaired = expandFlowField(filter, field, refs, pos, heap, heapPos, heapSize);
+
+	int reached = 0;
+	for (int i = 0; i < npolys; ++i)
+	{
+		if (cost[i] < FLT_MAX)
+			reached++;
+	}
+	field->m_reachedCount = reached;
+
+	if (repairedCount)
+		*repairedCount = repaired;
+
+	return DT_SUCCESS;
 }
 
 dtStatus dtNavMeshQuery::getPathFromDijkstraSearch(dtPolyRef endRef, dtPolyRef* path, int* pathCount, int maxPath) const
@@ -3369,13 +4705,31 @@ dtStatus dtNavMeshQuery::getPolyWallSegments(dtPolyRef ref, const dtQueryFilter*
 	
 	const bool storePortals = segmentRefs != 0;
 	
+	// Cached border portals, in the order the edges are visited.
+	const dtPolyPortal* portal = 0;
+	if (tile->polyPortalStart)
+		portal = &tile->portals[tile->polyPortalStart[poly - tile->polys]];
+	
 	dtStatus status = DT_SUCCESS;
 	
 	for (int i = 0, j = (int)poly->vertCount-1; i < (int)poly->vertCount; j = i++)
 	{
 		// Skip non-solid edges.
 		nints = 0;
-		if (poly->neis[j] & DT_EXT_LINK)
+		if ((poly->neis[j] & DT_EXT_LINK) && portal)
+		{
+			// Tile border, the portals are already sorted along the edge.
+			const dtPolyPortal* end = &tile->portals[tile->polyPortalStart[poly - tile->polys + 1]];
+			for (; portal != end && portal->edge == j; ++portal)
+			{
+				const dtMeshTile* neiTile = 0;
+				const dtPoly* neiPoly = 0;
+				m_nav->getTileAndPolyByRefUnsafe(portal->ref, &neiTile, &neiPoly);
+				if (filter->passFilter(portal->ref, neiTile, neiPoly))
+					insertInterval(ints, nints, MAX_INTERVAL, portal->tmin, portal->tmax, portal->ref);
+			}
+		}
+		else if (poly->neis[j] & DT_EXT_LINK)
 		{
 			// Tile border.
 			for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
@@ -3554,11 +4908,37 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 		if (parentRef)
 			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
 		
+		// Cached border portals, in the order the edges are visited.
+		const dtPolyPortal* portal = 0;
+		const dtPolyPortal* portalEnd = 0;
+		if (bestTile->polyPortalStart)
+		{
+			const unsigned int ip = (unsigned int)(bestPoly - bestTile->polys);
+			portal = &bestTile->portals[bestTile->polyPortalStart[ip]];
+			portalEnd = &bestTile->portals[bestTile->polyPortalStart[ip+1]];
+		}
+		
 		// Hit test walls.
 		for (int i = 0, j = (int)bestPoly->vertCount-1; i < (int)bestPoly->vertCount; j = i++)
 		{
 			// Skip non-solid edges.
-			if (bestPoly->neis[j] & DT_EXT_LINK)
+			if ((bestPoly->neis[j] & DT_EXT_LINK) && portal)
+			{
+				// Tile border, the edge is open if the first link of the edge passes the filter.
+				bool solid = true;
+				for (; portal != portalEnd && portal->edge == j; ++portal)
+				{
+					if (!portal->first)
+						continue;
+					const dtMeshTile* neiTile = 0;
+					const dtPoly* neiPoly = 0;
+					m_nav->getTileAndPolyByRefUnsafe(portal->ref, &neiTile, &neiPoly);
+					if (filter->passFilter(portal->ref, neiTile, neiPoly))
+						solid = false;
+				}
+				if (!solid) continue;
+			}
+			else if (bestPoly->neis[j] & DT_EXT_LINK)
 			{
 				// Tile border.
 				bool solid = true;
@@ -3700,6 +5080,20 @@ bool dtNavMeshQuery::isValidPolyRef(dtPolyRef ref, const dtQueryFilter* filter)
 	return true;
 }
 
+/// @par
+///
+/// Islands ignore the filter and the direction of off-mesh connections, so a true 
+/// result does not guarantee that a path exists under the filter. Both results only 
+/// hold until the mesh changes.
+///
+/// @see dtNavMesh::getPolyIsland
+bool dtNavMeshQuery::isReachable(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter) const
+{
+	if (!isValidPolyRef(startRef, filter) || !isValidPolyRef(endRef, filter))
+		return false;
+	return m_nav->getPolyIsland(startRef) == m_nav->getPolyIsland(endRef);
+}
+
 /// @par
 ///
 /// The closed list is the list of polygons that were fully evaluated during 
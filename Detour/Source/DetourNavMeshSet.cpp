@@ -0,0 +1,322 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <string.h>
+#include "DetourNavMeshSet.h"
+#include "DetourNavMesh.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+#include <new>
+
+// Layout of the stored data. Each mesh is a dtNavMeshSetMeshHeader followed by 
+// its tiles, each tile is a dtNavMeshSetTileHeader followed by the tile data.
+// All items are 4 byte aligned, the tile data in place can be added to a mesh.
+struct dtNavMeshSetHeader
+{
+	int magic;
+	int version;
+	int meshCount;
+};
+
+struct dtNavMeshSetMeshHeader
+{
+	dtNavMeshSetAgent agent;
+	dtNavMeshParams params;
+	int tileCount;
+};
+
+struct dtNavMeshSetTileHeader
+{
+	dtTileRef tileRef;
+	int dataSize;
+};
+
+dtNavMeshSet* dtAllocNavMeshSet()
+{
+	void* mem = dtAlloc(sizeof(dtNavMeshSet), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtNavMeshSet;
+}
+
+void dtFreeNavMeshSet(dtNavMeshSet* set)
+{
+	if (!set) return;
+	set->~dtNavMeshSet();
+	dtFree(set);
+}
+
+dtNavMeshSet::dtNavMeshSet() :
+	m_count(0)
+{
+	memset(m_navMeshes, 0, sizeof(m_navMeshes));
+	memset(m_agents, 0, sizeof(m_agents));
+}
+
+dtNavMeshSet::~dtNavMeshSet()
+{
+	clear();
+}
+
+void dtNavMeshSet::clear()
+{
+	for (int i = 0; i < m_count; ++i)
+	{
+		dtFreeNavMesh(m_navMeshes[i]);
+		m_navMeshes[i] = 0;
+	}
+	m_count = 0;
+}
+
+dtStatus dtNavMeshSet::addNavMesh(dtNavMesh* nav, const dtNavMeshSetAgent& agent)
+{
+	if (!nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_count >= DT_MAX_NAVMESH_SET_SIZE)
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	m_navMeshes[m_count] = nav;
+	m_agents[m_count] = agent;
+	m_count++;
+	return DT_SUCCESS;
+}
+
+int dtNavMeshSet::findNavMesh(const float radius, const float height) const
+{
+	int best = -1;
+	for (int i = 0; i < m_count; ++i)
+	{
+		const dtNavMeshSetAgent& agent = m_agents[i];
+		if (agent.radius < radius || agent.height < height)
+			continue;
+		if (best == -1 || agent.radius < m_agents[best].radius ||
+			(agent.radius == m_agents[best].radius && agent.height < m_agents[best].height))
+			best = i;
+	}
+	return best;
+}
+
+/// @par
+///
+/// The data is in the native endianness and only valid for the same #dtPolyRef size.
+/// Tiles keep their references, so polygon references stay valid across a store and load.
+dtStatus dtNavMeshSet::store(unsigned char** outData, int* outDataSize) const
+{
+	if (!outData || !outDataSize)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	int dataSize = sizeof(dtNavMeshSetHeader);
+	for (int i = 0; i < m_count; ++i)
+	{
+		const dtNavMesh* nav = m_navMeshes[i];
+		dataSize += sizeof(dtNavMeshSetMeshHeader);
+		for (int j = 0; j < nav->getMaxTiles(); ++j)
+		{
+			const dtMeshTile* tile = nav->getTile(j);
+			if (!tile || !tile->header || !tile->dataSize || (tile->flags & DT_TILE_RETIRED)) continue;
+			dataSize += sizeof(dtNavMeshSetTileHeader) + dtAlign4(tile->dataSize);
+		}
+	}
+	
+	unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+	if (!data)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memset(data, 0, dataSize);
+	
+	unsigned char* d = data;
+	dtNavMeshSetHeader header;
+	header.magic = DT_NAVMESH_SET_MAGIC;
+	header.version = DT_NAVMESH_SET_VERSION;
+	header.meshCount = m_count;
+	memcpy(d, &header, sizeof(header));
+	d += sizeof(header);
+	
+	for (int i = 0; i < m_count; ++i)
+	{
+		const dtNavMesh* nav = m_navMeshes[i];
+		dtNavMeshSetMeshHeader meshHeader;
+		meshHeader.agent = m_agents[i];
+		memcpy(&meshHeader.params, nav->getParams(), sizeof(dtNavMeshParams));
+		meshHeader.tileCount = 0;
+		for (int j = 0; j < nav->getMaxTiles(); ++j)
+		{
+			const dtMeshTile* tile = nav->getTile(j);
+			if (tile && tile->header && tile->dataSize && !(tile->flags & DT_TILE_RETIRED))
+				meshHeader.tileCount++;
+		}
+		memcpy(d, &meshHeader, sizeof(meshHeader));
+		d += sizeof(meshHeader);
+		
+		for (int j = 0; j < nav->getMaxTiles(); ++j)
+		{
+			const dtMeshTile* tile = nav->getTile(j);
+			if (!tile || !tile->header || !tile->dataSize || (tile->flags & DT_TILE_RETIRED)) continue;
+			
+			dtNavMeshSetTileHeader tileHeader;
+			tileHeader.tileRef = nav->getTileRef(tile);
+			tileHeader.dataSize = tile->dataSize;
+			memcpy(d, &tileHeader, sizeof(tileHeader));
+			d += sizeof(tileHeader);
+			
+			memcpy(d, tile->data, tile->dataSize);
+			if (tile->linkData)
+			{
+				// The polygons of tiles used in place are kept apart from the data, store the current flags and areas.
+				const int polysOffset = dtGetMeshHeaderSize(tile->header->version) + dtAlign4(sizeof(float)*3*tile->header->vertCount);
+				memcpy(d + polysOffset, tile->polys, sizeof(dtPoly)*tile->header->polyCount);
+			}
+			d += dtAlign4(tile->dataSize);
+		}
+	}
+	dtAssert(d == data + dataSize);
+	
+	*outData = data;
+	*outDataSize = dataSize;
+	
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// With #DT_TILE_READ_ONLY_DATA the tiles point into @p data, which must stay valid 
+/// and unchanged until the set is cleared or destroyed. Otherwise each tile is copied 
+/// and @p data can be freed as soon as the call returns.
+///
+/// The tiles of each mesh are added with dtNavMesh::addTiles().
+dtStatus dtNavMeshSet::load(unsigned char* data, const int dataSize, const int flags)
+{
+	if (!data || dataSize < (int)sizeof(dtNavMeshSetHeader))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	dtNavMeshSetHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != DT_NAVMESH_SET_MAGIC)
+		return DT_FAILURE | DT_WRONG_MAGIC;
+	if (header.version != DT_NAVMESH_SET_VERSION)
+		return DT_FAILURE | DT_WRONG_VERSION;
+	if (header.meshCount < 0 || header.meshCount > DT_MAX_NAVMESH_SET_SIZE)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	clear();
+	
+	const bool inPlace = (flags & DT_TILE_READ_ONLY_DATA) != 0;
+	const unsigned char* end = data + dataSize;
+	unsigned char* d = data + sizeof(header);
+	dtStatus status = DT_SUCCESS;
+	
+	for (int i = 0; i < header.meshCount; ++i)
+	{
+		dtNavMeshSetMeshHeader meshHeader;
+		if (end - d < (int)sizeof(meshHeader))
+		{
+			status = DT_FAILURE | DT_INVALID_PARAM;
+			break;
+		}
+		memcpy(&meshHeader, d, sizeof(meshHeader));
+		d += sizeof(meshHeader);
+		if (meshHeader.tileCount < 0)
+		{
+			status = DT_FAILURE | DT_INVALID_PARAM;
+			break;
+		}
+		
+		dtNavMesh* nav = dtAllocNavMesh();
+		if (!nav)
+		{
+			status = DT_FAILURE | DT_OUT_OF_MEMORY;
+			break;
+		}
+		status = nav->init(&meshHeader.params);
+		if (dtStatusFailed(status))
+		{
+			dtFreeNavMesh(nav);
+			break;
+		}
+		addNavMesh(nav, meshHeader.agent);
+		
+		const int tileCount = meshHeader.tileCount;
+		unsigned char** tileData = (unsigned char**)dtAlloc(sizeof(unsigned char*)*(tileCount > 0 ? tileCount : 1), DT_ALLOC_TEMP);
+		int* tileDataSizes = (int*)dtAlloc(sizeof(int)*(tileCount > 0 ? tileCount : 1), DT_ALLOC_TEMP);
+		dtTileRef* tileRefs = (dtTileRef*)dtAlloc(sizeof(dtTileRef)*(tileCount > 0 ? tileCount : 1), DT_ALLOC_TEMP);
+		if (!tileData || !tileDataSizes || !tileRefs)
+		{
+			dtFree(tileData);
+			dtFree(tileDataSizes);
+			dtFree(tileRefs);
+			status = DT_FAILURE | DT_OUT_OF_MEMORY;
+			break;
+		}
+		
+		int n = 0;
+		for (int j = 0; j < tileCount; ++j)
+		{
+			dtNavMeshSetTileHeader tileHeader;
+			if (end - d < (int)sizeof(tileHeader))
+				break;
+			memcpy(&tileHeader, d, sizeof(tileHeader));
+			d += sizeof(tileHeader);
+			if (tileHeader.dataSize <= 0 || end - d < dtAlign4(tileHeader.dataSize))
+				break;
+			
+			unsigned char* tile = d;
+			d += dtAlign4(tileHeader.dataSize);
+			if (!inPlace)
+			{
+				tile = (unsigned char*)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM);
+				if (!tile)
+					break;
+				memcpy(tile, d - dtAlign4(tileHeader.dataSize), tileHeader.dataSize);
+			}
+			tileData[n] = tile;
+			tileDataSizes[n] = tileHeader.dataSize;
+			tileRefs[n] = tileHeader.tileRef;
+			n++;
+		}
+		if (n < tileCount)
+			status = DT_FAILURE | DT_INVALID_PARAM;
+		
+		const int tileFlags = inPlace ? DT_TILE_READ_ONLY_DATA : DT_TILE_FREE_DATA;
+		dtTileRef* results = tileRefs;
+		const dtStatus addStatus = nav->addTiles(tileData, tileDataSizes, n, tileFlags, tileRefs, results);
+		if (!inPlace)
+		{
+			// Free the copies that could not be added.
+			for (int j = 0; j < n; ++j)
+			{
+				if (dtStatusFailed(addStatus) || !results[j])
+					dtFree(tileData[j]);
+			}
+		}
+		if (dtStatusFailed(addStatus))
+			status = addStatus;
+		else if (dtStatusDetail(addStatus, DT_PARTIAL_RESULT) && !dtStatusFailed(status))
+			status |= DT_PARTIAL_RESULT;
+		
+		dtFree(tileData);
+		dtFree(tileDataSizes);
+		dtFree(tileRefs);
+		
+		if (dtStatusFailed(status))
+			break;
+	}
+	
+	if (dtStatusFailed(status))
+		clear();
+	
+	return status;
+}
@@ -0,0 +1,333 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <string.h>
+#include "DetourPathCache.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+#include <new>
+
+static unsigned int hashBytes(unsigned int h, const void* data, const int size)
+{
+	// FNV-1a
+	const unsigned char* p = (const unsigned char*)data;
+	for (int i = 0; i < size; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int dtHashQueryFilter(const dtQueryFilter* filter)
+{
+	unsigned int h = 2166136261u;
+	const unsigned short includeFlags = filter->getIncludeFlags();
+	const unsigned short excludeFlags = filter->getExcludeFlags();
+	h = hashBytes(h, &includeFlags, sizeof(includeFlags));
+	h = hashBytes(h, &excludeFlags, sizeof(excludeFlags));
+	for (int i = 0; i < DT_MAX_AREAS; ++i)
+	{
+		const float cost = filter->getAreaCost(i);
+		h = hashBytes(h, &cost, sizeof(cost));
+	}
+	return h;
+}
+
+// Compares the filter data stored with a cache entry to the data of a filter.
+static bool sameFilterData(const float* areaCost, const unsigned short includeFlags, const unsigned short excludeFlags,
+						   const dtQueryFilter* filter)
+{
+	if (filter->getIncludeFlags() != includeFlags || filter->getExcludeFlags() != excludeFlags)
+		return false;
+	for (int i = 0; i < DT_MAX_AREAS; ++i)
+	{
+		if (filter->getAreaCost(i) != areaCost[i])
+			return false;
+	}
+	return true;
+}
+
+dtPathCache* dtAllocPathCache()
+{
+	void* mem = dtAlloc(sizeof(dtPathCache), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtPathCache;
+}
+
+void dtFreePathCache(dtPathCache* cache)
+{
+	if (!cache) return;
+	cache->~dtPathCache();
+	dtFree(cache);
+}
+
+/// @class dtPathCache
+///
+/// The cache is meant for agents that repeatedly path between the same points 
+/// of interest. A cache hit copies the stored polygon corridor instead of 
+/// running an A* search.
+///
+/// Paths are keyed by the start and end polygons and the data of the filter. 
+/// The hash of the filter (see #dtHashQueryFilter) selects the bucket, and 
+/// the include and exclude flags and area costs stored with each path are 
+/// compared on a hit, so filters with colliding hashes never share paths. 
+/// The start and end positions are not part of the key, a cached corridor is 
+/// reused for any positions within the same polygons. Only complete paths are 
+/// cached.
+///
+/// The cache is emptied automatically whenever the revision of the navigation 
+/// mesh changes (see dtNavMesh::getRevision), that is when tiles are added or 
+/// removed, for example by a dtTileCache update, or when polygon flags or areas 
+/// are changed.
+///
+/// The filter hash only covers the data of the default filter implementation. 
+/// Custom filters derived from #dtQueryFilter that use other data should use 
+/// one cache per filter configuration, or clear the cache when they change.
+///
+/// The cache is not thread safe, each thread needs its own cache.
+
+dtPathCache::dtPathCache() :
+	m_entries(0),
+	m_paths(0),
+	m_buckets(0),
+	m_bucketMask(0),
+	m_maxEntries(0),
+	m_maxPathSize(0),
+	m_entryCount(0),
+	m_lruHead(-1),
+	m_lruTail(-1),
+	m_nav(0),
+	m_revision(0),
+	m_hitCount(0),
+	m_missCount(0),
+	m_invalidationCount(0)
+{
+}
+
+dtPathCache::~dtPathCache()
+{
+	purge();
+}
+
+void dtPathCache::purge()
+{
+	dtFree(m_entries);
+	dtFree(m_paths);
+	dtFree(m_buckets);
+	m_entries = 0;
+	m_paths = 0;
+	m_buckets = 0;
+	m_maxEntries = 0;
+	m_maxPathSize = 0;
+}
+
+dtStatus dtPathCache::init(const int maxEntries, const int maxPathSize)
+{
+	if (maxEntries <= 0 || maxPathSize <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	purge();
+
+	const int bucketCount = (int)dtNextPow2((unsigned int)maxEntries);
+
+	m_entries = (Entry*)dtAlloc(sizeof(Entry)*maxEntries, DT_ALLOC_PERM);
+	m_paths = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*maxEntries*maxPathSize, DT_ALLOC_PERM);
+	m_buckets = (int*)dtAlloc(sizeof(int)*bucketCount, DT_ALLOC_PERM);
+	if (!m_entries || !m_paths || !m_buckets)
+	{
+		purge();
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	m_bucketMask = bucketCount-1;
+	m_maxEntries = maxEntries;
+	m_maxPathSize = maxPathSize;
+
+	clear();
+	resetStats();
+
+	return DT_SUCCESS;
+}
+
+void dtPathCache::clear()
+{
+	for (int i = 0; i <= m_bucketMask && m_buckets; ++i)
+		m_buckets[i] = -1;
+	m_entryCount = 0;
+	m_lruHead = -1;
+	m_lruTail = -1;
+	m_nav = 0;
+	m_revision = 0;
+}
+
+void dtPathCache::resetStats()
+{
+	m_hitCount = 0;
+	m_missCount = 0;
+	m_invalidationCount = 0;
+}
+
+int dtPathCache::hashKey(dtPolyRef startRef, dtPolyRef endRef, unsigned int filterHash) const
+{
+	unsigned int h = 2166136261u;
+	h = hashBytes(h, &startRef, sizeof(startRef));
+	h = hashBytes(h, &endRef, sizeof(endRef));
+	h = hashBytes(h, &filterHash, sizeof(filterHash));
+	return (int)(h & (unsigned int)m_bucketMask);
+}
+
+void dtPathCache::unlinkLru(const int idx)
+{
+	Entry& e = m_entries[idx];
+	if (e.lruPrev != -1)
+		m_entries[e.lruPrev].lruNext = e.lruNext;
+	else
+		m_lruHead = e.lruNext;
+	if (e.lruNext != -1)
+		m_entries[e.lruNext].lruPrev = e.lruPrev;
+	else
+		m_lruTail = e.lruPrev;
+	e.lruPrev = -1;
+	e.lruNext = -1;
+}
+
+void dtPathCache::pushLru(const int idx)
+{
+	Entry& e = m_entries[idx];
+	e.lruPrev = -1;
+	e.lruNext = m_lruHead;
+	if (m_lruHead != -1)
+		m_entries[m_lruHead].lruPrev = idx;
+	m_lruHead = idx;
+	if (m_lruTail == -1)
+		m_lruTail = idx;
+}
+
+void dtPathCache::removeFromBucket(const int idx)
+{
+	const Entry& e = m_entries[idx];
+	int* prev = &m_buckets[hashKey(e.startRef, e.endRef, e.filterHash)];
+	while (*prev != -1)
+	{
+		if (*prev == idx)
+		{
+			*prev = e.hashNext;
+			return;
+		}
+		prev = &m_entries[*prev].hashNext;
+	}
+}
+
+/// @par
+///
+/// On a cache miss the path is searched with dtNavMeshQuery::findPath() and the 
+/// result is stored if it is complete and fits in the cache. When the cache is 
+/// full, the least recently used path is replaced.
+///
+/// The cached corridor of a hit is the one found for the positions of the 
+/// query that stored it. The returned status is the status findPath() would 
+/// return for a complete path, including #DT_BUFFER_TOO_SMALL when @p maxPath 
+/// is too small for the cached path.
+///
+/// @see dtNavMeshQuery::findPath
+dtStatus dtPathCache::findPath(const dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef,
+							   const float* startPos, const float* endPos,
+							   const dtQueryFilter* filter,
+							   dtPolyRef* path, int* pathCount, const int maxPath)
+{
+	dtAssert(m_entries);
+
+	if (!query || !pathCount || !filter || !path || maxPath <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*pathCount = 0;
+
+	const dtNavMesh* nav = query->getAttachedNavMesh();
+	if (!nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	// Drop all paths when the navigation graph has changed.
+	if (nav != m_nav || nav->getRevision() != m_revision)
+	{
+		if (m_entryCount > 0)
+			m_invalidationCount++;
+		clear();
+		m_nav = nav;
+		m_revision = nav->getRevision();
+	}
+
+	const unsigned int filterHash = dtHashQueryFilter(filter);
+	const int bucket = hashKey(startRef, endRef, filterHash);
+
+	for (int i = m_buckets[bucket]; i != -1; i = m_entries[i].hashNext)
+	{
+		const Entry& e = m_entries[i];
+		if (e.startRef != startRef || e.endRef != endRef || e.filterHash != filterHash ||
+			!sameFilterData(e.areaCost, e.includeFlags, e.excludeFlags, filter))
+			continue;
+
+		unlinkLru(i);
+		pushLru(i);
+		m_hitCount++;
+
+		const int n = dtMin(e.pathCount, maxPath);
+		memcpy(path, &m_paths[i*m_maxPathSize], sizeof(dtPolyRef)*n);
+		*pathCount = n;
+		return n < e.pathCount ? DT_SUCCESS | DT_BUFFER_TOO_SMALL : DT_SUCCESS;
+	}
+
+	m_missCount++;
+
+	const dtStatus status = query->findPath(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
+	if (status != DT_SUCCESS || *pathCount > m_maxPathSize)
+		return status;
+
+	// Reuse a free entry or replace the least recently used one.
+	int idx;
+	if (m_entryCount < m_maxEntries)
+	{
+		idx = m_entryCount++;
+	}
+	else
+	{
+		idx = m_lruTail;
+		unlinkLru(idx);
+		removeFromBucket(idx);
+	}
+
+	Entry& e = m_entries[idx];
+	e.startRef = startRef;
+	e.endRef = endRef;
+	e.filterHash = filterHash;
+	for (int i = 0; i < DT_MAX_AREAS; ++i)
+		e.areaCost[i] = filter->getAreaCost(i);
+	e.includeFlags = filter->getIncludeFlags();
+	e.excludeFlags = filter->getExcludeFlags();
+	e.pathCount = *pathCount;
+	e.hashNext = m_buckets[bucket];
+	m_buckets[bucket] = idx;
+	pushLru(idx);
+	memcpy(&m_paths[idx*m_maxPathSize], path, sizeof(dtPolyRef)*e.pathCount);
+
+	return status;
+}
@@ -26,18 +26,24 @@
 #include "DetourProximityGrid.h"
 #include "DetourPathQueue.h"
 
-/// The maximum number of neighbors that a crowd agent can take into account
+/// The default maximum number of neighbors that a crowd agent can take into account
 /// for steering decisions.
 /// @ingroup crowd
+/// @see dtCrowdParams::maxNeighbours
 static const int DT_CROWDAGENT_MAX_NEIGHBOURS = 6;
 
-/// The maximum number of corners a crowd agent will look ahead in the path.
-/// This value is used for sizing the crowd agent corner buffers.
+/// The default maximum number of corners a crowd agent will look ahead in the path.
 /// Due to the behavior of the crowd manager, the actual number of useful
 /// corners will be one less than this number.
 /// @ingroup crowd
+/// @see dtCrowdParams::maxCorners
 static const int DT_CROWDAGENT_MAX_CORNERS = 4;
 
+/// The default maximum number of path finder iterations the crowd runs per update.
+/// @ingroup crowd
+/// @see dtCrowdParams::maxPathIterations
+static const int DT_CROWD_MAX_PATH_ITERATIONS = 100;
+
 /// The maximum number of crowd avoidance configurations supported by the
 /// crowd manager.
 /// @ingroup crowd
@@ -112,6 +118,9 @@ enum MoveRequestState
 };
 
 /// Represents an agent managed by a #dtCrowd object.
+///
+/// #neis, #cornerVerts, #cornerFlags and #cornerPolys point into pools owned by 
+/// the crowd, sized by dtCrowdParams::maxNeighbours and dtCrowdParams::maxCorners.
 /// @ingroup crowd
 struct dtCrowdAgent
 {
@@ -133,8 +142,8 @@ struct dtCrowdAgent
 	/// Time since the agent's path corridor was optimized.
 	float topologyOptTime;
 	
-	/// The known neighbors of the agent.
-	dtCrowdNeighbour neis[DT_CROWDAGENT_MAX_NEIGHBOURS];
+	/// The known neighbors of the agent. [Size: dtCrowd::getMaxNeighbours()]
+	dtCrowdNeighbour* neis;
 
 	/// The number of neighbors.
 	int nneis;
@@ -152,13 +161,13 @@ struct dtCrowdAgent
 	dtCrowdAgentParams params;
 
 	/// The local path corridor corners for the agent. (Staight path.) [(x, y, z) * #ncorners]
-	float cornerVerts[DT_CROWDAGENT_MAX_CORNERS*3];
+	float* cornerVerts;
 
 	/// The local path corridor corner flags. (See: #dtStraightPathFlags) [(flags) * #ncorners]
-	unsigned char cornerFlags[DT_CROWDAGENT_MAX_CORNERS];
+	unsigned char* cornerFlags;
 
 	/// The reference id of the polygon being entered at the corner. [(polyRef) * #ncorners]
-	dtPolyRef cornerPolys[DT_CROWDAGENT_MAX_CORNERS];
+	dtPolyRef* cornerPolys;
 
 	/// The number of corners.
 	int ncorners;
@@ -198,6 +207,35 @@ struct dtCrowdAgentDebugInfo
 	dtObstacleAvoidanceDebugData* vod;
 };
 
+/// Configuration parameters used to initialize a crowd.
+/// @ingroup crowd
+/// @see dtCrowd::init()
+struct dtCrowdParams
+{
+	int maxAgents;				///< The maximum number of agents the crowd can manage. [Limit: >= 1]
+	float maxAgentRadius;		///< The maximum radius of any agent that will be added to the crowd. [Limit: > 0]
+	int maxNeighbours;			///< The maximum number of neighbours an agent takes into account. [Limit: >= 1]
+	int maxCorners;				///< The maximum number of corners an agent looks ahead in its path. [Limit: >= 2]
+	int maxPathRequests;		///< The maximum number of path requests in flight at once. [Limit: >= 1]
+	int maxPathIterations;		///< The maximum number of path finder iterations per update. [Limit: >= 1]
+};
+
+/// A crowd update job, run over a range of active agents.
+///  @param[in]		data	The job data.
+///  @param[in]		begin	The first agent of the range.
+///  @param[in]		end		One past the last agent of the range.
+///  @param[in]		thread	The index of the thread running the range. [Limits: 0 <= value < thread count]
+/// @ingroup crowd
+typedef void (*dtCrowdJobFunc)(void* data, const int begin, const int end, const int thread);
+
+/// Runs a crowd update job over the agents [0, @p count), possibly on several threads.
+///  @param[in]		userData	The user data passed to dtCrowd::setParallelFor().
+///  @param[in]		job			The job to run.
+///  @param[in]		data		The job data, passed to @p job.
+///  @param[in]		count		The number of agents to run the job over.
+/// @ingroup crowd
+typedef void (*dtCrowdParallelForFunc)(void* userData, dtCrowdJobFunc job, void* data, const int count);
+
 /// Provides local steering behaviors for a group of agents. 
 /// @ingroup crowd
 class dtCrowd
@@ -227,9 +265,71 @@ class dtCrowd
 
 	dtNavMeshQuery* m_navquery;
 
+	int m_maxNeighbours;
+	int m_maxCorners;
+	int m_maxPathRequests;
+	int m_maxPathIterations;
+
+	// Agent neighbour and corner storage, m_maxNeighbours or m_maxCorners entries per agent.
+	dtCrowdNeighbour* m_neighbourPool;
+	float* m_cornerVertPool;
+	unsigned char* m_cornerFlagPool;
+	dtPolyRef* m_cornerPolyPool;
+
+	dtCrowdAgent** m_pathRequestQueue;
+
+	int* m_neighbourIds;
+	int m_maxNeighbourIds;
+
+	// The queries used by one thread of the update.
+	struct ThreadContext
+	{
+		dtNavMeshQuery* navquery;
+		dtObstacleAvoidanceQuery* obstacleQuery;
+		int* neighbourIds;
+		int velocitySampleCount;
+	};
+
+	// The agents and parameters of the current update.
+	struct UpdateState
+	{
+		dtCrowdAgent** agents;
+		int nagents;
+		float dt;
+		dtCrowdAgentDebugInfo* debug;
+	};
+
+	typedef void (dtCrowd::*UpdatePhase)(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+
+	struct PhaseJob
+	{
+		dtCrowd* crowd;
+		UpdatePhase phase;
+		const UpdateState* state;
+	};
+
+	dtCrowdParallelForFunc m_parallelFor;
+	void* m_parallelForUserData;
+	int m_threadCount;
+	ThreadContext* m_threads;
+
+	bool allocThreads();
+	void freeThreads();
+	void runPhase(UpdatePhase phase, const UpdateState& state);
+	static void runPhaseJob(void* data, const int begin, const int end, const int thread);
+
 	void updateTopologyOptimization(dtCrowdAgent** agents, const int nagents, const float dt);
 	void updateMoveRequest(const float dt);
-	void checkPathValidity(dtCrowdAgent** agents, const int nagents, const float dt);
+	void checkPathValidity(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void updateBoundaries(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void updateCorners(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void triggerOffMeshConnections(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void updateSteering(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void planVelocities(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void integrateAgents(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void calcCollisionDisplacements(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void applyCollisionDisplacements(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
+	void moveAgents(const UpdateState& state, ThreadContext& ctx, const int begin, const int end);
 
 	inline int getAgentIndex(const dtCrowdAgent* agent) const  { return (int)(agent - m_agents); }
 
@@ -247,6 +347,19 @@ public:
 	///  @param[in]		nav				The navigation mesh to use for planning.
 	/// @return True if the initialization succeeded.
 	bool init(const int maxAgents, const float maxAgentRadius, dtNavMesh* nav);
+
+	/// Initializes the crowd.  
+	///  @param[in]		params	The crowd configuration.
+	///  @param[in]		nav		The navigation mesh to use for planning.
+	/// @return True if the initialization succeeded.
+	bool init(const dtCrowdParams* params, dtNavMesh* nav);
+
+	/// Sets the function used to run the per agent phases of #update() in parallel.
+	///  @param[in]		parallelFor		The parallel for function, or null to update serially.
+	///  @param[in]		userData		The user data passed to @p parallelFor. [Opt]
+	///  @param[in]		threadCount		The number of threads @p parallelFor runs jobs on. [Limit: >= 1]
+	/// @return True if the thread queries were successfully allocated.
+	bool setParallelFor(dtCrowdParallelForFunc parallelFor, void* userData, const int threadCount);
 	
 	/// Sets the shared avoidance configuration for the specified index.
 	///  @param[in]		idx		The index. [Limits: 0 <= value < #DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS]
@@ -333,6 +446,14 @@ public:
 	/// @return The search halfExtents used by the crowd. [(x, y, z)]
 	const float* getQueryExtents() const { return m_agentPlacementHalfExtents; }
 	
+	/// The maximum number of neighbours each agent takes into account.
+	/// @return The size of the #dtCrowdAgent::neis array.
+	inline int getMaxNeighbours() const { return m_maxNeighbours; }
+
+	/// The maximum number of corners each agent looks ahead in its path.
+	/// @return The size of the #dtCrowdAgent corner arrays.
+	inline int getMaxCorners() const { return m_maxCorners; }
+
 	/// Gets the velocity sample count.
 	/// @return The velocity sample count.
 	inline int getVelocitySampleCount() const { return m_velocitySampleCount; }
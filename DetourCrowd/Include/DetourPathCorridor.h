@@ -31,6 +31,13 @@ class dtPathCorridor
 	dtPolyRef* m_path;
 	int m_npath;
 	int m_maxPath;
+
+	// The portals of the path, kept between calls to findCorners().
+	dtPolyRef* m_portalPath;		// The path the portals were gathered for.
+	float* m_portalVerts;			// The left vertices followed by the right vertices of the portals.
+	unsigned char* m_portalPolys;	// The types followed by the areas of the polygons.
+	int m_nportals;					// The number of portals gathered.
+	unsigned int m_portalRevision;	// The revision of the navigation mesh the portals were gathered from.
 	
 public:
 	dtPathCorridor();
@@ -137,6 +144,12 @@ private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtPathCorridor(const dtPathCorridor&);
 	dtPathCorridor& operator=(const dtPathCorridor&);
+
+	// Keeps the portals of the part of the path that is unchanged since they were gathered,
+	// drops them all if the navigation mesh changed.
+	void updatePortals(const dtNavMesh* nav);
+	// Gathers more portals, returns false if no more could be gathered.
+	bool gatherPortals(dtNavMeshQuery* navquery);
 };
 
 int dtMergeCorridorStartMoved(dtPolyRef* path, const int npath, const int maxPath,
@@ -24,6 +24,9 @@
 
 static const unsigned int DT_PATHQ_INVALID = 0;
 
+/// The default number of path requests that can be in flight at once.
+static const int DT_PATHQ_DEFAULT_MAX_QUEUE = 8;
+
 typedef unsigned int dtPathQueueRef;
 
 class dtPathQueue
@@ -43,8 +46,8 @@ class dtPathQueue
 		const dtQueryFilter* filter; ///< TODO: This is potentially dangerous!
 	};
 	
-	static const int MAX_QUEUE = 8;
-	PathQuery m_queue[MAX_QUEUE];
+	PathQuery* m_queue;
+	int m_maxQueue;
 	dtPathQueueRef m_nextHandle;
 	int m_maxPathSize;
 	int m_queueHead;
@@ -56,7 +59,8 @@ public:
 	dtPathQueue();
 	~dtPathQueue();
 	
-	bool init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav);
+	bool init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav,
+			  const int maxQueue = DT_PATHQ_DEFAULT_MAX_QUEUE);
 	
 	void update(const int maxIters);
 	
@@ -68,6 +72,8 @@ public:
 	
 	dtStatus getPathResult(dtPathQueueRef ref, dtPolyRef* path, int* pathSize, const int maxPath);
 	
+	inline int getMaxQueue() const { return m_maxQueue; }
+	
 	inline const dtNavMeshQuery* getNavQuery() const { return m_navquery; }
 
 private:
@@ -26,15 +26,15 @@ class dtProximityGrid
 	
 	struct Item
 	{
-		unsigned short id;
+		int id;
 		short x,y;
-		unsigned short next;
+		int next;
 	};
 	Item* m_pool;
 	int m_poolHead;
 	int m_poolSize;
 	
-	unsigned short* m_buckets;
+	int* m_buckets;
 	int m_bucketsSize;
 	
 	int m_bounds[4];
@@ -47,13 +47,13 @@ public:
 	
 	void clear();
 	
-	void addItem(const unsigned short id,
+	void addItem(const int id,
 				 const float minx, const float miny,
 				 const float maxx, const float maxy);
 	
 	int queryItems(const float minx, const float miny,
 				   const float maxx, const float maxy,
-				   unsigned short* ids, const int maxIds) const;
+				   int* ids, const int maxIds) const;
 	
 	int getItemCountAt(const int x, const int y) const;
 	
@@ -18,6 +18,7 @@
 
 #include <string.h>
 #include <float.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <new>
 #include "DetourCrowd.h"
@@ -45,8 +46,6 @@ void dtFreeCrowd(dtCrowd* ptr)
 }
 
 
-static const int MAX_ITERS_PER_UPDATE = 100;
-
 static const int MAX_PATHQUEUE_NODES = 4096;
 static const int MAX_COMMON_NODES = 512;
 
@@ -186,15 +185,14 @@ static int addNeighbour(const int idx, const float dist,
 
 static int getNeighbours(const float* pos, const float height, const float range,
 						 const dtCrowdAgent* skip, dtCrowdNeighbour* result, const int maxResult,
-						 dtCrowdAgent** agents, const int /*nagents*/, dtProximityGrid* grid)
+						 dtCrowdAgent** agents, const int /*nagents*/, dtProximityGrid* grid,
+						 int* ids, const int maxIds)
 {
 	int n = 0;
 	
-	static const int MAX_NEIS = 32;
-	unsigned short ids[MAX_NEIS];
 	int nids = grid->queryItems(pos[0]-range, pos[2]-range,
 								pos[0]+range, pos[2]+range,
-								ids, MAX_NEIS);
+								ids, maxIds);
 	
 	for (int i = 0; i < nids; ++i)
 	{
@@ -323,6 +321,7 @@ Notes:
   #dtCrowdAgent::active to determine if the agent is actually in use or not.
 - This class is meant to provide 'local' movement. There is a limit of 256 polygons in the path corridor.  
   So it is not meant to provide automatic pathfinding services over long distances.
+- The per agent phases of #update() can be spread over several threads using #setParallelFor().
 
 @see dtAllocCrowd(), dtFreeCrowd(), init(), dtCrowdAgent
 
@@ -339,7 +338,22 @@ dtCrowd::dtCrowd() :
 	m_maxPathResult(0),
 	m_maxAgentRadius(0),
 	m_velocitySampleCount(0),
-	m_navquery(0)
+	m_navquery(0),
+	m_maxNeighbours(0),
+	m_maxCorners(0),
+	m_maxPathRequests(0),
+	m_maxPathIterations(0),
+	m_neighbourPool(0),
+	m_cornerVertPool(0),
+	m_cornerFlagPool(0),
+	m_cornerPolyPool(0),
+	m_pathRequestQueue(0),
+	m_neighbourIds(0),
+	m_maxNeighbourIds(0),
+	m_parallelFor(0),
+	m_parallelForUserData(0),
+	m_threadCount(1),
+	m_threads(0)
 {
 }
 
@@ -361,6 +375,18 @@ void dtCrowd::purge()
 
 	dtFree(m_agentAnims);
 	m_agentAnims = 0;
+
+	dtFree(m_neighbourPool);
+	m_neighbourPool = 0;
+	dtFree(m_cornerVertPool);
+	m_cornerVertPool = 0;
+	dtFree(m_cornerFlagPool);
+	m_cornerFlagPool = 0;
+	dtFree(m_cornerPolyPool);
+	m_cornerPolyPool = 0;
+
+	dtFree(m_pathRequestQueue);
+	m_pathRequestQueue = 0;
 	
 	dtFree(m_pathResult);
 	m_pathResult = 0;
@@ -368,6 +394,11 @@ void dtCrowd::purge()
 	dtFreeProximityGrid(m_grid);
 	m_grid = 0;
 
+	freeThreads();
+
+	dtFree(m_neighbourIds);
+	m_neighbourIds = 0;
+
 	dtFreeObstacleAvoidanceQuery(m_obstacleQuery);
 	m_obstacleQuery = 0;
 	
@@ -378,12 +409,47 @@ void dtCrowd::purge()
 /// @par
 ///
 /// May be called more than once to purge and re-initialize the crowd.
+///
+/// Uses the default neighbour, corner and path request limits.
 bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* nav)
+{
+	dtCrowdParams params;
+	params.maxAgents = maxAgents;
+	params.maxAgentRadius = maxAgentRadius;
+	params.maxNeighbours = DT_CROWDAGENT_MAX_NEIGHBOURS;
+	params.maxCorners = DT_CROWDAGENT_MAX_CORNERS;
+	params.maxPathRequests = DT_PATHQ_DEFAULT_MAX_QUEUE;
+	params.maxPathIterations = DT_CROWD_MAX_PATH_ITERATIONS;
+	return init(&params, nav);
+}
+
+/// @par
+///
+/// May be called more than once to purge and re-initialize the crowd.
+///
+/// The neighbour and corner arrays of all agents are allocated from pools owned by the crowd.
+/// Fails if the pools would hold more than @c INT_MAX items.
+bool dtCrowd::init(const dtCrowdParams* params, dtNavMesh* nav)
 {
 	purge();
+
+	if (!params || params->maxAgents < 1 || params->maxNeighbours < 1 || params->maxCorners < 2 ||
+		params->maxPathRequests < 1 || params->maxPathIterations < 1)
+		return false;
+
+	// The pools and the neighbour candidates are indexed with ints.
+	if (params->maxAgents > INT_MAX/4 || params->maxNeighbours > INT_MAX/4 ||
+		params->maxNeighbours > INT_MAX/params->maxAgents ||
+		params->maxCorners > INT_MAX/3/params->maxAgents)
+		return false;
 	
-	m_maxAgents = maxAgents;
+	const float maxAgentRadius = params->maxAgentRadius;
+	m_maxAgents = params->maxAgents;
 	m_maxAgentRadius = maxAgentRadius;
+	m_maxNeighbours = params->maxNeighbours;
+	m_maxCorners = params->maxCorners;
+	m_maxPathRequests = params->maxPathRequests;
+	m_maxPathIterations = params->maxPathIterations;
 
 	// Larger than agent radius because it is also used for agent recovery.
 	dtVset(m_agentPlacementHalfExtents, m_maxAgentRadius*2.0f, m_maxAgentRadius*1.5f, m_maxAgentRadius*2.0f);
@@ -404,17 +470,17 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	memset(m_obstacleQueryParams, 0, sizeof(m_obstacleQueryParams));
 	for (int i = 0; i < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS; ++i)
 	{
-		dtObstacleAvoidanceParams* params = &m_obstacleQueryParams[i];
-		params->velBias = 0.4f;
-		params->weightDesVel = 2.0f;
-		params->weightCurVel = 0.75f;
-		params->weightSide = 0.75f;
-		params->weightToi = 2.5f;
-		params->horizTime = 2.5f;
-		params->gridSize = 33;
-		params->adaptiveDivs = 7;
-		params->adaptiveRings = 2;
-		params->adaptiveDepth = 5;
+		dtObstacleAvoidanceParams* oaParams = &m_obstacleQueryParams[i];
+		oaParams->velBias = 0.4f;
+		oaParams->weightDesVel = 2.0f;
+		oaParams->weightCurVel = 0.75f;
+		oaParams->weightSide = 0.75f;
+		oaParams->weightToi = 2.5f;
+		oaParams->horizTime = 2.5f;
+		oaParams->gridSize = 33;
+		oaParams->adaptiveDivs = 7;
+		oaParams->adaptiveRings = 2;
+		oaParams->adaptiveDepth = 5;
 	}
 	
 	// Allocate temp buffer for merging paths.
@@ -423,7 +489,11 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	if (!m_pathResult)
 		return false;
 	
-	if (!m_pathq.init(m_maxPathResult, MAX_PATHQUEUE_NODES, nav))
+	if (!m_pathq.init(m_maxPathResult, MAX_PATHQUEUE_NODES, nav, m_maxPathRequests))
+		return false;
+
+	m_pathRequestQueue = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*m_maxPathRequests, DT_ALLOC_PERM);
+	if (!m_pathRequestQueue)
 		return false;
 	
 	m_agents = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent)*m_maxAgents, DT_ALLOC_PERM);
@@ -437,11 +507,24 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	m_agentAnims = (dtCrowdAgentAnimation*)dtAlloc(sizeof(dtCrowdAgentAnimation)*m_maxAgents, DT_ALLOC_PERM);
 	if (!m_agentAnims)
 		return false;
+
+	const size_t neighbourCount = (size_t)m_maxAgents*m_maxNeighbours;
+	const size_t cornerCount = (size_t)m_maxAgents*m_maxCorners;
+	m_neighbourPool = (dtCrowdNeighbour*)dtAlloc(sizeof(dtCrowdNeighbour)*neighbourCount, DT_ALLOC_PERM);
+	m_cornerVertPool = (float*)dtAlloc(sizeof(float)*cornerCount*3, DT_ALLOC_PERM);
+	m_cornerFlagPool = (unsigned char*)dtAlloc(sizeof(unsigned char)*cornerCount, DT_ALLOC_PERM);
+	m_cornerPolyPool = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*cornerCount, DT_ALLOC_PERM);
+	if (!m_neighbourPool || !m_cornerVertPool || !m_cornerFlagPool || !m_cornerPolyPool)
+		return false;
 	
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
 		new(&m_agents[i]) dtCrowdAgent();
 		m_agents[i].active = false;
+		m_agents[i].neis = &m_neighbourPool[i*m_maxNeighbours];
+		m_agents[i].cornerVerts = &m_cornerVertPool[i*m_maxCorners*3];
+		m_agents[i].cornerFlags = &m_cornerFlagPool[i*m_maxCorners];
+		m_agents[i].cornerPolys = &m_cornerPolyPool[i*m_maxCorners];
 		if (!m_agents[i].corridor.init(m_maxPathResult))
 			return false;
 	}
@@ -457,10 +540,102 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 		return false;
 	if (dtStatusFailed(m_navquery->init(nav, MAX_COMMON_NODES)))
 		return false;
+
+	// Gather more neighbour candidates than are kept, so that the nearest ones can be picked.
+	m_maxNeighbourIds = dtMax(32, m_maxNeighbours*4);
+	m_neighbourIds = (int*)dtAlloc(sizeof(int)*m_maxNeighbourIds, DT_ALLOC_PERM);
+	if (!m_neighbourIds)
+		return false;
+
+	if (!allocThreads())
+		return false;
 	
 	return true;
 }
 
+/// @par
+///
+/// The per agent phases of #update() are handed to @p parallelFor, which must run the job over
+/// every agent of the range before returning. It may split the range into any number of sub ranges
+/// and run them concurrently, as long as each call passes a thread index below @p threadCount and
+/// no two concurrent calls share a thread index. Each thread index gets its own navigation mesh
+/// and obstacle avoidance queries, so the result of the update does not depend on the split.
+///
+/// The path request queue, topology optimization, proximity grid and off-mesh animations are
+/// still updated serially on the calling thread.
+///
+/// May be called before or after #init().
+bool dtCrowd::setParallelFor(dtCrowdParallelForFunc parallelFor, void* userData, const int threadCount)
+{
+	if (parallelFor && threadCount < 1)
+		return false;
+
+	freeThreads();
+
+	m_parallelFor = parallelFor;
+	m_parallelForUserData = userData;
+	m_threadCount = parallelFor ? threadCount : 1;
+
+	if (!m_navquery)
+		return true;
+	if (allocThreads())
+		return true;
+
+	// Fall back to serial update.
+	freeThreads();
+	m_parallelFor = 0;
+	m_parallelForUserData = 0;
+	m_threadCount = 1;
+	return false;
+}
+
+bool dtCrowd::allocThreads()
+{
+	m_threads = (ThreadContext*)dtAlloc(sizeof(ThreadContext)*m_threadCount, DT_ALLOC_PERM);
+	if (!m_threads)
+		return false;
+	memset(m_threads, 0, sizeof(ThreadContext)*m_threadCount);
+
+	// The first thread shares the crowd queries.
+	m_threads[0].navquery = m_navquery;
+	m_threads[0].obstacleQuery = m_obstacleQuery;
+	m_threads[0].neighbourIds = m_neighbourIds;
+
+	for (int i = 1; i < m_threadCount; ++i)
+	{
+		ThreadContext* ctx = &m_threads[i];
+		ctx->navquery = dtAllocNavMeshQuery();
+		if (!ctx->navquery)
+			return false;
+		if (dtStatusFailed(ctx->navquery->init(m_navquery->getAttachedNavMesh(), MAX_COMMON_NODES)))
+			return false;
+		ctx->obstacleQuery = dtAllocObstacleAvoidanceQuery();
+		if (!ctx->obstacleQuery)
+			return false;
+		if (!ctx->obstacleQuery->init(6, 8))
+			return false;
+		ctx->neighbourIds = (int*)dtAlloc(sizeof(int)*m_maxNeighbourIds, DT_ALLOC_PERM);
+		if (!ctx->neighbourIds)
+			return false;
+	}
+
+	return true;
+}
+
+void dtCrowd::freeThreads()
+{
+	if (!m_threads)
+		return;
+	for (int i = 1; i < m_threadCount; ++i)
+	{
+		dtFreeNavMeshQuery(m_threads[i].navquery);
+		dtFreeObstacleAvoidanceQuery(m_threads[i].obstacleQuery);
+		dtFree(m_threads[i].neighbourIds);
+	}
+	dtFree(m_threads);
+	m_threads = 0;
+}
+
 void dtCrowd::setObstacleAvoidanceParams(const int idx, const dtObstacleAvoidanceParams* params)
 {
 	if (idx >= 0 && idx < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS)
@@ -676,8 +851,7 @@ int dtCrowd::getActiveAgents(dtCrowdAgent** agents, const int maxAgents)
 
 void dtCrowd::updateMoveRequest(const float /*dt*/)
 {
-	const int PATH_MAX_AGENTS = 8;
-	dtCrowdAgent* queue[PATH_MAX_AGENTS];
+	dtCrowdAgent** queue = m_pathRequestQueue;
 	int nqueue = 0;
 	
 	// Fire off new requests.
@@ -764,7 +938,7 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 		
 		if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE)
 		{
-			nqueue = addToPathQueue(ag, queue, nqueue, PATH_MAX_AGENTS);
+			nqueue = addToPathQueue(ag, queue, nqueue, m_maxPathRequests);
 		}
 	}
 
@@ -779,7 +953,7 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 
 	
 	// Update requests.
-	m_pathq.update(MAX_ITERS_PER_UPDATE);
+	m_pathq.update(m_maxPathIterations);
 
 	dtStatus status;
 
@@ -937,19 +1111,58 @@ void dtCrowd::updateTopologyOptimization(dtCrowdAgent** agents, const int nagent
 
 }
 
-void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const float dt)
+void dtCrowd::runPhaseJob(void* data, const int begin, const int end, const int thread)
+{
+	const PhaseJob* job = (const PhaseJob*)data;
+	dtCrowd* crowd = job->crowd;
+	dtAssert(thread >= 0 && thread < crowd->m_threadCount);
+	(crowd->*job->phase)(*job->state, crowd->m_threads[thread], begin, end);
+}
+
+void dtCrowd::runPhase(UpdatePhase phase, const UpdateState& state)
+{
+	if (!state.nagents)
+		return;
+	
+	if (m_parallelFor && m_threads)
+	{
+		PhaseJob job;
+		job.crowd = this;
+		job.phase = phase;
+		job.state = &state;
+		for (int i = 0; i < m_threadCount; ++i)
+			m_threads[i].velocitySampleCount = 0;
+		m_parallelFor(m_parallelForUserData, runPhaseJob, &job, state.nagents);
+		for (int i = 0; i < m_threadCount; ++i)
+			m_velocitySampleCount += m_threads[i].velocitySampleCount;
+	}
+	else
+	{
+		ThreadContext ctx;
+		ctx.navquery = m_navquery;
+		ctx.obstacleQuery = m_obstacleQuery;
+		ctx.neighbourIds = m_neighbourIds;
+		ctx.velocitySampleCount = 0;
+		(this->*phase)(state, ctx, 0, state.nagents);
+		m_velocitySampleCount += ctx.velocitySampleCount;
+	}
+}
+
+void dtCrowd::checkPathValidity(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
 {
 	static const int CHECK_LOOKAHEAD = 10;
 	static const float TARGET_REPLAN_DELAY = 1.0; // seconds
 	
-	for (int i = 0; i < nagents; ++i)
+	dtNavMeshQuery* navquery = ctx.navquery;
+	
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 			
-		ag->targetReplanTime += dt;
+		ag->targetReplanTime += state.dt;
 
 		bool replan = false;
 
@@ -958,14 +1171,14 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		float agentPos[3];
 		dtPolyRef agentRef = ag->corridor.getFirstPoly();
 		dtVcopy(agentPos, ag->npos);
-		if (!m_navquery->isValidPolyRef(agentRef, &m_filters[ag->params.queryFilterType]))
+		if (!navquery->isValidPolyRef(agentRef, &m_filters[ag->params.queryFilterType]))
 		{
 			// Current location is not valid, try to reposition.
 			// TODO: this can snap agents, how to handle that?
 			float nearest[3];
 			dtVcopy(nearest, agentPos);
 			agentRef = 0;
-			m_navquery->findNearestPoly(ag->npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
+			navquery->findNearestPoly(ag->npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
 			dtVcopy(agentPos, nearest);
 
 			if (!agentRef)
@@ -981,7 +1194,7 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			// Make sure the first polygon is valid, but leave other valid
 			// polygons in the path so that replanner can adjust the path better.
 			ag->corridor.fixPathStart(agentRef, agentPos);
-//			ag->corridor.trimInvalidPath(agentRef, agentPos, m_navquery, &m_filter);
+//			ag->corridor.trimInvalidPath(agentRef, agentPos, navquery, &m_filter);
 			ag->boundary.reset();
 			dtVcopy(ag->npos, agentPos);
 
@@ -995,13 +1208,13 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		// Try to recover move request position.
 		if (ag->targetState != DT_CROWDAGENT_TARGET_NONE && ag->targetState != DT_CROWDAGENT_TARGET_FAILED)
 		{
-			if (!m_navquery->isValidPolyRef(ag->targetRef, &m_filters[ag->params.queryFilterType]))
+			if (!navquery->isValidPolyRef(ag->targetRef, &m_filters[ag->params.queryFilterType]))
 			{
 				// Current target is not valid, try to reposition.
 				float nearest[3];
 				dtVcopy(nearest, ag->targetPos);
 				ag->targetRef = 0;
-				m_navquery->findNearestPoly(ag->targetPos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &ag->targetRef, nearest);
+				navquery->findNearestPoly(ag->targetPos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &ag->targetRef, nearest);
 				dtVcopy(ag->targetPos, nearest);
 				replan = true;
 			}
@@ -1015,10 +1228,10 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		}
 
 		// If nearby corridor is not valid, replan.
-		if (!ag->corridor.isValid(CHECK_LOOKAHEAD, m_navquery, &m_filters[ag->params.queryFilterType]))
+		if (!ag->corridor.isValid(CHECK_LOOKAHEAD, navquery, &m_filters[ag->params.queryFilterType]))
 		{
 			// Fix current path.
-//			ag->corridor.trimInvalidPath(agentRef, agentPos, m_navquery, &m_filter);
+//			ag->corridor.trimInvalidPath(agentRef, agentPos, navquery, &m_filter);
 //			ag->boundary.reset();
 			replan = true;
 		}
@@ -1042,39 +1255,12 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		}
 	}
 }
-	
-void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
-{
-	m_velocitySampleCount = 0;
-	
-	const int debugIdx = debug ? debug->idx : -1;
-	
-	dtCrowdAgent** agents = m_activeAgents;
-	int nagents = getActiveAgents(agents, m_maxAgents);
 
-	// Check that all agents still have valid paths.
-	checkPathValidity(agents, nagents, dt);
-	
-	// Update async move request and path finder.
-	updateMoveRequest(dt);
-
-	// Optimize path topology.
-	updateTopologyOptimization(agents, nagents, dt);
-	
-	// Register agents to proximity grid.
-	m_grid->clear();
-	for (int i = 0; i < nagents; ++i)
-	{
-		dtCrowdAgent* ag = agents[i];
-		const float* p = ag->npos;
-		const float r = ag->params.radius;
-		m_grid->addItem((unsigned short)i, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
-	}
-	
-	// Get nearby navmesh segments and agents to collide with.
-	for (int i = 0; i < nagents; ++i)
+void dtCrowd::updateBoundaries(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 
@@ -1082,23 +1268,28 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		// if it has become invalid.
 		const float updateThr = ag->params.collisionQueryRange*0.25f;
 		if (dtVdist2DSqr(ag->npos, ag->boundary.getCenter()) > dtSqr(updateThr) ||
-			!ag->boundary.isValid(m_navquery, &m_filters[ag->params.queryFilterType]))
+			!ag->boundary.isValid(ctx.navquery, &m_filters[ag->params.queryFilterType]))
 		{
 			ag->boundary.update(ag->corridor.getFirstPoly(), ag->npos, ag->params.collisionQueryRange,
-								m_navquery, &m_filters[ag->params.queryFilterType]);
+								ctx.navquery, &m_filters[ag->params.queryFilterType]);
 		}
 		// Query neighbour agents
 		ag->nneis = getNeighbours(ag->npos, ag->params.height, ag->params.collisionQueryRange,
-								  ag, ag->neis, DT_CROWDAGENT_MAX_NEIGHBOURS,
-								  agents, nagents, m_grid);
+								  ag, ag->neis, m_maxNeighbours,
+								  state.agents, state.nagents, m_grid,
+								  ctx.neighbourIds, m_maxNeighbourIds);
 		for (int j = 0; j < ag->nneis; j++)
-			ag->neis[j].idx = getAgentIndex(agents[ag->neis[j].idx]);
+			ag->neis[j].idx = getAgentIndex(state.agents[ag->neis[j].idx]);
 	}
+}
+
+void dtCrowd::updateCorners(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
+{
+	const int debugIdx = state.debug ? state.debug->idx : -1;
 	
-	// Find next corner to steer to.
-	for (int i = 0; i < nagents; ++i)
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
@@ -1107,20 +1298,20 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		
 		// Find corners for steering
 		ag->ncorners = ag->corridor.findCorners(ag->cornerVerts, ag->cornerFlags, ag->cornerPolys,
-												DT_CROWDAGENT_MAX_CORNERS, m_navquery, &m_filters[ag->params.queryFilterType]);
+												m_maxCorners, ctx.navquery, &m_filters[ag->params.queryFilterType]);
 		
 		// Check to see if the corner after the next corner is directly visible,
 		// and short cut to there.
 		if ((ag->params.updateFlags & DT_CROWD_OPTIMIZE_VIS) && ag->ncorners > 0)
 		{
 			const float* target = &ag->cornerVerts[dtMin(1,ag->ncorners-1)*3];
-			ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, m_navquery, &m_filters[ag->params.queryFilterType]);
+			ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, ctx.navquery, &m_filters[ag->params.queryFilterType]);
 			
 			// Copy data for debug purposes.
 			if (debugIdx == i)
 			{
-				dtVcopy(debug->optStart, ag->corridor.getPos());
-				dtVcopy(debug->optEnd, target);
+				dtVcopy(state.debug->optStart, ag->corridor.getPos());
+				dtVcopy(state.debug->optEnd, target);
 			}
 		}
 		else
@@ -1128,16 +1319,18 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			// Copy data for debug purposes.
 			if (debugIdx == i)
 			{
-				dtVset(debug->optStart, 0,0,0);
-				dtVset(debug->optEnd, 0,0,0);
+				dtVset(state.debug->optStart, 0,0,0);
+				dtVset(state.debug->optEnd, 0,0,0);
 			}
 		}
 	}
-	
-	// Trigger off-mesh connections (depends on corners).
-	for (int i = 0; i < nagents; ++i)
+}
+
+void dtCrowd::triggerOffMeshConnections(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
@@ -1155,7 +1348,7 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			// Adjust the path over the off-mesh connection.
 			dtPolyRef refs[2];
 			if (ag->corridor.moveOverOffmeshConnection(ag->cornerPolys[ag->ncorners-1], refs,
-													   anim->startPos, anim->endPos, m_navquery))
+													   anim->startPos, anim->endPos, ctx.navquery))
 			{
 				dtVcopy(anim->initPos, ag->npos);
 				anim->polyRef = refs[1];
@@ -1174,11 +1367,13 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			}
 		}
 	}
-		
-	// Calculate steering.
-	for (int i = 0; i < nagents; ++i)
+}
+
+void dtCrowd::updateSteering(const UpdateState& state, ThreadContext& /*ctx*/, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
@@ -1253,24 +1448,29 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		// Set the desired velocity.
 		dtVcopy(ag->dvel, dvel);
 	}
+}
+
+void dtCrowd::planVelocities(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
+{
+	const int debugIdx = state.debug ? state.debug->idx : -1;
+	dtObstacleAvoidanceQuery* obstacleQuery = ctx.obstacleQuery;
 	
-	// Velocity planning.	
-	for (int i = 0; i < nagents; ++i)
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 		
 		if (ag->params.updateFlags & DT_CROWD_OBSTACLE_AVOIDANCE)
 		{
-			m_obstacleQuery->reset();
+			obstacleQuery->reset();
 			
 			// Add neighbours as obstacles.
 			for (int j = 0; j < ag->nneis; ++j)
 			{
 				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				m_obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
+				obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
 			}
 
 			// Append neighbour segments as obstacles.
@@ -1279,12 +1479,12 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				const float* s = ag->boundary.getSegment(j);
 				if (dtTriArea2D(ag->npos, s, s+3) < 0.0f)
 					continue;
-				m_obstacleQuery->addSegment(s, s+3);
+				obstacleQuery->addSegment(s, s+3);
 			}
 
 			dtObstacleAvoidanceDebugData* vod = 0;
 			if (debugIdx == i) 
-				vod = debug->vod;
+				vod = state.debug->vod;
 			
 			// Sample new safe velocity.
 			bool adaptive = true;
@@ -1294,15 +1494,15 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				
 			if (adaptive)
 			{
-				ns = m_obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
-															 ag->vel, ag->dvel, ag->nvel, params, vod);
+				ns = obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
+														   ag->vel, ag->dvel, ag->nvel, params, vod);
 			}
 			else
 			{
-				ns = m_obstacleQuery->sampleVelocityGrid(ag->npos, ag->params.radius, ag->desiredSpeed,
-														 ag->vel, ag->dvel, ag->nvel, params, vod);
+				ns = obstacleQuery->sampleVelocityGrid(ag->npos, ag->params.radius, ag->desiredSpeed,
+													   ag->vel, ag->dvel, ag->nvel, params, vod);
 			}
-			m_velocitySampleCount += ns;
+			ctx.velocitySampleCount += ns;
 		}
 		else
 		{
@@ -1310,91 +1510,98 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			dtVcopy(ag->nvel, ag->dvel);
 		}
 	}
+}
 
-	// Integrate.
-	for (int i = 0; i < nagents; ++i)
+void dtCrowd::integrateAgents(const UpdateState& state, ThreadContext& /*ctx*/, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
-		integrate(ag, dt);
+		integrate(ag, state.dt);
 	}
-	
-	// Handle collisions.
+}
+
+void dtCrowd::calcCollisionDisplacements(const UpdateState& state, ThreadContext& /*ctx*/, const int begin, const int end)
+{
 	static const float COLLISION_RESOLVE_FACTOR = 0.7f;
 	
-	for (int iter = 0; iter < 4; ++iter)
+	for (int i = begin; i < end; ++i)
 	{
-		for (int i = 0; i < nagents; ++i)
+		dtCrowdAgent* ag = state.agents[i];
+		const int idx0 = getAgentIndex(ag);
+		
+		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+
+		dtVset(ag->disp, 0,0,0);
+		
+		float w = 0;
+
+		for (int j = 0; j < ag->nneis; ++j)
 		{
-			dtCrowdAgent* ag = agents[i];
-			const int idx0 = getAgentIndex(ag);
-			
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
+			const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
+			const int idx1 = getAgentIndex(nei);
 
-			dtVset(ag->disp, 0,0,0);
+			float diff[3];
+			dtVsub(diff, ag->npos, nei->npos);
+			diff[1] = 0;
 			
-			float w = 0;
-
-			for (int j = 0; j < ag->nneis; ++j)
+			float dist = dtVlenSqr(diff);
+			if (dist > dtSqr(ag->params.radius + nei->params.radius))
+				continue;
+			dist = dtMathSqrtf(dist);
+			float pen = (ag->params.radius + nei->params.radius) - dist;
+			if (dist < 0.0001f)
 			{
-				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				const int idx1 = getAgentIndex(nei);
-
-				float diff[3];
-				dtVsub(diff, ag->npos, nei->npos);
-				diff[1] = 0;
-				
-				float dist = dtVlenSqr(diff);
-				if (dist > dtSqr(ag->params.radius + nei->params.radius))
-					continue;
-				dist = dtMathSqrtf(dist);
-				float pen = (ag->params.radius + nei->params.radius) - dist;
-				if (dist < 0.0001f)
-				{
-					// Agents on top of each other, try to choose diverging separation directions.
-					if (idx0 > idx1)
-						dtVset(diff, -ag->dvel[2],0,ag->dvel[0]);
-					else
-						dtVset(diff, ag->dvel[2],0,-ag->dvel[0]);
-					pen = 0.01f;
-				}
+				// Agents on top of each other, try to choose diverging separation directions.
+				if (idx0 > idx1)
+					dtVset(diff, -ag->dvel[2],0,ag->dvel[0]);
 				else
-				{
-					pen = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
-				}
-				
-				dtVmad(ag->disp, ag->disp, diff, pen);			
-				
-				w += 1.0f;
+					dtVset(diff, ag->dvel[2],0,-ag->dvel[0]);
+				pen = 0.01f;
 			}
-			
-			if (w > 0.0001f)
+			else
 			{
-				const float iw = 1.0f / w;
-				dtVscale(ag->disp, ag->disp, iw);
+				pen = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
 			}
+			
+			dtVmad(ag->disp, ag->disp, diff, pen);			
+			
+			w += 1.0f;
 		}
 		
-		for (int i = 0; i < nagents; ++i)
+		if (w > 0.0001f)
 		{
-			dtCrowdAgent* ag = agents[i];
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
-			
-			dtVadd(ag->npos, ag->npos, ag->disp);
+			const float iw = 1.0f / w;
+			dtVscale(ag->disp, ag->disp, iw);
 		}
 	}
-	
-	for (int i = 0; i < nagents; ++i)
+}
+
+void dtCrowd::applyCollisionDisplacements(const UpdateState& state, ThreadContext& /*ctx*/, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		dtCrowdAgent* ag = state.agents[i];
+		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+		
+		dtVadd(ag->npos, ag->npos, ag->disp);
+	}
+}
+
+void dtCrowd::moveAgents(const UpdateState& state, ThreadContext& ctx, const int begin, const int end)
+{
+	for (int i = begin; i < end; ++i)
+	{
+		dtCrowdAgent* ag = state.agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 		
 		// Move along navmesh.
-		ag->corridor.movePosition(ag->npos, m_navquery, &m_filters[ag->params.queryFilterType]);
+		ag->corridor.movePosition(ag->npos, ctx.navquery, &m_filters[ag->params.queryFilterType]);
 		// Get valid constrained position back.
 		dtVcopy(ag->npos, ag->corridor.getPos());
 
@@ -1404,9 +1611,73 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			ag->corridor.reset(ag->corridor.getFirstPoly(), ag->npos);
 			ag->partial = false;
 		}
+	}
+}
+
+/// @par
+///
+/// The per agent phases are run through the function set with #setParallelFor(), each phase
+/// completing for all agents before the next one starts.
+void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
+{
+	m_velocitySampleCount = 0;
+	
+	UpdateState state;
+	state.agents = m_activeAgents;
+	state.nagents = getActiveAgents(m_activeAgents, m_maxAgents);
+	state.dt = dt;
+	state.debug = debug;
+
+	dtCrowdAgent** agents = state.agents;
+	const int nagents = state.nagents;
+
+	// Check that all agents still have valid paths.
+	runPhase(&dtCrowd::checkPathValidity, state);
+	
+	// Update async move request and path finder.
+	updateMoveRequest(dt);
 
+	// Optimize path topology.
+	updateTopologyOptimization(agents, nagents, dt);
+	
+	// Register agents to proximity grid.
+	m_grid->clear();
+	for (int i = 0; i < nagents; ++i)
+	{
+		dtCrowdAgent* ag = agents[i];
+		const float* p = ag->npos;
+		const float r = ag->params.radius;
+		m_grid->addItem(i, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
+	}
+	
+	// Get nearby navmesh segments and agents to collide with.
+	runPhase(&dtCrowd::updateBoundaries, state);
+	
+	// Find next corner to steer to.
+	runPhase(&dtCrowd::updateCorners, state);
+	
+	// Trigger off-mesh connections (depends on corners).
+	runPhase(&dtCrowd::triggerOffMeshConnections, state);
+		
+	// Calculate steering.
+	runPhase(&dtCrowd::updateSteering, state);
+	
+	// Velocity planning.	
+	runPhase(&dtCrowd::planVelocities, state);
+
+	// Integrate.
+	runPhase(&dtCrowd::integrateAgents, state);
+	
+	// Handle collisions.
+	for (int iter = 0; iter < 4; ++iter)
+	{
+		runPhase(&dtCrowd::calcCollisionDisplacements, state);
+		runPhase(&dtCrowd::applyCollisionDisplacements, state);
 	}
 	
+	// Move along navmesh.
+	runPhase(&dtCrowd::moveAgents, state);
+	
 	// Update agents using off-mesh connection.
 	for (int i = 0; i < nagents; ++i)
 	{
@@ -200,7 +200,12 @@ may be needed.  E.g. If you move the target, check #getLastPoly() to see if it i
 dtPathCorridor::dtPathCorridor() :
 	m_path(0),
 	m_npath(0),
-	m_maxPath(0)
+	m_maxPath(0),
+	m_portalPath(0),
+	m_portalVerts(0),
+	m_portalPolys(0),
+	m_nportals(0),
+	m_portalRevision(0)
 {
 }
 
@@ -215,11 +220,19 @@ dtPathCorridor::~dtPathCorridor()
 bool dtPathCorridor::init(const int maxPath)
 {
 	dtAssert(!m_path);
-	m_path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*maxPath, DT_ALLOC_PERM);
-	if (!m_path)
+	// The path and the portal data share one allocation.
+	const int pathSize = sizeof(dtPolyRef)*maxPath;
+	const int vertsSize = sizeof(float)*maxPath*6;
+	unsigned char* data = (unsigned char*)dtAlloc(pathSize*2 + vertsSize + maxPath*2, DT_ALLOC_PERM);
+	if (!data)
 		return false;
+	m_path = (dtPolyRef*)data;
+	m_portalPath = (dtPolyRef*)(data + pathSize);
+	m_portalVerts = (float*)(data + pathSize*2);
+	m_portalPolys = data + pathSize*2 + vertsSize;
 	m_npath = 0;
 	m_maxPath = maxPath;
+	m_nportals = 0;
 	return true;
 }
 
@@ -247,6 +260,12 @@ For example: If the buffers are sized to hold 10 corners, the function will neve
 So if 10 corners are needed, the buffers should be sized for 11 corners.
 
 If the target is within range, it will be the last corner and have a polygon reference id of zero.
+
+The portals of the corridor are kept between calls. Only the portals of the part of the path that 
+changed since the previous call, for example by #movePosition() or #optimizePathVisibility(), are 
+looked up again, and only as far along the path as the corners reach. All portals are looked up 
+again when the revision of the navigation mesh changed. The corners are the same as 
+#dtNavMeshQuery::findStraightPath() finds for the whole path.
 */
 int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 							  dtPolyRef* cornerPolys, const int maxCorners,
@@ -257,9 +276,19 @@ int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 	
 	static const float MIN_TARGET_DIST = 0.01f;
 	
+	updatePortals(navquery->getAttachedNavMesh());
+	
 	int ncorners = 0;
-	navquery->findStraightPath(m_pos, m_target, m_path, m_npath,
-							   cornerVerts, cornerFlags, cornerPolys, &ncorners, maxCorners);
+	for (;;)
+	{
+		const dtStatus status = navquery->findStraightPath(m_pos, m_target, m_path, m_npath,
+														   m_portalVerts, &m_portalVerts[m_maxPath*3],
+														   m_portalPolys, &m_portalPolys[m_maxPath], m_nportals,
+														   cornerVerts, cornerFlags, cornerPolys, &ncorners, maxCorners);
+		// The funnel ran past the gathered portals, gather more and try again.
+		if (!dtStatusDetail(status, DT_OUT_OF_PORTALS) || !gatherPortals(navquery))
+			break;
+	}
 	
 	// Prune points in the beginning of the path which are too close.
 	while (ncorners)
@@ -289,6 +318,62 @@ int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 	return ncorners;
 }
 
+void dtPathCorridor::updatePortals(const dtNavMesh* nav)
+{
+	// A changed tile can keep its polygon refs, so the refs alone do not tell if the portals are current.
+	if (nav->getRevision() != m_portalRevision)
+	{
+		m_portalRevision = nav->getRevision();
+		m_nportals = 0;
+		return;
+	}
+	if (!m_nportals)
+		return;
+	
+	// Find the first polygon of the path, the start has usually moved forward along the gathered path.
+	int first = 0;
+	while (first <= m_nportals && m_portalPath[first] != m_path[0])
+		first++;
+	if (first > m_nportals)
+	{
+		m_nportals = 0;
+		return;
+	}
+	
+	// Keep the portals up to the first change.
+	int n = 0;
+	while (first+n < m_nportals && n+1 < m_npath && m_portalPath[first+n+1] == m_path[n+1])
+		n++;
+	if (first > 0 && n > 0)
+	{
+		memmove(m_portalPath, m_portalPath+first, sizeof(dtPolyRef)*(n+1));
+		memmove(m_portalVerts, m_portalVerts+first*3, sizeof(float)*3*n);
+		memmove(m_portalVerts+m_maxPath*3, m_portalVerts+(m_maxPath+first)*3, sizeof(float)*3*n);
+		memmove(m_portalPolys, m_portalPolys+first, n+1);
+		memmove(m_portalPolys+m_maxPath, m_portalPolys+m_maxPath+first, n+1);
+	}
+	m_nportals = n;
+}
+
+bool dtPathCorridor::gatherPortals(dtNavMeshQuery* navquery)
+{
+	static const int MIN_GATHER = 8;
+	
+	const int start = m_nportals;
+	if (start >= m_npath-1)
+		return false;
+	
+	// Gather at least as many portals as there are already, so that a long funnel 
+	// is not rerun too often.
+	const int end = dtMin(m_npath-1, start + dtMax(start, MIN_GATHER));
+	const int n = navquery->getPathPortals(&m_path[start], end-start+1,
+										   &m_portalVerts[start*3], &m_portalVerts[(m_maxPath+start)*3],
+										   &m_portalPolys[start], &m_portalPolys[m_maxPath+start]);
+	memcpy(&m_portalPath[start], &m_path[start], sizeof(dtPolyRef)*(n+1));
+	m_nportals = start+n;
+	return n > 0;
+}
+
 /** 
 @par
 
@@ -25,13 +25,13 @@
 
 
 dtPathQueue::dtPathQueue() :
+	m_queue(0),
+	m_maxQueue(0),
 	m_nextHandle(1),
 	m_maxPathSize(0),
 	m_queueHead(0),
 	m_navquery(0)
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
-		m_queue[i].path = 0;
 }
 
 dtPathQueue::~dtPathQueue()
@@ -43,25 +43,35 @@ void dtPathQueue::purge()
 {
 	dtFreeNavMeshQuery(m_navquery);
 	m_navquery = 0;
-	for (int i = 0; i < MAX_QUEUE; ++i)
-	{
+	for (int i = 0; i < m_maxQueue; ++i)
 		dtFree(m_queue[i].path);
-		m_queue[i].path = 0;
-	}
+	dtFree(m_queue);
+	m_queue = 0;
+	m_maxQueue = 0;
 }
 
-bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav)
+bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav,
+					   const int maxQueue)
 {
 	purge();
 
+	if (maxQueue < 1)
+		return false;
+
 	m_navquery = dtAllocNavMeshQuery();
 	if (!m_navquery)
 		return false;
 	if (dtStatusFailed(m_navquery->init(nav, maxSearchNodeCount)))
 		return false;
 	
+	m_queue = (PathQuery*)dtAlloc(sizeof(PathQuery)*maxQueue, DT_ALLOC_PERM);
+	if (!m_queue)
+		return false;
+	memset(m_queue, 0, sizeof(PathQuery)*maxQueue);
+	m_maxQueue = maxQueue;
+	
 	m_maxPathSize = maxPathSize;
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	for (int i = 0; i < m_maxQueue; ++i)
 	{
 		m_queue[i].ref = DT_PATHQ_INVALID;
 		m_queue[i].path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathSize, DT_ALLOC_PERM);
@@ -82,9 +92,9 @@ void dtPathQueue::update(const int maxIters)
 	// or upto maxIters pathfinder iterations has been consumed.
 	int iterCount = maxIters;
 	
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	for (int i = 0; i < m_maxQueue; ++i)
 	{
-		PathQuery& q = m_queue[m_queueHead % MAX_QUEUE];
+		PathQuery& q = m_queue[m_queueHead % m_maxQueue];
 		
 		// Skip inactive requests.
 		if (q.ref == DT_PATHQ_INVALID)
@@ -138,7 +148,7 @@ dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 {
 	// Find empty slot
 	int slot = -1;
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	for (int i = 0; i < m_maxQueue; ++i)
 	{
 		if (m_queue[i].ref == DT_PATHQ_INVALID)
 		{
@@ -170,7 +180,7 @@ dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 
 dtStatus dtPathQueue::getRequestStatus(dtPathQueueRef ref) const
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	for (int i = 0; i < m_maxQueue; ++i)
 	{
 		if (m_queue[i].ref == ref)
 			return m_queue[i].status;
@@ -180,7 +190,7 @@ dtStatus dtPathQueue::getRequestStatus(dtPathQueueRef ref) const
 
 dtStatus dtPathQueue::getPathResult(dtPathQueueRef ref, dtPolyRef* path, int* pathSize, const int maxPath)
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	for (int i = 0; i < m_maxQueue; ++i)
 	{
 		if (m_queue[i].ref == ref)
 		{
@@ -1088,6 +1088,47 @@ int rcGetHeightFieldSpanCount(rcContext* context, const rcHeightfield& heightfie
 bool rcBuildCompactHeightfield(rcContext* context, int walkableHeight, int walkableClimb,
 							   const rcHeightfield& heightfield, rcCompactHeightfield& compactHeightfield);
 
+/// Copies a compact heightfield.
+///
+/// The compact heightfield depends on the agent height and climb, but not on the agent radius. 
+/// Navigation meshes for agents that differ only in radius can share the rasterization and 
+/// compaction steps, and copy the result before eroding it with #rcErodeWalkableArea.
+///
+/// @see rcAllocCompactHeightfield, rcBuildCompactHeightfield
+/// @ingroup recast
+///
+/// @param[in,out]	context		The build context to use during the operation.
+/// @param[in]		src			The compact heightfield to copy.
+/// @param[out]		dst			The resulting copy. (Must be pre-allocated, must be empty.)
+/// @returns True if the operation completed successfully.
+bool rcCopyCompactHeightfield(rcContext* context, const rcCompactHeightfield& src, rcCompactHeightfield& dst);
+
+/// Builds one eroded compact heightfield for each of several agent radii.
+///
+/// The heightfield is compacted once, then copied and eroded with #rcErodeWalkableArea for 
+/// each radius. The results are the same as building and eroding a compact heightfield for 
+/// each radius separately. The remaining steps, starting with #rcBuildDistanceField or 
+/// #rcBuildRegionsMonotone, are run on each result as usual.
+///
+/// @see rcBuildCompactHeightfield, rcCopyCompactHeightfield, rcErodeWalkableArea
+/// @ingroup recast
+///
+/// @param[in,out]	context				The build context to use during the operation.
+/// @param[in]		walkableHeight		Minimum floor to 'ceiling' height that will still allow the floor area 
+/// 									to be considered walkable. [Limit: >= 3] [Units: vx]
+/// @param[in]		walkableClimb		Maximum ledge height that is considered to still be traversable. 
+/// 									[Limit: >=0] [Units: vx]
+/// @param[in]		heightfield			The heightfield to be compacted.
+/// @param[in]		walkableRadii		The erosion radius of each agent. [Limits: 0 <= value < 255] [Units: vx] 
+/// 									[Size: @p radiusCount]
+/// @param[in]		radiusCount			The number of radii. [Limit: > 0]
+/// @param[out]		compactHeightfields	The resulting compact heightfields. (Must be pre-allocated.) 
+/// 									[Size: @p radiusCount]
+/// @returns True if the operation completed successfully.
+bool rcBuildCompactHeightfields(rcContext* context, int walkableHeight, int walkableClimb,
+								const rcHeightfield& heightfield, const int* walkableRadii, int radiusCount,
+								rcCompactHeightfield** compactHeightfields);
+
 /// Erodes the walkable area within the heightfield by the specified radius.
 /// 
 /// Basically, any spans that are closer to a boundary or obstruction than the specified radius 
@@ -540,3 +540,97 @@ bool rcBuildCompactHeightfield(rcContext* context, const int walkableHeight, con
 
 	return true;
 }
+
+bool rcCopyCompactHeightfield(rcContext* context, const rcCompactHeightfield& src, rcCompactHeightfield& dst)
+{
+	rcAssert(context);
+
+	// Destination must be empty.
+	rcAssert(dst.cells == 0);
+	rcAssert(dst.spans == 0);
+	rcAssert(dst.dist == 0);
+	rcAssert(dst.areas == 0);
+
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.spanCount = src.spanCount;
+	dst.walkableHeight = src.walkableHeight;
+	dst.walkableClimb = src.walkableClimb;
+	dst.borderSize = src.borderSize;
+	dst.maxDistance = src.maxDistance;
+	dst.maxRegions = src.maxRegions;
+	rcVcopy(dst.bmin, src.bmin);
+	rcVcopy(dst.bmax, src.bmax);
+	dst.cs = src.cs;
+	dst.ch = src.ch;
+
+	const int cellCount = src.width * src.height;
+	dst.cells = (rcCompactCell*)rcAlloc(sizeof(rcCompactCell) * cellCount, RC_ALLOC_PERM);
+	if (!dst.cells)
+	{
+		context->log(RC_LOG_ERROR, "rcCopyCompactHeightfield: Out of memory 'dst.cells' (%d)", cellCount);
+		return false;
+	}
+	memcpy(dst.cells, src.cells, sizeof(rcCompactCell) * cellCount);
+
+	dst.spans = (rcCompactSpan*)rcAlloc(sizeof(rcCompactSpan) * src.spanCount, RC_ALLOC_PERM);
+	if (!dst.spans)
+	{
+		context->log(RC_LOG_ERROR, "rcCopyCompactHeightfield: Out of memory 'dst.spans' (%d)", src.spanCount);
+		return false;
+	}
+	memcpy(dst.spans, src.spans, sizeof(rcCompactSpan) * src.spanCount);
+
+	dst.areas = (unsigned char*)rcAlloc(sizeof(unsigned char) * src.spanCount, RC_ALLOC_PERM);
+	if (!dst.areas)
+	{
+		context->log(RC_LOG_ERROR, "rcCopyCompactHeightfield: Out of memory 'dst.areas' (%d)", src.spanCount);
+		return false;
+	}
+	memcpy(dst.areas, src.areas, sizeof(unsigned char) * src.spanCount);
+
+	if (src.dist)
+	{
+		dst.dist = (unsigned short*)rcAlloc(sizeof(unsigned short) * src.spanCount, RC_ALLOC_PERM);
+		if (!dst.dist)
+		{
+			context->log(RC_LOG_ERROR, "rcCopyCompactHeightfield: Out of memory 'dst.dist' (%d)", src.spanCount);
+			return false;
+		}
+		memcpy(dst.dist, src.dist, sizeof(unsigned short) * src.spanCount);
+	}
+
+	return true;
+}
+
+bool rcBuildCompactHeightfields(rcContext* context, const int walkableHeight, const int walkableClimb,
+								const rcHeightfield& heightfield, const int* walkableRadii, const int radiusCount,
+								rcCompactHeightfield** compactHeightfields)
+{
+	rcAssert(context);
+	rcAssert(radiusCount > 0);
+
+	if (!rcBuildCompactHeightfield(context, walkableHeight, walkableClimb, heightfield, *compactHeightfields[0]))
+	{
+		return false;
+	}
+
+	// Copy before eroding, everything up to here is shared by all radii.
+	for (int i = 1; i < radiusCount; ++i)
+	{
+		if (!rcCopyCompactHeightfield(context, *compactHeightfields[0], *compactHeightfields[i]))
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < radiusCount; ++i)
+	{
+		if (walkableRadii[i] > 0 && !rcErodeWalkableArea(context, walkableRadii[i], *compactHeightfields[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
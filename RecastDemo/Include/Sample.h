@@ -139,6 +139,16 @@ protected:
 	dtNavMesh* loadAll(const char* path);
 	void saveAll(const char* path, const dtNavMesh* mesh);
 
+private:
+	// The mapped navmesh set the tiles of the last loaded mesh point into.
+	unsigned char* m_navMeshFileData;
+	size_t m_navMeshFileSize;
+	bool m_navMeshFileMapped;
+
+	bool mapNavMeshFile(const char* path);
+	void releaseNavMeshFile();
+	dtNavMesh* loadMappedTiles(const char* path);
+
 public:
 	Sample();
 	virtual ~Sample();
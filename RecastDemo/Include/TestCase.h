@@ -49,6 +49,12 @@ class TestCase
 			findNearestPolyTime(0),
 			findPathTime(0),
 			findStraightPathTime(0),
+			expandedNodes(0),
+			anyAngleExpandedNodes(0),
+			anyAngleRaycasts(0),
+			anyAngleCachedRaycasts(0),
+			anyAngleStraight(0),
+			findPathAnyAngleTime(0),
 			next(0)
 		{
 		}
@@ -77,6 +83,14 @@ class TestCase
 		int findNearestPolyTime;
 		int findPathTime;
 		int findStraightPathTime;
+
+		// Regular and any-angle path search comparison.
+		int expandedNodes;
+		int anyAngleExpandedNodes;
+		int anyAngleRaycasts;
+		int anyAngleCachedRaycasts;
+		int anyAngleStraight;
+		int findPathAnyAngleTime;
 		
 		Test* next;
 	private:
@@ -41,8 +41,13 @@
 #include "QuadTree.h"
 #include <fstream>
 
-#ifdef WIN32
+#ifdef _WIN32
 #	define snprintf _snprintf
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
 #endif
 
 extern bool g_showBlock;
@@ -166,7 +171,10 @@ Sample::Sample() :
 	m_filterLedgeSpans(true),
 	m_filterWalkableLowHeightSpans(true),
 	m_tool(0),
-	m_ctx(0)
+	m_ctx(0),
+	m_navMeshFileData(0),
+	m_navMeshFileSize(0),
+	m_navMeshFileMapped(false)
 {
 	resetCommonSettings();
 	m_navQuery = dtAllocNavMeshQuery();
@@ -180,6 +188,7 @@ Sample::~Sample()
 {
 	dtFreeNavMeshQuery(m_navQuery);
 	dtFreeNavMesh(m_navMesh);
+	releaseNavMeshFile();
 	dtFreeCrowd(m_crowd);
 	delete m_tool;
 	for (int i = 0; i < MAX_TOOLS; i++)
@@ -443,7 +452,11 @@ void Sample::renderOverlayToolStates(double* proj, double* model, int* view)
 }
 
 static const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
-static const int NAVMESHSET_VERSION = 1;
+static const int NAVMESHSET_VERSION = 2;
+
+// Version 2 sets start the data of each tile at a multiple of this, so that the 
+// file can be memory mapped and the tiles used in place.
+static const int NAVMESHSET_TILE_ALIGN = 4096;
 
 struct NavMeshSetHeader
 {
@@ -459,6 +472,116 @@ struct NavMeshTileHeader
 	int dataSize;
 };
 
+static size_t alignNavMeshSetOffset(const size_t offset)
+{
+	return (offset + NAVMESHSET_TILE_ALIGN-1) & ~(size_t)(NAVMESHSET_TILE_ALIGN-1);
+}
+
+void Sample::releaseNavMeshFile()
+{
+	if (!m_navMeshFileData)
+		return;
+#ifndef _WIN32
+	if (m_navMeshFileMapped)
+		munmap(m_navMeshFileData, m_navMeshFileSize);
+	else
+#endif
+		dtFree(m_navMeshFileData);
+	m_navMeshFileData = 0;
+	m_navMeshFileSize = 0;
+	m_navMeshFileMapped = false;
+}
+
+// Maps the whole file read-only, or reads it if mapping is not available.
+bool Sample::mapNavMeshFile(const char* path)
+{
+	releaseNavMeshFile();
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* mapped = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+	m_navMeshFileData = (unsigned char*)mapped;
+	m_navMeshFileSize = (size_t)st.st_size;
+	m_navMeshFileMapped = true;
+	return true;
+#else
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size <= 0)
+	{
+		fclose(fp);
+		return false;
+	}
+	unsigned char* data = (unsigned char*)dtAlloc((size_t)size, DT_ALLOC_PERM);
+	if (!data || fread(data, (size_t)size, 1, fp) != 1)
+	{
+		dtFree(data);
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+	m_navMeshFileData = data;
+	m_navMeshFileSize = (size_t)size;
+	return true;
+#endif
+}
+
+// Adds the tiles of a version 2 set in place, the file stays mapped until the next load.
+dtNavMesh* Sample::loadMappedTiles(const char* path)
+{
+	if (!mapNavMeshFile(path))
+		return 0;
+	if (m_navMeshFileSize < sizeof(NavMeshSetHeader))
+	{
+		releaseNavMeshFile();
+		return 0;
+	}
+
+	NavMeshSetHeader header;
+	memcpy(&header, m_navMeshFileData, sizeof(NavMeshSetHeader));
+
+	dtNavMesh* mesh = dtAllocNavMesh();
+	if (!mesh || dtStatusFailed(mesh->init(&header.params)))
+	{
+		dtFreeNavMesh(mesh);
+		releaseNavMeshFile();
+		return 0;
+	}
+
+	size_t offset = sizeof(NavMeshSetHeader);
+	for (int i = 0; i < header.numTiles; ++i)
+	{
+		NavMeshTileHeader tileHeader;
+		if (offset + sizeof(tileHeader) > m_navMeshFileSize)
+			break;
+		memcpy(&tileHeader, m_navMeshFileData + offset, sizeof(tileHeader));
+		offset = alignNavMeshSetOffset(offset + sizeof(tileHeader));
+
+		if (!tileHeader.tileRef || tileHeader.dataSize <= 0 || offset + tileHeader.dataSize > m_navMeshFileSize)
+			break;
+
+		mesh->addTile(m_navMeshFileData + offset, tileHeader.dataSize, DT_TILE_READ_ONLY_DATA, tileHeader.tileRef, 0);
+		offset += tileHeader.dataSize;
+	}
+
+	return mesh;
+}
+
 dtNavMesh* Sample::loadAll(const char* path)
 {
 	FILE* fp = fopen(path, "rb");
@@ -477,7 +600,12 @@ dtNavMesh* Sample::loadAll(const char* path)
 		fclose(fp);
 		return 0;
 	}
-	if (header.version != NAVMESHSET_VERSION)
+	if (header.version == NAVMESHSET_VERSION)
+	{
+		fclose(fp);
+		return loadMappedTiles(path);
+	}
+	if (header.version != 1)
 	{
 		fclose(fp);
 		return 0;
@@ -533,7 +661,10 @@ void Sample::saveAll(const char* path, const dtNavMesh* mesh)
 {
 	if (!mesh) return;
 
-	FILE* fp = fopen(path, "wb");
+	// The tiles may point into a mapping of the same file, write a new file and replace it when done.
+	char tmpPath[1024];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	FILE* fp = fopen(tmpPath, "wb");
 	if (!fp)
 		return;
 
@@ -545,27 +676,55 @@ void Sample::saveAll(const char* path, const dtNavMesh* mesh)
 	for (int i = 0; i < mesh->getMaxTiles(); ++i)
 	{
 		const dtMeshTile* tile = mesh->getTile(i);
-		if (!tile || !tile->header || !tile->dataSize) continue;
+		if (!tile || !tile->header || !tile->dataSize || (tile->flags & DT_TILE_RETIRED)) continue;
 		header.numTiles++;
 	}
 	memcpy(&header.params, mesh->getParams(), sizeof(dtNavMeshParams));
 	fwrite(&header, sizeof(NavMeshSetHeader), 1, fp);
+	size_t offset = sizeof(NavMeshSetHeader);
 
 	// Store tiles.
 	for (int i = 0; i < mesh->getMaxTiles(); ++i)
 	{
 		const dtMeshTile* tile = mesh->getTile(i);
-		if (!tile || !tile->header || !tile->dataSize) continue;
+		if (!tile || !tile->header || !tile->dataSize || (tile->flags & DT_TILE_RETIRED)) continue;
 
 		NavMeshTileHeader tileHeader;
 		tileHeader.tileRef = mesh->getTileRef(tile);
 		tileHeader.dataSize = tile->dataSize;
 		fwrite(&tileHeader, sizeof(tileHeader), 1, fp);
+		offset += sizeof(tileHeader);
 
-		fwrite(tile->data, tile->dataSize, 1, fp);
+		// Pad the data to the next page.
+		static const unsigned char padding[NAVMESHSET_TILE_ALIGN] = { 0 };
+		const size_t paddingSize = alignNavMeshSetOffset(offset) - offset;
+		if (paddingSize)
+			fwrite(padding, paddingSize, 1, fp);
+		offset += paddingSize;
+
+		if (tile->linkData)
+		{
+			// The polygons of tiles used in place are kept apart from the data, store the current flags and areas.
+			const int polysOffset = dtGetMeshHeaderSize(tile->header->version) + dtAlign4(sizeof(float)*3*tile->header->vertCount);
+			const int polysSize = sizeof(dtPoly)*tile->header->polyCount;
+			fwrite(tile->data, polysOffset, 1, fp);
+			fwrite(tile->polys, polysSize, 1, fp);
+			fwrite(tile->data + polysOffset + polysSize, tile->dataSize - polysOffset - polysSize, 1, fp);
+		}
+		else
+		{
+			fwrite(tile->data, tile->dataSize, 1, fp);
+		}
+		offset += tile->dataSize;
 	}
 
 	fclose(fp);
+
+#ifdef _WIN32
+	// rename() does not replace an existing file on Windows.
+	remove(path);
+#endif
+	rename(tmpPath, path);
 }
 
 extern void sortLinks(int* links, int linkSize);
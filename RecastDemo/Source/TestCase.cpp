@@ -191,6 +191,7 @@ void TestCase::resetTimes()
 		iter->findNearestPolyTime = 0;
 		iter->findPathTime = 0;
 		iter->findStraightPathTime = 0;
+		iter->findPathAnyAngleTime = 0;
 	}
 }
 
@@ -237,10 +238,34 @@ void TestCase::doTests(dtNavMesh* navmesh, dtNavMeshQuery* navquery)
 			// Find path
 			TimeVal findPathStart = getPerfTime();
 
-			navquery->findPath(startRef, endRef, iter->spos, iter->epos, &filter, polys, &iter->npolys, MAX_POLYS);
+			dtFindPathStats stats;
+			navquery->findPath(startRef, endRef, iter->spos, iter->epos, &filter, polys, &iter->npolys, MAX_POLYS,
+							   0, &stats);
 			
 			TimeVal findPathEnd = getPerfTime();
 			iter->findPathTime += getPerfTimeUsec(findPathEnd - findPathStart);
+			iter->expandedNodes = stats.expandedNodes;
+
+			// Compare with an any-angle search.
+			{
+				dtPolyRef anyAnglePolys[MAX_POLYS];
+				int nanyAnglePolys = 0;
+				dtFindPathStats anyAngleStats;
+				TimeVal anyAngleStart = getPerfTime();
+				navquery->findPath(startRef, endRef, iter->spos, iter->epos, &filter, anyAnglePolys, &nanyAnglePolys, MAX_POLYS,
+								   DT_FINDPATH_ANY_ANGLE, &anyAngleStats);
+				TimeVal anyAngleEnd = getPerfTime();
+				iter->findPathAnyAngleTime += getPerfTimeUsec(anyAngleEnd - anyAngleStart);
+				iter->anyAngleExpandedNodes = anyAngleStats.expandedNodes;
+				iter->anyAngleRaycasts = anyAngleStats.raycasts;
+				iter->anyAngleCachedRaycasts = anyAngleStats.cachedRaycasts;
+				iter->anyAngleStraight = 0;
+				if (nanyAnglePolys)
+				{
+					navquery->findStraightPath(iter->spos, iter->epos, anyAnglePolys, nanyAnglePolys,
+											   straight, 0, 0, &iter->anyAngleStraight, MAX_POLYS);
+				}
+			}
 		
 			// Find straight path
 			if (iter->npolys)
@@ -321,6 +346,13 @@ void TestCase::doTests(dtNavMesh* navmesh, dtNavMeshQuery* navquery)
 		printf("    - poly:     %.4f ms\n", (float)iter->findNearestPolyTime/1000.0f);
 		printf("    - path:     %.4f ms\n", (float)iter->findPathTime/1000.0f);
 		printf("    - straight: %.4f ms\n", (float)iter->findStraightPathTime/1000.0f);
+		if (iter->type == TEST_PATHFIND)
+		{
+			printf("    - any-angle path: %.4f ms\n", (float)iter->findPathAnyAngleTime/1000.0f);
+			printf("    - nodes:    %d regular, %d any-angle\n", iter->expandedNodes, iter->anyAngleExpandedNodes);
+			printf("    - raycasts: %d (%d cached)\n", iter->anyAngleRaycasts, iter->anyAngleCachedRaycasts);
+			printf("    - corners:  %d regular, %d any-angle\n", iter->nstraight, iter->anyAngleStraight);
+		}
 		n++;
 	}
 }
@@ -0,0 +1,138 @@
+#ifndef TESTS_GRIDNAVMESH_H
+#define TESTS_GRIDNAVMESH_H
+
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+
+#include <cstring>
+#include <vector>
+
+// Builds the tiled grid navigation meshes shared by the Detour and DetourCrowd tests.
+namespace TestGrid
+{
+	// Each tile is a GRID_SIZE x GRID_SIZE grid of 1x1 quads, connected to the
+	// neighbouring tiles through portal edges.
+	static const int GRID_SIZE = 4;
+	static const float TILE_SIZE = (float)GRID_SIZE;
+
+	// The optional off-mesh connections are one-way and use the default flags and area.
+	inline unsigned char* buildGridTile(const int tx, const int ty, int& dataSize, const bool wideBvTree = false,
+								 const float* offMeshConVerts = 0, const int offMeshConCount = 0)
+	{
+		const int nverts = (GRID_SIZE + 1) * (GRID_SIZE + 1);
+		const int npolys = GRID_SIZE * GRID_SIZE;
+		const int nvp = 4;
+
+		std::vector<unsigned short> verts;
+		for (int z = 0; z <= GRID_SIZE; ++z)
+		{
+			for (int x = 0; x <= GRID_SIZE; ++x)
+			{
+				verts.push_back((unsigned short)x);
+				verts.push_back(0);
+				verts.push_back((unsigned short)z);
+			}
+		}
+
+		std::vector<unsigned short> polys;
+		for (int z = 0; z < GRID_SIZE; ++z)
+		{
+			for (int x = 0; x < GRID_SIZE; ++x)
+			{
+				polys.push_back((unsigned short)(z * (GRID_SIZE + 1) + x));
+				polys.push_back((unsigned short)((z + 1) * (GRID_SIZE + 1) + x));
+				polys.push_back((unsigned short)((z + 1) * (GRID_SIZE + 1) + x + 1));
+				polys.push_back((unsigned short)(z * (GRID_SIZE + 1) + x + 1));
+				// Neighbours: x-, z+, x+, z-
+				polys.push_back(x > 0 ? (unsigned short)(z * GRID_SIZE + x - 1) : 0x8000 | 0);
+				polys.push_back(z < GRID_SIZE - 1 ? (unsigned short)((z + 1) * GRID_SIZE + x) : 0x8000 | 1);
+				polys.push_back(x < GRID_SIZE - 1 ? (unsigned short)(z * GRID_SIZE + x + 1) : 0x8000 | 2);
+				polys.push_back(z > 0 ? (unsigned short)((z - 1) * GRID_SIZE + x) : 0x8000 | 3);
+			}
+		}
+
+		std::vector<unsigned short> flags(npolys, 1);
+		std::vector<unsigned char> areas(npolys, 0);
+
+		std::vector<float> offMeshConRad(offMeshConCount + 1, 0.1f);
+		std::vector<unsigned short> offMeshConFlags(offMeshConCount + 1, 1);
+		std::vector<unsigned char> offMeshConAreas(offMeshConCount + 1, 0);
+		std::vector<unsigned char> offMeshConDir(offMeshConCount + 1, 0);
+		std::vector<unsigned int> offMeshConUserID(offMeshConCount + 1, 0);
+
+		dtNavMeshCreateParams params;
+		memset(&params, 0, sizeof(params));
+		params.verts = &verts[0];
+		params.vertCount = nverts;
+		params.polys = &polys[0];
+		params.polyFlags = &flags[0];
+		params.polyAreas = &areas[0];
+		params.polyCount = npolys;
+		params.nvp = nvp;
+		params.offMeshConVerts = offMeshConVerts;
+		params.offMeshConRad = &offMeshConRad[0];
+		params.offMeshConFlags = &offMeshConFlags[0];
+		params.offMeshConAreas = &offMeshConAreas[0];
+		params.offMeshConDir = &offMeshConDir[0];
+		params.offMeshConUserID = &offMeshConUserID[0];
+		params.offMeshConCount = offMeshConCount;
+		params.tileX = tx;
+		params.tileY = ty;
+		params.bmin[0] = tx * TILE_SIZE;
+		params.bmin[1] = 0.0f;
+		params.bmin[2] = ty * TILE_SIZE;
+		params.bmax[0] = (tx + 1) * TILE_SIZE;
+		params.bmax[1] = 1.0f;
+		params.bmax[2] = (ty + 1) * TILE_SIZE;
+		params.walkableHeight = 2.0f;
+		params.walkableRadius = 0.5f;
+		params.walkableClimb = 0.5f;
+		params.cs = 1.0f;
+		params.ch = 0.5f;
+		params.buildBvTree = true;
+		params.buildWideBvTree = wideBvTree;
+
+		unsigned char* data = 0;
+		dataSize = 0;
+		if (!dtCreateNavMeshData(&params, &data, &dataSize))
+			return 0;
+		return data;
+	}
+
+	inline dtNavMesh* buildGridNavMesh(const int tilesX, const int tilesY, const bool wideBvTree = false)
+	{
+		dtNavMeshParams params;
+		memset(&params, 0, sizeof(params));
+		params.tileWidth = TILE_SIZE;
+		params.tileHeight = TILE_SIZE;
+		params.maxTiles = tilesX * tilesY;
+		params.maxPolys = GRID_SIZE * GRID_SIZE;
+
+		dtNavMesh* nav = dtAllocNavMesh();
+		if (!nav || dtStatusFailed(nav->init(&params)))
+		{
+			dtFreeNavMesh(nav);
+			return 0;
+		}
+
+		for (int y = 0; y < tilesY; ++y)
+		{
+			for (int x = 0; x < tilesX; ++x)
+			{
+				int dataSize = 0;
+				unsigned char* data = buildGridTile(x, y, dataSize, wideBvTree);
+				if (!data || dtStatusFailed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)))
+				{
+					dtFree(data);
+					dtFreeNavMesh(nav);
+					return 0;
+				}
+			}
+		}
+
+		return nav;
+	}
+}
+
+#endif // TESTS_GRIDNAVMESH_H
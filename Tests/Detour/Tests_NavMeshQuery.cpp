@@ -0,0 +1,2165 @@
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourNavMeshQueryTemplates.h"
+#include "DetourNavMeshSet.h"
+#include "DetourPathCache.h"
+#include "Tests_GridNavMesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <vector>
+
+using namespace TestGrid;
+
+namespace
+{
+	// Deterministic pseudo random value in [0, 1], so that every run sees the same points.
+	float nextRandom(unsigned int& seed)
+	{
+		seed = seed * 1103515245u + 12345u;
+		return ((seed >> 8) & 0xffff) / 65535.0f;
+	}
+
+	// Number of queries used by the batch tests, larger than one internal batch chunk.
+	const int BATCH_QUERY_COUNT = 600;
+
+	// Builds BATCH_QUERY_COUNT segments for the batch query tests. The start points are on a coarse
+	// lattice of polygon centres, so that many of them share a start polygon, and the end points are
+	// within @p reach of the start along x and z.
+	void buildBatchSegments(const dtNavMeshQuery* query, const dtQueryFilter* filter, unsigned int seed, const float reach,
+							std::vector<dtPolyRef>& startRefs, std::vector<float>& startPos, std::vector<float>& endPos)
+	{
+		const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+		const int count = BATCH_QUERY_COUNT;
+		startRefs.assign(count, 0);
+		startPos.assign(count * 3, 0.0f);
+		endPos.assign(count * 3, 0.0f);
+		for (int i = 0; i < count; ++i)
+		{
+			float* sp = &startPos[i * 3];
+			float* ep = &endPos[i * 3];
+			do
+			{
+				for (int j = 0; j < 3; j += 2)
+				{
+					sp[j] = (float)((int)(nextRandom(seed) * 5.999f)) * 2.0f + 0.5f;
+					ep[j] = sp[j] + (nextRandom(seed) - 0.5f) * 2.0f * reach;
+				}
+				query->findNearestPoly(sp, halfExtents, filter, &startRefs[i], 0);
+			}
+			while (!startRefs[i]);
+		}
+	}
+}
+
+TEST_CASE("dtNavMeshQuery::findNearestPolyBatch")
+{
+	const bool wideBvTree = GENERATE(false, true);
+	dtNavMesh* nav = buildGridNavMesh(2, 2, wideBvTree);
+	REQUIRE(nav != 0);
+	const dtNavMesh* constNav = nav;
+	REQUIRE((constNav->getTile(0)->bvWideTree != 0) == wideBvTree);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.75f, 1.0f, 0.75f };
+
+	SECTION("Matches findNearestPoly for every point")
+	{
+		// Some of the points are off the mesh.
+		const int count = BATCH_QUERY_COUNT;
+		std::vector<float> centers(count * 3);
+		unsigned int seed = 12345;
+		for (int i = 0; i < count * 3; ++i)
+			centers[i] = nextRandom(seed) * (2 * TILE_SIZE + 2.0f) - 1.0f;
+
+		std::vector<dtPolyRef> refs(count, 0);
+		std::vector<float> pts(count * 3, 0.0f);
+		bool over[count] = {};
+		REQUIRE(dtStatusSucceed(query->findNearestPolyBatch(&centers[0], count, halfExtents, &filter,
+															 &refs[0], &pts[0], over)));
+
+		int found = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			dtPolyRef ref = 0;
+			float pt[3] = { 0, 0, 0 };
+			bool isOver = false;
+			REQUIRE(dtStatusSucceed(query->findNearestPoly(&centers[i * 3], halfExtents, &filter, &ref, pt, &isOver)));
+			REQUIRE(refs[i] == ref);
+			if (ref)
+			{
+				found++;
+				REQUIRE(pts[i * 3 + 0] == pt[0]);
+				REQUIRE(pts[i * 3 + 1] == pt[1]);
+				REQUIRE(pts[i * 3 + 2] == pt[2]);
+				REQUIRE(over[i] == isOver);
+			}
+		}
+		REQUIRE(found > 0);
+		REQUIRE(found < count);
+	}
+
+	SECTION("Rejects invalid input")
+	{
+		dtPolyRef ref = 0;
+		const float center[3] = { 1.0f, 0.0f, 1.0f };
+		REQUIRE(dtStatusFailed(query->findNearestPolyBatch(0, 1, halfExtents, &filter, &ref, 0, 0)));
+		REQUIRE(dtStatusFailed(query->findNearestPolyBatch(center, 1, halfExtents, &filter, 0, 0, 0)));
+		REQUIRE(dtStatusSucceed(query->findNearestPolyBatch(center, 0, halfExtents, &filter, &ref, 0, 0)));
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::findPath any-angle")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 512)));
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 11.5f, 0.0f, 5.5f };
+	dtPolyRef startRef = 0, endRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+
+	dtPolyRef path[256];
+	int pathCount = 0;
+	dtFindPathStats stats;
+	REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 256,
+							DT_FINDPATH_ANY_ANGLE, &stats) == DT_SUCCESS);
+	REQUIRE(stats.expandedNodes > 0);
+	REQUIRE(stats.raycasts > 0);
+
+	// Same corridor as the sliced any-angle query.
+	dtPolyRef slicedPath[256];
+	int slicedPathCount = 0;
+	dtNavMeshQuery* slicedQuery = dtAllocNavMeshQuery();
+	REQUIRE(slicedQuery != 0);
+	REQUIRE(dtStatusSucceed(slicedQuery->init(nav, 512)));
+	REQUIRE(dtStatusInProgress(slicedQuery->initSlicedFindPath(startRef, endRef, startPos, endPos, &filter, DT_FINDPATH_ANY_ANGLE)));
+	REQUIRE(dtStatusSucceed(slicedQuery->updateSlicedFindPath(INT_MAX, 0)));
+	REQUIRE(dtStatusSucceed(slicedQuery->finalizeSlicedFindPath(slicedPath, &slicedPathCount, 256)));
+	REQUIRE(pathCount == slicedPathCount);
+	REQUIRE(memcmp(path, slicedPath, sizeof(dtPolyRef) * pathCount) == 0);
+	dtFreeNavMeshQuery(slicedQuery);
+
+	REQUIRE(path[0] == startRef);
+	REQUIRE(path[pathCount - 1] == endRef);
+
+	// Any-angle paths do not turn more often than regular paths.
+	dtPolyRef regularPath[256];
+	int regularPathCount = 0;
+	dtFindPathStats regularStats;
+	REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, regularPath, &regularPathCount, 256,
+							0, &regularStats) == DT_SUCCESS);
+	REQUIRE(regularStats.raycasts == 0);
+
+	float straight[256 * 3];
+	int straightCount = 0, regularStraightCount = 0;
+	REQUIRE(dtStatusSucceed(query->findStraightPath(startPos, endPos, path, pathCount, straight, 0, 0, &straightCount, 256)));
+	REQUIRE(dtStatusSucceed(query->findStraightPath(startPos, endPos, regularPath, regularPathCount, straight, 0, 0,
+													&regularStraightCount, 256)));
+	REQUIRE(straightCount <= regularStraightCount);
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::findStraightPath long corridor")
+{
+	dtNavMesh* nav = buildGridNavMesh(4, 4);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	// Serpentine corridor through every polygon, longer than the portals kept on the stack.
+	const int cells = GRID_SIZE * 4;
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	std::vector<dtPolyRef> path;
+	for (int z = 0; z < cells; ++z)
+	{
+		for (int i = 0; i < cells; ++i)
+		{
+			const int x = (z & 1) ? cells - 1 - i : i;
+			const float center[3] = { x + 0.5f, 0.0f, z + 0.5f };
+			dtPolyRef ref = 0;
+			REQUIRE(dtStatusSucceed(query->findNearestPoly(center, halfExtents, &filter, &ref, 0)));
+			REQUIRE(ref != 0);
+			path.push_back(ref);
+		}
+	}
+	const int pathCount = (int)path.size();
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 0.5f, 0.0f, cells - 0.5f };
+
+	const int maxStraight = 1024;
+	std::vector<float> straight(maxStraight * 3);
+	std::vector<unsigned char> flags(maxStraight);
+	std::vector<dtPolyRef> refs(maxStraight);
+	int straightCount = 0;
+
+	SECTION("Turns once per row")
+	{
+		REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, &straight[0], &flags[0], &refs[0],
+										&straightCount, maxStraight) == DT_SUCCESS);
+		REQUIRE(straightCount == cells + 1);
+		REQUIRE(flags[0] == DT_STRAIGHTPATH_START);
+		REQUIRE(flags[straightCount - 1] == DT_STRAIGHTPATH_END);
+		for (int z = 0; z + 1 < cells; ++z)
+		{
+			// The corridor wraps around the inner corner between two rows.
+			const float* pt = &straight[(z + 1) * 3];
+			REQUIRE(pt[0] == ((z & 1) ? 1.0f : (float)(cells - 1)));
+			REQUIRE(pt[2] == (float)(z + 1));
+		}
+	}
+
+	SECTION("Crossings follow the corridor")
+	{
+		REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, &straight[0], &flags[0], &refs[0],
+										&straightCount, maxStraight, DT_STRAIGHTPATH_ALL_CROSSINGS) == DT_SUCCESS);
+		REQUIRE(straightCount > cells + 1);
+		int idx = 0;
+		for (int i = 1; i + 1 < straightCount; ++i)
+		{
+			const int next = (int)(std::find(path.begin() + idx, path.end(), refs[i]) - path.begin());
+			REQUIRE(next < pathCount);
+			idx = next;
+		}
+	}
+
+	SECTION("Small result buffers are a prefix of the full path")
+	{
+		REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, &straight[0], &flags[0], &refs[0],
+										&straightCount, maxStraight) == DT_SUCCESS);
+		for (int maxCount = 1; maxCount <= 4; ++maxCount)
+		{
+			float partial[4 * 3];
+			unsigned char partialFlags[4];
+			dtPolyRef partialRefs[4];
+			int partialCount = 0;
+			REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, partial, partialFlags, partialRefs,
+											&partialCount, maxCount) == (DT_SUCCESS | DT_BUFFER_TOO_SMALL));
+			REQUIRE(partialCount == maxCount);
+			REQUIRE(memcmp(partial, &straight[0], sizeof(float) * 3 * maxCount) == 0);
+			// The last vertex would have been updated by the next one at the same position.
+			REQUIRE(memcmp(partialFlags, &flags[0], maxCount - 1) == 0);
+			REQUIRE(memcmp(partialRefs, &refs[0], sizeof(dtPolyRef) * (maxCount - 1)) == 0);
+		}
+	}
+
+	SECTION("Reports running out of portals")
+	{
+		const int nportals = 20;
+		std::vector<float> left(nportals * 3), right(nportals * 3);
+		std::vector<unsigned char> types(nportals + 1), areas(nportals + 1);
+		REQUIRE(query->getPathPortals(&path[0], nportals + 1, &left[0], &right[0], &types[0], &areas[0]) == nportals);
+		REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, &left[0], &right[0], &types[0], &areas[0],
+										nportals, &straight[0], &flags[0], &refs[0], &straightCount, maxStraight) ==
+				(DT_SUCCESS | DT_OUT_OF_PORTALS));
+		REQUIRE(refs[straightCount - 1] == path[nportals]);
+	}
+
+	SECTION("Stops at an invalid polygon")
+	{
+		const int cut = 100;
+		path[cut] = 0;
+		REQUIRE(query->findStraightPath(startPos, endPos, &path[0], pathCount, &straight[0], &flags[0], &refs[0],
+										&straightCount, maxStraight) == (DT_SUCCESS | DT_PARTIAL_RESULT));
+		REQUIRE(straightCount > 1);
+		REQUIRE(refs[straightCount - 1] == path[cut - 1]);
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::raycastBatch")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	// Leave a hole in the middle so that some rays hit walls.
+	REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	const int count = BATCH_QUERY_COUNT;
+	std::vector<dtPolyRef> startRefs;
+	std::vector<float> startPos, endPos;
+	buildBatchSegments(query, &filter, 4321, 3 * TILE_SIZE, startRefs, startPos, endPos);
+
+	std::vector<float> hitT(count);
+	std::vector<float> hitNormals(count * 3);
+	std::vector<dtPolyRef> lastRefs(count);
+	REQUIRE(query->raycastBatch(&startRefs[0], &startPos[0], &endPos[0], count, &filter,
+								&hitT[0], &hitNormals[0], &lastRefs[0]) == DT_SUCCESS);
+
+	int hits = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		dtPolyRef path[256];
+		dtRaycastHit hit;
+		hit.path = path;
+		hit.maxPath = 256;
+		REQUIRE(query->raycast(startRefs[i], &startPos[i * 3], &endPos[i * 3], &filter, 0, &hit) == DT_SUCCESS);
+		REQUIRE(hitT[i] == hit.t);
+		REQUIRE(hitNormals[i * 3 + 0] == hit.hitNormal[0]);
+		REQUIRE(hitNormals[i * 3 + 1] == hit.hitNormal[1]);
+		REQUIRE(hitNormals[i * 3 + 2] == hit.hitNormal[2]);
+		REQUIRE(lastRefs[i] == path[hit.pathCount - 1]);
+		if (hit.t < 1.0f)
+			hits++;
+	}
+	REQUIRE(hits > 0);
+	REQUIRE(hits < count);
+
+	REQUIRE(dtStatusFailed(query->raycastBatch(&startRefs[0], &startPos[0], &endPos[0], 1, &filter, 0, 0, 0)));
+	dtPolyRef badRef = 0;
+	REQUIRE(dtStatusFailed(query->raycastBatch(&badRef, &startPos[0], &endPos[0], 1, &filter, &hitT[0], 0, 0)));
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::moveAlongSurfaceBatch")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	// Leave a hole in the middle so that some movers slide along walls.
+	REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	const int count = BATCH_QUERY_COUNT;
+	std::vector<dtPolyRef> startRefs;
+	std::vector<float> startPos, endPos;
+	buildBatchSegments(query, &filter, 1234, 3.0f, startRefs, startPos, endPos);
+
+	std::vector<float> resultPos(count * 3);
+	std::vector<dtPolyRef> resultRefs(count);
+	REQUIRE(query->moveAlongSurfaceBatch(&startRefs[0], &startPos[0], &endPos[0], count, &filter,
+										 &resultPos[0], &resultRefs[0]) == DT_SUCCESS);
+
+	int blocked = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		float pos[3];
+		dtPolyRef visited[64];
+		int visitedCount = 0;
+		REQUIRE(query->moveAlongSurface(startRefs[i], &startPos[i * 3], &endPos[i * 3], &filter,
+										pos, visited, &visitedCount, 64) == DT_SUCCESS);
+		REQUIRE(resultPos[i * 3 + 0] == pos[0]);
+		REQUIRE(resultPos[i * 3 + 1] == pos[1]);
+		REQUIRE(resultPos[i * 3 + 2] == pos[2]);
+		REQUIRE(visitedCount > 0);
+		REQUIRE(resultRefs[i] == visited[visitedCount - 1]);
+		if (!dtVequal(pos, &endPos[i * 3]))
+			blocked++;
+	}
+	REQUIRE(blocked > 0);
+	REQUIRE(blocked < count);
+
+	REQUIRE(dtStatusFailed(query->moveAlongSurfaceBatch(&startRefs[0], &startPos[0], &endPos[0], 1, &filter, 0, 0)));
+	dtPolyRef badRef = 0;
+	REQUIRE(dtStatusFailed(query->moveAlongSurfaceBatch(&badRef, &startPos[0], &endPos[0], 1, &filter, &resultPos[0], 0)));
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::findDistanceMatrix")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+
+	const int nstart = 3;
+	const int nend = 4;
+	// The first end shares the polygon of the first start, the last end is a duplicate.
+	float startPos[nstart * 3] = { 0.5f, 0, 0.5f,  6.5f, 0, 1.5f,  3.5f, 0, 7.5f };
+	float endPos[nend * 3] = { 0.25f, 0, 0.75f,  7.5f, 0, 7.5f,  4.5f, 0, 3.5f,  7.5f, 0, 7.5f };
+	dtPolyRef startRefs[nstart];
+	dtPolyRef endRefs[nend];
+	for (int i = 0; i < nstart; ++i)
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(&startPos[i * 3], halfExtents, &filter, &startRefs[i], 0)));
+	for (int i = 0; i < nend; ++i)
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(&endPos[i * 3], halfExtents, &filter, &endRefs[i], 0)));
+
+	float costs[nstart * nend];
+	dtPolyRef parents[nstart * nend];
+
+	SECTION("Costs are consistent with the straight line distance")
+	{
+		REQUIRE(query->findDistanceMatrix(startRefs, startPos, nstart, endRefs, endPos, nend,
+										  &filter, costs, parents) == DT_SUCCESS);
+
+		REQUIRE(costs[0] == Catch::Approx(dtVdist(&startPos[0], &endPos[0])));
+		REQUIRE(parents[0] == 0);
+		for (int i = 0; i < nstart; ++i)
+		{
+			for (int j = 0; j < nend; ++j)
+				REQUIRE(costs[i * nend + j] >= dtVdist(&startPos[i * 3], &endPos[j * 3]) - 1e-4f);
+			REQUIRE(costs[i * nend + 1] == costs[i * nend + 3]);
+		}
+
+		// The search tree of the last start is left in the node pool.
+		dtPolyRef path[64];
+		int pathCount = 0;
+		REQUIRE(dtStatusSucceed(query->getPathFromDijkstraSearch(endRefs[1], path, &pathCount, 64)));
+		REQUIRE(pathCount >= 2);
+		REQUIRE(path[0] == startRefs[nstart - 1]);
+		REQUIRE(path[pathCount - 1] == endRefs[1]);
+		REQUIRE(path[pathCount - 2] == parents[(nstart - 1) * nend + 1]);
+	}
+
+	SECTION("Rows match single start searches")
+	{
+		REQUIRE(dtStatusSucceed(query->findDistanceMatrix(startRefs, startPos, nstart, endRefs, endPos, nend,
+														  &filter, costs, 0)));
+		for (int i = 0; i < nstart; ++i)
+		{
+			float row[nend];
+			REQUIRE(dtStatusSucceed(query->findDistanceMatrix(&startRefs[i], &startPos[i * 3], 1, endRefs, endPos, nend,
+															  &filter, row, 0)));
+			for (int j = 0; j < nend; ++j)
+				REQUIRE(row[j] == costs[i * nend + j]);
+		}
+	}
+
+	SECTION("Costs match findPath")
+	{
+		REQUIRE(dtStatusSucceed(query->findDistanceMatrix(startRefs, startPos, nstart, endRefs, endPos, nend,
+														  &filter, costs, 0)));
+		for (int i = 0; i < nstart; ++i)
+		{
+			for (int j = 1; j < nend; ++j)
+			{
+				dtPolyRef path[64];
+				int pathCount = 0;
+				REQUIRE(query->findPath(startRefs[i], endRefs[j], &startPos[i * 3], &endPos[j * 3], &filter,
+										path, &pathCount, 64) == DT_SUCCESS);
+				// findPath leaves the end node in the pool with the total path cost.
+				const dtNode* endNode = query->getNodePool()->findNode(endRefs[j], 0);
+				REQUIRE(endNode != 0);
+				REQUIRE(costs[i * nend + j] == Catch::Approx(endNode->total));
+			}
+		}
+	}
+
+	SECTION("Unreachable ends")
+	{
+		REQUIRE(dtStatusSucceed(nav->setPolyFlags(endRefs[2], 2)));
+		filter.setIncludeFlags(1);
+		const dtStatus status = query->findDistanceMatrix(startRefs, startPos, nstart, endRefs, endPos, nend,
+														  &filter, costs, parents);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		for (int i = 0; i < nstart; ++i)
+		{
+			REQUIRE(costs[i * nend + 2] == FLT_MAX);
+			REQUIRE(parents[i * nend + 2] == 0);
+			REQUIRE(costs[i * nend + 1] < FLT_MAX);
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::buildFlowField")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtFlowField* field = dtAllocFlowField();
+	REQUIRE(field != 0);
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const float goalPos[3] = { 6.5f, 0.0f, 6.5f };
+	dtPolyRef goalRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(goalPos, halfExtents, &filter, &goalRef, 0)));
+
+	SECTION("Every polygon leads to the goal")
+	{
+		REQUIRE(dtStatusSucceed(query->buildFlowField(goalRef, goalPos, &filter, field)));
+		REQUIRE(field->getGoalRef() == goalRef);
+		REQUIRE(field->getReachedCount() == 4 * GRID_SIZE * GRID_SIZE);
+
+		dtPolyRef next = 1;
+		float cost = -1.0f;
+		REQUIRE(dtStatusSucceed(field->getNextPoly(goalRef, &next, &cost)));
+		REQUIRE(next == 0);
+		REQUIRE(cost == 0.0f);
+
+		for (int i = 0; i < nav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(i);
+			if (!tile->header)
+				continue;
+			const dtPolyRef base = nav->getPolyRefBase(tile);
+			for (int j = 0; j < tile->header->polyCount; ++j)
+			{
+				dtPolyRef ref = base | (dtPolyRef)j;
+				int steps = 0;
+				while (ref != goalRef)
+				{
+					float refCost = 0;
+					REQUIRE(dtStatusSucceed(field->getNextPoly(ref, &next, &refCost)));
+					REQUIRE(next != 0);
+					float nextCost = 0;
+					REQUIRE(dtStatusSucceed(field->getNextPoly(next, &next, &nextCost)));
+					REQUIRE(nextCost < refCost);
+					REQUIRE(dtStatusSucceed(field->getNextPoly(ref, &ref, 0)));
+					REQUIRE(++steps <= 4 * GRID_SIZE);
+				}
+			}
+		}
+	}
+
+	SECTION("Excluded polygons are not reached")
+	{
+		const float blockedPos[3] = { 0.5f, 0.0f, 0.5f };
+		dtPolyRef blockedRef = 0;
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(blockedPos, halfExtents, &filter, &blockedRef, 0)));
+		REQUIRE(dtStatusSucceed(nav->setPolyFlags(blockedRef, 2)));
+		filter.setIncludeFlags(1);
+
+		REQUIRE(dtStatusSucceed(query->buildFlowField(goalRef, goalPos, &filter, field)));
+		REQUIRE(field->getReachedCount() == 4 * GRID_SIZE * GRID_SIZE - 1);
+		dtPolyRef next = 1;
+		float cost = 0;
+		REQUIRE(dtStatusSucceed(field->getNextPoly(blockedRef, &next, &cost)));
+		REQUIRE(next == 0);
+		REQUIRE(cost == FLT_MAX);
+	}
+
+	SECTION("One-way off-mesh connections lead into the goal")
+	{
+		// A single tile split by a wall along x = 2 and crossed by a one-way
+		// connection from the left side to the right.
+		dtNavMeshParams params;
+		memset(&params, 0, sizeof(params));
+		params.tileWidth = TILE_SIZE;
+		params.tileHeight = TILE_SIZE;
+		params.maxTiles = 1;
+		params.maxPolys = GRID_SIZE * GRID_SIZE + 1;
+		dtNavMesh* conNav = dtAllocNavMesh();
+		REQUIRE(conNav != 0);
+		REQUIRE(dtStatusSucceed(conNav->init(&params)));
+		const float conVerts[6] = { 0.5f, 0.0f, 0.5f,  3.5f, 0.0f, 2.5f };
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(0, 0, dataSize, false, conVerts, 1);
+		REQUIRE(data != 0);
+		dtTileRef tileRef = 0;
+		REQUIRE(dtStatusSucceed(conNav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, &tileRef)));
+		const dtPolyRef base = conNav->getPolyRefBase(((const dtNavMesh*)conNav)->getTileByRef(tileRef));
+		for (int z = 0; z < GRID_SIZE; ++z)
+			REQUIRE(dtStatusSucceed(conNav->setPolyFlags(base | (dtPolyRef)(z * GRID_SIZE + 2), 2)));
+		dtNavMeshQuery* conQuery = dtAllocNavMeshQuery();
+		REQUIRE(conQuery != 0);
+		REQUIRE(dtStatusSucceed(conQuery->init(conNav, 256)));
+		filter.setIncludeFlags(1);
+
+		const float tileGoalPos[3] = { 3.5f, 0.0f, 1.5f };
+		const dtPolyRef tileGoalRef = base | (dtPolyRef)(1 * GRID_SIZE + 3);
+		REQUIRE(dtStatusSucceed(conQuery->buildFlowField(tileGoalRef, tileGoalPos, &filter, field)));
+		// All but the wall, including the connection polygon.
+		REQUIRE(field->getReachedCount() == GRID_SIZE * GRID_SIZE - GRID_SIZE + 1);
+
+		const dtPolyRef conRef = base | (dtPolyRef)(GRID_SIZE * GRID_SIZE);
+		dtPolyRef next = 0;
+		REQUIRE(dtStatusSucceed(field->getNextPoly(base, &next, 0)));
+		REQUIRE(next == conRef);
+		REQUIRE(dtStatusSucceed(field->getNextPoly(conRef, &next, 0)));
+		REQUIRE(next == (base | (dtPolyRef)(2 * GRID_SIZE + 3)));
+
+		// The connection does not lead back.
+		const float leftPos[3] = { 0.5f, 0.0f, 3.5f };
+		REQUIRE(dtStatusSucceed(conQuery->buildFlowField(base | (dtPolyRef)(3 * GRID_SIZE), leftPos, &filter, field)));
+		REQUIRE(field->getReachedCount() == 2 * GRID_SIZE + 1);
+
+		dtFreeNavMeshQuery(conQuery);
+		dtFreeNavMesh(conNav);
+	}
+
+	SECTION("Lookups fail on replaced tiles")
+	{
+		REQUIRE(dtStatusSucceed(query->buildFlowField(goalRef, goalPos, &filter, field)));
+
+		const float pos[3] = { 0.5f, 0.0f, 0.5f };
+		dtPolyRef ref = 0;
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(pos, halfExtents, &filter, &ref, 0)));
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(0, 0, 0), 0, 0)));
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(0, 0, dataSize);
+		REQUIRE(data != 0);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(pos, halfExtents, &filter, &ref, 0)));
+
+		dtPolyRef next = 0;
+		REQUIRE(dtStatusFailed(field->getNextPoly(ref, &next, 0)));
+	}
+
+	dtFreeFlowField(field);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::updateFlowField")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtFlowField* field = dtAllocFlowField();
+	dtFlowField* rebuilt = dtAllocFlowField();
+	REQUIRE(field != 0);
+	REQUIRE(rebuilt != 0);
+
+	dtQueryFilter filter;
+	filter.setIncludeFlags(1);
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const float goalPos[3] = { 11.5f, 0.0f, 11.5f };
+	dtPolyRef goalRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(goalPos, halfExtents, &filter, &goalRef, 0)));
+	REQUIRE(dtStatusSucceed(query->buildFlowField(goalRef, goalPos, &filter, field)));
+
+	const dtNavMesh* cnav = nav;
+
+	SECTION("Rebuilt tile")
+	{
+		// Rebuild the center tile with a wall across it.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(1, 1, dataSize);
+		REQUIRE(data != 0);
+		dtTileRef tileRef = 0;
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, &tileRef)));
+		const dtPolyRef base = nav->getPolyRefBase(cnav->getTileByRef(tileRef));
+		for (int x = 0; x < GRID_SIZE - 1; ++x)
+			REQUIRE(dtStatusSucceed(nav->setPolyFlags(base | (dtPolyRef)(2 * GRID_SIZE + x), 2)));
+	}
+
+	SECTION("Removed tile")
+	{
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+	}
+
+	// Update twice, the second time with the center tile back in place, so
+	// that the scratch space of the field is reused at a larger size.
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		if (pass == 1)
+		{
+			if (nav->getTileRefAt(1, 1, 0))
+				REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+			int dataSize = 0;
+			unsigned char* data = buildGridTile(1, 1, dataSize);
+			REQUIRE(data != 0);
+			REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		}
+
+		int repaired = 0;
+		REQUIRE(dtStatusSucceed(query->updateFlowField(&filter, field, &repaired)));
+		REQUIRE(repaired > 0);
+		REQUIRE(repaired < 9 * GRID_SIZE * GRID_SIZE);
+
+		// The repaired field matches a field built from scratch.
+		REQUIRE(dtStatusSucceed(query->buildFlowField(goalRef, goalPos, &filter, rebuilt)));
+		REQUIRE(field->getReachedCount() == rebuilt->getReachedCount());
+		for (int i = 0; i < cnav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = cnav->getTile(i);
+			if (!tile->header)
+				continue;
+			const dtPolyRef base = nav->getPolyRefBase(tile);
+			for (int j = 0; j < tile->header->polyCount; ++j)
+			{
+				dtPolyRef next = 0, expectedNext = 0;
+				float cost = 0, expectedCost = 0;
+				REQUIRE(dtStatusSucceed(field->getNextPoly(base | (dtPolyRef)j, &next, &cost)));
+				REQUIRE(dtStatusSucceed(rebuilt->getNextPoly(base | (dtPolyRef)j, &expectedNext, &expectedCost)));
+				if (expectedCost == FLT_MAX)
+					REQUIRE(cost == FLT_MAX);
+				else
+					REQUIRE(cost == Catch::Approx(expectedCost));
+			}
+		}
+	}
+
+	dtFreeFlowField(rebuilt);
+	dtFreeFlowField(field);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtPathCache")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtPathCache* cache = dtAllocPathCache();
+	REQUIRE(cache != 0);
+	REQUIRE(dtStatusSucceed(cache->init(2, 64)));
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const float pos[3][3] = { { 0.5f, 0, 0.5f }, { 7.5f, 0, 7.5f }, { 0.5f, 0, 7.5f } };
+	dtPolyRef refs[3];
+	for (int i = 0; i < 3; ++i)
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(pos[i], halfExtents, &filter, &refs[i], 0)));
+
+	dtPolyRef expected[64];
+	int expectedCount = 0;
+	REQUIRE(query->findPath(refs[0], refs[1], pos[0], pos[1], &filter, expected, &expectedCount, 64) == DT_SUCCESS);
+
+	dtPolyRef path[64];
+	int pathCount = 0;
+
+	SECTION("Hits return the cached path")
+	{
+		REQUIRE(cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(cache->getMissCount() == 1);
+		REQUIRE(cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(cache->getHitCount() == 1);
+		REQUIRE(pathCount == expectedCount);
+		REQUIRE(memcmp(path, expected, sizeof(dtPolyRef) * expectedCount) == 0);
+
+		REQUIRE(cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 2) ==
+				(DT_SUCCESS | DT_BUFFER_TOO_SMALL));
+		REQUIRE(pathCount == 2);
+
+		// A different filter is a different key.
+		dtQueryFilter otherFilter;
+		otherFilter.setAreaCost(0, 2.0f);
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &otherFilter, path, &pathCount, 64);
+		REQUIRE(cache->getMissCount() == 2);
+
+		// So is a different filter with the same hash.
+		dtQueryFilter collidingFilter;
+		otherFilter.setAreaCost(0, 82.353515625f);
+		collidingFilter.setAreaCost(0, 2048.1357421875f);
+		REQUIRE(dtHashQueryFilter(&otherFilter) == dtHashQueryFilter(&collidingFilter));
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &otherFilter, path, &pathCount, 64);
+		REQUIRE(cache->getMissCount() == 3);
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &collidingFilter, path, &pathCount, 64);
+		REQUIRE(cache->getMissCount() == 4);
+	}
+
+	SECTION("Least recently used paths are replaced")
+	{
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		cache->findPath(query, refs[0], refs[2], pos[0], pos[2], &filter, path, &pathCount, 64);
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		cache->findPath(query, refs[1], refs[2], pos[1], pos[2], &filter, path, &pathCount, 64);
+		REQUIRE(cache->getEntryCount() == 2);
+		REQUIRE(cache->getMissCount() == 3);
+
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		REQUIRE(cache->getHitCount() == 2);
+		cache->findPath(query, refs[0], refs[2], pos[0], pos[2], &filter, path, &pathCount, 64);
+		REQUIRE(cache->getMissCount() == 4);
+	}
+
+	SECTION("Changes to the navigation mesh invalidate the cache")
+	{
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		REQUIRE(dtStatusSucceed(nav->setPolyArea(expected[expectedCount / 2], 1)));
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		REQUIRE(cache->getInvalidationCount() == 1);
+		REQUIRE(cache->getMissCount() == 2);
+
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 0, 0), 0, 0)));
+		cache->findPath(query, refs[0], refs[1], pos[0], pos[1], &filter, path, &pathCount, 64);
+		REQUIRE(cache->getInvalidationCount() == 2);
+		REQUIRE(cache->getMissCount() == 3);
+		REQUIRE(cache->getHitCount() == 0);
+	}
+
+	dtFreePathCache(cache);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Wall segment cache")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	dtNavMesh* cachedNav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	REQUIRE(cachedNav != 0);
+	REQUIRE(dtStatusSucceed(cachedNav->setWallSegmentCache(true)));
+	REQUIRE(cachedNav->getWallSegmentCache());
+
+	// Remove the middle tile and add it back, so that the caches of the neighbours are rebuilt twice.
+	dtNavMesh* navs[2] = { nav, cachedNav };
+	for (int i = 0; i < 2; ++i)
+	{
+		REQUIRE(dtStatusSucceed(navs[i]->removeTile(navs[i]->getTileRefAt(1, 1, 0), 0, 0)));
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(1, 1, dataSize);
+		REQUIRE(data != 0);
+		REQUIRE(dtStatusSucceed(navs[i]->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+
+		// Block a row of polygons along a tile border, the filter is applied by the queries.
+		const dtPolyRef base = navs[i]->getPolyRefBase(navs[i]->getTileAt(1, 0, 0));
+		for (int x = 0; x < GRID_SIZE; ++x)
+			REQUIRE(dtStatusSucceed(navs[i]->setPolyFlags(base | (dtPolyRef)((GRID_SIZE - 1) * GRID_SIZE + x), 2)));
+	}
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* cachedQuery = dtAllocNavMeshQuery();
+	REQUIRE(query != 0);
+	REQUIRE(cachedQuery != 0);
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	REQUIRE(dtStatusSucceed(cachedQuery->init(cachedNav, 256)));
+
+	dtQueryFilter filter;
+	filter.setExcludeFlags(2);
+
+	const int maxSegs = 16;
+	for (int t = 0; t < cachedNav->getMaxTiles(); ++t)
+	{
+		const dtMeshTile* cachedTile = ((const dtNavMesh*)cachedNav)->getTile(t);
+		if (!cachedTile->header)
+			continue;
+		REQUIRE(cachedTile->polyPortalStart != 0);
+		const dtMeshTile* tile = nav->getTileAt(cachedTile->header->x, cachedTile->header->y, 0);
+		REQUIRE(tile != 0);
+		REQUIRE(tile->polyPortalStart == 0);
+
+		for (int p = 0; p < tile->header->polyCount; ++p)
+		{
+			const dtPolyRef ref = nav->getPolyRefBase(tile) | (dtPolyRef)p;
+			const dtPolyRef cachedRef = cachedNav->getPolyRefBase(cachedTile) | (dtPolyRef)p;
+
+			for (int withRefs = 0; withRefs < 2; ++withRefs)
+			{
+				float segs[maxSegs * 6], cachedSegs[maxSegs * 6];
+				dtPolyRef refs[maxSegs], cachedRefs[maxSegs];
+				int nsegs = 0, cachedNsegs = 0;
+				REQUIRE(dtStatusSucceed(query->getPolyWallSegments(ref, &filter, segs, withRefs ? refs : 0, &nsegs, maxSegs)));
+				REQUIRE(dtStatusSucceed(cachedQuery->getPolyWallSegments(cachedRef, &filter, cachedSegs,
+																		  withRefs ? cachedRefs : 0, &cachedNsegs, maxSegs)));
+				REQUIRE(nsegs == cachedNsegs);
+				REQUIRE(memcmp(segs, cachedSegs, sizeof(float) * 6 * nsegs) == 0);
+				for (int k = 0; withRefs && k < nsegs; ++k)
+					REQUIRE((refs[k] != 0) == (cachedRefs[k] != 0));
+			}
+
+			float center[3] = { 0, 0, 0 };
+			const dtPoly* poly = &tile->polys[p];
+			for (int v = 0; v < (int)poly->vertCount; ++v)
+				dtVmad(center, center, &tile->verts[poly->verts[v] * 3], 1.0f / poly->vertCount);
+			float dist = 0, hitPos[3], hitNormal[3];
+			float cachedDist = 0, cachedHitPos[3], cachedHitNormal[3];
+			REQUIRE(dtStatusSucceed(query->findDistanceToWall(ref, center, 3.0f, &filter, &dist, hitPos, hitNormal)));
+			REQUIRE(dtStatusSucceed(cachedQuery->findDistanceToWall(cachedRef, center, 3.0f, &filter,
+																	&cachedDist, cachedHitPos, cachedHitNormal)));
+			REQUIRE(dist == cachedDist);
+			if (dist < 3.0f)
+			{
+				REQUIRE(dtVequal(hitPos, cachedHitPos));
+			}
+		}
+	}
+
+	// The cache does not support concurrent editing.
+	cachedNav->setDeferredReclaim(true);
+	REQUIRE(!cachedNav->getWallSegmentCache());
+	REQUIRE(dtStatusFailed(cachedNav->setWallSegmentCache(true)));
+	REQUIRE(cachedNav->getTileAt(1, 1, 0)->polyPortalStart == 0);
+
+	dtFreeNavMeshQuery(cachedQuery);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(cachedNav);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Wide BVTree")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMesh* wideNav = buildGridNavMesh(2, 2, true);
+	REQUIRE(wideNav != 0);
+	REQUIRE(wideNav->getTileAt(0, 0, 0)->bvWideTree != 0);
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* wideQuery = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	REQUIRE(dtStatusSucceed(wideQuery->init(wideNav, 256)));
+
+	dtQueryFilter filter;
+
+	SECTION("Finds the same polygons as the binary tree")
+	{
+		const float halfExtents[3] = { 1.3f, 2.0f, 0.6f };
+		for (int z = 0; z < 20; ++z)
+		{
+			for (int x = 0; x < 20; ++x)
+			{
+				const float center[3] = { x * 0.45f - 0.5f, 0.5f, z * 0.45f - 0.5f };
+				dtPolyRef polys[64];
+				dtPolyRef widePolys[64];
+				int npolys = 0;
+				int nwidePolys = 0;
+				REQUIRE(dtStatusSucceed(query->queryPolygons(center, halfExtents, &filter, polys, &npolys, 64)));
+				REQUIRE(dtStatusSucceed(wideQuery->queryPolygons(center, halfExtents, &filter, widePolys, &nwidePolys, 64)));
+
+				// The binary tree can report its unused trailing node as polygon 0, compare unique sets.
+				std::sort(polys, polys + npolys);
+				npolys = (int)(std::unique(polys, polys + npolys) - polys);
+				std::sort(widePolys, widePolys + nwidePolys);
+				REQUIRE(npolys == nwidePolys);
+				for (int i = 0; i < npolys; ++i)
+					REQUIRE(polys[i] == widePolys[i]);
+			}
+		}
+	}
+
+	dtFreeNavMeshQuery(wideQuery);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(wideNav);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Version 7 tile data")
+{
+	// Version 7 data is the current layout without the wide tree count in the header.
+	int dataSize = 0;
+	unsigned char* data = buildGridTile(0, 0, dataSize);
+	REQUIRE(data != 0);
+	const int headerSize = dtGetMeshHeaderSize(DT_NAVMESH_VERSION);
+	const int oldHeaderSize = dtGetMeshHeaderSize(7);
+	REQUIRE(oldHeaderSize < headerSize);
+
+	const int oldDataSize = dataSize - (headerSize - oldHeaderSize);
+	unsigned char* oldData = (unsigned char*)dtAlloc(oldDataSize, DT_ALLOC_PERM);
+	memcpy(oldData, data, oldHeaderSize);
+	memcpy(oldData + oldHeaderSize, data + headerSize, dataSize - headerSize);
+	((dtMeshHeader*)oldData)->version = 7;
+	dtFree(data);
+
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE;
+	params.tileHeight = TILE_SIZE;
+	params.maxTiles = 1;
+	params.maxPolys = GRID_SIZE * GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	REQUIRE(dtStatusSucceed(nav->addTile(oldData, oldDataSize, DT_TILE_FREE_DATA, 0, 0)));
+
+	const dtMeshTile* tile = nav->getTileAt(0, 0, 0);
+	REQUIRE(tile != 0);
+	REQUIRE(tile->bvWideTree == 0);
+	REQUIRE(tile->bvTree != 0);
+	REQUIRE(tile->header->polyCount == GRID_SIZE * GRID_SIZE);
+	REQUIRE(tile->verts[3] == Catch::Approx(1.0f));
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+	const float center[3] = { 1.5f, 0.0f, 2.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtPolyRef ref = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(center, halfExtents, &filter, &ref, 0)));
+	REQUIRE(ref == (nav->getPolyRefBase(tile) | (dtPolyRef)(2 * GRID_SIZE + 1)));
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Compact tile data")
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE;
+	params.tileHeight = TILE_SIZE;
+	params.maxTiles = 4;
+	params.maxPolys = GRID_SIZE * GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+
+	for (int i = 0; i < 4; ++i)
+	{
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(i % 2, i / 2, dataSize, i == 3);
+		REQUIRE(data != 0);
+
+		unsigned char* compactData = 0;
+		int compactDataSize = 0;
+		REQUIRE(dtCompressNavMeshData(data, dataSize, &compactData, &compactDataSize));
+		REQUIRE(compactDataSize * 2 <= dataSize);
+
+		unsigned char* tileData = 0;
+		int tileDataSize = 0;
+		REQUIRE(dtDecompressNavMeshData(compactData, compactDataSize, &tileData, &tileDataSize));
+		REQUIRE(tileDataSize == dataSize);
+		REQUIRE(memcmp(tileData, data, sizeof(dtMeshHeader)) == 0);
+		REQUIRE(!dtDecompressNavMeshData(compactData, compactDataSize - 1, &tileData, &tileDataSize));
+		REQUIRE(!dtDecompressNavMeshData(data, dataSize, &tileData, &tileDataSize));
+		dtFree(compactData);
+		dtFree(data);
+
+		REQUIRE(dtStatusSucceed(nav->addTile(tileData, tileDataSize, DT_TILE_FREE_DATA, 0, 0)));
+	}
+
+	dtNavMesh* refNav = buildGridNavMesh(2, 2);
+	REQUIRE(refNav != 0);
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* refQuery = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	REQUIRE(dtStatusSucceed(refQuery->init(refNav, 256)));
+	dtQueryFilter filter;
+
+	// Decoded vertices are within the quantization error of the original ones.
+	for (int i = 0; i < 4; ++i)
+	{
+		const dtMeshTile* tile = nav->getTileAt(i % 2, i / 2, 0);
+		const dtMeshTile* refTile = refNav->getTileAt(i % 2, i / 2, 0);
+		REQUIRE(tile->header->vertCount == refTile->header->vertCount);
+		for (int j = 0; j < tile->header->vertCount * 3; ++j)
+			REQUIRE(tile->verts[j] == Catch::Approx(refTile->verts[j]).margin(1e-4f));
+		REQUIRE(tile->linksFreeList != DT_NULL_LINK);
+	}
+
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 7.5f, 0.0f, 6.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtPolyRef startRef = 0, endRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+
+	dtPolyRef path[64], refPath[64];
+	int pathCount = 0, refPathCount = 0;
+	REQUIRE(dtStatusSucceed(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64)));
+	REQUIRE(dtStatusSucceed(refQuery->findPath(startRef, endRef, startPos, endPos, &filter, refPath, &refPathCount, 64)));
+	// The grid has many equal cost corridors, only the end points are expected to match.
+	// The reference corridor is used for both meshes below.
+	REQUIRE(pathCount == refPathCount);
+	REQUIRE(path[0] == refPath[0]);
+	REQUIRE(path[pathCount - 1] == refPath[refPathCount - 1]);
+
+	float straight[64 * 3], refStraight[64 * 3];
+	int straightCount = 0, refStraightCount = 0;
+	REQUIRE(dtStatusSucceed(query->findStraightPath(startPos, endPos, refPath, refPathCount, straight, 0, 0, &straightCount, 64)));
+	REQUIRE(dtStatusSucceed(refQuery->findStraightPath(startPos, endPos, refPath, refPathCount, refStraight, 0, 0, &refStraightCount, 64)));
+	// Corners on the grid are collinear, the decoding error may add or drop some of them.
+	REQUIRE(straightCount >= 2);
+	REQUIRE(refStraightCount >= 2);
+	for (int i = 0; i < 3; ++i)
+	{
+		REQUIRE(straight[i] == Catch::Approx(refStraight[i]).margin(1e-4f));
+		REQUIRE(straight[(straightCount - 1) * 3 + i] == Catch::Approx(refStraight[(refStraightCount - 1) * 3 + i]).margin(1e-4f));
+	}
+
+	dtFreeNavMeshQuery(refQuery);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(refNav);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Compact tile data keeps tile borders exact")
+{
+	// Two neighbour tiles with uneven heights, so that their vertex bounds differ.
+	unsigned char* data[2];
+	int dataSize[2];
+	float* verts[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		data[i] = buildGridTile(i, 0, dataSize[i]);
+		REQUIRE(data[i] != 0);
+		const dtMeshHeader* header = (const dtMeshHeader*)data[i];
+		verts[i] = (float*)(data[i] + dtGetMeshHeaderSize(header->version));
+		for (int j = 0; j < header->vertCount; ++j)
+		{
+			float* v = &verts[i][j * 3];
+			v[1] = (float)(((int)v[0] * 7 + (int)v[2] * 13) % 10) / 10.0f + 0.03f * (float)v[0];
+		}
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		unsigned char* compactData = 0;
+		int compactDataSize = 0;
+		REQUIRE(dtCompressNavMeshData(data[i], dataSize[i], &compactData, &compactDataSize));
+		unsigned char* tileData = 0;
+		int tileDataSize = 0;
+		REQUIRE(dtDecompressNavMeshData(compactData, compactDataSize, &tileData, &tileDataSize));
+		REQUIRE(tileDataSize == dataSize[i]);
+
+		const dtMeshHeader* header = (const dtMeshHeader*)tileData;
+		const float* decoded = (const float*)(tileData + dtGetMeshHeaderSize(header->version));
+		int borderCount = 0;
+		for (int j = 0; j < header->vertCount; ++j)
+		{
+			const float* v = &verts[i][j * 3];
+			if (v[0] == header->bmin[0] || v[0] == header->bmax[0] || v[2] == header->bmin[2] || v[2] == header->bmax[2])
+			{
+				REQUIRE(memcmp(&decoded[j * 3], v, sizeof(float) * 3) == 0);
+				borderCount++;
+			}
+			else
+			{
+				for (int k = 0; k < 3; ++k)
+					REQUIRE(decoded[j * 3 + k] == Catch::Approx(v[k]).margin(1e-4f));
+			}
+		}
+		REQUIRE(borderCount == 4 * GRID_SIZE);
+
+		dtFree(tileData);
+		dtFree(compactData);
+	}
+
+	dtFree(data[0]);
+	dtFree(data[1]);
+}
+
+TEST_CASE("Read-only tile data")
+{
+	// Pack all tiles into one block, as if mapped from a file, and share it between two meshes.
+	std::vector<unsigned char> block;
+	std::vector<int> offsets, sizes;
+	for (int i = 0; i < 4; ++i)
+	{
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(i % 2, i / 2, dataSize);
+		REQUIRE(data != 0);
+		offsets.push_back((int)block.size());
+		sizes.push_back(dataSize);
+		block.insert(block.end(), data, data + dataSize);
+		dtFree(data);
+	}
+	const std::vector<unsigned char> original = block;
+
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE;
+	params.tileHeight = TILE_SIZE;
+	params.maxTiles = 4;
+	params.maxPolys = GRID_SIZE * GRID_SIZE;
+	dtNavMesh* navs[2];
+	for (int n = 0; n < 2; ++n)
+	{
+		navs[n] = dtAllocNavMesh();
+		REQUIRE(dtStatusSucceed(navs[n]->init(&params)));
+		for (int i = 0; i < 4; ++i)
+			REQUIRE(dtStatusSucceed(navs[n]->addTile(&block[offsets[i]], sizes[i], DT_TILE_READ_ONLY_DATA, 0, 0)));
+	}
+
+	const dtMeshTile* tile = navs[0]->getTileAt(1, 1, 0);
+	REQUIRE(tile->linkData != 0);
+	REQUIRE(tile->data == &block[offsets[3]]);
+	REQUIRE(tile->verts == (const float*)(tile->data + dtGetMeshHeaderSize(DT_NAVMESH_VERSION)));
+
+	const dtPolyRef base = navs[0]->getPolyRefBase(tile);
+	REQUIRE(dtStatusSucceed(navs[0]->setPolyFlags(base, 2)));
+	REQUIRE(block == original);
+
+	dtNavMesh* refNav = buildGridNavMesh(2, 2);
+	REQUIRE(refNav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* refQuery = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(navs[1], 256)));
+	REQUIRE(dtStatusSucceed(refQuery->init(refNav, 256)));
+	dtQueryFilter filter;
+
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 7.5f, 0.0f, 6.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtPolyRef startRef = 0, endRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+	dtPolyRef path[64], refPath[64];
+	int pathCount = 0, refPathCount = 0;
+	REQUIRE(dtStatusSucceed(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64)));
+	REQUIRE(dtStatusSucceed(refQuery->findPath(startRef, endRef, startPos, endPos, &filter, refPath, &refPathCount, 64)));
+	REQUIRE(pathCount == refPathCount);
+	for (int i = 0; i < pathCount; ++i)
+		REQUIRE(path[i] == refPath[i]);
+
+	const dtMeshTile* removedTile = navs[1]->getTileAt(1, 1, 0);
+	unsigned char* removedData = 0;
+	REQUIRE(dtStatusSucceed(navs[1]->removeTile(navs[1]->getTileRef(removedTile), &removedData, 0)));
+	REQUIRE(removedData == &block[offsets[3]]);
+	REQUIRE(removedTile->linkData == 0);
+	REQUIRE(block == original);
+
+	dtFreeNavMeshQuery(refQuery);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(refNav);
+	dtFreeNavMesh(navs[1]);
+	dtFreeNavMesh(navs[0]);
+}
+
+TEST_CASE("dtNavMesh::addTiles")
+{
+	const int tilesX = 4, tilesY = 3;
+	dtNavMesh* refNav = buildGridNavMesh(tilesX, tilesY);
+	REQUIRE(refNav != 0);
+
+	dtNavMeshParams params = *refNav->getParams();
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+
+	SECTION("Serial")
+	{
+	}
+	SECTION("Threaded")
+	{
+		// Runs the job in one chunk per thread, with the chunks spread over real threads.
+		dtNavMeshParallelForFunc threadedFor = [](void* /*userData*/, dtNavMeshJobFunc job, void* data, const int count)
+		{
+			const int nthreads = 4;
+			const int chunk = (count + nthreads - 1) / nthreads;
+			std::vector<std::thread> threads;
+			for (int t = 0; t < nthreads && t * chunk < count; ++t)
+				threads.push_back(std::thread(job, data, t * chunk, std::min(count, (t + 1) * chunk)));
+			for (size_t t = 0; t < threads.size(); ++t)
+				threads[t].join();
+		};
+		nav->setParallelFor(threadedFor, 0);
+	}
+
+	// Add the first row one by one and the rest in bulk, so that bulk tiles link with old ones too.
+	std::vector<unsigned char*> data;
+	std::vector<int> dataSizes;
+	for (int y = 0; y < tilesY; ++y)
+	{
+		for (int x = 0; x < tilesX; ++x)
+		{
+			int dataSize = 0;
+			unsigned char* tileData = buildGridTile(x, y, dataSize);
+			REQUIRE(tileData != 0);
+			if (y == 0)
+			{
+				REQUIRE(dtStatusSucceed(nav->addTile(tileData, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+				continue;
+			}
+			data.push_back(tileData);
+			dataSizes.push_back(dataSize);
+		}
+	}
+	// A duplicate of the last tile is skipped.
+	int dupSize = 0;
+	unsigned char* dup = buildGridTile(tilesX - 1, tilesY - 1, dupSize);
+	data.push_back(dup);
+	dataSizes.push_back(dupSize);
+
+	std::vector<dtTileRef> refs(data.size());
+	const unsigned int revision = nav->getRevision();
+	const dtStatus status = nav->addTiles(&data[0], &dataSizes[0], (int)data.size(), DT_TILE_FREE_DATA, 0, &refs[0]);
+	REQUIRE(dtStatusSucceed(status));
+	REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+	REQUIRE(refs.back() == 0);
+	for (size_t i = 0; i + 1 < refs.size(); ++i)
+		REQUIRE(refs[i] != 0);
+	REQUIRE(nav->getRevision() != revision);
+
+	// Adding nothing leaves the mesh unchanged.
+	dtTileRef dupRef = 1;
+	REQUIRE(dtStatusDetail(nav->addTiles(&dup, &dupSize, 1, DT_TILE_FREE_DATA, 0, &dupRef), DT_PARTIAL_RESULT));
+	REQUIRE(dupRef == 0);
+	REQUIRE(nav->getRevision() == revision + 1);
+	dtFree(dup);
+
+	// All tiles are connected.
+	const dtMeshTile* first = nav->getTileAt(0, 0, 0);
+	const unsigned int island = nav->getPolyIsland(nav->getPolyRefBase(first));
+	REQUIRE(island != 0);
+
+	// Link order differs, but each polygon has the same links.
+	for (int y = 0; y < tilesY; ++y)
+	{
+		for (int x = 0; x < tilesX; ++x)
+		{
+			const dtMeshTile* tile = nav->getTileAt(x, y, 0);
+			const dtMeshTile* refTile = refNav->getTileAt(x, y, 0);
+			REQUIRE(tile != 0);
+			for (int i = 0; i < tile->header->polyCount; ++i)
+			{
+				REQUIRE(nav->getPolyIsland(nav->getPolyRefBase(tile) | (dtPolyRef)i) == island);
+				std::vector<std::vector<unsigned int> > links, refLinks;
+				for (unsigned int k = tile->polys[i].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+				{
+					const dtLink& l = tile->links[k];
+					const dtMeshTile* t = 0;
+					const dtPoly* p = 0;
+					nav->getTileAndPolyByRefUnsafe(l.ref, &t, &p);
+					links.push_back({ (unsigned int)t->header->x, (unsigned int)t->header->y, (unsigned int)(p - t->polys),
+						l.edge, l.side, l.bmin, l.bmax });
+				}
+				for (unsigned int k = refTile->polys[i].firstLink; k != DT_NULL_LINK; k = refTile->links[k].next)
+				{
+					const dtLink& l = refTile->links[k];
+					const dtMeshTile* t = 0;
+					const dtPoly* p = 0;
+					refNav->getTileAndPolyByRefUnsafe(l.ref, &t, &p);
+					refLinks.push_back({ (unsigned int)t->header->x, (unsigned int)t->header->y, (unsigned int)(p - t->polys),
+						l.edge, l.side, l.bmin, l.bmax });
+				}
+				std::sort(links.begin(), links.end());
+				std::sort(refLinks.begin(), refLinks.end());
+				REQUIRE(links == refLinks);
+			}
+		}
+	}
+
+	dtFreeNavMesh(nav);
+	dtFreeNavMesh(refNav);
+}
+
+TEST_CASE("Tile position lookup")
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE;
+	params.tileHeight = TILE_SIZE;
+	params.maxTiles = 64;
+	params.maxPolys = GRID_SIZE * GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+
+	// Sparse locations, enough to grow the table, with layers added out of order.
+	const int layers[3] = { 2, 0, 1 };
+	for (int i = 0; i < 20; ++i)
+	{
+		for (int l = 0; l < 3; ++l)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildGridTile(i * 7 - 50, i * 3, dataSize);
+			REQUIRE(data != 0);
+			((dtMeshHeader*)data)->layer = layers[l];
+			REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		}
+	}
+
+	const dtMeshTile* tiles[4];
+	for (int i = 0; i < 20; ++i)
+	{
+		REQUIRE(nav->getTilesAt(i * 7 - 50, i * 3, tiles, 4) == 3);
+		for (int l = 0; l < 3; ++l)
+		{
+			REQUIRE(tiles[l]->header->layer == l);
+			REQUIRE(nav->getTileAt(i * 7 - 50, i * 3, l) == tiles[l]);
+		}
+		REQUIRE(nav->getTileAt(i * 7 - 50, i * 3, 3) == 0);
+		REQUIRE(nav->getTilesAt(i * 7 - 50, i * 3 + 1, tiles, 4) == 0);
+	}
+
+	// Without memory for the new column the tile stays in place.
+	const dtTileRef middleRef = nav->getTileRefAt(-50, 0, 1);
+	const unsigned int revision = nav->getRevision();
+	dtAllocSetCustom([](size_t, dtAllocHint) -> void* { return 0; }, 0);
+	const dtStatus status = nav->removeTile(middleRef, 0, 0);
+	dtAllocSetCustom(0, 0);
+	REQUIRE(dtStatusDetail(status, DT_OUT_OF_MEMORY));
+	REQUIRE(nav->getTileRefAt(-50, 0, 1) == middleRef);
+	REQUIRE(nav->getTilesAt(-50, 0, tiles, 4) == 3);
+	REQUIRE(nav->getRevision() == revision);
+
+	// Remove the middle layers, then everything, and add the tiles back.
+	for (int i = 0; i < 20; ++i)
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(i * 7 - 50, i * 3, 1), 0, 0)));
+	REQUIRE(nav->getTilesAt(14 - 50, 6, tiles, 4) == 2);
+	REQUIRE(tiles[0]->header->layer == 0);
+	REQUIRE(tiles[1]->header->layer == 2);
+	for (int i = 0; i < 20; ++i)
+	{
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(i * 7 - 50, i * 3, 0), 0, 0)));
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(i * 7 - 50, i * 3, 2), 0, 0)));
+		REQUIRE(nav->getTilesAt(i * 7 - 50, i * 3, tiles, 4) == 0);
+	}
+	for (int i = 0; i < 60; ++i)
+	{
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(i % 8, i / 8, dataSize);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+	}
+	for (int i = 0; i < 60; ++i)
+		REQUIRE(nav->getTileAt(i % 8, i / 8, 0) != 0);
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Polygon islands")
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE;
+	params.tileHeight = TILE_SIZE;
+	params.maxTiles = 4;
+	params.maxPolys = GRID_SIZE * GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+
+	// Two tiles with a gap between them, added in bulk.
+	unsigned char* data[2];
+	int dataSizes[2];
+	data[0] = buildGridTile(0, 0, dataSizes[0]);
+	data[1] = buildGridTile(2, 0, dataSizes[1]);
+	REQUIRE(dtStatusSucceed(nav->addTiles(data, dataSizes, 2, DT_TILE_FREE_DATA, 0, 0)));
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 11.5f, 0.0f, 3.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtPolyRef startRef = 0, endRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+	const dtPolyRef otherRef = nav->getPolyRefBase(nav->getTileAt(0, 0, 0)) | 15;
+
+	REQUIRE(nav->getPolyIsland(startRef) != 0);
+	REQUIRE(nav->getPolyIsland(startRef) == nav->getPolyIsland(otherRef));
+	REQUIRE(query->isReachable(startRef, otherRef, &filter));
+	REQUIRE(!query->isReachable(startRef, endRef, &filter));
+
+	// The search is skipped when asked to, and explores the start island otherwise.
+	dtPolyRef path[64];
+	int pathCount = 0;
+	dtFindPathStats stats;
+	dtStatus status = query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64, DT_FINDPATH_REACHABLE_ONLY, &stats);
+	REQUIRE(dtStatusSucceed(status));
+	REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+	REQUIRE(pathCount == 1);
+	REQUIRE(path[0] == startRef);
+	REQUIRE(stats.expandedNodes == 0);
+	status = query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64, 0, &stats);
+	REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+	REQUIRE(stats.expandedNodes == GRID_SIZE * GRID_SIZE);
+
+	// Filling the gap joins the islands.
+	int dataSize = 0;
+	unsigned char* gap = buildGridTile(1, 0, dataSize);
+	dtTileRef gapRef = 0;
+	REQUIRE(dtStatusSucceed(nav->addTile(gap, dataSize, DT_TILE_FREE_DATA, 0, &gapRef)));
+	REQUIRE(query->isReachable(startRef, endRef, &filter));
+	status = query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64, DT_FINDPATH_REACHABLE_ONLY);
+	REQUIRE(status == DT_SUCCESS);
+	REQUIRE(path[pathCount - 1] == endRef);
+
+	// Removing it again only splits the islands once they are rebuilt.
+	REQUIRE(dtStatusSucceed(nav->removeTile(gapRef, 0, 0)));
+	REQUIRE(query->isReachable(startRef, endRef, &filter));
+	REQUIRE(dtStatusSucceed(nav->rebuildIslands()));
+	REQUIRE(!query->isReachable(startRef, endRef, &filter));
+	REQUIRE(query->isReachable(startRef, otherRef, &filter));
+
+	// Streaming the gap in and out releases the island nodes of the removed copies 
+	// every so often, which rebuilds and splits the islands too.
+	int rebuilds = 0;
+	for (int i = 0; i < 100; ++i)
+	{
+		gap = buildGridTile(1, 0, dataSize);
+		REQUIRE(dtStatusSucceed(nav->addTile(gap, dataSize, DT_TILE_FREE_DATA, 0, &gapRef)));
+		REQUIRE(query->isReachable(startRef, endRef, &filter));
+		REQUIRE(dtStatusSucceed(nav->removeTile(gapRef, 0, 0)));
+		if (!query->isReachable(startRef, endRef, &filter))
+			rebuilds++;
+		REQUIRE(query->isReachable(startRef, otherRef, &filter));
+	}
+	REQUIRE(rebuilds > 1);
+	REQUIRE(rebuilds < 100);
+
+	REQUIRE(dtStatusSucceed(nav->setPolyFlags(otherRef, 0)));
+	REQUIRE(!query->isReachable(startRef, otherRef, &filter));
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::findRandomPoint")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+
+	struct Random
+	{
+		static float next()
+		{
+			static unsigned int seed = 12345;
+			seed = seed * 1103515245u + 12345u;
+			return (float)((seed >> 8) & 0xffff) / 65536.0f;
+		}
+	};
+
+	// The tiles have the same area, so they are picked equally often.
+	const int nsamples = 6000;
+	int counts[6] = { 0 };
+	for (int i = 0; i < nsamples; ++i)
+	{
+		dtPolyRef ref = 0;
+		float pt[3];
+		REQUIRE(dtStatusSucceed(query->findRandomPoint(&filter, Random::next, &ref, pt)));
+		REQUIRE(nav->isValidPolyRef(ref));
+		const dtMeshHeader* header = nav->getTileByRef(ref)->header;
+#ifdef DT_FIXED_POINT
+		// Points may lie on a tile border when the fixed-point helpers round them.
+		REQUIRE(pt[0] >= header->bmin[0]);
+		REQUIRE(pt[0] <= header->bmax[0]);
+		REQUIRE(pt[2] >= header->bmin[2]);
+		REQUIRE(pt[2] <= header->bmax[2]);
+#else
+		const int tx = (int)(pt[0] / TILE_SIZE), ty = (int)(pt[2] / TILE_SIZE);
+		REQUIRE(header == nav->getTileAt(tx, ty, 0)->header);
+#endif
+		counts[header->y * 3 + header->x]++;
+	}
+	for (int i = 0; i < 6; ++i)
+	{
+		REQUIRE(counts[i] > nsamples / 6 * 8 / 10);
+		REQUIRE(counts[i] < nsamples / 6 * 12 / 10);
+	}
+
+	// Removed tiles are not picked, and filters excluding most of the mesh still find the rest.
+	REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(0, 0, 0), 0, 0)));
+	const dtMeshTile* tile = nav->getTileAt(2, 1, 0);
+	REQUIRE(dtStatusSucceed(nav->setPolyFlags(nav->getPolyRefBase(tile) | 5, 2)));
+	dtQueryFilter rareFilter;
+	rareFilter.setIncludeFlags(2);
+	for (int i = 0; i < 100; ++i)
+	{
+		dtPolyRef ref = 0;
+		float pt[3];
+		REQUIRE(dtStatusSucceed(query->findRandomPoint(&filter, Random::next, &ref, pt)));
+		REQUIRE(nav->getTileByRef(ref) != 0);
+		REQUIRE(nav->getTileByRef(ref) != nav->getTileAt(0, 0, 0));
+		REQUIRE((pt[0] >= TILE_SIZE || pt[2] >= TILE_SIZE));
+		REQUIRE(dtStatusSucceed(query->findRandomPoint(&rareFilter, Random::next, &ref, pt)));
+		REQUIRE(ref == (nav->getPolyRefBase(tile) | 5));
+	}
+
+	dtPolyRef startRef = 0;
+	const float center[3] = { 6.5f, 0.0f, 6.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(center, halfExtents, &filter, &startRef, 0)));
+	for (int i = 0; i < 100; ++i)
+	{
+		dtPolyRef ref = 0;
+		float pt[3];
+		REQUIRE(dtStatusSucceed(query->findRandomPointAroundCircle(startRef, center, 2.0f, &filter, Random::next, &ref, pt)));
+		REQUIRE(dtVdist2D(center, pt) < 4.0f);
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+namespace
+{
+	// A filter that is not derived from dtQueryFilter, blocking one polygon.
+	struct BlockingFilter
+	{
+		dtPolyRef blocked;
+
+		bool passFilter(const dtPolyRef ref, const dtMeshTile*, const dtPoly*) const
+		{
+			return ref != blocked;
+		}
+
+		float getCost(const float* pa, const float* pb,
+					  const dtPolyRef, const dtMeshTile*, const dtPoly*,
+					  const dtPolyRef, const dtMeshTile*, const dtPoly*,
+					  const dtPolyRef, const dtMeshTile*, const dtPoly*) const
+		{
+			return dtVdist(pa, pb);
+		}
+	};
+}
+
+TEST_CASE("Templated filter queries")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	BlockingFilter blocking;
+	blocking.blocked = 0;
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 7.5f, 0.0f, 7.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtPolyRef startRef = 0, endRef = 0;
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+	REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+
+	SECTION("Match the dtQueryFilter versions")
+	{
+		dtPolyRef path[64], templPath[64];
+		int pathCount = 0, templPathCount = 0;
+		REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(query->findPath<BlockingFilter>(startRef, endRef, startPos, endPos, &blocking, templPath, &templPathCount, 64) == DT_SUCCESS);
+		REQUIRE(templPathCount == pathCount);
+		REQUIRE(std::equal(path, path + pathCount, templPath));
+
+		dtRaycastHit hit, templHit;
+		memset(&hit, 0, sizeof(hit));
+		memset(&templHit, 0, sizeof(templHit));
+		hit.path = path;
+		hit.maxPath = 64;
+		templHit.path = templPath;
+		templHit.maxPath = 64;
+		REQUIRE(dtStatusSucceed(query->raycast(startRef, startPos, endPos, &filter, 0, &hit)));
+		REQUIRE(dtStatusSucceed(query->raycast<BlockingFilter>(startRef, startPos, endPos, &blocking, 0, &templHit)));
+		REQUIRE(templHit.t == hit.t);
+		REQUIRE(templHit.pathCount == hit.pathCount);
+		REQUIRE(std::equal(path, path + hit.pathCount, templPath));
+
+		dtPolyRef polys[64], templPolys[64];
+		int polyCount = 0, templPolyCount = 0;
+		REQUIRE(dtStatusSucceed(query->findPolysAroundCircle(startRef, startPos, 2.5f, &filter, polys, 0, 0, &polyCount, 64)));
+		REQUIRE(dtStatusSucceed(query->findPolysAroundCircle<BlockingFilter>(startRef, startPos, 2.5f, &blocking, templPolys, 0, 0, &templPolyCount, 64)));
+		REQUIRE(templPolyCount == polyCount);
+		REQUIRE(std::equal(polys, polys + polyCount, templPolys));
+	}
+
+	SECTION("Use the filter type's functions")
+	{
+		// Block the polygon diagonally next to the start.
+		const float blockedPos[3] = { 1.5f, 0.0f, 1.5f };
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(blockedPos, halfExtents, &filter, &blocking.blocked, 0)));
+
+		dtPolyRef path[64];
+		int pathCount = 0;
+		REQUIRE(query->findPath<BlockingFilter>(startRef, endRef, startPos, endPos, &blocking, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(path[pathCount - 1] == endRef);
+		REQUIRE(std::find(path, path + pathCount, blocking.blocked) == path + pathCount);
+
+		dtRaycastHit hit;
+		memset(&hit, 0, sizeof(hit));
+		REQUIRE(dtStatusSucceed(query->raycast<BlockingFilter>(startRef, startPos, endPos, &blocking, 0, &hit)));
+		REQUIRE(hit.t < 1.0f);
+
+		dtPolyRef polys[64];
+		int polyCount = 0;
+		REQUIRE(dtStatusSucceed(query->findPolysAroundCircle<BlockingFilter>(startRef, startPos, 2.5f, &blocking, polys, 0, 0, &polyCount, 64)));
+		REQUIRE(polyCount > 0);
+		REQUIRE(std::find(polys, polys + polyCount, blocking.blocked) == polys + polyCount);
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+#ifdef DT_FIXED_POINT
+namespace
+{
+	unsigned int hashBytes(unsigned int hash, const void* data, const size_t size)
+	{
+		// FNV-1a
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+}
+
+TEST_CASE("Fixed-point surface queries")
+{
+	dtNavMesh* nav = buildGridNavMesh(2, 2);
+	REQUIRE(nav != 0);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	// Block a few polygons to make walls inside the mesh.
+	const dtPolyRef blocked[3] = {
+		nav->getPolyRefBase(nav->getTileAt(0, 0, 0)) | 5,
+		nav->getPolyRefBase(nav->getTileAt(0, 0, 0)) | 14,
+		nav->getPolyRefBase(nav->getTileAt(1, 1, 0)) | 6,
+	};
+	for (int i = 0; i < 3; ++i)
+		REQUIRE(dtStatusSucceed(nav->setPolyFlags(blocked[i], 2)));
+	dtQueryFilter filter;
+	filter.setExcludeFlags(2);
+
+	SECTION("Results are rounded to the fixed-point grid")
+	{
+		const dtPolyRef startRef = nav->getPolyRefBase(nav->getTileAt(0, 0, 0));
+		const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+		const float endPos[3] = { -1.0f, 0.0f, 2.3f };
+		float resultPos[3];
+		dtPolyRef visited[16];
+		int visitedCount = 0;
+		REQUIRE(dtStatusSucceed(query->moveAlongSurface(startRef, startPos, endPos, &filter, resultPos, visited, &visitedCount, 16)));
+		REQUIRE(resultPos[0] == 0.0f);
+		REQUIRE(resultPos[2] == 2355.0f / DT_FIXED_SCALE);
+	}
+
+	SECTION("Results are bit-identical across builds")
+	{
+		// The expected hash must not change with the optimization level or
+		// floating point settings the library and this test are built with.
+		unsigned int hash = 2166136261u;
+		unsigned int seed = 1;
+		for (int i = 0; i < 500; ++i)
+		{
+			seed = seed * 1103515245u + 12345u;
+			const int cx = (seed >> 8) % (2 * GRID_SIZE);
+			const int cz = (seed >> 16) % (2 * GRID_SIZE);
+			seed = seed * 1103515245u + 12345u;
+			const float startPos[3] = {
+				cx + 0.1f + ((seed >> 4) % 3277) * (1.0f / 4096.0f),
+				0.0f,
+				cz + 0.1f + ((seed >> 16) % 3277) * (1.0f / 4096.0f),
+			};
+			seed = seed * 1103515245u + 12345u;
+			const float endPos[3] = {
+				startPos[0] + (float)((int)((seed >> 4) % 24576) - 12288) * (1.0f / 4096.0f),
+				0.0f,
+				startPos[2] + (float)((int)((seed >> 16) % 24576) - 12288) * (1.0f / 4096.0f),
+			};
+
+			const dtMeshTile* tile = nav->getTileAt(cx / GRID_SIZE, cz / GRID_SIZE, 0);
+			const dtPolyRef startRef = nav->getPolyRefBase(tile) | (dtPolyRef)((cz % GRID_SIZE) * GRID_SIZE + cx % GRID_SIZE);
+			if (std::find(blocked, blocked + 3, startRef) != blocked + 3)
+				continue;
+
+			float resultPos[3];
+			dtPolyRef visited[16];
+			int visitedCount = 0;
+			REQUIRE(dtStatusSucceed(query->moveAlongSurface(startRef, startPos, endPos, &filter, resultPos, visited, &visitedCount, 16)));
+			hash = hashBytes(hash, resultPos, sizeof(resultPos));
+			hash = hashBytes(hash, &visitedCount, sizeof(visitedCount));
+
+			float straightPath[16 * 3];
+			unsigned char straightPathFlags[16];
+			int straightPathCount = 0;
+			REQUIRE(dtStatusSucceed(query->findStraightPath(startPos, resultPos, visited, visitedCount,
+															straightPath, straightPathFlags, 0, &straightPathCount, 16,
+															DT_STRAIGHTPATH_ALL_CROSSINGS)));
+			hash = hashBytes(hash, straightPath, sizeof(float) * 3 * straightPathCount);
+			hash = hashBytes(hash, straightPathFlags, straightPathCount);
+		}
+		REQUIRE(hash == 0xfee97a1du);
+	}
+
+	SECTION("Helpers")
+	{
+		// Points closer than the float threshold are equal, even when they round to different units.
+		const float a[3] = { 0.5f / DT_FIXED_SCALE, 0.0f, 0.0f };
+		const float b[3] = { 0.5f / DT_FIXED_SCALE - 1.0f / (1 << 24), 0.0f, 0.0f };
+		REQUIRE(dtToFixed(a[0]) != dtToFixed(b[0]));
+		REQUIRE(dtVequal(a, b));
+		const float c[3] = { 4.0f / DT_FIXED_SCALE, 0.0f, 0.0f };
+		REQUIRE(!dtVequal(a, c));
+
+		// Far away coordinates are clamped instead of overflowing.
+		const float far0[3] = { -1e9f, -1e9f, -1e9f };
+		const float far1[3] = { 1e9f, 1e9f, 1e9f };
+		const float maxDist = 2.0f * (float)DT_FIXED_MAX / DT_FIXED_SCALE;
+		REQUIRE(dtVdistSqr(far0, far1) == Catch::Approx(3.0f * maxDist * maxDist));
+		REQUIRE(dtTriArea2D(far0, far1, c) == Catch::Approx(maxDist * c[0]));
+		float mid[3];
+		dtVlerp(mid, far0, far1, 0.5f);
+		REQUIRE(mid[0] == 0.0f);
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+#endif
+
+TEST_CASE("dtNavMeshSet")
+{
+	dtNavMeshSet* set = dtAllocNavMeshSet();
+	REQUIRE(set != 0);
+	const dtNavMeshSetAgent small = { 0.5f, 2.0f, 0.5f };
+	const dtNavMeshSetAgent large = { 1.0f, 2.0f, 0.5f };
+	REQUIRE(dtStatusSucceed(set->addNavMesh(buildGridNavMesh(3, 2), large)));
+	REQUIRE(dtStatusSucceed(set->addNavMesh(buildGridNavMesh(2, 2), small)));
+	REQUIRE(set->findNavMesh(0.3f, 1.8f) == 1);
+	REQUIRE(set->findNavMesh(0.8f, 1.8f) == 0);
+	REQUIRE(set->findNavMesh(1.2f, 1.8f) == -1);
+	REQUIRE(set->findNavMesh(0.3f, 2.5f) == -1);
+
+	unsigned char* data = 0;
+	int dataSize = 0;
+	REQUIRE(dtStatusSucceed(set->store(&data, &dataSize)));
+
+	dtNavMeshQueryScratch* scratch = dtAllocNavMeshQueryScratch();
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(scratch->init(256)));
+	dtQueryFilter filter;
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 7.5f, 0.0f, 6.5f };
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+
+	const int flags[2] = { 0, DT_TILE_READ_ONLY_DATA };
+	for (int f = 0; f < 2; ++f)
+	{
+		dtNavMeshSet* loaded = dtAllocNavMeshSet();
+		REQUIRE(dtStatusSucceed(loaded->load(data, dataSize, flags[f])));
+		REQUIRE(loaded->getNavMeshCount() == 2);
+		REQUIRE(loaded->getAgent(0).radius == large.radius);
+		REQUIRE(loaded->getAgent(1).radius == small.radius);
+
+		// One query object serves both meshes, the references are kept across store and load.
+		for (int i = 0; i < 2; ++i)
+		{
+			const dtNavMesh* nav = loaded->getNavMesh(i);
+			const dtNavMesh* refNav = set->getNavMesh(i);
+			REQUIRE(nav->getParams()->maxTiles == refNav->getParams()->maxTiles);
+			REQUIRE(nav->getTileRefAt(1, 1, 0) == refNav->getTileRefAt(1, 1, 0));
+			REQUIRE(dtStatusSucceed(query->init(nav, scratch)));
+
+			dtPolyRef startRef = 0, endRef = 0;
+			REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+			REQUIRE(dtStatusSucceed(query->findNearestPoly(endPos, halfExtents, &filter, &endRef, 0)));
+			dtPolyRef path[64];
+			int pathCount = 0;
+			REQUIRE(dtStatusSucceed(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64)));
+			REQUIRE(path[pathCount - 1] == endRef);
+		}
+		dtFreeNavMeshSet(loaded);
+	}
+
+	// Corrupt data is rejected.
+	data[0] ^= 0xff;
+	dtNavMeshSet* loaded = dtAllocNavMeshSet();
+	REQUIRE(dtStatusFailed(loaded->load(data, dataSize, 0)));
+	data[0] ^= 0xff;
+	REQUIRE(dtStatusFailed(loaded->load(data, dataSize - 8, 0)));
+	REQUIRE(loaded->getNavMeshCount() == 0);
+	dtFreeNavMeshSet(loaded);
+
+	dtFree(data);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMeshQueryScratch(scratch);
+	dtFreeNavMeshSet(set);
+}
+
+TEST_CASE("Retired tiles")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	nav->setDeferredReclaim(true);
+
+	const dtMeshTile* tile = nav->getTileAt(1, 1, 0);
+	REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRef(tile), 0, 0)));
+
+	// The tile keeps its header until it is reclaimed, but it is no longer part of the mesh.
+	REQUIRE(tile->header != 0);
+	REQUIRE((tile->flags & DT_TILE_RETIRED) != 0);
+	REQUIRE(nav->getTileRef(tile) == 0);
+	const dtPolyRef ref = nav->getPolyRefBase(tile);
+	REQUIRE(!nav->isValidPolyRef(ref));
+	const dtMeshTile* refTile = 0;
+	const dtPoly* refPoly = 0;
+	REQUIRE(dtStatusFailed(nav->getTileAndPolyByRef(ref, &refTile, &refPoly)));
+	REQUIRE(nav->getTileByRef((dtTileRef)ref) == 0);
+	REQUIRE(dtStatusFailed(nav->removeTile((dtTileRef)ref, 0, 0)));
+
+	// Storing the mesh leaves the removed tile out.
+	dtNavMeshSet* set = dtAllocNavMeshSet();
+	REQUIRE(set != 0);
+	const dtNavMeshSetAgent agent = { 0.5f, 2.0f, 0.5f };
+	REQUIRE(dtStatusSucceed(set->addNavMesh(nav, agent)));
+	unsigned char* data = 0;
+	int dataSize = 0;
+	REQUIRE(dtStatusSucceed(set->store(&data, &dataSize)));
+
+	dtNavMeshSet* loaded = dtAllocNavMeshSet();
+	REQUIRE(dtStatusSucceed(loaded->load(data, dataSize, 0)));
+	const dtNavMesh* loadedNav = loaded->getNavMesh(0);
+	int tileCount = 0;
+	for (int i = 0; i < loadedNav->getMaxTiles(); ++i)
+	{
+		if (loadedNav->getTile(i)->header)
+			tileCount++;
+	}
+	REQUIRE(tileCount == 8);
+	REQUIRE(loadedNav->getTileAt(1, 1, 0) == 0);
+
+	// Once reclaimed, the slot is free again.
+	nav->reclaimRetired(nav->advanceEditEpoch());
+	REQUIRE(tile->header == 0);
+	REQUIRE(tile->flags == 0);
+
+	// Without memory for the retired list, the tile is reclaimed right away instead of leaked.
+	dtNavMesh* oomNav = buildGridNavMesh(3, 3);
+	REQUIRE(oomNav != 0);
+	oomNav->setDeferredReclaim(true);
+	const dtMeshTile* oomTile = oomNav->getTileAt(1, 1, 0);
+	const dtTileRef oomRef = oomNav->getTileRef(oomTile);
+	dtAllocSetCustom([](size_t, dtAllocHint) -> void* { return 0; }, 0);
+	const dtStatus status = oomNav->removeTile(oomRef, 0, 0);
+	dtAllocSetCustom(0, 0);
+	REQUIRE(dtStatusSucceed(status));
+	REQUIRE(oomNav->getRetiredCount() == 0);
+	REQUIRE(oomTile->header == 0);
+	dtFreeNavMesh(oomNav);
+
+	dtFree(data);
+	dtFreeNavMeshSet(loaded);
+	dtFreeNavMeshSet(set);
+}
+
+TEST_CASE("Concurrent queries with per-thread scratch")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	const dtNavMesh* constNav = nav;
+
+	// Snapshot the tile data to check that the queries do not write to the mesh.
+	std::vector<std::vector<unsigned char> > snapshot;
+	for (int i = 0; i < constNav->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = constNav->getTile(i);
+		if (tile->header)
+			snapshot.push_back(std::vector<unsigned char>(tile->data, tile->data + tile->dataSize));
+	}
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const int npairs = 64;
+
+	struct Result
+	{
+		std::vector<dtPolyRef> path;
+		dtStatus status;
+		float hitT;
+	};
+
+	// Runs every query once with the given query object.
+	auto runQueries = [&](const dtNavMeshQuery& query, std::vector<Result>& results)
+	{
+		results.resize(npairs);
+		for (int i = 0; i < npairs; ++i)
+		{
+			const float startPos[3] = { 0.5f + (i % 12), 0.0f, 0.5f + (i / 12) };
+			const float endPos[3] = { 11.5f - (i % 7), 0.0f, 11.5f - (i % 5) };
+			dtPolyRef startRef = 0, endRef = 0;
+			query.findNearestPoly(startPos, halfExtents, &filter, &startRef, 0);
+			query.findNearestPoly(endPos, halfExtents, &filter, &endRef, 0);
+
+			dtPolyRef path[256];
+			int npath = 0;
+			results[i].status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, 256);
+			results[i].path.assign(path, path + npath);
+
+			float hitNormal[3];
+			results[i].hitT = -1.0f;
+			query.raycast(startRef, startPos, endPos, &filter, &results[i].hitT, hitNormal, path, &npath, 256);
+		}
+	};
+
+	dtNavMeshQuery serialQuery;
+	REQUIRE(dtStatusSucceed(serialQuery.init(nav, 512)));
+	std::vector<Result> expected;
+	runQueries(serialQuery, expected);
+	REQUIRE(expected[0].path.size() > 1);
+
+	const int nthreads = 8;
+	std::vector<std::vector<Result> > results(nthreads);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < nthreads; ++t)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			dtNavMeshQueryScratch scratch;
+			if (dtStatusFailed(scratch.init(512)))
+				return;
+			for (int iter = 0; iter < 10; ++iter)
+			{
+				// Query objects using external scratch are cheap to create per call.
+				dtNavMeshQuery query;
+				query.init(constNav, &scratch);
+				runQueries(query, results[t]);
+			}
+		}));
+	}
+	for (int t = 0; t < nthreads; ++t)
+		threads[t].join();
+
+	for (int t = 0; t < nthreads; ++t)
+	{
+		REQUIRE(results[t].size() == expected.size());
+		for (int i = 0; i < npairs; ++i)
+		{
+			REQUIRE(results[t][i].status == expected[i].status);
+			REQUIRE(results[t][i].path == expected[i].path);
+			REQUIRE(results[t][i].hitT == expected[i].hitT);
+		}
+	}
+
+	int n = 0;
+	for (int i = 0; i < constNav->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = constNav->getTile(i);
+		if (!tile->header)
+			continue;
+		REQUIRE(memcmp(&snapshot[n][0], tile->data, tile->dataSize) == 0);
+		n++;
+	}
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Streaming tiles while querying")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+	nav->setDeferredReclaim(true);
+	const dtNavMesh* constNav = nav;
+
+	dtQueryFilter filter;
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+	const float endPos[3] = { 11.5f, 0.0f, 11.5f };
+
+	auto findCornerPath = [&](const dtNavMeshQuery& query, std::vector<dtPolyRef>& path)
+	{
+		dtPolyRef startRef = 0, endRef = 0;
+		query.findNearestPoly(startPos, halfExtents, &filter, &startRef, 0);
+		query.findNearestPoly(endPos, halfExtents, &filter, &endRef, 0);
+		dtPolyRef polys[256];
+		int npolys = 0;
+		const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, polys, &npolys, 256);
+		path.assign(polys, polys + npolys);
+		return status;
+	};
+
+	dtNavMeshQuery serialQuery;
+	REQUIRE(dtStatusSucceed(serialQuery.init(nav, 512)));
+	std::vector<dtPolyRef> expected;
+	REQUIRE(dtStatusSucceed(findCornerPath(serialQuery, expected)));
+
+	const int nreaders = 4;
+	std::atomic<unsigned int> publishedEpoch(nav->getEditEpoch());
+	std::atomic<unsigned int> readerEpochs[nreaders];
+	for (int t = 0; t < nreaders; ++t)
+		readerEpochs[t] = UINT_MAX;
+	std::atomic<bool> stop(false);
+	std::atomic<int> queries(0);
+
+	std::vector<std::thread> readers;
+	for (int t = 0; t < nreaders; ++t)
+	{
+		readers.push_back(std::thread([&, t]()
+		{
+			dtNavMeshQueryScratch scratch;
+			if (dtStatusFailed(scratch.init(512)))
+				return;
+			dtNavMeshQuery query;
+			query.init(constNav, &scratch);
+			std::vector<dtPolyRef> path;
+			while (!stop)
+			{
+				unsigned int epoch;
+				do
+				{
+					epoch = publishedEpoch;
+					readerEpochs[t] = epoch;
+				}
+				while (publishedEpoch != epoch);
+
+				findCornerPath(query, path);
+				float t0 = 0, hitNormal[3];
+				dtPolyRef raycastPath[64];
+				int nraycastPath = 0;
+				if (!path.empty())
+					query.raycast(path[0], startPos, endPos, &filter, &t0, hitNormal, raycastPath, &nraycastPath, 64);
+				queries++;
+
+				readerEpochs[t] = UINT_MAX;
+			}
+		}));
+	}
+
+	auto reclaim = [&]()
+	{
+		publishedEpoch = nav->advanceEditEpoch();
+		unsigned int safeEpoch = publishedEpoch;
+		for (int t = 0; t < nreaders; ++t)
+		{
+			const unsigned int epoch = readerEpochs[t];
+			if (epoch != UINT_MAX && (int)(epoch - safeEpoch) < 0)
+				safeEpoch = epoch;
+		}
+		nav->reclaimRetired(safeEpoch);
+	};
+
+	// Stream the center tile in and out while the readers cross it.
+	for (int iter = 0; iter < 100; ++iter)
+	{
+		const dtTileRef ref = nav->getTileRefAt(1, 1, 0);
+		REQUIRE(ref != 0);
+		REQUIRE(dtStatusSucceed(nav->removeTile(ref, 0, 0)));
+		REQUIRE(nav->getTileAt(1, 1, 0) == 0);
+		reclaim();
+
+		// Wait until the readers have let go of the retired items.
+		while (nav->getRetiredCount() > 0)
+		{
+			std::this_thread::yield();
+			reclaim();
+		}
+
+		int dataSize = 0;
+		unsigned char* data = buildGridTile(1, 1, dataSize);
+		REQUIRE(data != 0);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		reclaim();
+	}
+
+	// Let the readers run at least once, even if the writer finished first.
+	// Give up after a while, so a reader that failed to start fails the test below.
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (queries == 0 && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+	stop = true;
+	for (int t = 0; t < nreaders; ++t)
+		readers[t].join();
+	REQUIRE(queries > 0);
+
+	nav->setDeferredReclaim(false);
+	REQUIRE(nav->getRetiredCount() == 0);
+
+	// The mesh is fully connected again. The center tile got new references.
+	std::vector<dtPolyRef> path;
+	REQUIRE(dtStatusSucceed(findCornerPath(serialQuery, path)));
+	REQUIRE(!dtStatusDetail(findCornerPath(serialQuery, path), DT_PARTIAL_RESULT));
+	REQUIRE(path.size() == expected.size());
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,210 @@
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourProximityGrid.h"
+#include "../Detour/Tests_GridNavMesh.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace TestGrid;
+
+TEST_CASE("dtCrowd parallel update")
+{
+	dtNavMesh* nav = buildGridNavMesh(3, 3);
+	REQUIRE(nav != 0);
+
+	// Runs the job in one chunk per thread, with the chunks spread over real threads.
+	dtCrowdParallelForFunc threadedFor = [](void* userData, dtCrowdJobFunc job, void* data, const int count)
+	{
+		const int nthreads = *(const int*)userData;
+		const int chunk = (count + nthreads - 1) / nthreads;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < nthreads && t * chunk < count; ++t)
+			threads.push_back(std::thread(job, data, t * chunk, std::min(count, (t + 1) * chunk), t));
+		for (size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+	};
+	int nthreads = 4;
+
+	const int nagents = 40;
+	dtCrowd* crowds[2] = { dtAllocCrowd(), dtAllocCrowd() };
+	REQUIRE(crowds[0] != 0);
+	REQUIRE(crowds[1] != 0);
+	// Setting the parallel for before init must work too.
+	REQUIRE(crowds[1]->setParallelFor(threadedFor, &nthreads, nthreads));
+	for (int c = 0; c < 2; ++c)
+	{
+		REQUIRE(crowds[c]->init(nagents, 0.3f, nav));
+
+		dtCrowdAgentParams params;
+		memset(&params, 0, sizeof(params));
+		params.radius = 0.3f;
+		params.height = 1.0f;
+		params.maxAcceleration = 8.0f;
+		params.maxSpeed = 2.0f;
+		params.collisionQueryRange = params.radius * 12.0f;
+		params.pathOptimizationRange = params.radius * 30.0f;
+		params.separationWeight = 2.0f;
+		params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_OPTIMIZE_VIS | DT_CROWD_OPTIMIZE_TOPO |
+			DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_SEPARATION;
+
+		for (int i = 0; i < nagents; ++i)
+		{
+			const float pos[3] = { 0.5f + (i % 8) * 0.7f, 0.0f, 0.5f + (i / 8) * 0.7f };
+			const int idx = crowds[c]->addAgent(pos, &params);
+			REQUIRE(idx == i);
+
+			// Half the agents cross the mesh, the rest are driven by velocity.
+			if (i % 2 == 0)
+			{
+				const float target[3] = { 11.5f - (i % 5), 0.0f, 11.5f - (i % 3) };
+				dtPolyRef targetRef = 0;
+				float nearest[3];
+				crowds[c]->getNavMeshQuery()->findNearestPoly(target, crowds[c]->getQueryHalfExtents(),
+															  crowds[c]->getFilter(0), &targetRef, nearest);
+				REQUIRE(crowds[c]->requestMoveTarget(i, targetRef, nearest));
+			}
+			else
+			{
+				const float vel[3] = { 1.0f, 0.0f, (i % 3) - 1.0f };
+				REQUIRE(crowds[c]->requestMoveVelocity(i, vel));
+			}
+		}
+	}
+
+	for (int step = 0; step < 60; ++step)
+	{
+		crowds[0]->update(0.1f, 0);
+		crowds[1]->update(0.1f, 0);
+
+		REQUIRE(crowds[1]->getVelocitySampleCount() == crowds[0]->getVelocitySampleCount());
+		for (int i = 0; i < nagents; ++i)
+		{
+			const dtCrowdAgent* a = crowds[0]->getAgent(i);
+			const dtCrowdAgent* b = crowds[1]->getAgent(i);
+			REQUIRE(b->state == a->state);
+			REQUIRE(b->nneis == a->nneis);
+			REQUIRE(b->ncorners == a->ncorners);
+			REQUIRE(memcmp(b->npos, a->npos, sizeof(a->npos)) == 0);
+			REQUIRE(memcmp(b->vel, a->vel, sizeof(a->vel)) == 0);
+		}
+	}
+	REQUIRE(crowds[0]->getVelocitySampleCount() > 0);
+
+	// Agents with a move target should have made progress towards it.
+	const dtCrowdAgent* ag = crowds[1]->getAgent(0);
+	REQUIRE(ag->npos[0] > 3.0f);
+
+	// Switching back to the serial update keeps working.
+	REQUIRE(crowds[1]->setParallelFor(0, 0, 0));
+	crowds[1]->update(0.1f, 0);
+	REQUIRE(!crowds[1]->setParallelFor(threadedFor, &nthreads, 0));
+
+	dtFreeCrowd(crowds[0]);
+	dtFreeCrowd(crowds[1]);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtCrowd limits")
+{
+	SECTION("Proximity grid ids beyond 16 bits")
+	{
+		const int nitems = 70000;
+		dtProximityGrid* grid = dtAllocProximityGrid();
+		REQUIRE(grid != 0);
+		REQUIRE(grid->init(nitems, 1.0f));
+		for (int i = 0; i < nitems; ++i)
+		{
+			const float x = (float)(i % 300) + 0.5f;
+			const float y = (float)(i / 300) + 0.5f;
+			grid->addItem(i, x - 0.1f, y - 0.1f, x + 0.1f, y + 0.1f);
+		}
+
+		int ids[4];
+		const float x = (float)((nitems - 1) % 300) + 0.5f;
+		const float y = (float)((nitems - 1) / 300) + 0.5f;
+		REQUIRE(grid->queryItems(x - 0.1f, y - 0.1f, x + 0.1f, y + 0.1f, ids, 4) == 1);
+		REQUIRE(ids[0] == nitems - 1);
+		dtFreeProximityGrid(grid);
+	}
+
+	SECTION("Configurable neighbours, corners and path requests")
+	{
+		dtNavMesh* nav = buildGridNavMesh(3, 3);
+		REQUIRE(nav != 0);
+
+		dtCrowdParams crowdParams;
+		crowdParams.maxAgents = 64;
+		crowdParams.maxAgentRadius = 0.2f;
+		crowdParams.maxNeighbours = 16;
+		crowdParams.maxCorners = 8;
+		crowdParams.maxPathRequests = 64;
+		crowdParams.maxPathIterations = 4096;
+
+		dtCrowd* crowd = dtAllocCrowd();
+		REQUIRE(crowd != 0);
+		REQUIRE(crowd->init(&crowdParams, nav));
+		REQUIRE(crowd->getMaxNeighbours() == 16);
+		REQUIRE(crowd->getMaxCorners() == 8);
+		REQUIRE(crowd->getPathQueue()->getMaxQueue() == 64);
+
+		dtCrowdAgentParams params;
+		memset(&params, 0, sizeof(params));
+		params.radius = 0.2f;
+		params.height = 1.0f;
+		params.maxAcceleration = 8.0f;
+		params.maxSpeed = 2.0f;
+		params.collisionQueryRange = 3.0f;
+		params.pathOptimizationRange = 6.0f;
+
+		// A dense block of agents, all heading for the far corner.
+		for (int i = 0; i < crowdParams.maxAgents; ++i)
+		{
+			const float pos[3] = { 0.25f + (i % 8) * 0.4f, 0.0f, 0.25f + (i / 8) * 0.4f };
+			REQUIRE(crowd->addAgent(pos, &params) == i);
+
+			const float target[3] = { 11.5f, 0.0f, 11.5f };
+			dtPolyRef targetRef = 0;
+			float nearest[3];
+			crowd->getNavMeshQuery()->findNearestPoly(target, crowd->getQueryHalfExtents(), crowd->getFilter(0), &targetRef, nearest);
+			REQUIRE(crowd->requestMoveTarget(i, targetRef, nearest));
+		}
+
+		crowd->update(0.1f, 0);
+		crowd->update(0.1f, 0);
+
+		int maxNeis = 0;
+		for (int i = 0; i < crowdParams.maxAgents; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			// All requests fit in the queue and the iteration budget, so every path is complete.
+			REQUIRE(ag->targetState == DT_CROWDAGENT_TARGET_VALID);
+			REQUIRE(ag->ncorners <= 8);
+			maxNeis = dtMax(maxNeis, ag->nneis);
+		}
+		REQUIRE(maxNeis > DT_CROWDAGENT_MAX_NEIGHBOURS);
+		REQUIRE(maxNeis <= 16);
+
+		// Invalid limits are rejected.
+		crowdParams.maxCorners = 1;
+		REQUIRE(!crowd->init(&crowdParams, nav));
+
+		// So are pools too large to index.
+		crowdParams.maxCorners = 8;
+		crowdParams.maxNeighbours = INT_MAX / 32;
+		REQUIRE(!crowd->init(&crowdParams, nav));
+		crowdParams.maxNeighbours = 16;
+		crowdParams.maxCorners = INT_MAX / 128;
+		REQUIRE(!crowd->init(&crowdParams, nav));
+
+		dtFreeCrowd(crowd);
+		dtFreeNavMesh(nav);
+	}
+}
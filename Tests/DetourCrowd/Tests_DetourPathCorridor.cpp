@@ -1,6 +1,11 @@
 #include "catch2/catch_all.hpp"
 
+#include "DetourCommon.h"
+#include "DetourNavMeshQuery.h"
 #include "DetourPathCorridor.h"
+#include "../Detour/Tests_GridNavMesh.h"
+
+using namespace TestGrid;
 
 TEST_CASE("dtMergeCorridorStartMoved")
 {
@@ -117,3 +122,152 @@ TEST_CASE("dtMergeCorridorStartMoved")
         CHECK_THAT(path, Catch::Matchers::RangeEquals(expectedPath));
     }
 }
+
+TEST_CASE("dtPathCorridor::findCorners")
+{
+    dtNavMesh* nav = buildGridNavMesh(3, 3);
+    REQUIRE(nav != 0);
+    // Leave a hole in the middle so that the corridor bends around it.
+    REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+    dtNavMeshQuery* query = dtAllocNavMeshQuery();
+    REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+    dtQueryFilter filter;
+    const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+    const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+    float targetPos[3] = { 11.5f, 0.0f, 11.5f };
+    dtPolyRef startRef = 0, endRef = 0;
+    REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+    REQUIRE(dtStatusSucceed(query->findNearestPoly(targetPos, halfExtents, &filter, &endRef, 0)));
+    dtPolyRef path[256];
+    int npath = 0;
+    REQUIRE(query->findPath(startRef, endRef, startPos, targetPos, &filter, path, &npath, 256) == DT_SUCCESS);
+
+    dtPathCorridor corridor;
+    REQUIRE(corridor.init(256));
+    corridor.reset(startRef, startPos);
+    corridor.setCorridor(targetPos, path, npath);
+
+    // Move along the corridor, changing it on the way, and compare the corners 
+    // against the straight path of the whole corridor.
+    static const int MAX_CORNERS = 4;
+    int steps = 0;
+    for (; steps < 200; ++steps)
+    {
+        float corners[MAX_CORNERS * 3];
+        unsigned char cornerFlags[MAX_CORNERS];
+        dtPolyRef cornerPolys[MAX_CORNERS];
+        const int ncorners = corridor.findCorners(corners, cornerFlags, cornerPolys, MAX_CORNERS, query, &filter);
+
+        float expected[MAX_CORNERS * 3];
+        unsigned char expectedFlags[MAX_CORNERS];
+        dtPolyRef expectedPolys[MAX_CORNERS];
+        int nexpected = 0;
+        query->findStraightPath(corridor.getPos(), corridor.getTarget(), corridor.getPath(), corridor.getPathCount(),
+                                expected, expectedFlags, expectedPolys, &nexpected, MAX_CORNERS);
+        // findCorners() skips the corners at the position.
+        int first = 0;
+        while (first < nexpected && dtVdist2DSqr(&expected[first * 3], corridor.getPos()) <= dtSqr(0.01f))
+            first++;
+        REQUIRE(ncorners == nexpected - first);
+        for (int i = 0; i < ncorners; ++i)
+        {
+            REQUIRE(dtVequal(&corners[i * 3], &expected[(first + i) * 3]));
+            REQUIRE(cornerFlags[i] == expectedFlags[first + i]);
+            REQUIRE(cornerPolys[i] == expectedPolys[first + i]);
+        }
+        if (!ncorners)
+            break;
+
+        // Step toward the first corner.
+        float delta[3], npos[3];
+        dtVsub(delta, &corners[0], corridor.getPos());
+        const float dist = dtVlen(delta);
+        dtVmad(npos, corridor.getPos(), delta, dtMin(1.0f, 0.7f / dist));
+        REQUIRE(corridor.movePosition(npos, query, &filter));
+        if (steps % 5 == 0)
+            corridor.optimizePathVisibility(&corners[(ncorners - 1) * 3], 6.0f, query, &filter);
+        if (steps == 10)
+        {
+            targetPos[0] = 10.5f;
+            REQUIRE(corridor.moveTargetPosition(targetPos, query, &filter));
+        }
+    }
+    REQUIRE(steps > 10);
+    REQUIRE(dtVdist2D(corridor.getPos(), corridor.getTarget()) < 0.01f);
+
+    dtFreeNavMeshQuery(query);
+    dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtPathCorridor::findCorners after the navigation mesh changed")
+{
+    dtNavMesh* nav = buildGridNavMesh(3, 3);
+    REQUIRE(nav != 0);
+    // Leave a hole in the middle so that the corridor bends around it.
+    REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 1, 0), 0, 0)));
+    dtNavMeshQuery* query = dtAllocNavMeshQuery();
+    REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+    dtQueryFilter filter;
+    const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+    const float startPos[3] = { 0.5f, 0.0f, 0.5f };
+    const float targetPos[3] = { 11.5f, 0.0f, 11.5f };
+    dtPolyRef startRef = 0, endRef = 0;
+    REQUIRE(dtStatusSucceed(query->findNearestPoly(startPos, halfExtents, &filter, &startRef, 0)));
+    REQUIRE(dtStatusSucceed(query->findNearestPoly(targetPos, halfExtents, &filter, &endRef, 0)));
+    dtPolyRef path[256];
+    int npath = 0;
+    REQUIRE(query->findPath(startRef, endRef, startPos, targetPos, &filter, path, &npath, 256) == DT_SUCCESS);
+
+    dtPathCorridor corridor;
+    REQUIRE(corridor.init(256));
+    corridor.reset(startRef, startPos);
+    corridor.setCorridor(targetPos, path, npath);
+
+    static const int MAX_CORNERS = 4;
+    float corners[MAX_CORNERS * 3];
+    unsigned char cornerFlags[MAX_CORNERS];
+    dtPolyRef cornerPolys[MAX_CORNERS];
+    REQUIRE(corridor.findCorners(corners, cornerFlags, cornerPolys, MAX_CORNERS, query, &filter) > 1);
+
+    // Replace the tiles with raised ones that keep the refs, so the path stays the same.
+    for (int y = 0; y < 3; ++y)
+    {
+        for (int x = 0; x < 3; ++x)
+        {
+            const dtTileRef ref = nav->getTileRefAt(x, y, 0);
+            if (!ref)
+                continue;
+            REQUIRE(dtStatusSucceed(nav->removeTile(ref, 0, 0)));
+            int dataSize = 0;
+            unsigned char* data = buildGridTile(x, y, dataSize);
+            REQUIRE(data != 0);
+            dtMeshHeader* header = (dtMeshHeader*)data;
+            float* verts = (float*)(data + dtAlign4(sizeof(dtMeshHeader)));
+            for (int i = 0; i < header->vertCount; ++i)
+                verts[i * 3 + 1] += 0.25f;
+            header->bmin[1] += 0.25f;
+            header->bmax[1] += 0.25f;
+            dtTileRef newRef = 0;
+            REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, ref, &newRef)));
+            REQUIRE(newRef == ref);
+        }
+    }
+
+    const int ncorners = corridor.findCorners(corners, cornerFlags, cornerPolys, MAX_CORNERS, query, &filter);
+    float expected[MAX_CORNERS * 3];
+    unsigned char expectedFlags[MAX_CORNERS];
+    dtPolyRef expectedPolys[MAX_CORNERS];
+    int nexpected = 0;
+    query->findStraightPath(corridor.getPos(), corridor.getTarget(), corridor.getPath(), corridor.getPathCount(),
+                            expected, expectedFlags, expectedPolys, &nexpected, MAX_CORNERS);
+    // The first expected corner is the start position, which findCorners() skips.
+    REQUIRE(ncorners == nexpected - 1);
+    for (int i = 0; i < ncorners; ++i)
+        REQUIRE(dtVequal(&corners[i * 3], &expected[(i + 1) * 3]));
+    REQUIRE(corners[1] == 0.25f);
+
+    dtFreeNavMeshQuery(query);
+    dtFreeNavMesh(nav);
+}
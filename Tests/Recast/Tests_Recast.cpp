@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -935,3 +936,81 @@ TEST_CASE("rcRasterizeTriangles", "[recast]")
 		REQUIRE(!solid.spans[1 + 2 * width]->next);
 	}
 }
+
+TEST_CASE("rcBuildCompactHeightfields", "[recast]")
+{
+	rcContext ctx;
+
+	// A floor with a raised block in the middle, low enough that the floor under it is blocked.
+	const float verts[] = {
+		0, 0, 0,
+		10, 0, 0,
+		10, 0, 10,
+		0, 0, 10,
+		4, 1.5f, 4,
+		6, 1.5f, 4,
+		6, 1.5f, 6,
+		4, 1.5f, 6,
+	};
+	const int tris[] = {
+		0, 2, 1,
+		0, 3, 2,
+		4, 6, 5,
+		4, 7, 6,
+	};
+	const unsigned char areas[] = { RC_WALKABLE_AREA, RC_WALKABLE_AREA, RC_WALKABLE_AREA, RC_WALKABLE_AREA };
+	const float bmin[] = { 0, 0, 0 };
+	const float bmax[] = { 10, 2, 10 };
+	const float cellSize = 0.25f;
+	const float cellHeight = 0.2f;
+	const int walkableHeight = 10;
+	const int walkableClimb = 2;
+
+	rcHeightfield solid;
+	REQUIRE(rcCreateHeightfield(&ctx, solid, 40, 40, bmin, bmax, cellSize, cellHeight));
+	REQUIRE(rcRasterizeTriangles(&ctx, verts, 8, tris, areas, 4, solid, 1));
+
+	const int radiusCount = 3;
+	const int radii[radiusCount] = { 0, 2, 5 };
+	rcCompactHeightfield shared[radiusCount];
+	rcCompactHeightfield* sharedPtrs[radiusCount] = { &shared[0], &shared[1], &shared[2] };
+	REQUIRE(rcBuildCompactHeightfields(&ctx, walkableHeight, walkableClimb, solid, radii, radiusCount, sharedPtrs));
+
+	int previousWalkable = INT_MAX;
+	for (int i = 0; i < radiusCount; ++i)
+	{
+		// Each result matches a compact heightfield built and eroded on its own.
+		rcCompactHeightfield separate;
+		REQUIRE(rcBuildCompactHeightfield(&ctx, walkableHeight, walkableClimb, solid, separate));
+		if (radii[i] > 0)
+			REQUIRE(rcErodeWalkableArea(&ctx, radii[i], separate));
+		REQUIRE(shared[i].spanCount == separate.spanCount);
+		REQUIRE(memcmp(shared[i].cells, separate.cells, sizeof(rcCompactCell) * separate.width * separate.height) == 0);
+		REQUIRE(memcmp(shared[i].spans, separate.spans, sizeof(rcCompactSpan) * separate.spanCount) == 0);
+		REQUIRE(memcmp(shared[i].areas, separate.areas, separate.spanCount) == 0);
+
+		// And so does the polygon mesh built from it.
+		rcCompactHeightfield* chfs[2] = { &shared[i], &separate };
+		rcPolyMesh meshes[2];
+		for (int j = 0; j < 2; ++j)
+		{
+			REQUIRE(rcBuildDistanceField(&ctx, *chfs[j]));
+			REQUIRE(rcBuildRegions(&ctx, *chfs[j], 0, 8, 20));
+			rcContourSet cset;
+			REQUIRE(rcBuildContours(&ctx, *chfs[j], 1.3f, 12, cset));
+			REQUIRE(rcBuildPolyMesh(&ctx, cset, 6, meshes[j]));
+		}
+		REQUIRE(meshes[0].npolys > 0);
+		REQUIRE(meshes[0].nverts == meshes[1].nverts);
+		REQUIRE(meshes[0].npolys == meshes[1].npolys);
+		REQUIRE(memcmp(meshes[0].verts, meshes[1].verts, sizeof(unsigned short) * 3 * meshes[0].nverts) == 0);
+		REQUIRE(memcmp(meshes[0].polys, meshes[1].polys, sizeof(unsigned short) * 2 * 6 * meshes[0].npolys) == 0);
+
+		// Larger agents get less walkable area.
+		int walkable = 0;
+		for (int s = 0; s < shared[i].spanCount; ++s)
+			walkable += shared[i].areas[s] != RC_NULL_AREA;
+		REQUIRE(walkable < previousWalkable);
+		previousWalkable = walkable;
+	}
+}